@@ -30,6 +30,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QOpenGLContext>
 #include <QOpenGLFramebufferObject>
 
+#include <cstring>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 namespace KWin
 {
 
@@ -67,6 +73,10 @@ void AbstractEglBackend::unbindWaylandDisplay()
 
 void AbstractEglBackend::cleanup()
 {
+    if (m_pixelUnpackBuffer) {
+        glDeleteBuffers(1, &m_pixelUnpackBuffer);
+        m_pixelUnpackBuffer = 0;
+    }
     cleanupGL();
     doneCurrent();
     eglDestroyContext(m_display, m_context);
@@ -124,6 +134,25 @@ void AbstractEglBackend::initKWinGL()
         options->setGlPreferBufferSwap('e'); // for unknown drivers - should not happen
     glPlatform->printResults();
     initGL(&getProcAddress);
+
+    if (glPlatform->isGLES()) {
+        m_supportsPixelUnpackBuffers = hasGLVersion(3, 0);
+    } else {
+        m_supportsPixelUnpackBuffers = hasGLVersion(3, 0) ||
+            (hasGLExtension(QByteArrayLiteral("GL_ARB_pixel_buffer_object")) &&
+             hasGLExtension(QByteArrayLiteral("GL_ARB_map_buffer_range")));
+    }
+}
+
+GLuint AbstractEglBackend::pixelUnpackBuffer()
+{
+    if (!m_supportsPixelUnpackBuffers) {
+        return 0;
+    }
+    if (!m_pixelUnpackBuffer) {
+        glGenBuffers(1, &m_pixelUnpackBuffer);
+    }
+    return m_pixelUnpackBuffer;
 }
 
 void AbstractEglBackend::initBufferAge()
@@ -357,6 +386,11 @@ void AbstractEglTexture::updateTexture(WindowPixmap *pixmap)
     const QRegion damage = s->trackedDamage();
     s->resetTrackedDamage();
 
+    if (updateShmTexture(image, damage)) {
+        q->unbind();
+        return;
+    }
+
     // TODO: this should be shared with GLTexture::update
     if (GLPlatform::instance()->isGLES()) {
         if (s_supportsARGB32 && (image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied)) {
@@ -382,6 +416,128 @@ void AbstractEglTexture::updateTexture(WindowPixmap *pixmap)
     q->unbind();
 }
 
+// swaps the red and blue channel of each pixel, the byte order of QImage::Format_ARGB32 on little
+// endian is BGRA, optionally forces an opaque alpha channel for formats without alpha
+static void copySwizzled(const uchar *src, uchar *dst, int pixels, bool opaque)
+{
+    const quint32 *s = reinterpret_cast<const quint32 *>(src);
+    quint32 *d = reinterpret_cast<quint32 *>(dst);
+    const quint32 alpha = opaque ? 0xff000000 : 0;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i greenAlpha = _mm_set1_epi32(0xff00ff00);
+    const __m128i blue = _mm_set1_epi32(0x000000ff);
+    const __m128i forcedAlpha = _mm_set1_epi32(alpha);
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        __m128i r = _mm_and_si128(p, greenAlpha);
+        r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(p, 16), blue));
+        r = _mm_or_si128(r, _mm_slli_epi32(_mm_and_si128(p, blue), 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), _mm_or_si128(r, forcedAlpha));
+    }
+#endif
+    for (; i < pixels; ++i) {
+        const quint32 p = s[i];
+        d[i] = (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16) | alpha;
+    }
+}
+
+bool AbstractEglTexture::updateShmTexture(const QImage &image, const QRegion &region)
+{
+    const bool opaque = image.format() == QImage::Format_RGB32;
+    if (!opaque && image.format() != QImage::Format_ARGB32_Premultiplied) {
+        return false;
+    }
+    const bool isGLES = GLPlatform::instance()->isGLES();
+    // without BGRA support GLES textures are RGBA, opaque images got an RGBA texture as well
+    const bool swizzle = isGLES && (!s_supportsARGB32 || opaque);
+    const GLenum format = swizzle ? GL_RGBA : (isGLES ? GL_BGRA_EXT : GL_BGRA);
+
+    QVector<QRect> rects;
+    int bytes = 0;
+    for (const QRect &r : (region & image.rect()).rects()) {
+        rects << r;
+        bytes += r.width() * r.height() * 4;
+    }
+    if (rects.isEmpty()) {
+        return true;
+    }
+
+    const uchar *bits = image.constBits();
+    const int stride = image.bytesPerLine();
+
+    // copies the pixels of rect tightly packed to dst
+    auto pack = [&](const QRect &rect, uchar *dst) {
+        const int rowBytes = rect.width() * 4;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            const uchar *src = bits + y * stride + rect.x() * 4;
+            if (swizzle) {
+                copySwizzled(src, dst, rect.width(), opaque);
+            } else {
+                std::memcpy(dst, src, rowBytes);
+            }
+            dst += rowBytes;
+        }
+    };
+
+    // stream the damage through a pixel unpack buffer, so that the driver can copy it to the
+    // texture asynchronously instead of blocking until the upload is done
+    if (const GLuint buffer = m_backend->pixelUnpackBuffer()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        // orphan the previous storage, the driver keeps it until the last upload from it is done
+        // and hands out new storage, so one buffer is enough to have several uploads in flight
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        uchar *map = static_cast<uchar *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (map) {
+            int offset = 0;
+            for (const QRect &rect : rects) {
+                pack(rect, map + offset);
+                offset += rect.width() * rect.height() * 4;
+            }
+            const bool unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            offset = 0;
+            for (const QRect &rect : rects) {
+                if (unmapped) {
+                    glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                                    format, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid *>(intptr_t(offset)));
+                }
+                offset += rect.width() * rect.height() * 4;
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (unmapped) {
+                return true;
+            }
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    if (!swizzle && s_supportsUnpack) {
+        // let GL pick the rects straight out of the shm buffer
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 4);
+        for (const QRect &rect : rects) {
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, rect.x());
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, rect.y());
+            glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                            format, GL_UNSIGNED_BYTE, bits);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        return true;
+    }
+
+    QByteArray scratch;
+    for (const QRect &rect : rects) {
+        scratch.resize(rect.width() * rect.height() * 4);
+        pack(rect, reinterpret_cast<uchar *>(scratch.data()));
+        glTexSubImage2D(m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                        format, GL_UNSIGNED_BYTE, scratch.constData());
+    }
+    return true;
+}
+
 bool AbstractEglTexture::loadShmTexture(const QPointer< KWayland::Server::BufferInterface > &buffer)
 {
     const QImage &image = buffer->data();
@@ -409,7 +565,13 @@ bool AbstractEglTexture::loadShmTexture(const QPointer< KWayland::Server::Buffer
         return false;
     }
     if (GLPlatform::instance()->isGLES()) {
-        if (s_supportsARGB32 && format == GL_RGBA8) {
+        if (image.format() != QImage::Format_ARGB32) {
+            // the wl_shm formats get uploaded without converting the whole image
+            const GLenum glFormat = (s_supportsARGB32 && format == GL_RGBA8) ? GL_BGRA_EXT : GL_RGBA;
+            glTexImage2D(m_target, 0, glFormat, size.width(), size.height(),
+                         0, glFormat, GL_UNSIGNED_BYTE, nullptr);
+            updateShmTexture(image, QRect(QPoint(0, 0), size));
+        } else if (s_supportsARGB32) {
             const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
             glTexImage2D(m_target, 0, GL_BGRA_EXT, im.width(), im.height(),
                          0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.bits());
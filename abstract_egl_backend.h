@@ -51,6 +51,12 @@ public:
 
     static void unbindWaylandDisplay();
 
+    /**
+     * @returns the pixel unpack buffer used for streaming shm buffers into textures or @c 0 if
+     * pixel buffer objects are not supported.
+     **/
+    GLuint pixelUnpackBuffer();
+
 protected:
     AbstractEglBackend();
     void setEglDisplay(const EGLDisplay &display);
@@ -78,6 +84,8 @@ private:
     EGLContext m_context = EGL_NO_CONTEXT;
     EGLConfig m_config = nullptr;
     QList<QByteArray> m_clientExtensions;
+    bool m_supportsPixelUnpackBuffers = false;
+    GLuint m_pixelUnpackBuffer = 0;
 };
 
 class KWIN_EXPORT AbstractEglTexture : public SceneOpenGL::TexturePrivate
@@ -101,6 +109,12 @@ protected:
     }
 
 private:
+    /**
+     * Uploads the @p region of the shm @p image to the bound texture without converting the
+     * whole image. Only the formats used for wl_shm buffers are supported.
+     * @returns @c false if the format is not supported
+     **/
+    bool updateShmTexture(const QImage &image, const QRegion &region);
     bool loadShmTexture(const QPointer<KWayland::Server::BufferInterface> &buffer);
     bool loadEglTexture(const QPointer<KWayland::Server::BufferInterface> &buffer);
     EGLImageKHR attach(const QPointer<KWayland::Server::BufferInterface> &buffer);
@@ -0,0 +1,207 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include <config-kwin.h>
+#include "drm_harness.h"
+#include "mock_drm.h"
+#include "drm_backend.h"
+#include "drm_buffer.h"
+#include "drm_object_plane.h"
+#include "drm_output.h"
+#include "wayland_server.h"
+
+#include <KWayland/Server/buffer_interface.h>
+
+#include <QtTest/QtTest>
+
+using namespace KWin;
+using KWayland::Server::BufferInterface;
+
+static const QString s_socketName = QStringLiteral("wayland_test_drm_atomic_benchmark-0");
+static const QSize s_modeSize(1920, 1080);
+
+class DrmAtomicBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void benchmarkInit_data();
+    void benchmarkInit();
+    void benchmarkModeset_data();
+    void benchmarkModeset();
+    void benchmarkPageFlip_data();
+    void benchmarkPageFlip();
+    void benchmarkAssignOverlays_data();
+    void benchmarkAssignOverlays();
+};
+
+void DrmAtomicBenchmark::initTestCase()
+{
+    QVERIFY(waylandServer()->init(s_socketName.toLocal8Bit()));
+}
+
+void DrmAtomicBenchmark::benchmarkInit_data()
+{
+    QTest::addColumn<int>("outputs");
+    QTest::addColumn<int>("overlays");
+
+    QTest::newRow("laptop") << 1 << 1;
+    QTest::newRow("dock") << 3 << 2;
+}
+
+void DrmAtomicBenchmark::benchmarkInit()
+{
+    QFETCH(int, outputs);
+    QFETCH(int, overlays);
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, QVector<QSize>(outputs, s_modeSize), overlays * outputs);
+    QBENCHMARK {
+        DrmHarness harness(&gpu);
+        QCOMPARE(harness.outputs().count(), outputs);
+    }
+}
+
+void DrmAtomicBenchmark::benchmarkModeset_data()
+{
+    benchmarkInit_data();
+}
+
+void DrmAtomicBenchmark::benchmarkModeset()
+{
+    QFETCH(int, outputs);
+    QFETCH(int, overlays);
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, QVector<QSize>(outputs, s_modeSize), overlays * outputs);
+    const int modesets = gpu.modesetCount;
+    // the first frame of an output does the atomic mode set, benchmarkInit has the rest
+    QBENCHMARK {
+        DrmHarness harness(&gpu);
+        for (DrmOutput *output : harness.outputs()) {
+            QVERIFY(harness.backend()->present(harness.backend()->createBuffer(output->size()), output));
+        }
+        harness.dispatchEvents();
+    }
+    QVERIFY(gpu.modesetCount > modesets);
+}
+
+void DrmAtomicBenchmark::benchmarkPageFlip_data()
+{
+    QTest::addColumn<int>("outputs");
+    QTest::addColumn<int>("overlays");
+
+    QTest::newRow("1 output") << 1 << 0;
+    QTest::newRow("1 output, 2 overlays") << 1 << 2;
+    QTest::newRow("3 outputs") << 3 << 0;
+    QTest::newRow("3 outputs, 2 overlays") << 3 << 2;
+}
+
+void DrmAtomicBenchmark::benchmarkPageFlip()
+{
+    QFETCH(int, outputs);
+    QFETCH(int, overlays);
+#if !HAVE_GBM
+    if (overlays) {
+        QSKIP("Client buffers need gbm for direct scanout");
+    }
+#endif
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, QVector<QSize>(outputs, s_modeSize), overlays * outputs);
+    DrmHarness harness(&gpu);
+    DrmBackend *backend = harness.backend();
+    const auto drmOutputs = harness.outputs();
+    QCOMPARE(drmOutputs.count(), outputs);
+
+    // double buffered primary planes and a video per overlay plane
+    QHash<DrmOutput*, QVector<DrmBuffer*>> buffers;
+    QHash<DrmOutput*, QVector<BufferInterface*>> videos;
+    for (DrmOutput *output : drmOutputs) {
+        buffers[output] << backend->createBuffer(output->size()) << backend->createBuffer(output->size());
+        for (int i = 0; i < overlays; ++i) {
+            videos[output] << harness.createClientBuffer(QSize(640, 360));
+        }
+        QVERIFY(backend->present(buffers[output].last(), output));
+    }
+    harness.dispatchEvents();
+
+    const int commits = gpu.commitCount;
+    const int properties = gpu.committedProperties;
+    int frame = 0;
+    QBENCHMARK {
+        for (DrmOutput *output : drmOutputs) {
+            // the videos move over the screen
+            QVector<QPair<BufferInterface*, QRect>> candidates;
+            for (int i = 0; i < overlays; ++i) {
+                candidates << qMakePair(videos[output].at(i), QRect(output->geometry().x() + frame % 100 + i * 700, 100, 640, 360));
+            }
+            QCOMPARE(output->assignOverlays(candidates).rectCount(), overlays);
+            QVERIFY(backend->present(buffers[output].at(frame % 2), output));
+        }
+        harness.dispatchEvents();
+        ++frame;
+    }
+    QCOMPARE(gpu.activePlanes(gpu.planes), outputs * (1 + overlays));
+    const int frameCommits = gpu.commitCount - commits;
+    const int frameProperties = gpu.committedProperties - properties;
+    qInfo("%s: %.1f properties/frame", QTest::currentDataTag(), frameProperties / double(frameCommits));
+    // a frame only changes the framebuffer of the primary plane, the overlays send the whole
+    // state they got tested with, apart from the first frame with the overlays
+    QVERIFY(frameProperties < frameCommits * (1 + int(DrmPlane::PropertyIndex::Count) * overlays) + 50 * outputs);
+}
+
+void DrmAtomicBenchmark::benchmarkAssignOverlays_data()
+{
+    QTest::addColumn<int>("overlays");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("4") << 4;
+}
+
+void DrmAtomicBenchmark::benchmarkAssignOverlays()
+{
+#if !HAVE_GBM
+    QSKIP("Client buffers need gbm for direct scanout");
+#endif
+    QFETCH(int, overlays);
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {s_modeSize}, overlays);
+    DrmHarness harness(&gpu);
+    DrmOutput *output = harness.outputs().first();
+    QCOMPARE(DrmHarness::overlayPlanes(output).count(), overlays);
+    QVERIFY(harness.backend()->present(harness.backend()->createBuffer(output->size()), output));
+    harness.dispatchEvents();
+
+    QVector<QPair<BufferInterface*, QRect>> candidates;
+    QRegion expectedCovered;
+    for (int i = 0; i < overlays; ++i) {
+        candidates << qMakePair(harness.createClientBuffer(QSize(400, 300)), QRect(i * 400, 0, 400, 300));
+        expectedCovered |= candidates.last().second;
+    }
+    QRegion covered;
+    // imports and tests each candidate, none of them is on screen yet
+    QBENCHMARK {
+        covered = output->assignOverlays(candidates);
+    }
+    QCOMPARE(covered, expectedCovered);
+    QVERIFY(gpu.testCommitCount >= overlays);
+    // the tests leave the state alone
+    QCOMPARE(gpu.activePlanes(gpu.planes), 1);
+}
+
+DRMTEST_MAIN(DrmAtomicBenchmark)
+#include "atomic_benchmark.moc"
@@ -0,0 +1,640 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include <config-kwin.h>
+#include "drm_harness.h"
+#include "mock_drm.h"
+#include "drm_backend.h"
+#include "drm_buffer.h"
+#include "drm_object_plane.h"
+#include "drm_output.h"
+#include "wayland_server.h"
+
+#include <KWayland/Server/buffer_interface.h>
+
+#include <QtTest/QtTest>
+
+#include <drm_fourcc.h>
+
+using namespace KWin;
+using KWayland::Server::BufferInterface;
+
+static const QString s_socketName = QStringLiteral("wayland_test_drm_backend-0");
+
+class TestDrmBackend : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testOutputs_data();
+    void testOutputs();
+    void testCursorPlane_data();
+    void testCursorPlane();
+    void testAtomicPresent();
+    void testLegacyPresent();
+    void testScanoutReleasesBuffer();
+    void testCursorOnlyCommit_data();
+    void testCursorOnlyCommit();
+    void testCursorFallback_data();
+    void testCursorFallback();
+    void testAssignOverlays();
+    void testOverlayFallback_data();
+    void testOverlayFallback();
+    void testTripleBuffering();
+    void testDoubleBuffering();
+    void testQueuedFrameOutputOff_data();
+    void testQueuedFrameOutputOff();
+};
+
+static uint64_t planeValue(MockDrmGpu *gpu, DrmPlane *plane, const QByteArray &name)
+{
+    return gpu->object(plane->id())->propertyValue(name);
+}
+
+/**
+ * Presents a new frame on @p output and waits for its page flip.
+ **/
+static DrmBuffer *presentFrame(DrmHarness *harness, DrmOutput *output)
+{
+    DrmBuffer *buffer = harness->backend()->createBuffer(output->size());
+    if (!harness->backend()->present(buffer, output)) {
+        return nullptr;
+    }
+    harness->dispatchEvents();
+    return buffer;
+}
+
+void TestDrmBackend::initTestCase()
+{
+    QVERIFY(waylandServer()->init(s_socketName.toLocal8Bit()));
+}
+
+void TestDrmBackend::testOutputs_data()
+{
+    QTest::addColumn<QVector<QSize>>("sizes");
+    QTest::addColumn<QVector<QRect>>("expectedGeometries");
+
+    QTest::newRow("laptop") << QVector<QSize>{QSize(1920, 1080)}
+                            << QVector<QRect>{QRect(0, 0, 1920, 1080)};
+    QTest::newRow("dock") << QVector<QSize>{QSize(1920, 1080), QSize(2560, 1440), QSize(1280, 1024)}
+                          << QVector<QRect>{QRect(0, 0, 1920, 1080), QRect(1920, 0, 2560, 1440), QRect(4480, 0, 1280, 1024)};
+}
+
+void TestDrmBackend::testOutputs()
+{
+    MockDrmGpu gpu;
+    QFETCH(QVector<QSize>, sizes);
+    DrmHarness::setupGpu(&gpu, sizes);
+    DrmHarness harness(&gpu);
+    QVERIFY(harness.backend()->atomicModeSetting());
+
+    const auto outputs = harness.outputs();
+    QCOMPARE(outputs.count(), sizes.count());
+    QFETCH(QVector<QRect>, expectedGeometries);
+    QVector<uint32_t> crtcs;
+    for (int i = 0; i < outputs.count(); ++i) {
+        DrmOutput *output = outputs.at(i);
+        QCOMPARE(output->geometry(), expectedGeometries.at(i));
+        QVERIFY(DrmHarness::primaryPlane(output));
+        QVERIFY(DrmHarness::cursorPlane(output));
+        QVERIFY(!crtcs.contains(DrmHarness::crtcId(output)));
+        crtcs << DrmHarness::crtcId(output);
+        // blanked with the legacy mode set, the first frame does the atomic one
+        QVERIFY(gpu.crtc(DrmHarness::crtcId(output))->bufferId);
+        QVERIFY(!output->presentsWithoutModeset(harness.backend()->createBuffer(output->size())));
+    }
+}
+
+void TestDrmBackend::testCursorPlane_data()
+{
+    QTest::addColumn<QVector<uint32_t>>("formats");
+    QTest::addColumn<bool>("expectedPlane");
+
+    QTest::newRow("ARGB8888") << QVector<uint32_t>{DRM_FORMAT_ARGB8888} << true;
+    QTest::newRow("XRGB8888 and ARGB8888") << QVector<uint32_t>{DRM_FORMAT_XRGB8888, DRM_FORMAT_ARGB8888} << true;
+    QTest::newRow("XRGB8888") << QVector<uint32_t>{DRM_FORMAT_XRGB8888} << false;
+}
+
+void TestDrmBackend::testCursorPlane()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    QFETCH(QVector<uint32_t>, formats);
+    for (auto &plane : gpu.planes) {
+        if (plane.propertyValue(QByteArrayLiteral("type")) == DRM_PLANE_TYPE_CURSOR) {
+            plane.formats = formats;
+        }
+    }
+    DrmHarness harness(&gpu);
+    DrmOutput *output = harness.outputs().first();
+    const uint32_t crtcId = DrmHarness::crtcId(output);
+    QFETCH(bool, expectedPlane);
+    QCOMPARE(DrmHarness::cursorPlane(output) != nullptr, expectedPlane);
+    if (expectedPlane) {
+        QCOMPARE(DrmHarness::cursorPlane(output)->formats(), formats);
+    }
+
+    DrmBuffer *cursor = harness.backend()->createBuffer(QSize(64, 64), DRM_FORMAT_ARGB8888);
+    output->showCursor(cursor);
+    // a cursor plane waits for the next commit, the legacy cursor is set right away
+    QCOMPARE(DrmHarness::cursorDirty(output), expectedPlane);
+    QCOMPARE(gpu.crtc(crtcId)->cursorHandle, expectedPlane ? 0u : cursor->handle());
+}
+
+void TestDrmBackend::testAtomicPresent()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    DrmHarness harness(&gpu);
+    DrmBackend *backend = harness.backend();
+    DrmOutput *output = harness.outputs().first();
+    DrmPlane *primary = DrmHarness::primaryPlane(output);
+    const uint32_t crtcId = DrmHarness::crtcId(output);
+
+    // the first frame sets the mode
+    DrmBuffer *buffer = backend->createBuffer(output->size());
+    QVERIFY(!output->presentsWithoutModeset(buffer));
+    QVERIFY(backend->canPresent(output));
+    const int modesets = gpu.modesetCount;
+    QVERIFY(backend->present(buffer, output));
+    QCOMPARE(gpu.modesetCount, modesets + 1);
+    QVERIFY(gpu.blobs.contains(gpu.crtc(crtcId)->propertyValue(QByteArrayLiteral("MODE_ID"))));
+    QCOMPARE(gpu.crtc(crtcId)->propertyValue(QByteArrayLiteral("ACTIVE")), uint64_t(1));
+    QCOMPARE(gpu.connectors.first().propertyValue(QByteArrayLiteral("CRTC_ID")), uint64_t(crtcId));
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("FB_ID")), uint64_t(buffer->bufferId()));
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("CRTC_ID")), uint64_t(crtcId));
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("SRC_W")), uint64_t(1920 << 16));
+    QVERIFY(DrmHarness::pageFlipPending(output));
+    QVERIFY(!backend->canPresent(output));
+
+    harness.dispatchEvents();
+    QVERIFY(!DrmHarness::pageFlipPending(output));
+    QCOMPARE(primary->current(), buffer);
+    QVERIFY(backend->canPresent(output));
+
+    // from now on a frame only changes the framebuffer of the primary plane
+    DrmBuffer *buffer2 = backend->createBuffer(output->size());
+    QVERIFY(output->presentsWithoutModeset(buffer2));
+    const int properties = gpu.committedProperties;
+    QVERIFY(backend->present(buffer2, output));
+    QCOMPARE(gpu.modesetCount, modesets + 1);
+    QCOMPARE(gpu.committedProperties, properties + 1);
+    QCOMPARE(gpu.committedObjects, QVector<uint32_t>{primary->id()});
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("FB_ID")), uint64_t(buffer2->bufferId()));
+    harness.dispatchEvents();
+    QCOMPARE(primary->current(), buffer2);
+}
+
+void TestDrmBackend::testLegacyPresent()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    DrmHarness harness(&gpu, false);
+    DrmBackend *backend = harness.backend();
+    QVERIFY(!backend->atomicModeSetting());
+    DrmOutput *output = harness.outputs().first();
+    const uint32_t crtcId = DrmHarness::crtcId(output);
+
+    // the black buffer set the mode already
+    DrmBuffer *buffer = backend->createBuffer(output->size());
+    QVERIFY(output->presentsWithoutModeset(buffer));
+    const int modesets = gpu.modesetCount;
+    QVERIFY(backend->present(buffer, output));
+    QCOMPARE(gpu.modesetCount, modesets);
+    QCOMPARE(gpu.crtc(crtcId)->bufferId, buffer->bufferId());
+    QVERIFY(DrmHarness::pageFlipPending(output));
+    QVERIFY(!backend->canPresent(output));
+    harness.dispatchEvents();
+    QVERIFY(!DrmHarness::pageFlipPending(output));
+    QVERIFY(backend->canPresent(output));
+    QCOMPARE(gpu.commitCount, 0);
+}
+
+void TestDrmBackend::testScanoutReleasesBuffer()
+{
+#if !HAVE_GBM
+    QSKIP("Client buffers need gbm for direct scanout");
+#endif
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    DrmHarness harness(&gpu);
+    DrmBackend *backend = harness.backend();
+    DrmOutput *output = harness.outputs().first();
+    DrmPlane *primary = DrmHarness::primaryPlane(output);
+    QVERIFY(presentFrame(&harness, output));
+
+    // a client swapping between two buffers
+    BufferInterface *first = harness.createClientBuffer(output->size());
+    BufferInterface *second = harness.createClientBuffer(output->size());
+    DrmBuffer *scanout = backend->createBuffer(first);
+    QVERIFY(scanout);
+    QVERIFY(output->presentsWithoutModeset(scanout));
+    QVERIFY(backend->present(scanout, output));
+    harness.dispatchEvents();
+    QCOMPARE(primary->current()->clientBuffer(), first);
+
+    // the client attaches the second buffer, the first one stays on screen until the next flip
+    harness.detachClientBuffer(first);
+    QVERIFY(first->isReferenced());
+    DrmBuffer *next = backend->createBuffer(second);
+    QVERIFY(next);
+    QVERIFY(backend->present(next, output));
+    QVERIFY(first->isReferenced());
+    harness.dispatchEvents();
+
+    // the scanout continues with the second buffer and gives the first one back to the client
+    QCOMPARE(primary->current()->clientBuffer(), second);
+    QVERIFY(!first->isReferenced());
+    QVERIFY(second->isReferenced());
+}
+
+void TestDrmBackend::testCursorOnlyCommit_data()
+{
+    QTest::addColumn<quint32>("cursorFormat");
+    QTest::addColumn<bool>("expectedPlane");
+
+    QTest::newRow("ARGB8888") << quint32(DRM_FORMAT_ARGB8888) << true;
+    // the cursor plane cannot scan it out and rejects the commit
+    QTest::newRow("XRGB8888") << quint32(DRM_FORMAT_XRGB8888) << false;
+}
+
+void TestDrmBackend::testCursorOnlyCommit()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    DrmHarness harness(&gpu);
+    DrmBackend *backend = harness.backend();
+    DrmOutput *output = harness.outputs().first();
+    const uint32_t crtcId = DrmHarness::crtcId(output);
+    DrmPlane *cursorPlane = DrmHarness::cursorPlane(output);
+    QVERIFY(cursorPlane);
+    QVERIFY(presentFrame(&harness, output));
+
+    QFETCH(quint32, cursorFormat);
+    DrmBuffer *cursor = backend->createBuffer(QSize(64, 64), cursorFormat);
+    output->showCursor(cursor);
+    output->moveCursor(QPoint(100, 50));
+    QVERIFY(DrmHarness::cursorDirty(output));
+    const int commits = gpu.commitCount;
+    harness.presentCursors();
+    QVERIFY(!DrmHarness::cursorDirty(output));
+
+    QFETCH(bool, expectedPlane);
+    if (!expectedPlane) {
+        QCOMPARE(gpu.commitCount, commits);
+        QVERIFY(!DrmHarness::cursorPlane(output));
+        QVERIFY(!DrmHarness::pageFlipPending(output));
+        QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("FB_ID")), uint64_t(0));
+        QCOMPARE(gpu.crtc(crtcId)->cursorHandle, cursor->handle());
+        QCOMPARE(gpu.crtc(crtcId)->cursorPos, QPoint(100, 50));
+        return;
+    }
+    // nothing but the cursor plane, with a page flip like any other frame
+    QCOMPARE(gpu.commitCount, commits + 1);
+    QCOMPARE(gpu.committedObjects, QVector<uint32_t>{cursorPlane->id()});
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("FB_ID")), uint64_t(cursor->bufferId()));
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("CRTC_ID")), uint64_t(crtcId));
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("CRTC_X")), uint64_t(100));
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("CRTC_Y")), uint64_t(50));
+    QCOMPARE(gpu.crtc(crtcId)->cursorHandle, 0u);
+    QVERIFY(DrmHarness::pageFlipPending(output));
+    QVERIFY(!backend->canPresent(output));
+
+    // a move during the flip goes out once it completed
+    output->moveCursor(QPoint(120, 50));
+    harness.presentCursors();
+    QCOMPARE(gpu.commitCount, commits + 1);
+    QVERIFY(DrmHarness::cursorDirty(output));
+    harness.dispatchEvents();
+    QCOMPARE(gpu.commitCount, commits + 2);
+    QCOMPARE(gpu.committedObjects, QVector<uint32_t>{cursorPlane->id()});
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("CRTC_X")), uint64_t(120));
+    QVERIFY(!DrmHarness::cursorDirty(output));
+    harness.dispatchEvents();
+    QVERIFY(!DrmHarness::pageFlipPending(output));
+
+    // hiding the cursor turns the plane off
+    output->hideCursor();
+    harness.presentCursors();
+    QCOMPARE(gpu.commitCount, commits + 3);
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("FB_ID")), uint64_t(0));
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("CRTC_ID")), uint64_t(0));
+    harness.dispatchEvents();
+}
+
+void TestDrmBackend::testCursorFallback_data()
+{
+    QTest::addColumn<bool>("withFrame");
+
+    QTest::newRow("cursor-only commit") << false;
+    QTest::newRow("with frame") << true;
+}
+
+void TestDrmBackend::testCursorFallback()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    DrmHarness harness(&gpu);
+    DrmBackend *backend = harness.backend();
+    DrmOutput *output = harness.outputs().first();
+    const uint32_t crtcId = DrmHarness::crtcId(output);
+    DrmPlane *primary = DrmHarness::primaryPlane(output);
+    DrmPlane *cursorPlane = DrmHarness::cursorPlane(output);
+    QVERIFY(cursorPlane);
+    QVERIFY(presentFrame(&harness, output));
+
+    // the driver fails every commit with the cursor plane
+    gpu.rejectedObjects << cursorPlane->id();
+    DrmBuffer *cursor = backend->createBuffer(QSize(64, 64), DRM_FORMAT_ARGB8888);
+    output->showCursor(cursor);
+    output->moveCursor(QPoint(10, 10));
+
+    QFETCH(bool, withFrame);
+    if (withFrame) {
+        // the frame goes out without the cursor
+        DrmBuffer *buffer = backend->createBuffer(output->size());
+        QVERIFY(backend->present(buffer, output));
+        QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("FB_ID")), uint64_t(buffer->bufferId()));
+        QVERIFY(!gpu.committedObjects.contains(cursorPlane->id()));
+        QVERIFY(DrmHarness::pageFlipPending(output));
+        harness.dispatchEvents();
+    } else {
+        harness.presentCursors();
+        QVERIFY(!DrmHarness::pageFlipPending(output));
+    }
+    QVERIFY(!DrmHarness::cursorPlane(output));
+    QVERIFY(!DrmHarness::cursorDirty(output));
+    QCOMPARE(planeValue(&gpu, cursorPlane, QByteArrayLiteral("FB_ID")), uint64_t(0));
+    QCOMPARE(gpu.crtc(crtcId)->cursorHandle, cursor->handle());
+    QCOMPARE(gpu.crtc(crtcId)->cursorPos, QPoint(10, 10));
+
+    // the cursor stays on the CRTC
+    output->moveCursor(QPoint(20, 20));
+    QCOMPARE(gpu.crtc(crtcId)->cursorPos, QPoint(20, 20));
+    QVERIFY(presentFrame(&harness, output));
+    QVERIFY(!gpu.committedObjects.contains(cursorPlane->id()));
+}
+
+void TestDrmBackend::testAssignOverlays()
+{
+#if !HAVE_GBM
+    QSKIP("Client buffers need gbm for direct scanout");
+#endif
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)}, 2);
+    DrmHarness harness(&gpu);
+    DrmOutput *output = harness.outputs().first();
+    const uint32_t crtcId = DrmHarness::crtcId(output);
+    const auto overlays = DrmHarness::overlayPlanes(output);
+    QCOMPARE(overlays.count(), 2);
+    QVERIFY(presentFrame(&harness, output));
+
+    // ordered top to bottom
+    BufferInterface *popup = harness.createClientBuffer(QSize(200, 100));
+    BufferInterface *video = harness.createClientBuffer(QSize(640, 360));
+    const QVector<QPair<BufferInterface*, QRect>> candidates{
+        {popup, QRect(100, 100, 200, 100)},
+        {video, QRect(400, 300, 640, 360)}
+    };
+    const QRegion expectedCovered = QRegion(100, 100, 200, 100) | QRegion(400, 300, 640, 360);
+    const int framebuffers = gpu.framebuffers.count();
+    const int testCommits = gpu.testCommitCount;
+    QCOMPARE(output->assignOverlays(candidates), expectedCovered);
+    QVERIFY(output->overlaysChanged());
+    QCOMPARE(gpu.framebuffers.count(), framebuffers + 2);
+    // each assignment got tested, without changing what is on screen
+    QCOMPARE(gpu.testCommitCount, testCommits + 2);
+    QCOMPARE(gpu.activePlanes(gpu.planes), 1);
+    QCOMPARE(overlays.at(0)->next()->clientBuffer(), popup);
+    QCOMPARE(overlays.at(1)->next()->clientBuffer(), video);
+
+    // the next frame puts them on screen
+    QVERIFY(presentFrame(&harness, output));
+    QCOMPARE(gpu.activePlanes(gpu.planes), 3);
+    QCOMPARE(planeValue(&gpu, overlays.at(0), QByteArrayLiteral("CRTC_ID")), uint64_t(crtcId));
+    QCOMPARE(planeValue(&gpu, overlays.at(0), QByteArrayLiteral("CRTC_X")), uint64_t(100));
+    QCOMPARE(planeValue(&gpu, overlays.at(1), QByteArrayLiteral("CRTC_Y")), uint64_t(300));
+    QCOMPARE(planeValue(&gpu, overlays.at(1), QByteArrayLiteral("SRC_W")), uint64_t(640 << 16));
+
+    // an unchanged scene keeps the buffers on their planes
+    QCOMPARE(output->assignOverlays(candidates), expectedCovered);
+    QVERIFY(!output->overlaysChanged());
+    QCOMPARE(gpu.framebuffers.count(), framebuffers + 3);
+    QVERIFY(presentFrame(&harness, output));
+    QCOMPARE(gpu.activePlanes(gpu.planes), 3);
+    QCOMPARE(overlays.at(0)->current()->clientBuffer(), popup);
+
+    // without candidates the planes are turned off and release the client buffers
+    QVERIFY(output->assignOverlays({}).isEmpty());
+    QVERIFY(output->overlaysChanged());
+    DrmBuffer *buffer = harness.backend()->createBuffer(output->size());
+    QVERIFY(harness.backend()->present(buffer, output));
+    QCOMPARE(gpu.activePlanes(gpu.planes), 1);
+    const int shown = gpu.framebuffers.count();
+    harness.dispatchEvents();
+    QCOMPARE(gpu.framebuffers.count(), shown - 2);
+    QVERIFY(!overlays.at(0)->current());
+    QVERIFY(!overlays.at(1)->current());
+}
+
+void TestDrmBackend::testOverlayFallback_data()
+{
+    QTest::addColumn<int>("candidates");
+    QTest::addColumn<QSize>("bufferSize");
+    QTest::addColumn<QRect>("geometry");
+    QTest::addColumn<quint32>("format");
+    QTest::addColumn<int>("maxActivePlanes");
+    QTest::addColumn<bool>("rejectFirst");
+    QTest::addColumn<bool>("pendingFlip");
+    QTest::addColumn<int>("expectedAssigned");
+
+    const QSize size(200, 100);
+    const QRect geometry(100, 100, 200, 100);
+    const quint32 xrgb = DRM_FORMAT_XRGB8888;
+    QTest::newRow("two planes") << 2 << size << geometry << xrgb << 16 << false << false << 2;
+    QTest::newRow("plane limit") << 2 << size << geometry << xrgb << 2 << false << false << 1;
+    QTest::newRow("rejected plane") << 1 << size << geometry << xrgb << 16 << true << false << 1;
+    QTest::newRow("second plane after rejected one") << 2 << size << geometry << xrgb << 16 << true << false << 1;
+    QTest::newRow("wrong size") << 1 << size << QRect(100, 100, 100, 100) << xrgb << 16 << false << false << 0;
+    QTest::newRow("outside output") << 1 << size << QRect(1800, 100, 200, 100) << xrgb << 16 << false << false << 0;
+    QTest::newRow("unsupported format") << 1 << size << geometry << quint32(DRM_FORMAT_RGB565) << 16 << false << false << 0;
+    QTest::newRow("pending flip") << 1 << size << geometry << xrgb << 16 << false << true << 0;
+}
+
+void TestDrmBackend::testOverlayFallback()
+{
+#if !HAVE_GBM
+    QSKIP("Client buffers need gbm for direct scanout");
+#endif
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)}, 2);
+    DrmHarness harness(&gpu);
+    DrmOutput *output = harness.outputs().first();
+    const auto overlays = DrmHarness::overlayPlanes(output);
+    QCOMPARE(overlays.count(), 2);
+    QVERIFY(presentFrame(&harness, output));
+
+    QFETCH(int, maxActivePlanes);
+    gpu.maxActivePlanes = maxActivePlanes;
+    QFETCH(bool, rejectFirst);
+    if (rejectFirst) {
+        gpu.rejectedObjects << overlays.first()->id();
+    }
+    QFETCH(bool, pendingFlip);
+    if (pendingFlip) {
+        QVERIFY(harness.backend()->present(harness.backend()->createBuffer(output->size()), output));
+    }
+
+    QFETCH(int, candidates);
+    QFETCH(QSize, bufferSize);
+    QFETCH(QRect, geometry);
+    QFETCH(quint32, format);
+    QVector<QPair<BufferInterface*, QRect>> list;
+    for (int i = 0; i < candidates; ++i) {
+        list << qMakePair(harness.createClientBuffer(bufferSize, format), geometry.translated(0, i * geometry.height()));
+    }
+    const int framebuffers = gpu.framebuffers.count();
+    const QRegion covered = output->assignOverlays(list);
+
+    QFETCH(int, expectedAssigned);
+    QRegion expectedCovered;
+    for (int i = 0; i < expectedAssigned; ++i) {
+        expectedCovered |= list.at(i).second;
+    }
+    QCOMPARE(covered, expectedCovered);
+    QCOMPARE(output->overlaysChanged(), expectedAssigned != 0);
+    const int assigned = std::count_if(overlays.begin(), overlays.end(), [] (DrmPlane *p) { return p->next(); });
+    QCOMPARE(assigned, expectedAssigned);
+    if (rejectFirst) {
+        QVERIFY(!overlays.first()->next());
+    }
+    // the buffers which did not make it are gone again
+    QCOMPARE(gpu.framebuffers.count(), framebuffers + expectedAssigned);
+    QCOMPARE(gpu.activePlanes(gpu.planes), 1);
+}
+
+void TestDrmBackend::testTripleBuffering()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    DrmHarness harness(&gpu);
+    DrmBackend *backend = harness.backend();
+    backend->setTripleBuffering(true);
+    DrmOutput *output = harness.outputs().first();
+    DrmPlane *primary = DrmHarness::primaryPlane(output);
+
+    DrmBuffer *buffer = backend->createBuffer(output->size());
+    QVERIFY(backend->present(buffer, output));
+    QVERIFY(DrmHarness::pageFlipPending(output));
+    const int commits = gpu.commitCount;
+
+    // the next frame waits behind the pending flip
+    QVERIFY(backend->canPresent(output));
+    DrmBuffer *queued = backend->createBuffer(output->size());
+    const uint32_t queuedId = queued->bufferId();
+    QVERIFY(backend->present(queued, output));
+    QCOMPARE(DrmHarness::queuedBuffer(output), queued);
+    QCOMPARE(gpu.commitCount, commits);
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("FB_ID")), uint64_t(buffer->bufferId()));
+
+    // a newer frame replaces it
+    DrmBuffer *newer = backend->createBuffer(output->size());
+    QVERIFY(backend->present(newer, output));
+    QCOMPARE(DrmHarness::queuedBuffer(output), newer);
+    QVERIFY(!gpu.hasFramebuffer(queuedId));
+    QCOMPARE(gpu.commitCount, commits);
+
+    // the flip commits the queued frame right away
+    harness.dispatchEvents();
+    QVERIFY(!DrmHarness::queuedBuffer(output));
+    QCOMPARE(gpu.commitCount, commits + 1);
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("FB_ID")), uint64_t(newer->bufferId()));
+    QCOMPARE(primary->current(), buffer);
+    QVERIFY(DrmHarness::pageFlipPending(output));
+    harness.dispatchEvents();
+    QVERIFY(!DrmHarness::pageFlipPending(output));
+    QCOMPARE(primary->current(), newer);
+    QCOMPARE(harness.backend()->buffers().count(), 2);
+}
+
+void TestDrmBackend::testDoubleBuffering()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    DrmHarness harness(&gpu);
+    DrmBackend *backend = harness.backend();
+    DrmOutput *output = harness.outputs().first();
+    DrmPlane *primary = DrmHarness::primaryPlane(output);
+
+    DrmBuffer *buffer = backend->createBuffer(output->size());
+    QVERIFY(backend->present(buffer, output));
+    QVERIFY(!backend->canPresent(output));
+    // the buffer stays with the caller until the flip completed
+    DrmBuffer *next = backend->createBuffer(output->size());
+    QVERIFY(!backend->present(next, output));
+    QVERIFY(!DrmHarness::queuedBuffer(output));
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("FB_ID")), uint64_t(buffer->bufferId()));
+
+    harness.dispatchEvents();
+    QVERIFY(backend->canPresent(output));
+    QVERIFY(backend->present(next, output));
+    QCOMPARE(planeValue(&gpu, primary, QByteArrayLiteral("FB_ID")), uint64_t(next->bufferId()));
+    harness.dispatchEvents();
+}
+
+void TestDrmBackend::testQueuedFrameOutputOff_data()
+{
+    QTest::addColumn<bool>("atomicModeSetting");
+
+    QTest::newRow("atomic") << true;
+    QTest::newRow("legacy") << false;
+}
+
+void TestDrmBackend::testQueuedFrameOutputOff()
+{
+    MockDrmGpu gpu;
+    DrmHarness::setupGpu(&gpu, {QSize(1920, 1080)});
+    QFETCH(bool, atomicModeSetting);
+    DrmHarness harness(&gpu, atomicModeSetting);
+    DrmBackend *backend = harness.backend();
+    backend->setTripleBuffering(true);
+    DrmOutput *output = harness.outputs().first();
+
+    DrmBuffer *buffer = backend->createBuffer(output->size());
+    QVERIFY(backend->present(buffer, output));
+    DrmBuffer *queued = backend->createBuffer(output->size());
+    const uint32_t queuedId = queued->bufferId();
+    QVERIFY(backend->present(queued, output));
+    QCOMPARE(DrmHarness::queuedBuffer(output), queued);
+    const int commits = gpu.commitCount;
+
+    // the output goes off before the queued frame can be committed
+    DrmHarness::setDpmsEnabled(output, false);
+    harness.dispatchEvents();
+    QVERIFY(!DrmHarness::queuedBuffer(output));
+    QVERIFY(!DrmHarness::pageFlipPending(output));
+    QCOMPARE(gpu.commitCount, commits);
+    // the dropped frame gives its buffer back
+    QVERIFY(!backend->buffers().contains(queued));
+    QVERIFY(!gpu.hasFramebuffer(queuedId));
+    DrmHarness::setDpmsEnabled(output, true);
+}
+
+DRMTEST_MAIN(TestDrmBackend)
+#include "backend_test.moc"
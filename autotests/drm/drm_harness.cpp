@@ -0,0 +1,233 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include <config-kwin.h>
+#include "drm_harness.h"
+#include "mock_drm.h"
+#include "drm_backend.h"
+#include "drm_buffer.h"
+#include "drm_object_plane.h"
+#include "drm_output.h"
+#include "logind.h"
+#include "wayland_server.h"
+
+#include <KWayland/Server/buffer_interface.h>
+#include <KWayland/Server/clientconnection.h>
+
+#include <KSharedConfig>
+
+#include <QStandardPaths>
+
+#include <wayland-server.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#if HAVE_GBM
+#include "mock_gbm.h"
+#endif
+
+namespace KWin
+{
+
+/**
+ * Stands in for the logind session of the DrmBackend, without a bus to talk to.
+ **/
+class LogindTest
+{
+public:
+    static void setSessionActive(bool active) {
+        if (!LogindIntegration::s_self) {
+            LogindIntegration::s_self = new LogindIntegration(QDBusConnection(QStringLiteral("kwin-testdrm")), QCoreApplication::instance());
+        }
+        LogindIntegration::s_self->m_sessionActive = active;
+    }
+};
+
+DrmTestApplication::DrmTestApplication(int &argc, char **argv)
+    : Application(OperationModeXwayland, argc, argv)
+{
+    QStandardPaths::setTestModeEnabled(true);
+    setConfig(KSharedConfig::openConfig(QString(), KConfig::SimpleConfig));
+    WaylandServer::create(this);
+}
+
+DrmTestApplication::~DrmTestApplication() = default;
+
+void DrmTestApplication::performStartup()
+{
+}
+
+DrmHarness::DrmHarness(MockDrmGpu *gpu, bool atomicModeSetting)
+    : m_gpu(gpu)
+    , m_backend(new DrmBackend)
+{
+    LogindTest::setSessionActive(true);
+    m_backend->m_fd = gpu->openFd();
+    m_backend->m_active = true;
+#if HAVE_GBM
+    m_backend->setGbmDevice(gbm_create_device(m_backend->m_fd));
+#endif
+    if (atomicModeSetting) {
+        m_backend->initAtomicModeSetting();
+    }
+    m_backend->queryResources();
+}
+
+DrmHarness::~DrmHarness()
+{
+    while (m_backend->m_pageFlipsPending != 0 && !m_gpu->pageFlips.isEmpty()) {
+        dispatchEvents();
+    }
+    m_backend->m_pageFlipsPending = 0;
+    // the buffers of the frames are left to the compositor, delete them together with the
+    // black and queued ones, which the outputs would delete again
+    for (DrmOutput *output : m_backend->m_outputs) {
+        output->cleanupBlackBuffer();
+        output->m_queuedBuffer = nullptr;
+    }
+    const QVector<DrmBuffer*> buffers = m_backend->buffers();
+    qDeleteAll(buffers);
+    const int fd = m_backend->m_fd;
+    delete m_backend;
+    m_gpu->releaseFd(fd);
+    for (void *resource : qAsConst(m_attachedBuffers)) {
+        KWayland::Server::BufferInterface::get(reinterpret_cast<wl_resource*>(resource))->unref();
+    }
+#if HAVE_GBM
+    for (void *resource : qAsConst(m_clientBuffers)) {
+        MockGbm::waylandBuffers.remove(resource);
+    }
+#endif
+    if (m_client) {
+        m_client->destroy();
+        close(m_clientFd);
+    }
+}
+
+void DrmHarness::setupGpu(MockDrmGpu *gpu, const QVector<QSize> &sizes, int overlays)
+{
+    for (int i = 0; i < sizes.count(); ++i) {
+        gpu->addCrtc();
+    }
+    for (int i = 0; i < sizes.count(); ++i) {
+        gpu->addConnector(0, sizes.at(i));
+        gpu->addPlane(QByteArrayLiteral("Primary"), 1 << i);
+        gpu->addPlane(QByteArrayLiteral("Cursor"), 1 << i);
+    }
+    for (int i = 0; i < overlays; ++i) {
+        gpu->addPlane(QByteArrayLiteral("Overlay"), (1 << sizes.count()) - 1);
+    }
+}
+
+QVector<DrmOutput*> DrmHarness::outputs() const
+{
+    return m_backend->m_outputs;
+}
+
+void DrmHarness::dispatchEvents()
+{
+    drmEventContext context;
+    memset(&context, 0, sizeof(context));
+    context.version = 2;
+    context.page_flip_handler = DrmBackend::pageFlipHandler;
+    drmHandleEvent(m_backend->m_fd, &context);
+}
+
+void DrmHarness::presentCursors()
+{
+    m_backend->presentCursors();
+}
+
+KWayland::Server::BufferInterface *DrmHarness::createClientBuffer(const QSize &size, uint32_t format)
+{
+    if (!m_client) {
+        const auto connection = waylandServer()->createConnection();
+        m_client = connection.connection;
+        m_clientFd = connection.fd;
+    }
+    wl_resource *resource = wl_resource_create(m_client->client(), &wl_buffer_interface, 1, 0);
+    if (!resource) {
+        return nullptr;
+    }
+#if HAVE_GBM
+    MockGbmBuffer buffer;
+    buffer.size = size;
+    buffer.format = format;
+    MockGbm::waylandBuffers.insert(resource, buffer);
+#else
+    Q_UNUSED(size)
+    Q_UNUSED(format)
+#endif
+    m_clientBuffers << resource;
+    m_attachedBuffers << resource;
+    // like the surface it would be attached to
+    auto clientBuffer = KWayland::Server::BufferInterface::get(resource);
+    clientBuffer->ref();
+    return clientBuffer;
+}
+
+void DrmHarness::detachClientBuffer(KWayland::Server::BufferInterface *buffer)
+{
+    if (m_attachedBuffers.removeOne(buffer->resource())) {
+        buffer->unref();
+    }
+}
+
+DrmPlane *DrmHarness::primaryPlane(DrmOutput *output)
+{
+    return output->m_primaryPlane;
+}
+
+DrmPlane *DrmHarness::cursorPlane(DrmOutput *output)
+{
+    return output->m_cursorPlane;
+}
+
+QVector<DrmPlane*> DrmHarness::overlayPlanes(DrmOutput *output)
+{
+    return output->m_overlayPlanes;
+}
+
+bool DrmHarness::pageFlipPending(DrmOutput *output)
+{
+    return output->m_pageFlipPending;
+}
+
+DrmBuffer *DrmHarness::queuedBuffer(DrmOutput *output)
+{
+    return output->m_queuedBuffer;
+}
+
+bool DrmHarness::cursorDirty(DrmOutput *output)
+{
+    return output->m_cursorDirty;
+}
+
+uint32_t DrmHarness::crtcId(DrmOutput *output)
+{
+    return output->m_crtcId;
+}
+
+void DrmHarness::setDpmsEnabled(DrmOutput *output, bool enabled)
+{
+    output->m_dpmsMode = enabled ? DrmOutput::DpmsMode::On : DrmOutput::DpmsMode::Off;
+}
+
+}
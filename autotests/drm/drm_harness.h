@@ -0,0 +1,134 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef KWIN_DRM_HARNESS_H
+#define KWIN_DRM_HARNESS_H
+
+#include "../../main.h"
+
+#include <QSize>
+#include <QVector>
+
+#include <drm_fourcc.h>
+
+struct MockDrmGpu;
+
+namespace KWayland
+{
+namespace Server
+{
+class BufferInterface;
+class ClientConnection;
+}
+}
+
+namespace KWin
+{
+
+class DrmBackend;
+class DrmBuffer;
+class DrmOutput;
+class DrmPlane;
+
+/**
+ * A Wayland server without a platform, for the DrmBackend driven by DrmHarness.
+ **/
+class DrmTestApplication : public Application
+{
+    Q_OBJECT
+public:
+    DrmTestApplication(int &argc, char **argv);
+    virtual ~DrmTestApplication();
+
+protected:
+    void performStartup() override;
+};
+
+/**
+ * Sets up the real DrmBackend on a mock device the way DrmBackend::openDrm does, without udev
+ * and a logind session. The session is considered active.
+ **/
+class DrmHarness
+{
+public:
+    explicit DrmHarness(MockDrmGpu *gpu, bool atomicModeSetting = true);
+    ~DrmHarness();
+
+    /**
+     * Adds a connector with its own CRTC, primary and cursor plane for each of @p sizes and
+     * @p overlays overlay planes which can go to any CRTC.
+     **/
+    static void setupGpu(MockDrmGpu *gpu, const QVector<QSize> &sizes, int overlays = 0);
+
+    DrmBackend *backend() const {
+        return m_backend;
+    }
+    QVector<DrmOutput*> outputs() const;
+    /**
+     * Delivers the page flips completed by the mock device, like the socket notifier of the
+     * DrmBackend does.
+     **/
+    void dispatchEvents();
+    /**
+     * Commits the pending cursor changes of all outputs, as after a cursor move.
+     **/
+    void presentCursors();
+    /**
+     * Creates a client buffer which the mock gbm imports for direct scanout, unless its
+     * @p format cannot be scanned out.
+     **/
+    KWayland::Server::BufferInterface *createClientBuffer(const QSize &size, uint32_t format = DRM_FORMAT_XRGB8888);
+    /**
+     * Drops the reference of the surface on @p buffer, as when the client attaches its next buffer.
+     **/
+    void detachClientBuffer(KWayland::Server::BufferInterface *buffer);
+
+    static DrmPlane *primaryPlane(DrmOutput *output);
+    static DrmPlane *cursorPlane(DrmOutput *output);
+    static QVector<DrmPlane*> overlayPlanes(DrmOutput *output);
+    static bool pageFlipPending(DrmOutput *output);
+    static DrmBuffer *queuedBuffer(DrmOutput *output);
+    static bool cursorDirty(DrmOutput *output);
+    static uint32_t crtcId(DrmOutput *output);
+    /**
+     * Switches @p output on or off like DrmOutput::setDpms, without the input filter waking it up.
+     **/
+    static void setDpmsEnabled(DrmOutput *output, bool enabled);
+
+private:
+    MockDrmGpu *m_gpu;
+    DrmBackend *m_backend;
+    KWayland::Server::ClientConnection *m_client = nullptr;
+    int m_clientFd = -1;
+    QVector<void*> m_clientBuffers;
+    QVector<void*> m_attachedBuffers;
+};
+
+}
+
+#define DRMTEST_MAIN(TestObject) \
+int main(int argc, char *argv[]) \
+{ \
+    setenv("QT_QPA_PLATFORM", "offscreen", true); \
+    KWin::DrmTestApplication app(argc, argv); \
+    TestObject tc; \
+    return QTest::qExec(&tc, argc, argv); \
+}
+
+#endif
@@ -0,0 +1,1081 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "mock_drm.h"
+
+#include <QHash>
+
+#include <drm_fourcc.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef DRM_CAP_CURSOR_WIDTH
+#define DRM_CAP_CURSOR_WIDTH 0x8
+#endif
+
+#ifndef DRM_CAP_CURSOR_HEIGHT
+#define DRM_CAP_CURSOR_HEIGHT 0x9
+#endif
+
+static QHash<int, MockDrmGpu*> s_gpus;
+
+static MockDrmGpu *gpuForFd(int fd)
+{
+    return s_gpus.value(fd, nullptr);
+}
+
+static int failWith(int error)
+{
+    errno = error;
+    return -error;
+}
+
+MockDrmProperty *MockDrmObject::property(const QByteArray &name)
+{
+    for (auto &p : properties) {
+        if (p.name == name) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+MockDrmProperty *MockDrmObject::propertyById(uint32_t propertyId)
+{
+    for (auto &p : properties) {
+        if (p.id == propertyId) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t MockDrmObject::propertyValue(const QByteArray &name) const
+{
+    for (const auto &p : properties) {
+        if (p.name == name) {
+            return p.value;
+        }
+    }
+    return 0;
+}
+
+MockDrmGpu::MockDrmGpu()
+    : fd(memfd_create("kwin-mock-drm", MFD_CLOEXEC))
+{
+    s_gpus.insert(fd, this);
+}
+
+MockDrmGpu::~MockDrmGpu()
+{
+    s_gpus.remove(fd);
+    close(fd);
+}
+
+int MockDrmGpu::openFd()
+{
+    const int newFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    s_gpus.insert(newFd, this);
+    return newFd;
+}
+
+void MockDrmGpu::releaseFd(int fd)
+{
+    s_gpus.remove(fd);
+}
+
+static void addProperty(MockDrmGpu *gpu, MockDrmObject *object, const QByteArray &name, uint64_t value = 0)
+{
+    MockDrmProperty p;
+    p.id = gpu->nextId++;
+    p.name = name;
+    p.value = value;
+    object->properties << p;
+}
+
+uint32_t MockDrmGpu::addCrtc()
+{
+    MockDrmCrtc crtc;
+    crtc.id = nextId++;
+    crtc.type = DRM_MODE_OBJECT_CRTC;
+    addProperty(this, &crtc, QByteArrayLiteral("MODE_ID"));
+    addProperty(this, &crtc, QByteArrayLiteral("ACTIVE"));
+    crtcs << crtc;
+    return crtc.id;
+}
+
+uint32_t MockDrmGpu::addConnector(uint32_t crtcId, const QSize &modeSize)
+{
+    MockDrmConnector connector;
+    connector.id = nextId++;
+    connector.type = DRM_MODE_OBJECT_CONNECTOR;
+    connector.encoderId = nextId++;
+    connector.modeSize = modeSize;
+    addProperty(this, &connector, QByteArrayLiteral("CRTC_ID"), crtcId);
+    connectors << connector;
+    return connector.id;
+}
+
+uint32_t MockDrmGpu::addPlane(const QByteArray &type, uint32_t possibleCrtcs)
+{
+    // values as defined by the kernel, deliberately not in the order KWin uses
+    const QVector<QPair<QByteArray, uint64_t>> types = {
+        qMakePair(QByteArrayLiteral("Overlay"), uint64_t(0)),
+        qMakePair(QByteArrayLiteral("Primary"), uint64_t(1)),
+        qMakePair(QByteArrayLiteral("Cursor"), uint64_t(2))
+    };
+    MockDrmPlane plane;
+    plane.id = nextId++;
+    plane.type = DRM_MODE_OBJECT_PLANE;
+    plane.possibleCrtcs = possibleCrtcs;
+    if (type == QByteArrayLiteral("Cursor")) {
+        plane.formats = {DRM_FORMAT_ARGB8888};
+    } else {
+        plane.formats = {DRM_FORMAT_XRGB8888, DRM_FORMAT_ARGB8888};
+    }
+    addProperty(this, &plane, QByteArrayLiteral("type"));
+    plane.properties.last().enums = types;
+    for (const auto &t : types) {
+        if (t.first == type) {
+            plane.properties.last().value = t.second;
+        }
+    }
+    const QVector<QByteArray> names = {
+        QByteArrayLiteral("SRC_X"),
+        QByteArrayLiteral("SRC_Y"),
+        QByteArrayLiteral("SRC_W"),
+        QByteArrayLiteral("SRC_H"),
+        QByteArrayLiteral("CRTC_X"),
+        QByteArrayLiteral("CRTC_Y"),
+        QByteArrayLiteral("CRTC_W"),
+        QByteArrayLiteral("CRTC_H"),
+        QByteArrayLiteral("FB_ID"),
+        QByteArrayLiteral("CRTC_ID")
+    };
+    for (const QByteArray &name : names) {
+        addProperty(this, &plane, name);
+    }
+    planes << plane;
+    return plane.id;
+}
+
+MockDrmObject *MockDrmGpu::object(uint32_t objectId)
+{
+    for (auto &o : crtcs) {
+        if (o.id == objectId) {
+            return &o;
+        }
+    }
+    for (auto &o : connectors) {
+        if (o.id == objectId) {
+            return &o;
+        }
+    }
+    for (auto &o : planes) {
+        if (o.id == objectId) {
+            return &o;
+        }
+    }
+    return nullptr;
+}
+
+MockDrmCrtc *MockDrmGpu::crtc(uint32_t crtcId)
+{
+    for (auto &c : crtcs) {
+        if (c.id == crtcId) {
+            return &c;
+        }
+    }
+    return nullptr;
+}
+
+MockDrmPlane *MockDrmGpu::plane(uint32_t planeId)
+{
+    for (auto &p : planes) {
+        if (p.id == planeId) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+int MockDrmGpu::activePlanes(const QVector<MockDrmPlane> &state) const
+{
+    return std::count_if(state.constBegin(), state.constEnd(),
+        [] (const MockDrmPlane &p) {
+            return p.propertyValue(QByteArrayLiteral("FB_ID")) != 0 && p.propertyValue(QByteArrayLiteral("CRTC_ID")) != 0;
+        }
+    );
+}
+
+bool MockDrmGpu::hasFramebuffer(uint32_t bufferId) const
+{
+    return std::any_of(framebuffers.constBegin(), framebuffers.constEnd(),
+        [bufferId] (const MockDrmFramebuffer &fb) {
+            return fb.id == bufferId;
+        }
+    );
+}
+
+static const MockDrmFramebuffer *findFramebuffer(MockDrmGpu *gpu, uint32_t bufferId)
+{
+    for (const auto &fb : qAsConst(gpu->framebuffers)) {
+        if (fb.id == bufferId) {
+            return &fb;
+        }
+    }
+    return nullptr;
+}
+
+static int crtcIndex(MockDrmGpu *gpu, uint32_t crtcId)
+{
+    for (int i = 0; i < gpu->crtcs.count(); ++i) {
+        if (gpu->crtcs.at(i).id == crtcId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool hasPendingPageFlip(MockDrmGpu *gpu, uint32_t crtcId)
+{
+    return std::any_of(gpu->pageFlips.constBegin(), gpu->pageFlips.constEnd(),
+        [crtcId] (const MockDrmPageFlip &flip) {
+            return flip.crtcs.contains(crtcId);
+        }
+    );
+}
+
+/**
+ * Checks the planes like the kernel's atomic check does.
+ * @returns @c 0 or the errno a commit resulting in @p planes fails with
+ **/
+static int checkPlanes(MockDrmGpu *gpu, const QVector<MockDrmPlane> &planes)
+{
+    for (const MockDrmPlane &p : planes) {
+        const uint64_t bufferId = p.propertyValue(QByteArrayLiteral("FB_ID"));
+        const uint64_t crtcId = p.propertyValue(QByteArrayLiteral("CRTC_ID"));
+        if (!bufferId && !crtcId) {
+            continue;
+        }
+        if (!bufferId || !crtcId) {
+            // a plane needs both or none
+            return EINVAL;
+        }
+        const int index = crtcIndex(gpu, crtcId);
+        if (index < 0 || !(p.possibleCrtcs & (1 << index))) {
+            return EINVAL;
+        }
+        const MockDrmFramebuffer *fb = findFramebuffer(gpu, bufferId);
+        if (!fb || !p.formats.contains(fb->format)) {
+            return EINVAL;
+        }
+        // the source rectangle is in 16.16 fixed point and has to be inside the framebuffer
+        const uint64_t right = (p.propertyValue(QByteArrayLiteral("SRC_X")) + p.propertyValue(QByteArrayLiteral("SRC_W"))) >> 16;
+        const uint64_t bottom = (p.propertyValue(QByteArrayLiteral("SRC_Y")) + p.propertyValue(QByteArrayLiteral("SRC_H"))) >> 16;
+        if (right > uint64_t(fb->size.width()) || bottom > uint64_t(fb->size.height())) {
+            return ENOSPC;
+        }
+    }
+    if (gpu->activePlanes(planes) > gpu->maxActivePlanes) {
+        return EINVAL;
+    }
+    return 0;
+}
+
+drmModeResPtr drmModeGetResources(int fd)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    drmModeRes *res = new drmModeRes;
+    memset(res, 0, sizeof(drmModeRes));
+    res->count_crtcs = gpu->crtcs.count();
+    res->crtcs = new uint32_t[gpu->crtcs.count()];
+    for (int i = 0; i < gpu->crtcs.count(); ++i) {
+        res->crtcs[i] = gpu->crtcs.at(i).id;
+    }
+    res->count_connectors = gpu->connectors.count();
+    res->connectors = new uint32_t[gpu->connectors.count()];
+    for (int i = 0; i < gpu->connectors.count(); ++i) {
+        res->connectors[i] = gpu->connectors.at(i).id;
+    }
+    res->count_fbs = gpu->framebuffers.count();
+    res->fbs = new uint32_t[gpu->framebuffers.count()];
+    for (int i = 0; i < gpu->framebuffers.count(); ++i) {
+        res->fbs[i] = gpu->framebuffers.at(i).id;
+    }
+    res->max_width = 16384;
+    res->max_height = 16384;
+    return res;
+}
+
+void drmModeFreeResources(drmModeResPtr ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    delete [] ptr->crtcs;
+    delete [] ptr->connectors;
+    delete [] ptr->fbs;
+    delete ptr;
+}
+
+drmModePlaneResPtr drmModeGetPlaneResources(int fd)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    drmModePlaneRes *res = new drmModePlaneRes;
+    res->count_planes = gpu->planes.count();
+    res->planes = new uint32_t[gpu->planes.count()];
+    for (int i = 0; i < gpu->planes.count(); ++i) {
+        res->planes[i] = gpu->planes.at(i).id;
+    }
+    return res;
+}
+
+void drmModeFreePlaneResources(drmModePlaneResPtr ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    delete [] ptr->planes;
+    delete ptr;
+}
+
+drmModePlanePtr drmModeGetPlane(int fd, uint32_t plane_id)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    for (const MockDrmPlane &p : qAsConst(gpu->planes)) {
+        if (p.id != plane_id) {
+            continue;
+        }
+        drmModePlane *plane = new drmModePlane;
+        memset(plane, 0, sizeof(drmModePlane));
+        plane->plane_id = p.id;
+        plane->possible_crtcs = p.possibleCrtcs;
+        plane->crtc_id = p.propertyValue(QByteArrayLiteral("CRTC_ID"));
+        plane->fb_id = p.propertyValue(QByteArrayLiteral("FB_ID"));
+        plane->count_formats = p.formats.count();
+        plane->formats = new uint32_t[p.formats.count()];
+        for (int i = 0; i < p.formats.count(); ++i) {
+            plane->formats[i] = p.formats.at(i);
+        }
+        return plane;
+    }
+    errno = ENOENT;
+    return nullptr;
+}
+
+void drmModeFreePlane(drmModePlanePtr ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    delete [] ptr->formats;
+    delete ptr;
+}
+
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int fd, uint32_t object_id, uint32_t object_type)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    MockDrmObject *object = gpu->object(object_id);
+    if (!object || object->type != object_type) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModeObjectProperties *properties = new drmModeObjectProperties;
+    properties->count_props = object->properties.count();
+    properties->props = new uint32_t[object->properties.count()];
+    properties->prop_values = new uint64_t[object->properties.count()];
+    for (int i = 0; i < object->properties.count(); ++i) {
+        properties->props[i] = object->properties.at(i).id;
+        properties->prop_values[i] = object->properties.at(i).value;
+    }
+    return properties;
+}
+
+void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    delete [] ptr->props;
+    delete [] ptr->prop_values;
+    delete ptr;
+}
+
+static MockDrmProperty *findProperty(MockDrmGpu *gpu, uint32_t propertyId)
+{
+    for (auto &o : gpu->crtcs) {
+        if (MockDrmProperty *p = o.propertyById(propertyId)) {
+            return p;
+        }
+    }
+    for (auto &o : gpu->connectors) {
+        if (MockDrmProperty *p = o.propertyById(propertyId)) {
+            return p;
+        }
+    }
+    for (auto &o : gpu->planes) {
+        if (MockDrmProperty *p = o.propertyById(propertyId)) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+drmModePropertyPtr drmModeGetProperty(int fd, uint32_t propertyId)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    MockDrmProperty *p = findProperty(gpu, propertyId);
+    if (!p) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModePropertyRes *prop = new drmModePropertyRes;
+    memset(prop, 0, sizeof(drmModePropertyRes));
+    prop->prop_id = p->id;
+    qstrncpy(prop->name, p->name.constData(), DRM_PROP_NAME_LEN);
+    if (p->enums.isEmpty()) {
+        prop->flags = DRM_MODE_PROP_RANGE;
+        return prop;
+    }
+    prop->flags = DRM_MODE_PROP_ENUM;
+    prop->count_enums = p->enums.count();
+    prop->enums = new drm_mode_property_enum[p->enums.count()];
+    for (int i = 0; i < p->enums.count(); ++i) {
+        prop->enums[i].value = p->enums.at(i).second;
+        qstrncpy(prop->enums[i].name, p->enums.at(i).first.constData(), DRM_PROP_NAME_LEN);
+    }
+    return prop;
+}
+
+void drmModeFreeProperty(drmModePropertyPtr ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    delete [] ptr->enums;
+    delete ptr;
+}
+
+drmModeAtomicReqPtr drmModeAtomicAlloc(void)
+{
+    return new _drmModeAtomicReq;
+}
+
+void drmModeAtomicFree(drmModeAtomicReqPtr req)
+{
+    delete req;
+}
+
+int drmModeAtomicAddProperty(drmModeAtomicReqPtr req, uint32_t object_id, uint32_t property_id, uint64_t value)
+{
+    if (!req) {
+        return failWith(EINVAL);
+    }
+    req->items.append({object_id, property_id, value});
+    return req->items.count();
+}
+
+int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req, uint32_t flags, void *user_data)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu || !req) {
+        return failWith(EINVAL);
+    }
+    if (gpu->commitError) {
+        return failWith(gpu->commitError);
+    }
+    // the request gets applied to a copy of the state and only committed if it is valid
+    QVector<MockDrmCrtc> crtcs = gpu->crtcs;
+    QVector<MockDrmConnector> connectors = gpu->connectors;
+    QVector<MockDrmPlane> planes = gpu->planes;
+    auto find = [&] (uint32_t objectId) -> MockDrmObject* {
+        for (auto &o : crtcs) {
+            if (o.id == objectId) {
+                return &o;
+            }
+        }
+        for (auto &o : connectors) {
+            if (o.id == objectId) {
+                return &o;
+            }
+        }
+        for (auto &o : planes) {
+            if (o.id == objectId) {
+                return &o;
+            }
+        }
+        return nullptr;
+    };
+    bool modeset = false;
+    QVector<uint32_t> affectedCrtcs;
+    QVector<uint32_t> changedObjects;
+    for (const auto &item : qAsConst(req->items)) {
+        if (gpu->rejectedObjects.contains(item.objectId)) {
+            return failWith(EINVAL);
+        }
+        MockDrmObject *object = find(item.objectId);
+        MockDrmProperty *property = object ? object->propertyById(item.propertyId) : nullptr;
+        if (!property) {
+            return failWith(EINVAL);
+        }
+        if (property->name == QByteArrayLiteral("FB_ID") && item.value != 0 && !gpu->hasFramebuffer(item.value)) {
+            return failWith(EINVAL);
+        }
+        if (property->name == QByteArrayLiteral("MODE_ID") && item.value != 0 && !gpu->blobs.contains(item.value)) {
+            return failWith(EINVAL);
+        }
+        if (object->type == DRM_MODE_OBJECT_CRTC) {
+            affectedCrtcs << object->id;
+            modeset = modeset || property->value != item.value;
+        } else if (object->type == DRM_MODE_OBJECT_CONNECTOR) {
+            modeset = modeset || property->value != item.value;
+        } else {
+            const uint64_t crtcId = object->propertyValue(QByteArrayLiteral("CRTC_ID"));
+            if (crtcId) {
+                affectedCrtcs << crtcId;
+            }
+            if (property->name == QByteArrayLiteral("CRTC_ID") && item.value) {
+                affectedCrtcs << item.value;
+            }
+        }
+        if (!changedObjects.contains(object->id)) {
+            changedObjects << object->id;
+        }
+        property->value = item.value;
+    }
+    if (modeset && !(flags & DRM_MODE_ATOMIC_ALLOW_MODESET)) {
+        return failWith(EINVAL);
+    }
+    if (const int error = checkPlanes(gpu, planes)) {
+        return failWith(error);
+    }
+    if (flags & DRM_MODE_ATOMIC_TEST_ONLY) {
+        gpu->testCommitCount++;
+        return 0;
+    }
+    for (uint32_t crtc : qAsConst(affectedCrtcs)) {
+        if (hasPendingPageFlip(gpu, crtc)) {
+            return failWith(EBUSY);
+        }
+    }
+    gpu->crtcs = crtcs;
+    gpu->connectors = connectors;
+    gpu->planes = planes;
+    gpu->commitCount++;
+    gpu->committedProperties += req->items.count();
+    gpu->committedObjects = changedObjects;
+    if (modeset) {
+        gpu->modesetCount++;
+    }
+    if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
+        MockDrmPageFlip flip;
+        flip.crtcs = affectedCrtcs;
+        flip.userData = user_data;
+        gpu->pageFlips << flip;
+    }
+    return 0;
+}
+
+int drmModeAtomicGetCursor(drmModeAtomicReqPtr req)
+{
+    if (!req) {
+        return failWith(EINVAL);
+    }
+    return req->items.count();
+}
+
+void drmModeAtomicSetCursor(drmModeAtomicReqPtr req, int cursor)
+{
+    if (!req || cursor > req->items.count()) {
+        return;
+    }
+    req->items.resize(cursor);
+}
+
+int drmModeCreatePropertyBlob(int fd, const void *data, size_t size, uint32_t *id)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu || !data || !id) {
+        return failWith(EINVAL);
+    }
+    *id = gpu->nextId++;
+    gpu->blobs.insert(*id, QByteArray(reinterpret_cast<const char*>(data), size));
+    return 0;
+}
+
+drmModePropertyBlobPtr drmModeGetPropertyBlob(int fd, uint32_t blob_id)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    auto it = gpu->blobs.constFind(blob_id);
+    if (it == gpu->blobs.constEnd()) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModePropertyBlob *blob = new drmModePropertyBlob;
+    blob->id = blob_id;
+    blob->length = it->size();
+    char *data = new char[it->size()];
+    memcpy(data, it->constData(), it->size());
+    blob->data = data;
+    return blob;
+}
+
+void drmModeFreePropertyBlob(drmModePropertyBlobPtr ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    delete [] static_cast<char*>(ptr->data);
+    delete ptr;
+}
+
+static int addFramebuffer(MockDrmGpu *gpu, uint32_t width, uint32_t height, uint32_t pitch, uint32_t format, uint32_t *buf_id)
+{
+    MockDrmFramebuffer fb;
+    fb.id = gpu->nextId++;
+    fb.size = QSize(width, height);
+    fb.stride = pitch;
+    fb.format = format;
+    gpu->framebuffers << fb;
+    *buf_id = fb.id;
+    return 0;
+}
+
+int drmModeAddFB(int fd, uint32_t width, uint32_t height, uint8_t depth,
+                 uint8_t bpp, uint32_t pitch, uint32_t bo_handle, uint32_t *buf_id)
+{
+    Q_UNUSED(bo_handle)
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu || !buf_id || bpp != 32) {
+        return failWith(EINVAL);
+    }
+    // the kernel derives the format from depth and bpp
+    switch (depth) {
+    case 24:
+        return addFramebuffer(gpu, width, height, pitch, DRM_FORMAT_XRGB8888, buf_id);
+    case 32:
+        return addFramebuffer(gpu, width, height, pitch, DRM_FORMAT_ARGB8888, buf_id);
+    default:
+        return failWith(EINVAL);
+    }
+}
+
+int drmModeAddFB2(int fd, uint32_t width, uint32_t height, uint32_t pixel_format,
+                  const uint32_t bo_handles[4], const uint32_t pitches[4], const uint32_t offsets[4],
+                  uint32_t *buf_id, uint32_t flags)
+{
+    Q_UNUSED(bo_handles)
+    Q_UNUSED(offsets)
+    Q_UNUSED(flags)
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu || !buf_id) {
+        return failWith(EINVAL);
+    }
+    if (pixel_format != DRM_FORMAT_XRGB8888 && pixel_format != DRM_FORMAT_ARGB8888) {
+        return failWith(EINVAL);
+    }
+    return addFramebuffer(gpu, width, height, pitches[0], pixel_format, buf_id);
+}
+
+int drmModeRmFB(int fd, uint32_t bufferId)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        return failWith(EINVAL);
+    }
+    auto it = std::find_if(gpu->framebuffers.begin(), gpu->framebuffers.end(),
+        [bufferId] (const MockDrmFramebuffer &fb) {
+            return fb.id == bufferId;
+        }
+    );
+    if (it == gpu->framebuffers.end()) {
+        return failWith(ENOENT);
+    }
+    gpu->framebuffers.erase(it);
+    // like the kernel, turn off what still scans the framebuffer out
+    for (auto &p : gpu->planes) {
+        if (p.propertyValue(QByteArrayLiteral("FB_ID")) == bufferId) {
+            p.property(QByteArrayLiteral("FB_ID"))->value = 0;
+            p.property(QByteArrayLiteral("CRTC_ID"))->value = 0;
+        }
+    }
+    for (auto &c : gpu->crtcs) {
+        if (c.bufferId == bufferId) {
+            c.bufferId = 0;
+        }
+    }
+    return 0;
+}
+
+static drmModeModeInfo createMode(const QSize &size)
+{
+    // CVT reduced blanking like timings at 60 Hz
+    drmModeModeInfo mode;
+    memset(&mode, 0, sizeof(mode));
+    mode.hdisplay = size.width();
+    mode.hsync_start = size.width() + 88;
+    mode.hsync_end = size.width() + 132;
+    mode.htotal = size.width() + 280;
+    mode.vdisplay = size.height();
+    mode.vsync_start = size.height() + 4;
+    mode.vsync_end = size.height() + 9;
+    mode.vtotal = size.height() + 45;
+    mode.vrefresh = 60;
+    mode.clock = mode.htotal * mode.vtotal * 60 / 1000;
+    mode.type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED;
+    qstrncpy(mode.name, QByteArray::number(size.width()).append('x').append(QByteArray::number(size.height())).constData(), DRM_DISPLAY_MODE_LEN);
+    return mode;
+}
+
+drmModeConnectorPtr drmModeGetConnector(int fd, uint32_t connectorId)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    for (const MockDrmConnector &c : qAsConst(gpu->connectors)) {
+        if (c.id != connectorId) {
+            continue;
+        }
+        drmModeConnector *connector = new drmModeConnector;
+        memset(connector, 0, sizeof(drmModeConnector));
+        connector->connector_id = c.id;
+        // only an encoder driving a CRTC is bound to the connector
+        connector->encoder_id = c.propertyValue(QByteArrayLiteral("CRTC_ID")) ? c.encoderId : 0;
+        connector->connector_type = c.connectorType;
+        connector->connector_type_id = 1;
+        connector->connection = c.connected ? DRM_MODE_CONNECTED : DRM_MODE_DISCONNECTED;
+        connector->count_modes = 1;
+        connector->modes = new drmModeModeInfo[1];
+        connector->modes[0] = createMode(c.modeSize);
+        connector->count_props = c.properties.count();
+        connector->props = new uint32_t[c.properties.count()];
+        connector->prop_values = new uint64_t[c.properties.count()];
+        for (int i = 0; i < c.properties.count(); ++i) {
+            connector->props[i] = c.properties.at(i).id;
+            connector->prop_values[i] = c.properties.at(i).value;
+        }
+        connector->count_encoders = 1;
+        connector->encoders = new uint32_t[1];
+        connector->encoders[0] = c.encoderId;
+        return connector;
+    }
+    errno = ENOENT;
+    return nullptr;
+}
+
+void drmModeFreeConnector(drmModeConnectorPtr ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    delete [] ptr->modes;
+    delete [] ptr->props;
+    delete [] ptr->prop_values;
+    delete [] ptr->encoders;
+    delete ptr;
+}
+
+drmModeEncoderPtr drmModeGetEncoder(int fd, uint32_t encoder_id)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    for (const MockDrmConnector &c : qAsConst(gpu->connectors)) {
+        if (c.encoderId != encoder_id) {
+            continue;
+        }
+        drmModeEncoder *encoder = new drmModeEncoder;
+        memset(encoder, 0, sizeof(drmModeEncoder));
+        encoder->encoder_id = c.encoderId;
+        encoder->encoder_type = DRM_MODE_ENCODER_TMDS;
+        encoder->crtc_id = c.propertyValue(QByteArrayLiteral("CRTC_ID"));
+        // every encoder can drive every CRTC
+        encoder->possible_crtcs = (1 << gpu->crtcs.count()) - 1;
+        return encoder;
+    }
+    errno = ENOENT;
+    return nullptr;
+}
+
+void drmModeFreeEncoder(drmModeEncoderPtr ptr)
+{
+    delete ptr;
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int fd, uint32_t crtcId)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    const MockDrmCrtc *c = gpu->crtc(crtcId);
+    if (!c) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    drmModeCrtc *crtc = new drmModeCrtc;
+    memset(crtc, 0, sizeof(drmModeCrtc));
+    crtc->crtc_id = c->id;
+    crtc->buffer_id = c->bufferId;
+    crtc->mode_valid = c->modeValid;
+    if (c->modeValid) {
+        crtc->mode = c->mode;
+        crtc->width = c->mode.hdisplay;
+        crtc->height = c->mode.vdisplay;
+    }
+    return crtc;
+}
+
+void drmModeFreeCrtc(drmModeCrtcPtr ptr)
+{
+    delete ptr;
+}
+
+int drmModeSetCrtc(int fd, uint32_t crtcId, uint32_t bufferId, uint32_t x, uint32_t y,
+                   uint32_t *connectors, int count, drmModeModeInfoPtr mode)
+{
+    Q_UNUSED(x)
+    Q_UNUSED(y)
+    Q_UNUSED(connectors)
+    Q_UNUSED(count)
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        return failWith(EINVAL);
+    }
+    MockDrmCrtc *crtc = gpu->crtc(crtcId);
+    if (!crtc || (bufferId && !gpu->hasFramebuffer(bufferId))) {
+        return failWith(EINVAL);
+    }
+    crtc->bufferId = bufferId;
+    crtc->modeValid = mode != nullptr;
+    if (mode) {
+        crtc->mode = *mode;
+    }
+    gpu->modesetCount++;
+    return 0;
+}
+
+int drmModePageFlip(int fd, uint32_t crtc_id, uint32_t fb_id, uint32_t flags, void *user_data)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        return failWith(EINVAL);
+    }
+    MockDrmCrtc *crtc = gpu->crtc(crtc_id);
+    // a page flip needs a CRTC which got set up
+    if (!crtc || !crtc->bufferId || !gpu->hasFramebuffer(fb_id)) {
+        return failWith(EINVAL);
+    }
+    if (hasPendingPageFlip(gpu, crtc_id)) {
+        return failWith(EBUSY);
+    }
+    crtc->bufferId = fb_id;
+    if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
+        MockDrmPageFlip flip;
+        flip.crtcs << crtc_id;
+        flip.userData = user_data;
+        gpu->pageFlips << flip;
+    }
+    return 0;
+}
+
+int drmModeSetCursor(int fd, uint32_t crtcId, uint32_t bo_handle, uint32_t width, uint32_t height)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        return failWith(EINVAL);
+    }
+    MockDrmCrtc *crtc = gpu->crtc(crtcId);
+    if (!crtc) {
+        return failWith(ENOENT);
+    }
+    if (bo_handle && !gpu->dumbBuffers.contains(bo_handle)) {
+        return failWith(ENOENT);
+    }
+    crtc->cursorHandle = bo_handle;
+    crtc->cursorSize = bo_handle ? QSize(width, height) : QSize();
+    return 0;
+}
+
+int drmModeMoveCursor(int fd, uint32_t crtcId, int x, int y)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        return failWith(EINVAL);
+    }
+    MockDrmCrtc *crtc = gpu->crtc(crtcId);
+    if (!crtc) {
+        return failWith(ENOENT);
+    }
+    crtc->cursorPos = QPoint(x, y);
+    return 0;
+}
+
+int drmModeConnectorSetProperty(int fd, uint32_t connector_id, uint32_t property_id, uint64_t value)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu) {
+        return failWith(EINVAL);
+    }
+    MockDrmObject *connector = gpu->object(connector_id);
+    MockDrmProperty *property = connector && connector->type == DRM_MODE_OBJECT_CONNECTOR ? connector->propertyById(property_id) : nullptr;
+    if (!property) {
+        return failWith(EINVAL);
+    }
+    property->value = value;
+    return 0;
+}
+
+int drmGetCap(int fd, uint64_t capability, uint64_t *value)
+{
+    if (!gpuForFd(fd) || !value) {
+        return failWith(EINVAL);
+    }
+    switch (capability) {
+    case DRM_CAP_DUMB_BUFFER:
+        *value = 1;
+        return 0;
+    case DRM_CAP_CURSOR_WIDTH:
+    case DRM_CAP_CURSOR_HEIGHT:
+        *value = 64;
+        return 0;
+    default:
+        return failWith(EINVAL);
+    }
+}
+
+int drmSetClientCap(int fd, uint64_t capability, uint64_t value)
+{
+    Q_UNUSED(value)
+    if (!gpuForFd(fd)) {
+        return failWith(EINVAL);
+    }
+    switch (capability) {
+    case DRM_CLIENT_CAP_UNIVERSAL_PLANES:
+    case DRM_CLIENT_CAP_ATOMIC:
+        return 0;
+    default:
+        return failWith(EINVAL);
+    }
+}
+
+int drmIoctl(int fd, unsigned long request, void *arg)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu || !arg) {
+        return failWith(EINVAL);
+    }
+    switch (request) {
+    case DRM_IOCTL_MODE_CREATE_DUMB: {
+        auto args = reinterpret_cast<drm_mode_create_dumb*>(arg);
+        if (!args->width || !args->height || args->bpp != 32) {
+            return failWith(EINVAL);
+        }
+        const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+        MockDrmDumbBuffer buffer;
+        buffer.offset = gpu->dumbBufferOffset;
+        buffer.size = uint64_t(args->width) * 4 * args->height;
+        // the mapping of each buffer starts on a page of its own
+        gpu->dumbBufferOffset += (buffer.size + pageSize - 1) / pageSize * pageSize;
+        if (ftruncate(gpu->fd, gpu->dumbBufferOffset) != 0) {
+            return failWith(ENOMEM);
+        }
+        args->handle = gpu->nextId++;
+        args->pitch = args->width * 4;
+        args->size = buffer.size;
+        gpu->dumbBuffers.insert(args->handle, buffer);
+        return 0;
+    }
+    case DRM_IOCTL_MODE_MAP_DUMB: {
+        auto args = reinterpret_cast<drm_mode_map_dumb*>(arg);
+        auto it = gpu->dumbBuffers.constFind(args->handle);
+        if (it == gpu->dumbBuffers.constEnd()) {
+            return failWith(ENOENT);
+        }
+        args->offset = it->offset;
+        return 0;
+    }
+    case DRM_IOCTL_MODE_DESTROY_DUMB: {
+        auto args = reinterpret_cast<drm_mode_destroy_dumb*>(arg);
+        auto it = gpu->dumbBuffers.find(args->handle);
+        if (it == gpu->dumbBuffers.end()) {
+            return failWith(ENOENT);
+        }
+        // give the memory back, the offsets are not reused
+        fallocate(gpu->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, it->offset, it->size);
+        gpu->dumbBuffers.erase(it);
+        return 0;
+    }
+    default:
+        return failWith(EINVAL);
+    }
+}
+
+int drmHandleEvent(int fd, drmEventContextPtr evctx)
+{
+    MockDrmGpu *gpu = gpuForFd(fd);
+    if (!gpu || !evctx) {
+        return failWith(EINVAL);
+    }
+    // the handlers may already commit the next frame
+    const QVector<MockDrmPageFlip> flips = gpu->pageFlips;
+    gpu->pageFlips.clear();
+    for (const MockDrmPageFlip &flip : flips) {
+        gpu->frameCount++;
+        if (evctx->page_flip_handler) {
+            evctx->page_flip_handler(fd, gpu->frameCount, 0, 0, flip.userData);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef MOCK_DRM_H
+#define MOCK_DRM_H
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QPoint>
+#include <QSize>
+#include <QVector>
+
+struct MockDrmProperty {
+    uint32_t id = 0;
+    QByteArray name;
+    uint64_t value = 0;
+    // name and value of the enum values, if any
+    QVector<QPair<QByteArray, uint64_t>> enums;
+};
+
+struct MockDrmObject {
+    uint32_t id = 0;
+    uint32_t type = 0;
+    QVector<MockDrmProperty> properties;
+
+    MockDrmProperty *property(const QByteArray &name);
+    MockDrmProperty *propertyById(uint32_t propertyId);
+    uint64_t propertyValue(const QByteArray &name) const;
+};
+
+struct MockDrmCrtc : MockDrmObject {
+    // state set through the legacy ioctls
+    uint32_t bufferId = 0;
+    bool modeValid = false;
+    drmModeModeInfo mode;
+    uint32_t cursorHandle = 0;
+    QSize cursorSize;
+    QPoint cursorPos;
+};
+
+struct MockDrmConnector : MockDrmObject {
+    uint32_t encoderId = 0;
+    uint32_t connectorType = DRM_MODE_CONNECTOR_DisplayPort;
+    bool connected = true;
+    // the only mode, at 60 Hz
+    QSize modeSize;
+};
+
+struct MockDrmPlane : MockDrmObject {
+    uint32_t possibleCrtcs = 0;
+    QVector<uint32_t> formats;
+};
+
+struct MockDrmFramebuffer {
+    uint32_t id = 0;
+    QSize size;
+    uint32_t stride = 0;
+    uint32_t format = 0;
+};
+
+struct MockDrmDumbBuffer {
+    // where the buffer is mapped in the device fd
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+struct MockDrmPageFlip {
+    QVector<uint32_t> crtcs;
+    void *userData = nullptr;
+};
+
+/**
+ * A fake DRM device with CRTCs, connectors, planes and their atomic properties. The libdrm
+ * functions used by the DRM platform operate on the device registered for the fd they get.
+ * The fd is a memfd, thus dumb buffers can be mapped like on a real device.
+ **/
+struct MockDrmGpu {
+    MockDrmGpu();
+    ~MockDrmGpu();
+
+    uint32_t addCrtc();
+    /**
+     * @param crtcId the CRTC the connector is already driven by, e.g. from the boot splash
+     **/
+    uint32_t addConnector(uint32_t crtcId = 0, const QSize &modeSize = QSize(1920, 1080));
+    /**
+     * @param type one of the values of the "type" enum, "Primary", "Cursor" or "Overlay"
+     **/
+    uint32_t addPlane(const QByteArray &type, uint32_t possibleCrtcs);
+    MockDrmObject *object(uint32_t objectId);
+    MockDrmCrtc *crtc(uint32_t crtcId);
+    MockDrmPlane *plane(uint32_t planeId);
+    /**
+     * The number of planes which are visible in the plane @p state.
+     **/
+    int activePlanes(const QVector<MockDrmPlane> &state) const;
+    bool hasFramebuffer(uint32_t bufferId) const;
+    /**
+     * Opens another fd for the device, which can be closed like one from logind.
+     **/
+    int openFd();
+    void releaseFd(int fd);
+
+    int fd = -1;
+    QVector<MockDrmCrtc> crtcs;
+    QVector<MockDrmConnector> connectors;
+    QVector<MockDrmPlane> planes;
+    QVector<MockDrmFramebuffer> framebuffers;
+    QHash<uint32_t, MockDrmDumbBuffer> dumbBuffers;
+    QHash<uint32_t, QByteArray> blobs;
+    // page flips which completed in the "hardware", delivered by drmHandleEvent
+    QVector<MockDrmPageFlip> pageFlips;
+    // a test-only or real commit fails with EINVAL if more planes would be active
+    int maxActivePlanes = 16;
+    // errno the next commits fail with, 0 to let them succeed
+    int commitError = 0;
+    // test-only and real commits touching one of these objects fail with EINVAL
+    QVector<uint32_t> rejectedObjects;
+
+    int commitCount = 0;
+    int testCommitCount = 0;
+    int modesetCount = 0;
+    int committedProperties = 0;
+    // the objects changed by the last successful commit
+    QVector<uint32_t> committedObjects;
+    unsigned int frameCount = 0;
+
+    uint32_t nextId = 1;
+    uint64_t dumbBufferOffset = 0;
+};
+
+struct _drmModeAtomicReq {
+    struct Item {
+        uint32_t objectId;
+        uint32_t propertyId;
+        uint64_t value;
+    };
+    QVector<Item> items;
+};
+
+#endif
@@ -0,0 +1,150 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "mock_gbm.h"
+
+#include <errno.h>
+
+QHash<void*, MockGbmBuffer> MockGbm::waylandBuffers;
+
+static uint32_t s_nextHandle = 1;
+
+struct gbm_device *gbm_create_device(int fd)
+{
+    gbm_device *device = new gbm_device;
+    device->fd = fd;
+    return device;
+}
+
+void gbm_device_destroy(struct gbm_device *gbm)
+{
+    delete gbm;
+}
+
+static gbm_bo *createBo(gbm_device *device, const QSize &size, uint32_t format)
+{
+    gbm_bo *bo = new gbm_bo;
+    bo->device = device;
+    bo->size = size;
+    bo->format = format;
+    bo->handle = s_nextHandle++;
+    return bo;
+}
+
+struct gbm_bo *gbm_bo_import(struct gbm_device *gbm, uint32_t type, void *buffer, uint32_t usage)
+{
+    Q_UNUSED(usage)
+    if (!gbm || type != GBM_BO_IMPORT_WL_BUFFER) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    auto it = MockGbm::waylandBuffers.constFind(buffer);
+    if (it == MockGbm::waylandBuffers.constEnd()) {
+        // e.g. a shared memory buffer
+        errno = EINVAL;
+        return nullptr;
+    }
+    return createBo(gbm, it->size, it->format);
+}
+
+uint32_t gbm_bo_get_width(struct gbm_bo *bo)
+{
+    return bo->size.width();
+}
+
+uint32_t gbm_bo_get_height(struct gbm_bo *bo)
+{
+    return bo->size.height();
+}
+
+uint32_t gbm_bo_get_stride(struct gbm_bo *bo)
+{
+    return bo->size.width() * 4;
+}
+
+uint32_t gbm_bo_get_format(struct gbm_bo *bo)
+{
+    return bo->format;
+}
+
+union gbm_bo_handle gbm_bo_get_handle(struct gbm_bo *bo)
+{
+    gbm_bo_handle handle;
+    handle.u64 = 0;
+    handle.u32 = bo->handle;
+    return handle;
+}
+
+void gbm_bo_set_user_data(struct gbm_bo *bo, void *data, void (*destroy_user_data)(struct gbm_bo *, void *))
+{
+    bo->userData = data;
+    bo->destroyUserData = destroy_user_data;
+}
+
+void gbm_bo_destroy(struct gbm_bo *bo)
+{
+    if (bo->destroyUserData) {
+        bo->destroyUserData(bo, bo->userData);
+    }
+    delete bo;
+}
+
+struct gbm_surface *gbm_surface_create(struct gbm_device *gbm, uint32_t width, uint32_t height, uint32_t format, uint32_t flags)
+{
+    Q_UNUSED(flags)
+    gbm_surface *surface = new gbm_surface;
+    surface->device = gbm;
+    surface->size = QSize(width, height);
+    surface->format = format;
+    return surface;
+}
+
+struct gbm_bo *gbm_surface_lock_front_buffer(struct gbm_surface *surface)
+{
+    // like Mesa the buffers get reused once released, at most three of them
+    for (gbm_bo *bo : qAsConst(surface->buffers)) {
+        if (!bo->locked) {
+            bo->locked = true;
+            return bo;
+        }
+    }
+    if (surface->buffers.count() >= 3) {
+        return nullptr;
+    }
+    gbm_bo *bo = createBo(surface->device, surface->size, surface->format);
+    bo->surface = surface;
+    bo->locked = true;
+    surface->buffers << bo;
+    return bo;
+}
+
+void gbm_surface_release_buffer(struct gbm_surface *surface, struct gbm_bo *bo)
+{
+    Q_UNUSED(surface)
+    bo->locked = false;
+}
+
+void gbm_surface_destroy(struct gbm_surface *surface)
+{
+    const QVector<gbm_bo*> buffers = surface->buffers;
+    for (gbm_bo *bo : buffers) {
+        gbm_bo_destroy(bo);
+    }
+    delete surface;
+}
@@ -0,0 +1,63 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef MOCK_GBM_H
+#define MOCK_GBM_H
+#include <gbm.h>
+
+#include <QHash>
+#include <QSize>
+#include <QVector>
+
+struct MockGbmBuffer {
+    QSize size;
+    uint32_t format = 0;
+};
+
+struct gbm_device {
+    int fd = -1;
+};
+
+struct gbm_bo {
+    gbm_device *device = nullptr;
+    gbm_surface *surface = nullptr;
+    QSize size;
+    uint32_t format = 0;
+    uint32_t handle = 0;
+    void *userData = nullptr;
+    void (*destroyUserData)(gbm_bo *, void *) = nullptr;
+    // for buffers of a surface, whether the client has locked it
+    bool locked = false;
+};
+
+struct gbm_surface {
+    gbm_device *device = nullptr;
+    QSize size;
+    uint32_t format = 0;
+    QVector<gbm_bo*> buffers;
+};
+
+/**
+ * The client buffers which gbm_bo_import imports from a wl_buffer resource.
+ **/
+struct MockGbm {
+    static QHash<void*, MockGbmBuffer> waylandBuffers;
+};
+
+#endif
@@ -0,0 +1,329 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "drm_harness.h"
+#include "mock_drm.h"
+#include "drm_backend.h"
+#include "drm_buffer.h"
+#include "drm_object_connector.h"
+#include "drm_object_crtc.h"
+#include "drm_object_plane.h"
+
+#include <QtTest/QtTest>
+
+#include <drm_fourcc.h>
+
+Q_DECLARE_METATYPE(KWin::DrmPlane::TypeIndex)
+
+using namespace KWin;
+
+class TestDrmObject : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testCrtc();
+    void testConnector();
+    void testPlane_data();
+    void testPlane();
+    void testInvalidObject();
+    void testPopulate();
+    void testChangedValueSentAgain();
+    void testDisablePlane();
+    void testTestOnly();
+    void testPageFlip();
+};
+
+static void commitPlane(MockDrmGpu *gpu, DrmPlane *plane)
+{
+    // what DrmOutput does for a successful commit
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    QCOMPARE(plane->atomicReqPlanePopulate(req), DrmObject::AtomicReturn::Success);
+    QCOMPARE(drmModeAtomicCommit(gpu->fd, req, 0, nullptr), 0);
+    drmModeAtomicFree(req);
+    plane->setPropsValid(plane->propsValid() | plane->propsPending());
+    plane->setPropsPending(0);
+}
+
+static void setPlaneGeometry(DrmPlane *plane, const QRect &geometry, uint32_t crtcId)
+{
+    plane->setPropValue(int(DrmPlane::PropertyIndex::SrcX), 0);
+    plane->setPropValue(int(DrmPlane::PropertyIndex::SrcY), 0);
+    plane->setPropValue(int(DrmPlane::PropertyIndex::SrcW), geometry.width() << 16);
+    plane->setPropValue(int(DrmPlane::PropertyIndex::SrcH), geometry.height() << 16);
+    plane->setPropValue(int(DrmPlane::PropertyIndex::CrtcX), geometry.x());
+    plane->setPropValue(int(DrmPlane::PropertyIndex::CrtcY), geometry.y());
+    plane->setPropValue(int(DrmPlane::PropertyIndex::CrtcW), geometry.width());
+    plane->setPropValue(int(DrmPlane::PropertyIndex::CrtcH), geometry.height());
+    plane->setPropValue(int(DrmPlane::PropertyIndex::CrtcId), crtcId);
+}
+
+void TestDrmObject::testCrtc()
+{
+    MockDrmGpu gpu;
+    const uint32_t id = gpu.addCrtc();
+    gpu.object(id)->property(QByteArrayLiteral("ACTIVE"))->value = 1;
+
+    DrmCrtc crtc(id, gpu.fd);
+    QVERIFY(crtc.init());
+    QCOMPARE(crtc.id(), id);
+    QCOMPARE(crtc.propId(int(DrmCrtc::PropertyIndex::ModeId)), gpu.object(id)->property(QByteArrayLiteral("MODE_ID"))->id);
+    QCOMPARE(crtc.propId(int(DrmCrtc::PropertyIndex::Active)), gpu.object(id)->property(QByteArrayLiteral("ACTIVE"))->id);
+    QCOMPARE(crtc.propValue(int(DrmCrtc::PropertyIndex::Active)), uint64_t(1));
+    QCOMPARE(crtc.propsValid(), 0u);
+    QCOMPARE(crtc.propsPending(), 0u);
+}
+
+void TestDrmObject::testConnector()
+{
+    MockDrmGpu gpu;
+    const uint32_t crtcId = gpu.addCrtc();
+    const uint32_t id = gpu.addConnector(crtcId);
+
+    DrmConnector connector(id, gpu.fd);
+    QVERIFY(connector.init());
+    QCOMPARE(connector.propId(int(DrmConnector::PropertyIndex::CrtcId)), gpu.object(id)->property(QByteArrayLiteral("CRTC_ID"))->id);
+    QCOMPARE(connector.propValue(int(DrmConnector::PropertyIndex::CrtcId)), uint64_t(crtcId));
+}
+
+void TestDrmObject::testPlane_data()
+{
+    QTest::addColumn<QByteArray>("type");
+    QTest::addColumn<KWin::DrmPlane::TypeIndex>("expectedType");
+    QTest::addColumn<QVector<uint32_t>>("expectedFormats");
+
+    const QVector<uint32_t> formats{DRM_FORMAT_XRGB8888, DRM_FORMAT_ARGB8888};
+    QTest::newRow("primary") << QByteArrayLiteral("Primary") << DrmPlane::TypeIndex::Primary << formats;
+    QTest::newRow("cursor") << QByteArrayLiteral("Cursor") << DrmPlane::TypeIndex::Cursor << QVector<uint32_t>{DRM_FORMAT_ARGB8888};
+    QTest::newRow("overlay") << QByteArrayLiteral("Overlay") << DrmPlane::TypeIndex::Overlay << formats;
+}
+
+void TestDrmObject::testPlane()
+{
+    MockDrmGpu gpu;
+    const uint32_t crtc1 = gpu.addCrtc();
+    const uint32_t crtc2 = gpu.addCrtc();
+    QFETCH(QByteArray, type);
+    const uint32_t id = gpu.addPlane(type, 1 << 1);
+
+    DrmPlane plane(id, gpu.fd);
+    QVERIFY(plane.init());
+    QTEST(plane.type(), "expectedType");
+    QCOMPARE(plane.possibleCrtcs(), 2u);
+    QVERIFY(!plane.isCrtcSupported(crtc1));
+    QVERIFY(plane.isCrtcSupported(crtc2));
+    QTEST(plane.formats(), "expectedFormats");
+    QVERIFY(!plane.current());
+    QVERIFY(!plane.next());
+}
+
+void TestDrmObject::testInvalidObject()
+{
+    MockDrmGpu gpu;
+    const uint32_t crtcId = gpu.addCrtc();
+    // no such plane
+    DrmPlane plane(crtcId + 100, gpu.fd);
+    QVERIFY(!plane.init());
+    // wrong object type
+    DrmConnector connector(crtcId, gpu.fd);
+    QVERIFY(!connector.init());
+}
+
+void TestDrmObject::testPopulate()
+{
+    MockDrmGpu gpu;
+    const uint32_t crtcId = gpu.addCrtc();
+    const uint32_t planeId = gpu.addPlane(QByteArrayLiteral("Primary"), 1);
+    DrmHarness harness(&gpu, false);
+    DrmPlane plane(planeId, gpu.fd);
+    QVERIFY(plane.init());
+
+    QScopedPointer<DrmBuffer> buffer(harness.backend()->createBuffer(QSize(640, 480)));
+    QVERIFY(!buffer.isNull());
+    plane.setNext(buffer.data());
+    setPlaneGeometry(&plane, QRect(0, 0, 640, 480), crtcId);
+
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    QCOMPARE(plane.atomicReqPlanePopulate(req), DrmObject::AtomicReturn::Success);
+    // all properties besides the type
+    QCOMPARE(req->items.count(), int(DrmPlane::PropertyIndex::Count) - 1);
+    QCOMPARE(drmModeAtomicCommit(gpu.fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr), 0);
+    drmModeAtomicFree(req);
+    plane.setPropsValid(plane.propsValid() | plane.propsPending());
+    plane.setPropsPending(0);
+
+    const MockDrmObject *mockPlane = gpu.object(planeId);
+    QCOMPARE(mockPlane->propertyValue(QByteArrayLiteral("FB_ID")), uint64_t(buffer->bufferId()));
+    QCOMPARE(mockPlane->propertyValue(QByteArrayLiteral("CRTC_ID")), uint64_t(crtcId));
+    QCOMPARE(mockPlane->propertyValue(QByteArrayLiteral("SRC_W")), uint64_t(640 << 16));
+    QCOMPARE(mockPlane->propertyValue(QByteArrayLiteral("CRTC_H")), uint64_t(480));
+
+    // nothing changed, nothing to commit
+    req = drmModeAtomicAlloc();
+    QCOMPARE(plane.atomicReqPlanePopulate(req), DrmObject::AtomicReturn::NoChange);
+    QVERIFY(req->items.isEmpty());
+    drmModeAtomicFree(req);
+
+    // a page flip only changes the framebuffer
+    QScopedPointer<DrmBuffer> buffer2(harness.backend()->createBuffer(QSize(640, 480)));
+    plane.setNext(buffer2.data());
+    req = drmModeAtomicAlloc();
+    QCOMPARE(plane.atomicReqPlanePopulate(req), DrmObject::AtomicReturn::Success);
+    QCOMPARE(req->items.count(), 1);
+    QCOMPARE(req->items.first().propertyId, plane.propId(int(DrmPlane::PropertyIndex::FbId)));
+    QCOMPARE(req->items.first().value, uint64_t(buffer2->bufferId()));
+    drmModeAtomicFree(req);
+}
+
+void TestDrmObject::testChangedValueSentAgain()
+{
+    MockDrmGpu gpu;
+    const uint32_t crtcId = gpu.addCrtc();
+    const uint32_t planeId = gpu.addPlane(QByteArrayLiteral("Overlay"), 1);
+    DrmHarness harness(&gpu, false);
+    DrmPlane plane(planeId, gpu.fd);
+    QVERIFY(plane.init());
+    QScopedPointer<DrmBuffer> buffer(harness.backend()->createBuffer(QSize(100, 100)));
+    plane.setNext(buffer.data());
+    setPlaneGeometry(&plane, QRect(10, 10, 100, 100), crtcId);
+    commitPlane(&gpu, &plane);
+
+    // moving the plane has to reach the kernel although the properties were valid
+    setPlaneGeometry(&plane, QRect(20, 10, 100, 100), crtcId);
+    QVERIFY(!(plane.propsValid() & (1U << int(DrmPlane::PropertyIndex::CrtcX))));
+    QVERIFY(plane.propsValid() & (1U << int(DrmPlane::PropertyIndex::CrtcY)));
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    QCOMPARE(plane.atomicReqPlanePopulate(req), DrmObject::AtomicReturn::Success);
+    QCOMPARE(req->items.count(), 1);
+    QCOMPARE(req->items.first().propertyId, plane.propId(int(DrmPlane::PropertyIndex::CrtcX)));
+    QCOMPARE(drmModeAtomicCommit(gpu.fd, req, 0, nullptr), 0);
+    drmModeAtomicFree(req);
+    QCOMPARE(gpu.object(planeId)->propertyValue(QByteArrayLiteral("CRTC_X")), uint64_t(20));
+}
+
+void TestDrmObject::testDisablePlane()
+{
+    MockDrmGpu gpu;
+    const uint32_t crtcId = gpu.addCrtc();
+    const uint32_t planeId = gpu.addPlane(QByteArrayLiteral("Overlay"), 1);
+    DrmHarness harness(&gpu, false);
+    DrmPlane plane(planeId, gpu.fd);
+    QVERIFY(plane.init());
+    QScopedPointer<DrmBuffer> buffer(harness.backend()->createBuffer(QSize(100, 100)));
+    plane.setNext(buffer.data());
+    setPlaneGeometry(&plane, QRect(0, 0, 100, 100), crtcId);
+    commitPlane(&gpu, &plane);
+    QCOMPARE(gpu.activePlanes(gpu.planes), 1);
+
+    plane.setCurrent(buffer.data());
+    plane.setNext(nullptr);
+    commitPlane(&gpu, &plane);
+    QCOMPARE(gpu.activePlanes(gpu.planes), 0);
+    const MockDrmObject *mockPlane = gpu.object(planeId);
+    QCOMPARE(mockPlane->propertyValue(QByteArrayLiteral("FB_ID")), uint64_t(0));
+    QCOMPARE(mockPlane->propertyValue(QByteArrayLiteral("CRTC_ID")), uint64_t(0));
+    QCOMPARE(mockPlane->propertyValue(QByteArrayLiteral("CRTC_W")), uint64_t(0));
+}
+
+void TestDrmObject::testTestOnly()
+{
+    MockDrmGpu gpu;
+    gpu.maxActivePlanes = 1;
+    const uint32_t crtcId = gpu.addCrtc();
+    const uint32_t primaryId = gpu.addPlane(QByteArrayLiteral("Primary"), 1);
+    const uint32_t overlayId = gpu.addPlane(QByteArrayLiteral("Overlay"), 1);
+    DrmHarness harness(&gpu, false);
+    DrmPlane primary(primaryId, gpu.fd);
+    QVERIFY(primary.init());
+    DrmPlane overlay(overlayId, gpu.fd);
+    QVERIFY(overlay.init());
+    QScopedPointer<DrmBuffer> buffer(harness.backend()->createBuffer(QSize(640, 480)));
+    primary.setNext(buffer.data());
+    setPlaneGeometry(&primary, QRect(0, 0, 640, 480), crtcId);
+    commitPlane(&gpu, &primary);
+
+    QScopedPointer<DrmBuffer> overlayBuffer(harness.backend()->createBuffer(QSize(100, 100)));
+    overlay.setNext(overlayBuffer.data());
+    setPlaneGeometry(&overlay, QRect(0, 0, 100, 100), crtcId);
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    QCOMPARE(overlay.atomicReqPlanePopulate(req), DrmObject::AtomicReturn::Success);
+    QCOMPARE(drmModeAtomicCommit(gpu.fd, req, DRM_MODE_ATOMIC_TEST_ONLY, nullptr), -EINVAL);
+    QCOMPARE(gpu.testCommitCount, 0);
+
+    // with a second plane the test passes, but does not change the state
+    gpu.maxActivePlanes = 2;
+    QCOMPARE(drmModeAtomicCommit(gpu.fd, req, DRM_MODE_ATOMIC_TEST_ONLY, nullptr), 0);
+    drmModeAtomicFree(req);
+    QCOMPARE(gpu.testCommitCount, 1);
+    QCOMPARE(gpu.activePlanes(gpu.planes), 1);
+    QCOMPARE(gpu.object(overlayId)->propertyValue(QByteArrayLiteral("FB_ID")), uint64_t(0));
+}
+
+static int s_pageFlips = 0;
+static void *s_pageFlipData = nullptr;
+
+static void pageFlipHandler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *data)
+{
+    Q_UNUSED(fd)
+    Q_UNUSED(frame)
+    Q_UNUSED(sec)
+    Q_UNUSED(usec)
+    s_pageFlips++;
+    s_pageFlipData = data;
+}
+
+void TestDrmObject::testPageFlip()
+{
+    MockDrmGpu gpu;
+    const uint32_t crtcId = gpu.addCrtc();
+    const uint32_t planeId = gpu.addPlane(QByteArrayLiteral("Primary"), 1);
+    DrmHarness harness(&gpu, false);
+    DrmPlane plane(planeId, gpu.fd);
+    QVERIFY(plane.init());
+    QScopedPointer<DrmBuffer> buffer(harness.backend()->createBuffer(QSize(640, 480)));
+    QScopedPointer<DrmBuffer> buffer2(harness.backend()->createBuffer(QSize(640, 480)));
+    plane.setNext(buffer.data());
+    setPlaneGeometry(&plane, QRect(0, 0, 640, 480), crtcId);
+    commitPlane(&gpu, &plane);
+
+    s_pageFlips = 0;
+    s_pageFlipData = nullptr;
+    plane.setNext(buffer2.data());
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    QCOMPARE(plane.atomicReqPlanePopulate(req), DrmObject::AtomicReturn::Success);
+    QCOMPARE(drmModeAtomicCommit(gpu.fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, &plane), 0);
+    // the CRTC is busy until the page flip got handled
+    QCOMPARE(drmModeAtomicCommit(gpu.fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, &plane), -EBUSY);
+    QCOMPARE(gpu.commitCount, 2);
+
+    drmEventContext context;
+    memset(&context, 0, sizeof(context));
+    context.version = 2;
+    context.page_flip_handler = pageFlipHandler;
+    QCOMPARE(drmHandleEvent(gpu.fd, &context), 0);
+    QCOMPARE(s_pageFlips, 1);
+    QCOMPARE(s_pageFlipData, static_cast<void*>(&plane));
+    QCOMPARE(drmHandleEvent(gpu.fd, &context), 0);
+    QCOMPARE(s_pageFlips, 1);
+
+    QCOMPARE(drmModeAtomicCommit(gpu.fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, &plane), 0);
+    drmModeAtomicFree(req);
+}
+
+QTEST_GUILESS_MAIN(TestDrmObject)
+#include "object_test.moc"
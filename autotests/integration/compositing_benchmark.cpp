@@ -0,0 +1,250 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "kwin_wayland_test.h"
+#include "composite.h"
+#include "effects.h"
+#include "effectloader.h"
+#include "frametimeline.h"
+#include "platform.h"
+#include "scene.h"
+#include "shell_client.h"
+#include "wayland_server.h"
+#include "effect_builtins.h"
+
+#include <KConfigGroup>
+
+#include <KWayland/Client/surface.h>
+
+#include <QTextStream>
+
+#include <algorithm>
+
+using namespace KWin;
+using namespace KWayland::Client;
+static const QString s_socketName = QStringLiteral("wayland_test_kwin_compositing_benchmark-0");
+// the number of frames recorded for each benchmark
+static const int s_frameCount = 120;
+
+/**
+ * Measures how long the compositor takes to paint a frame with a number of windows.
+ *
+ * The scene is chosen with the KWIN_COMPOSE environment variable, e.g. "Q" for QPainter
+ * or "O2" for OpenGL, which is usable with llvmpipe. Besides the QTest benchmark result,
+ * each benchmark prints a tab separated line starting with "KWIN_BENCHMARK" containing
+ * the percentiles of the per frame times in usec recorded by the FrameTimeline.
+ *
+ * It is not part of the ctest run, start it with dbus-run-session from the build directory.
+ **/
+class CompositingBenchmark : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void benchmarkPaint_data();
+    void benchmarkPaint();
+
+private:
+    struct Window {
+        Surface *surface;
+        QObject *shellSurface;
+        QSize size;
+        QColor color;
+    };
+    QVector<Window> m_windows;
+    QString m_effect;
+};
+
+void CompositingBenchmark::initTestCase()
+{
+    if (qgetenv("KWIN_COMPOSE").isEmpty()) {
+        qputenv("KWIN_COMPOSE", QByteArrayLiteral("Q"));
+    }
+    if (qgetenv("KWIN_COMPOSE").startsWith('O') && !QFile::exists(QStringLiteral("/dev/dri/card0"))) {
+        QSKIP("Needs a dri device");
+    }
+    qRegisterMetaType<KWin::ShellClient*>();
+    qRegisterMetaType<KWin::AbstractClient*>();
+    qRegisterMetaType<KWin::Effect*>();
+    QSignalSpy workspaceCreatedSpy(kwinApp(), &Application::workspaceCreated);
+    QVERIFY(workspaceCreatedSpy.isValid());
+    kwinApp()->platform()->setInitialWindowSize(QSize(1280, 1024));
+    QVERIFY(waylandServer()->init(s_socketName.toLocal8Bit()));
+
+    // disable all effects, the benchmarks load the ones they need
+    auto config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    KConfigGroup plugins(config, QStringLiteral("Plugins"));
+    ScriptedEffectLoader loader;
+    const auto builtinNames = BuiltInEffects::availableEffectNames() << loader.listOfKnownEffects();
+    for (QString name : builtinNames) {
+        plugins.writeEntry(name + QStringLiteral("Enabled"), false);
+    }
+
+    config->sync();
+    kwinApp()->setConfig(config);
+
+    qputenv("XCURSOR_THEME", QByteArrayLiteral("DMZ-White"));
+    qputenv("XCURSOR_SIZE", QByteArrayLiteral("24"));
+
+    kwinApp()->start();
+    QVERIFY(workspaceCreatedSpy.wait());
+    QVERIFY(Compositor::self());
+    QVERIFY(Compositor::self()->scene());
+
+    QTextStream(stdout) << "KWIN_BENCHMARK\tscene\tbenchmark\tframes"
+                        << "\trender_p50\trender_p90\trender_p99\trender_max"
+                        << "\tpresent_p50\tpresent_p90\tpresent_p99\tpresent_max\n";
+}
+
+void CompositingBenchmark::init()
+{
+    QVERIFY(Test::setupWaylandConnection());
+}
+
+void CompositingBenchmark::cleanup()
+{
+    for (const Window &window : m_windows) {
+        delete window.shellSurface;
+        delete window.surface;
+    }
+    m_windows.clear();
+    Test::destroyWaylandConnection();
+    QTRY_VERIFY(waylandServer()->clients().isEmpty());
+
+    EffectsHandlerImpl *e = static_cast<EffectsHandlerImpl*>(effects);
+    if (!m_effect.isEmpty() && e->isEffectLoaded(m_effect)) {
+        e->unloadEffect(m_effect);
+    }
+    m_effect.clear();
+}
+
+void CompositingBenchmark::benchmarkPaint_data()
+{
+    QTest::addColumn<int>("windowCount");
+    QTest::addColumn<qreal>("opacity");
+    QTest::addColumn<bool>("damage");
+    QTest::addColumn<QString>("effect");
+
+    QTest::newRow("10/opaque/static") << 10 << 1.0 << false << QString();
+    QTest::newRow("10/opaque/damaged") << 10 << 1.0 << true << QString();
+    QTest::newRow("50/opaque/damaged") << 50 << 1.0 << true << QString();
+    QTest::newRow("50/translucent/damaged") << 50 << 0.8 << true << QString();
+    QTest::newRow("50/translucent/damaged/translucency") << 50 << 0.8 << true << QStringLiteral("kwin4_effect_translucency");
+    QTest::newRow("50/opaque/damaged/blur") << 50 << 1.0 << true << QStringLiteral("blur");
+}
+
+static qint64 percentile(const QVector<qint64> &sorted, int p)
+{
+    if (sorted.isEmpty()) {
+        return -1;
+    }
+    return sorted.at((sorted.count() - 1) * p / 100);
+}
+
+void CompositingBenchmark::benchmarkPaint()
+{
+    QFETCH(int, windowCount);
+    QFETCH(qreal, opacity);
+    QFETCH(bool, damage);
+    QFETCH(QString, effect);
+
+    if (!effect.isEmpty()) {
+        EffectsHandlerImpl *e = static_cast<EffectsHandlerImpl*>(effects);
+        if (!e->loadEffect(effect)) {
+            QSKIP("Effect not supported by the scene");
+        }
+        m_effect = effect;
+    }
+
+    // windows of varying size cascaded over the screen
+    for (int i = 0; i < windowCount; ++i) {
+        Window window;
+        window.surface = Test::createSurface(this);
+        QVERIFY(window.surface);
+        window.shellSurface = Test::createShellSurface(Test::ShellSurfaceType::WlShell, window.surface, this);
+        QVERIFY(window.shellSurface);
+        window.size = QSize(200 + (i * 37) % 400, 150 + (i * 53) % 300);
+        window.color = QColor::fromHsv((i * 29) % 360, 255, 255);
+        ShellClient *c = Test::renderAndWaitForShown(window.surface, window.size, window.color);
+        QVERIFY(c);
+        c->move(QPoint((i * 41) % 1000, (i * 29) % 800));
+        c->setOpacity(opacity);
+        m_windows << window;
+    }
+
+    FrameTimeline *timeline = Compositor::self()->frameTimeline();
+    const auto before = timeline->frames();
+    const quint64 first = before.isEmpty() ? 1 : before.last().sequence + 1;
+
+    QVector<qint64> renderTimes;
+    QVector<qint64> presentTimes;
+    QElapsedTimer timeout;
+    timeout.start();
+    int iteration = 0;
+    while (timeout.elapsed() < 30000) {
+        if (damage) {
+            for (const Window &window : qAsConst(m_windows)) {
+                Test::render(window.surface, window.size, window.color.darker(100 + iteration % 50));
+            }
+            Test::flushWaylandConnection();
+        } else {
+            Compositor::self()->addRepaintFull();
+        }
+        iteration++;
+        QTest::qWait(16);
+
+        const auto frames = timeline->frames();
+        if (!frames.isEmpty() && frames.last().sequence >= first + s_frameCount) {
+            for (const FrameTimeline::Frame &frame : frames) {
+                if (frame.sequence < first || frame.sequence >= first + s_frameCount) {
+                    continue;
+                }
+                const qint64 start = frame.timestamps[int(FrameTimeline::Stage::Start)];
+                const qint64 painted = frame.timestamps[int(FrameTimeline::Stage::PaintWindows)];
+                const qint64 presented = frame.timestamps[int(FrameTimeline::Stage::Present)];
+                if (painted >= 0) {
+                    renderTimes << (painted - start) / 1000;
+                }
+                if (presented >= 0) {
+                    presentTimes << (presented - start) / 1000;
+                }
+            }
+            break;
+        }
+    }
+    QVERIFY(!renderTimes.isEmpty());
+    std::sort(renderTimes.begin(), renderTimes.end());
+    std::sort(presentTimes.begin(), presentTimes.end());
+
+    const QString scene = Compositor::self()->scene()->compositingType() & OpenGLCompositing
+        ? QStringLiteral("OpenGL") : QStringLiteral("QPainter");
+    QTextStream(stdout) << "KWIN_BENCHMARK\t" << scene << '\t' << QTest::currentDataTag() << '\t' << renderTimes.count()
+                        << '\t' << percentile(renderTimes, 50) << '\t' << percentile(renderTimes, 90)
+                        << '\t' << percentile(renderTimes, 99) << '\t' << renderTimes.last()
+                        << '\t' << percentile(presentTimes, 50) << '\t' << percentile(presentTimes, 90)
+                        << '\t' << percentile(presentTimes, 99) << '\t' << (presentTimes.isEmpty() ? -1 : presentTimes.last())
+                        << '\n';
+    QTest::setBenchmarkResult(percentile(renderTimes, 50) / 1000.0, QTest::WalltimeMilliseconds);
+}
+
+WAYLANDTEST_MAIN(CompositingBenchmark)
+#include "compositing_benchmark.moc"
@@ -134,6 +134,10 @@ void SceneQPainterTest::testCursorMoving()
     QVERIFY(!cursorImage.isNull());
     p.drawImage(QPoint(45, 45) - kwinApp()->platform()->softwareCursorHotspot(), cursorImage);
     QCOMPARE(referenceImage, *scene->backend()->buffer());
+    // the virtual backend reuses its buffer, so only the cursor got repainted
+    QVERIFY(scene->backend()->supportsBufferAge());
+    QCOMPARE(scene->backend()->bufferAge(0), 1);
+    QVERIFY(scene->backend()->accumulatedDamageHistory(0).isEmpty());
 }
 
 void SceneQPainterTest::testWindow_data()
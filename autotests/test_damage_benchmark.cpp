@@ -0,0 +1,350 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "../rectset.h"
+#include "../scene.h"
+
+#include <QtTest/QtTest>
+
+#include <atomic>
+
+#if defined(__GLIBC__)
+// count the allocations of the region handling, including the ones Qt's containers do
+// with malloc directly instead of operator new
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+static std::atomic<bool> s_countAllocations(false);
+static std::atomic<quint64> s_allocations(0);
+
+extern "C" void *malloc(size_t size)
+{
+    if (s_countAllocations.load(std::memory_order_relaxed)) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (s_countAllocations.load(std::memory_order_relaxed)) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    if (s_countAllocations.load(std::memory_order_relaxed)) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+using namespace KWin;
+
+namespace
+{
+
+static const QRect s_screen(0, 0, 1920, 1080);
+
+struct TraceWindow {
+    QRect geometry;
+    bool opaque;
+    bool visible;
+};
+
+struct TraceEvent {
+    enum class Type {
+        Repaint,
+        Move,
+        Show,
+        Hide
+    };
+    Type type;
+    int window;
+    // window local for Repaint, the new geometry for Move
+    QRect rect;
+};
+
+/**
+ * A synthetic session: the initial windows bottom to top and the events of each frame.
+ **/
+struct DamageTrace {
+    QVector<TraceWindow> windows;
+    QVector<QVector<TraceEvent>> frames;
+};
+
+/**
+ * Replays a DamageTrace through the region handling of a frame. The repaints of the windows
+ * are collected like Toplevel::addRepaint and Compositor::addRepaint do, the occlusion culling
+ * and the damage history are the ones of the scene for a screen with buffer age support.
+ **/
+class DamagePipeline
+{
+public:
+    explicit DamagePipeline(const DamageTrace &trace)
+        : m_trace(trace)
+        , m_windows(trace.windows)
+        , m_windowRepaints(trace.windows.count())
+    {
+    }
+
+    void replay() {
+        for (const QVector<TraceEvent> &frame : m_trace.frames) {
+            for (const TraceEvent &event : frame) {
+                handle(event);
+            }
+            paintFrame();
+        }
+    }
+
+    quint64 paintedPixels() const {
+        return m_paintedPixels;
+    }
+
+private:
+    void handle(const TraceEvent &event) {
+        TraceWindow &window = m_windows[event.window];
+        switch (event.type) {
+        case TraceEvent::Type::Repaint:
+            // Toplevel::addRepaint
+            m_windowRepaints[event.window] |= event.rect.translated(window.geometry.topLeft()) & window.geometry;
+            break;
+        case TraceEvent::Type::Move:
+            // Toplevel::addLayerRepaint of the old geometry and addRepaintFull of the new one
+            m_repaints |= window.geometry;
+            window.geometry = event.rect;
+            m_windowRepaints[event.window] |= window.geometry;
+            break;
+        case TraceEvent::Type::Show:
+            window.visible = true;
+            m_windowRepaints[event.window] |= window.geometry;
+            break;
+        case TraceEvent::Type::Hide:
+            window.visible = false;
+            m_repaints |= window.geometry;
+            break;
+        }
+    }
+
+    void paintFrame() {
+        // Compositor::performCompositing
+        const QRegion region = m_repaints & s_screen;
+        m_repaints = QRegion();
+
+        // the prePaintWindow pass of Scene::paintSimpleScreen
+        QVector<WindowPaintRegion> windows;
+        windows.reserve(m_windows.count());
+        QRegion dirtyArea = region;
+        for (int i = 0; i < m_windows.count(); ++i) {
+            const TraceWindow &window = m_windows.at(i);
+            QRegion paint = region;
+            paint |= m_windowRepaints.at(i);
+            m_windowRepaints[i] = QRegion();
+            if (!window.visible) {
+                continue;
+            }
+            dirtyArea |= paint;
+            windows.append({paint, window.opaque ? QRegion(window.geometry) : QRegion()});
+        }
+
+        // the repaint region for a buffer of age 2
+        const QRegion repaintRegion = m_damageHistory.accumulated(2, s_screen);
+        const QRegion repaintClip = repaintRegion - dirtyArea;
+        dirtyArea |= repaintRegion;
+
+        const QRegion displayRegion(s_screen);
+        QRegion background;
+        const QRegion paintedArea = cullWindowPaintRegions(windows, dirtyArea, repaintRegion, displayRegion, &background);
+        for (const QRect &rect : paintedArea.rects()) {
+            m_paintedPixels += rect.width() * rect.height();
+        }
+        m_damageHistory.add(dirtyArea == displayRegion ? displayRegion : paintedArea - repaintClip);
+    }
+
+    const DamageTrace &m_trace;
+    QVector<TraceWindow> m_windows;
+    QVector<QRegion> m_windowRepaints;
+    QRegion m_repaints;
+    DamageHistory m_damageHistory;
+    quint64 m_paintedPixels = 0;
+};
+
+static const int s_frames = 600;
+
+// a panel at the bottom and a maximized, opaque window every trace starts with
+static DamageTrace createDesktop()
+{
+    DamageTrace trace;
+    trace.windows << TraceWindow{QRect(0, 0, 1920, 1080), true, true};
+    trace.windows << TraceWindow{QRect(0, 1044, 1920, 36), false, true};
+    trace.frames.resize(s_frames);
+    return trace;
+}
+
+static DamageTrace createTypingTrace()
+{
+    // a terminal with 8x16 cells, each frame a character is typed and the cursor moves,
+    // after each line the terminal scrolls
+    DamageTrace trace = createDesktop();
+    const int terminal = trace.windows.count();
+    trace.windows << TraceWindow{QRect(200, 150, 810, 500), false, true};
+    const int columns = 100;
+    const int rows = 30;
+    for (int i = 0; i < s_frames; ++i) {
+        const int column = i % columns;
+        const int row = qMin(rows - 1, i / columns);
+        QVector<TraceEvent> &frame = trace.frames[i];
+        frame << TraceEvent{TraceEvent::Type::Repaint, terminal, QRect(5 + column * 8, 5 + row * 16, 16, 16)};
+        if (column == columns - 1 && row == rows - 1) {
+            frame << TraceEvent{TraceEvent::Type::Repaint, terminal, QRect(5, 5, 800, rows * 16)};
+        }
+    }
+    return trace;
+}
+
+static DamageTrace createVideoTrace()
+{
+    // a video player repainting the video each frame and the progress bar once a second
+    DamageTrace trace = createDesktop();
+    const int player = trace.windows.count();
+    trace.windows << TraceWindow{QRect(300, 150, 1280, 780), true, true};
+    for (int i = 0; i < s_frames; ++i) {
+        QVector<TraceEvent> &frame = trace.frames[i];
+        frame << TraceEvent{TraceEvent::Type::Repaint, player, QRect(0, 30, 1280, 720)};
+        if (i % 60 == 0) {
+            frame << TraceEvent{TraceEvent::Type::Repaint, player, QRect(10, 755, 1260, 20)};
+        }
+    }
+    return trace;
+}
+
+static DamageTrace createDraggingTrace()
+{
+    // a translucent window with shadow moved around over a few other windows
+    DamageTrace trace = createDesktop();
+    for (int i = 0; i < 4; ++i) {
+        trace.windows << TraceWindow{QRect(100 + i * 350, 100 + i * 80, 600, 450), true, true};
+    }
+    const int dragged = trace.windows.count();
+    QRect geometry(50, 50, 660, 510);
+    trace.windows << TraceWindow{geometry, false, true};
+    for (int i = 0; i < s_frames; ++i) {
+        const int step = (i / 150) % 2 ? -1 : 1;
+        geometry.translate(step * 5, step * 3);
+        trace.frames[i] << TraceEvent{TraceEvent::Type::Move, dragged, geometry};
+    }
+    return trace;
+}
+
+static DamageTrace createTooltipsTrace()
+{
+    // the pointer moving over a toolbar, showing and hiding small translucent tooltips
+    DamageTrace trace = createDesktop();
+    trace.windows << TraceWindow{QRect(0, 0, 1920, 1044), true, true};
+    const int first = trace.windows.count();
+    const int tooltips = 40;
+    for (int i = 0; i < tooltips; ++i) {
+        trace.windows << TraceWindow{QRect(20 + i * 47, 60 + (i % 3) * 10, 140, 40), false, false};
+    }
+    for (int i = 0; i < s_frames; ++i) {
+        QVector<TraceEvent> &frame = trace.frames[i];
+        const int current = first + (i / 5) % tooltips;
+        const int previous = first + ((i / 5) + tooltips - 1) % tooltips;
+        if (i % 5 == 0) {
+            frame << TraceEvent{TraceEvent::Type::Hide, previous, QRect()};
+            frame << TraceEvent{TraceEvent::Type::Show, current, QRect()};
+        }
+        // the toolbar button below the pointer gets highlighted
+        frame << TraceEvent{TraceEvent::Type::Repaint, first - 1, QRect(20 + (i / 5) % tooltips * 47, 10, 40, 40)};
+    }
+    return trace;
+}
+
+}
+
+Q_DECLARE_METATYPE(DamageTrace)
+
+class DamageBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void benchmarkTrace_data();
+    void benchmarkTrace();
+};
+
+void DamageBenchmark::benchmarkTrace_data()
+{
+    QTest::addColumn<DamageTrace>("trace");
+
+    QTest::newRow("typing") << createTypingTrace();
+    QTest::newRow("video") << createVideoTrace();
+    QTest::newRow("dragging") << createDraggingTrace();
+    QTest::newRow("tooltips") << createTooltipsTrace();
+}
+
+void DamageBenchmark::benchmarkTrace()
+{
+    QFETCH(DamageTrace, trace);
+
+    // an operation is either a damage event or the paint pass of a frame
+    int events = 0;
+    for (const QVector<TraceEvent> &frame : trace.frames) {
+        events += frame.count();
+    }
+    const int operations = events + trace.frames.count();
+
+    // QBENCHMARK reports the time for all frames of the trace
+    quint64 frames = 0;
+    quint64 paintedPixels = 0;
+    quint64 replayed = 0;
+    qint64 elapsed = 0;
+    QElapsedTimer timer;
+#if defined(__GLIBC__)
+    s_allocations = 0;
+#endif
+    QBENCHMARK {
+        DamagePipeline pipeline(trace);
+        timer.start();
+#if defined(__GLIBC__)
+        s_countAllocations = true;
+#endif
+        pipeline.replay();
+#if defined(__GLIBC__)
+        s_countAllocations = false;
+#endif
+        elapsed += timer.nsecsElapsed();
+        frames += trace.frames.count();
+        replayed += operations;
+        paintedPixels += pipeline.paintedPixels();
+    }
+    // every trace repaints something on each frame
+    QVERIFY(paintedPixels >= frames);
+    const double seconds = qMax(elapsed, qint64(1)) / 1e9;
+    qInfo("%s: %.0f ops/s, %.0f frames/s", QTest::currentDataTag(), replayed / seconds, frames / seconds);
+#if defined(__GLIBC__)
+    qInfo("%s: %.1f allocations/frame", QTest::currentDataTag(), double(s_allocations) / frames);
+#endif
+}
+
+QTEST_GUILESS_MAIN(DamageBenchmark)
+#include "test_damage_benchmark.moc"
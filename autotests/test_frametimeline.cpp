@@ -0,0 +1,189 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "../frametimeline.h"
+
+#include <QtTest/QtTest>
+
+using namespace KWin;
+
+class TestFrameTimeline : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testEmpty();
+    void testMark();
+    void testMarkEarlierFrame();
+    void testRingBuffer();
+    void testEstimatorMinimumSamples();
+    void testEstimatorPercentile();
+    void testEstimatorRingBuffer();
+    void testEstimatorReset();
+};
+
+// the estimate adds a safety margin of a millisecond to the percentile
+static const qint64 s_margin = 1000000;
+static const qint64 s_ms = 1000000;
+
+void TestFrameTimeline::testEmpty()
+{
+    FrameTimeline timeline;
+    QCOMPARE(timeline.currentFrame(), quint64(0));
+    QVERIFY(timeline.frames().isEmpty());
+    QCOMPARE(timeline.elapsed(FrameTimeline::Stage::Start, FrameTimeline::Stage::Present), qint64(-1));
+    // marking without a frame is a no-op
+    timeline.mark(FrameTimeline::Stage::Present);
+    timeline.markQueued();
+    QVERIFY(timeline.frames().isEmpty());
+}
+
+void TestFrameTimeline::testMark()
+{
+    FrameTimeline timeline;
+    timeline.setBufferCount(3);
+    timeline.beginFrame();
+    QCOMPARE(timeline.currentFrame(), quint64(1));
+    QCOMPARE(timeline.elapsed(FrameTimeline::Stage::Start, FrameTimeline::Stage::Present), qint64(-1));
+    timeline.mark(FrameTimeline::Stage::Present);
+    timeline.markQueued();
+    QVERIFY(timeline.elapsed(FrameTimeline::Stage::Start, FrameTimeline::Stage::Present) >= 0);
+
+    const auto frames = timeline.frames();
+    QCOMPARE(frames.count(), 1);
+    QCOMPARE(frames.first().sequence, quint64(1));
+    QCOMPARE(frames.first().bufferCount, 3);
+    QVERIFY(frames.first().queued);
+    QVERIFY(frames.first().timestamps[int(FrameTimeline::Stage::PageFlip)] < 0);
+
+    // a new frame starts without the stages of the previous one
+    timeline.beginFrame();
+    QCOMPARE(timeline.elapsed(FrameTimeline::Stage::Start, FrameTimeline::Stage::Present), qint64(-1));
+    QVERIFY(!timeline.frames().last().queued);
+}
+
+void TestFrameTimeline::testMarkEarlierFrame()
+{
+    // the page flip of the first frame completes while the second one is rendered
+    FrameTimeline timeline;
+    timeline.beginFrame();
+    const quint64 first = timeline.currentFrame();
+    timeline.beginFrame();
+    timeline.mark(FrameTimeline::Stage::PageFlip, first);
+
+    const auto frames = timeline.frames();
+    QCOMPARE(frames.count(), 2);
+    QVERIFY(frames.at(0).timestamps[int(FrameTimeline::Stage::PageFlip)] >= 0);
+    QVERIFY(frames.at(1).timestamps[int(FrameTimeline::Stage::PageFlip)] < 0);
+
+    // frames which are not recorded anymore are not touched
+    for (int i = 0; i < FrameTimeline::s_capacity; ++i) {
+        timeline.beginFrame();
+    }
+    timeline.mark(FrameTimeline::Stage::PageFlip, first + 1);
+    for (const FrameTimeline::Frame &frame : timeline.frames()) {
+        QVERIFY(frame.timestamps[int(FrameTimeline::Stage::PageFlip)] < 0);
+    }
+}
+
+void TestFrameTimeline::testRingBuffer()
+{
+    FrameTimeline timeline;
+    const int count = FrameTimeline::s_capacity + 10;
+    for (int i = 0; i < count; ++i) {
+        timeline.beginFrame();
+    }
+    const auto frames = timeline.frames();
+    QCOMPARE(frames.count(), int(FrameTimeline::s_capacity));
+    // oldest first
+    QCOMPARE(frames.first().sequence, quint64(count - FrameTimeline::s_capacity + 1));
+    QCOMPARE(frames.last().sequence, quint64(count));
+    // the text has a header and a line per frame
+    QCOMPARE(timeline.toString().count(QLatin1Char('\n')), FrameTimeline::s_capacity + 1);
+}
+
+void TestFrameTimeline::testEstimatorMinimumSamples()
+{
+    RenderTimeEstimator estimator;
+    QCOMPARE(estimator.estimate(42), qint64(42));
+    for (int i = 0; i < 7; ++i) {
+        estimator.addSample(5 * s_ms);
+        QCOMPARE(estimator.estimate(42), qint64(42));
+    }
+    // invalid samples don't count
+    estimator.addSample(-1);
+    QCOMPARE(estimator.estimate(42), qint64(42));
+    estimator.addSample(5 * s_ms);
+    QCOMPARE(estimator.estimate(42), 5 * s_ms + s_margin);
+}
+
+void TestFrameTimeline::testEstimatorPercentile()
+{
+    RenderTimeEstimator estimator;
+    for (int i = 1; i <= 8; ++i) {
+        estimator.addSample(i * s_ms);
+    }
+    // the 90th percentile of eight samples is the seventh one
+    QCOMPARE(estimator.estimate(0), 7 * s_ms + s_margin);
+
+    estimator.reset();
+    for (int i = 0; i < RenderTimeEstimator::s_sampleCount - 1; ++i) {
+        estimator.addSample(2 * s_ms);
+    }
+    // a single slow frame does not delay the following ones
+    estimator.addSample(50 * s_ms);
+    QCOMPARE(estimator.estimate(0), 2 * s_ms + s_margin);
+
+    // but an expensive effect which stays active for a few frames does
+    for (int i = 0; i < 7; ++i) {
+        estimator.addSample(10 * s_ms);
+    }
+    QCOMPARE(estimator.estimate(0), 10 * s_ms + s_margin);
+}
+
+void TestFrameTimeline::testEstimatorRingBuffer()
+{
+    RenderTimeEstimator estimator;
+    for (int i = 0; i < RenderTimeEstimator::s_sampleCount; ++i) {
+        estimator.addSample(20 * s_ms);
+    }
+    QCOMPARE(estimator.estimate(0), 20 * s_ms + s_margin);
+    // the old samples get replaced
+    for (int i = 0; i < RenderTimeEstimator::s_sampleCount; ++i) {
+        estimator.addSample(3 * s_ms);
+    }
+    QCOMPARE(estimator.estimate(0), 3 * s_ms + s_margin);
+}
+
+void TestFrameTimeline::testEstimatorReset()
+{
+    RenderTimeEstimator estimator;
+    for (int i = 0; i < RenderTimeEstimator::s_sampleCount; ++i) {
+        estimator.addSample(5 * s_ms);
+    }
+    estimator.reset();
+    QCOMPARE(estimator.estimate(42), qint64(42));
+    // the samples before the reset are gone
+    for (int i = 0; i < 8; ++i) {
+        estimator.addSample(1 * s_ms);
+    }
+    QCOMPARE(estimator.estimate(42), 1 * s_ms + s_margin);
+}
+
+QTEST_GUILESS_MAIN(TestFrameTimeline)
+#include "test_frametimeline.moc"
@@ -0,0 +1,231 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "../qpainterrecorder.h"
+
+#include <QtTest/QtTest>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+using namespace KWin;
+
+class TestQPainterRecorder : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testEmpty();
+    void testReplay_data();
+    void testReplay();
+    void testReplayInThread();
+    void testReplayText_data();
+    void testReplayText();
+    void testReplayTextConcurrently();
+
+private:
+    static QImage createImage();
+    static void paintScene(QPainter *painter);
+};
+
+QImage TestQPainterRecorder::createImage()
+{
+    QImage image(200, 100, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+void TestQPainterRecorder::paintScene(QPainter *painter)
+{
+    // mimics what SceneQPainter does with a screen and a translucent window
+    painter->save();
+    painter->setWindow(QRect(100, 50, 200, 100));
+    painter->setClipping(true);
+    painter->setClipRegion(QRegion(100, 50, 150, 80) - QRegion(120, 60, 10, 10));
+    painter->setBrush(Qt::black);
+    painter->drawRects(QVector<QRect>{QRect(100, 50, 200, 100)});
+
+    painter->save();
+    painter->translate(110, 55);
+    painter->setClipRect(QRect(0, 0, 100, 50), Qt::IntersectClip);
+    QImage window(120, 60, QImage::Format_ARGB32_Premultiplied);
+    window.fill(QColor(255, 0, 0, 128));
+    painter->setOpacity(0.5);
+    painter->drawImage(QPoint(0, 0), window, QRect(10, 10, 100, 50));
+    painter->restore();
+
+    painter->setCompositionMode(QPainter::CompositionMode_Source);
+    painter->fillRect(QRect(200, 60, 20, 20), QColor(0, 255, 0, 100));
+    painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter->setPen(QPen(Qt::blue, 3));
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->drawLine(QPointF(100, 50), QPointF(300, 150));
+    painter->drawRoundedRect(QRectF(230, 90, 40, 30), 5.0, 5.0);
+    painter->restore();
+}
+
+void TestQPainterRecorder::testEmpty()
+{
+    QImage image = createImage();
+    QPainterRecorder recorder(&image);
+    QVERIFY(recorder.isEmpty());
+    QCOMPARE(recorder.width(), image.width());
+    QCOMPARE(recorder.height(), image.height());
+    recorder.replay();
+    QCOMPARE(image, createImage());
+}
+
+void TestQPainterRecorder::testReplay_data()
+{
+    QTest::addColumn<bool>("clearAfterwards");
+
+    QTest::newRow("replay") << false;
+    QTest::newRow("clear") << true;
+}
+
+void TestQPainterRecorder::testReplay()
+{
+    QFETCH(bool, clearAfterwards);
+    QImage expected = createImage();
+    QPainter painter(&expected);
+    paintScene(&painter);
+    painter.end();
+
+    QImage image = createImage();
+    QPainterRecorder recorder(&image);
+    painter.begin(&recorder);
+    paintScene(&painter);
+    painter.end();
+    // recording must not touch the target
+    QCOMPARE(image, createImage());
+    QVERIFY(!recorder.isEmpty());
+
+    if (clearAfterwards) {
+        recorder.clear();
+        QVERIFY(recorder.isEmpty());
+        recorder.replay();
+        QCOMPARE(image, createImage());
+    } else {
+        recorder.replay();
+        QCOMPARE(image, expected);
+    }
+}
+
+void TestQPainterRecorder::testReplayInThread()
+{
+    QImage expected = createImage();
+    QPainter painter(&expected);
+    paintScene(&painter);
+    painter.end();
+
+    QImage image = createImage();
+    QPainterRecorder recorder(&image);
+    painter.begin(&recorder);
+    paintScene(&painter);
+    painter.end();
+
+    QtConcurrent::run([&recorder] {
+        recorder.replay();
+    }).waitForFinished();
+    QCOMPARE(image, expected);
+}
+
+void TestQPainterRecorder::testReplayText_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("rightToLeft");
+    QTest::addColumn<bool>("underline");
+    QTest::addColumn<bool>("strikeOut");
+
+    QTest::newRow("plain") << QStringLiteral("KWin") << false << false << false;
+    QTest::newRow("decorated") << QStringLiteral("KWin") << false << true << true;
+    QTest::newRow("rtl") << QStringLiteral("\u05e9\u05dc\u05d5\u05dd KWin") << true << true << false;
+}
+
+void TestQPainterRecorder::testReplayText()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, rightToLeft);
+    QFETCH(bool, underline);
+    QFETCH(bool, strikeOut);
+    const auto paintText = [&] (QPainter *painter) {
+        QFont font = painter->font();
+        font.setPixelSize(20);
+        font.setUnderline(underline);
+        font.setStrikeOut(strikeOut);
+        painter->setFont(font);
+        painter->setPen(Qt::blue);
+        painter->setLayoutDirection(rightToLeft ? Qt::RightToLeft : Qt::LeftToRight);
+        painter->translate(10, 5);
+        painter->drawText(QRect(0, 0, 180, 90), Qt::AlignCenter, text);
+    };
+
+    QImage expected = createImage();
+    QPainter painter(&expected);
+    paintText(&painter);
+    painter.end();
+    QVERIFY(expected != createImage());
+
+    QImage image = createImage();
+    QPainterRecorder recorder(&image);
+    painter.begin(&recorder);
+    paintText(&painter);
+    painter.end();
+    QVERIFY(!recorder.isEmpty());
+
+    QtConcurrent::run([&recorder] {
+        recorder.replay();
+    }).waitForFinished();
+    QCOMPARE(image, expected);
+}
+
+void TestQPainterRecorder::testReplayTextConcurrently()
+{
+    // like several screens drawing the same window title at once
+    const auto paintText = [] (QPainter *painter) {
+        QFont font = painter->font();
+        font.setPixelSize(16);
+        painter->setFont(font);
+        painter->setPen(Qt::black);
+        for (int i = 0; i < 4; ++i) {
+            painter->drawText(QRect(0, i * 25, 200, 25), Qt::AlignCenter, QStringLiteral("KWin %1").arg(i));
+        }
+    };
+
+    QImage expected = createImage();
+    QPainter painter(&expected);
+    paintText(&painter);
+    painter.end();
+
+    QImage target = createImage();
+    QPainterRecorder recorder(&target);
+    painter.begin(&recorder);
+    paintText(&painter);
+    painter.end();
+
+    QVector<QImage> images(8, createImage());
+    QtConcurrent::blockingMap(images, [&recorder] (QImage &image) {
+        QPainter painter(&image);
+        recorder.replay(&painter);
+    });
+    for (const QImage &image : images) {
+        QCOMPARE(image, expected);
+    }
+}
+
+QTEST_MAIN(TestQPainterRecorder)
+#include "test_qpainterrecorder.moc"
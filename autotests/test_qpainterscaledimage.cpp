@@ -0,0 +1,215 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "../qpainterscaledimage.h"
+
+#include <QtTest/QtTest>
+
+using namespace KWin;
+
+class TestQPainterScaledImage : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testLevelForScale_data();
+    void testLevelForScale();
+    void testMapToLevel_data();
+    void testMapToLevel();
+    void testMapToBuffer();
+    void testDownscaleBox_data();
+    void testDownscaleBox();
+    void testLevels();
+    void testDamage();
+
+private:
+    static QImage createImage(const QSize &size);
+    static QImage referenceDownscale(const QImage &source);
+};
+
+QImage TestQPainterScaledImage::createImage(const QSize &size)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < size.height(); ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            const int alpha = (x * 7 + y * 13) & 0xff;
+            line[x] = qPremultiply(qRgba((x * 31) & 0xff, (y * 17) & 0xff, (x * y) & 0xff, alpha));
+        }
+    }
+    return image;
+}
+
+QImage TestQPainterScaledImage::referenceDownscale(const QImage &source)
+{
+    // averages the two rows first and then the two columns, rounding up each time
+    const auto average = [] (quint32 first, quint32 second, int shift) {
+        return (((first >> shift) & 0xff) + ((second >> shift) & 0xff) + 1) >> 1;
+    };
+    QImage target(qMax(1, source.width() / 2), qMax(1, source.height() / 2), source.format());
+    for (int y = 0; y < target.height(); ++y) {
+        for (int x = 0; x < target.width(); ++x) {
+            const int left = qMin(x * 2, source.width() - 1);
+            const int right = qMin(x * 2 + 1, source.width() - 1);
+            const int top = qMin(y * 2, source.height() - 1);
+            const int bottom = qMin(y * 2 + 1, source.height() - 1);
+            quint32 result = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                const quint32 first = average(source.pixel(left, top), source.pixel(left, bottom), shift);
+                const quint32 second = average(source.pixel(right, top), source.pixel(right, bottom), shift);
+                result |= ((first + second + 1) >> 1) << shift;
+            }
+            target.setPixel(x, y, result);
+        }
+    }
+    return target;
+}
+
+void TestQPainterScaledImage::testLevelForScale_data()
+{
+    QTest::addColumn<qreal>("scale");
+    QTest::addColumn<int>("level");
+
+    QTest::newRow("enlarged") << 2.0 << 0;
+    QTest::newRow("unscaled") << 1.0 << 0;
+    QTest::newRow("0.6") << 0.6 << 0;
+    QTest::newRow("half") << 0.5 << 1;
+    QTest::newRow("0.3") << 0.3 << 1;
+    QTest::newRow("quarter") << 0.25 << 2;
+    QTest::newRow("eighth") << 0.125 << 3;
+    QTest::newRow("sixteenth") << 0.0625 << 4;
+    QTest::newRow("tiny") << 0.001 << 4;
+}
+
+void TestQPainterScaledImage::testLevelForScale()
+{
+    QFETCH(qreal, scale);
+    QTEST(QPainterScaledImage::levelForScale(scale), "level");
+}
+
+void TestQPainterScaledImage::testMapToLevel_data()
+{
+    QTest::addColumn<QRect>("rect");
+    QTest::addColumn<int>("level");
+    QTest::addColumn<QRect>("expected");
+
+    QTest::newRow("level 0") << QRect(3, 5, 7, 9) << 0 << QRect(3, 5, 7, 9);
+    QTest::newRow("aligned") << QRect(4, 8, 4, 8) << 1 << QRect(2, 4, 2, 4);
+    QTest::newRow("unaligned") << QRect(3, 5, 2, 2) << 1 << QRect(1, 2, 2, 2);
+    QTest::newRow("single pixel") << QRect(7, 7, 1, 1) << 2 << QRect(1, 1, 1, 1);
+    QTest::newRow("level 4") << QRect(15, 0, 2, 33) << 4 << QRect(0, 0, 2, 3);
+}
+
+void TestQPainterScaledImage::testMapToLevel()
+{
+    QFETCH(QRect, rect);
+    QFETCH(int, level);
+    QTEST(QPainterScaledImage::mapToLevel(rect, level), "expected");
+}
+
+void TestQPainterScaledImage::testMapToBuffer()
+{
+    const QRegion damage = QRegion(1, 2, 3, 4) | QRegion(10, 10, 5, 5);
+    QCOMPARE(QPainterScaledImage::mapToBuffer(damage, 1), damage);
+    QCOMPARE(QPainterScaledImage::mapToBuffer(damage, 2), QRegion(2, 4, 6, 8) | QRegion(20, 20, 10, 10));
+    QCOMPARE(QPainterScaledImage::mapToBuffer(damage, 3), QRegion(3, 6, 9, 12) | QRegion(30, 30, 15, 15));
+}
+
+void TestQPainterScaledImage::testDownscaleBox_data()
+{
+    QTest::addColumn<QSize>("size");
+
+    QTest::newRow("even") << QSize(64, 32);
+    QTest::newRow("odd") << QSize(37, 13);
+    // the vectorized path handles four target pixels at once
+    QTest::newRow("narrow") << QSize(9, 9);
+    QTest::newRow("single column") << QSize(1, 10);
+    QTest::newRow("single pixel") << QSize(1, 1);
+}
+
+void TestQPainterScaledImage::testDownscaleBox()
+{
+    QFETCH(QSize, size);
+    const QImage source = createImage(size);
+    const QImage expected = referenceDownscale(source);
+
+    QImage target(expected.size(), source.format());
+    target.fill(Qt::transparent);
+    QPainterScaledImage::downscaleBox(source, target, target.rect());
+    QCOMPARE(target, expected);
+
+    // only the pixels in the rect get written
+    QImage partial(expected.size(), source.format());
+    partial.fill(Qt::transparent);
+    const QRect rect = QRect(QPoint(target.width() / 3, target.height() / 3), target.size() / 2) & target.rect();
+    QPainterScaledImage::downscaleBox(source, partial, rect);
+    for (int y = 0; y < partial.height(); ++y) {
+        for (int x = 0; x < partial.width(); ++x) {
+            QCOMPARE(partial.pixel(x, y), rect.contains(x, y) ? expected.pixel(x, y) : 0u);
+        }
+    }
+}
+
+void TestQPainterScaledImage::testLevels()
+{
+    const QImage source = createImage(QSize(100, 60));
+    QPainterScaledImage scaled;
+    QCOMPARE(scaled.image(source, 0), source);
+    QImage expected = source;
+    for (int level = 1; level <= QPainterScaledImage::s_maxLevel; ++level) {
+        expected = referenceDownscale(expected);
+        QCOMPARE(scaled.image(source, level), expected);
+    }
+    // there is no level smaller than a sixteenth
+    QCOMPARE(scaled.image(source, QPainterScaledImage::s_maxLevel + 1), expected);
+    QCOMPARE(expected.size(), QSize(6, 3));
+}
+
+void TestQPainterScaledImage::testDamage()
+{
+    QImage source = createImage(QSize(128, 96));
+    QPainterScaledImage scaled;
+    scaled.image(source, 3);
+
+    // a surface with scale 2 damages a quarter of the pixels of the buffer
+    const QRegion surfaceDamage = QRegion(5, 3, 10, 7) | QRegion(40, 30, 1, 1);
+    const QRegion damage = QPainterScaledImage::mapToBuffer(surfaceDamage, 2);
+    for (const QRect &rect : damage.rects()) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                source.setPixel(x, y, 0xff00ff00);
+            }
+        }
+    }
+    scaled.addDamage(damage);
+
+    QPainterScaledImage recreated;
+    for (int level = 1; level <= 3; ++level) {
+        QCOMPARE(scaled.image(source, level), recreated.image(source, level));
+    }
+    // damage without any level created yet is not kept
+    QPainterScaledImage unused;
+    unused.addDamage(damage);
+    QCOMPARE(unused.image(source, 2), recreated.image(source, 2));
+
+    scaled.clear();
+    QCOMPARE(scaled.image(source, 2), recreated.image(source, 2));
+}
+
+QTEST_GUILESS_MAIN(TestQPainterScaledImage)
+#include "test_qpainterscaledimage.moc"
@@ -0,0 +1,255 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "../qpainterrecorder.h"
+#include "../qpaintertiledbuffer.h"
+
+#include <QtTest/QtTest>
+
+#include <algorithm>
+
+using namespace KWin;
+
+class TestQPainterTiledBuffer : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testTiles();
+    void testTilesIn_data();
+    void testTilesIn();
+    void testReplay_data();
+    void testReplay();
+    void testBinning();
+
+private:
+    static QImage createImage();
+    static void paintTileEdges(QPainter *painter);
+};
+
+QImage TestQPainterTiledBuffer::createImage()
+{
+    QImage image(200, 100, QImage::Format_RGB32);
+    image.fill(Qt::black);
+    return image;
+}
+
+void TestQPainterTiledBuffer::paintTileEdges(QPainter *painter)
+{
+    // everything crosses the edges of the tiles at odd positions, so that each tile
+    // has to continue what its neighbours paint
+    painter->save();
+    painter->setClipRegion(QRegion(5, 3, 190, 94) - QRegion(60, 20, 10, 10));
+    QLinearGradient gradient(QPointF(0, 0), QPointF(200, 100));
+    gradient.setColorAt(0, Qt::darkBlue);
+    gradient.setColorAt(1, Qt::darkYellow);
+    painter->fillRect(QRect(0, 0, 200, 100), gradient);
+
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen(QPen(Qt::white, 3));
+    painter->setBrush(QColor(255, 0, 0, 128));
+    painter->drawEllipse(QPointF(64, 32), 30.5, 20.5);
+    painter->drawLine(QPointF(0.5, 99.5), QPointF(199.5, 0.5));
+
+    QImage pattern(61, 37, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < pattern.height(); ++y) {
+        for (int x = 0; x < pattern.width(); ++x) {
+            pattern.setPixel(x, y, (x + y) % 2 ? 0xff00ff00 : 0x80000080);
+        }
+    }
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    painter->setOpacity(0.75);
+    painter->drawImage(QRectF(20.5, 40.25, 90, 50), pattern);
+    painter->setOpacity(1.0);
+    painter->drawTiledPixmap(QRect(100, 10, 90, 70), QPixmap::fromImage(pattern), QPoint(3, 5));
+
+    painter->setPen(Qt::black);
+    QFont font = painter->font();
+    font.setPixelSize(18);
+    font.setUnderline(true);
+    painter->setFont(font);
+    painter->drawText(QRect(10, 50, 180, 40), Qt::AlignCenter, QStringLiteral("KWin tiles"));
+    painter->restore();
+}
+
+void TestQPainterTiledBuffer::testTiles()
+{
+    QPainterTiledBuffer buffer(QSize(200, 100), QImage::Format_RGB32, 32);
+    QCOMPARE(buffer.size(), QSize(200, 100));
+    QCOMPARE(buffer.tileSize(), 32);
+    QCOMPARE(buffer.tileCount(), 7 * 4);
+    QCOMPARE(buffer.tileGeometry(0), QRect(0, 0, 32, 32));
+    QCOMPARE(buffer.tileGeometry(8), QRect(32, 32, 32, 32));
+    // the tiles at the edges are cut
+    QCOMPARE(buffer.tileGeometry(6), QRect(192, 0, 8, 32));
+    QCOMPARE(buffer.tileGeometry(27), QRect(192, 96, 8, 4));
+    QCOMPARE(buffer.tile(27).size(), QSize(8, 4));
+    QRegion covered;
+    for (int i = 0; i < buffer.tileCount(); ++i) {
+        QVERIFY(!buffer.isDirty(i));
+        QVERIFY(!covered.intersects(buffer.tileGeometry(i)));
+        covered |= buffer.tileGeometry(i);
+    }
+    QCOMPARE(covered, QRegion(0, 0, 200, 100));
+}
+
+void TestQPainterTiledBuffer::testTilesIn_data()
+{
+    QTest::addColumn<QRegion>("region");
+    QTest::addColumn<QVector<int>>("expected");
+
+    QTest::newRow("empty") << QRegion() << QVector<int>();
+    QTest::newRow("outside") << QRegion(200, 0, 10, 10) << QVector<int>();
+    QTest::newRow("single") << QRegion(1, 1, 10, 10) << QVector<int>{0};
+    QTest::newRow("tile") << QRegion(32, 32, 32, 32) << QVector<int>{8};
+    QTest::newRow("across") << QRegion(30, 30, 4, 4) << QVector<int>{0, 1, 7, 8};
+    QTest::newRow("edge") << QRegion(190, 90, 20, 20) << QVector<int>{19, 20, 26, 27};
+    QTest::newRow("twice") << (QRegion(0, 0, 10, 10) | QRegion(20, 20, 5, 5)) << QVector<int>{0};
+}
+
+void TestQPainterTiledBuffer::testTilesIn()
+{
+    QFETCH(QRegion, region);
+    QFETCH(QVector<int>, expected);
+    QPainterTiledBuffer buffer(QSize(200, 100), QImage::Format_RGB32, 32);
+    QVector<int> tiles = buffer.tilesIn(region);
+    std::sort(tiles.begin(), tiles.end());
+    QCOMPARE(tiles, expected);
+}
+
+void TestQPainterTiledBuffer::testReplay_data()
+{
+    QTest::addColumn<int>("tileSize");
+
+    QTest::newRow("16") << 16;
+    QTest::newRow("odd") << 23;
+    QTest::newRow("64") << 64;
+    QTest::newRow("single tile") << 256;
+}
+
+void TestQPainterTiledBuffer::testReplay()
+{
+    QFETCH(int, tileSize);
+    QImage expected = createImage();
+    QPainter painter(&expected);
+    paintTileEdges(&painter);
+    painter.end();
+
+    QImage image = createImage();
+    QPainterTiledBuffer buffer(image.size(), image.format(), tileSize);
+    buffer.fill(Qt::black);
+    QCOMPARE(buffer.copyDirtyTiles(&image), QRegion(image.rect()));
+    for (int i = 0; i < buffer.tileCount(); ++i) {
+        QVERIFY(!buffer.isDirty(i));
+    }
+    QCOMPARE(image, createImage());
+
+    QPainterRecorder recorder(&image);
+    painter.begin(&recorder);
+    paintTileEdges(&painter);
+    painter.end();
+    const QRegion painted(0, 0, 150, 80);
+    buffer.replay(recorder, painted);
+    // the linear buffer only changes on copy
+    QCOMPARE(image, createImage());
+    for (int i = 0; i < buffer.tileCount(); ++i) {
+        QCOMPARE(buffer.dirtyRegion(i), painted.intersected(buffer.tileGeometry(i)));
+    }
+    QCOMPARE(buffer.copyDirtyTiles(&image), painted);
+    // the painted region matches painting the whole image at once, the rest is untouched
+    QImage partial = createImage();
+    painter.begin(&partial);
+    painter.setClipRegion(painted);
+    painter.drawImage(0, 0, expected);
+    painter.end();
+    QCOMPARE(image, partial);
+    QCOMPARE(buffer.copyDirtyTiles(&image), QRegion());
+
+    buffer.replay(recorder, QRegion(image.rect()));
+    QCOMPARE(buffer.copyDirtyTiles(&image), QRegion(image.rect()));
+    QCOMPARE(image, expected);
+
+    // a target not matching the buffer is left alone
+    QImage wrongFormat = createImage().convertToFormat(QImage::Format_ARGB32);
+    buffer.fill(Qt::white);
+    QCOMPARE(buffer.copyDirtyTiles(&wrongFormat), QRegion());
+    QCOMPARE(wrongFormat, createImage().convertToFormat(QImage::Format_ARGB32));
+}
+
+void TestQPainterTiledBuffer::testBinning()
+{
+    QImage image = createImage();
+    QPainterTiledBuffer buffer(image.size(), image.format(), 32);
+    buffer.fill(Qt::black);
+    buffer.copyDirtyTiles(&image);
+
+    QPainterRecorder recorder(&image);
+    QPainter painter(&recorder);
+    painter.fillRect(QRect(40, 40, 10, 10), Qt::red);
+    painter.end();
+    // only the tile the rect is in gets painted, though the whole buffer is replayed
+    buffer.replay(recorder, QRegion(image.rect()));
+    for (int i = 0; i < buffer.tileCount(); ++i) {
+        QCOMPARE(buffer.isDirty(i), i == 8);
+    }
+    QCOMPARE(buffer.copyDirtyTiles(&image), QRegion(32, 32, 32, 32));
+
+    // the clip limits the tiles as well
+    recorder.clear();
+    painter.begin(&recorder);
+    painter.setClipRect(QRect(10, 10, 25, 25));
+    painter.fillRect(image.rect(), Qt::green);
+    painter.end();
+    buffer.replay(recorder, QRegion(image.rect()));
+    for (int i = 0; i < buffer.tileCount(); ++i) {
+        QCOMPARE(buffer.isDirty(i), i == 0 || i == 1 || i == 7 || i == 8);
+    }
+    buffer.copyDirtyTiles(&image);
+
+    // strokes reach out of the geometry
+    recorder.clear();
+    painter.begin(&recorder);
+    painter.setPen(QPen(Qt::blue, 9));
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.drawRect(QRectF(130.5, 60.5, 1, 1));
+    painter.translate(150, 10);
+    painter.scale(2, 2);
+    painter.drawLine(QPointF(0, 0), QPointF(10, 2));
+    painter.end();
+    buffer.replay(recorder, QRegion(image.rect()));
+    QVERIFY(!buffer.isDirty(27));
+    buffer.copyDirtyTiles(&image);
+
+    QImage expected = createImage();
+    painter.begin(&expected);
+    painter.fillRect(QRect(40, 40, 10, 10), Qt::red);
+    painter.setClipRect(QRect(10, 10, 25, 25));
+    painter.fillRect(expected.rect(), Qt::green);
+    painter.setClipping(false);
+    painter.setPen(QPen(Qt::blue, 9));
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.drawRect(QRectF(130.5, 60.5, 1, 1));
+    painter.translate(150, 10);
+    painter.scale(2, 2);
+    painter.drawLine(QPointF(0, 0), QPointF(10, 2));
+    painter.end();
+    QCOMPARE(image, expected);
+}
+
+QTEST_MAIN(TestQPainterTiledBuffer)
+#include "test_qpaintertiledbuffer.moc"
@@ -0,0 +1,259 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "../rectset.h"
+
+#include <QtTest/QtTest>
+
+using namespace KWin;
+
+class TestRectSet : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testEmpty();
+    void testFromRegion();
+    void testUnite_data();
+    void testUnite();
+    void testSubtract_data();
+    void testSubtract();
+    void testIntersects();
+    void testRandomOperations();
+    void testDamageHistory();
+    void benchmarkOcclusion_data();
+    void benchmarkOcclusion();
+
+private:
+    static bool isDisjoint(const RectSet &set);
+};
+
+bool TestRectSet::isDisjoint(const RectSet &set)
+{
+    for (const QRect *a = set.begin(); a != set.end(); ++a) {
+        for (const QRect *b = a + 1; b != set.end(); ++b) {
+            if (a->intersects(*b)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void TestRectSet::testEmpty()
+{
+    RectSet set;
+    QVERIFY(set.isEmpty());
+    QCOMPARE(set.rectCount(), 0);
+    QVERIFY(set.boundingRect().isEmpty());
+    QVERIFY(!set.intersects(QRect(0, 0, 10, 10)));
+    QVERIFY(set.toRegion().isEmpty());
+
+    set.unite(QRect());
+    QVERIFY(set.isEmpty());
+    QVERIFY(RectSet(QRect()).isEmpty());
+    QVERIFY(RectSet(QRegion()).isEmpty());
+}
+
+void TestRectSet::testFromRegion()
+{
+    const QRegion region = QRegion(0, 0, 100, 100) | QRegion(50, 50, 100, 100);
+    const RectSet set(region);
+    QCOMPARE(set.rectCount(), region.rectCount());
+    QCOMPARE(set.boundingRect(), region.boundingRect());
+    QCOMPARE(set.toRegion(), region);
+}
+
+void TestRectSet::testUnite_data()
+{
+    QTest::addColumn<QVector<QRect>>("rects");
+
+    QTest::newRow("single") << QVector<QRect>{QRect(0, 0, 10, 10)};
+    QTest::newRow("disjoint") << QVector<QRect>{QRect(0, 0, 10, 10), QRect(20, 20, 10, 10)};
+    QTest::newRow("contained") << QVector<QRect>{QRect(0, 0, 100, 100), QRect(20, 20, 10, 10)};
+    QTest::newRow("containing") << QVector<QRect>{QRect(20, 20, 10, 10), QRect(0, 0, 100, 100)};
+    QTest::newRow("overlapping") << QVector<QRect>{QRect(0, 0, 100, 100), QRect(50, 50, 100, 100)};
+    QTest::newRow("cross") << QVector<QRect>{QRect(40, 0, 20, 100), QRect(0, 40, 100, 20)};
+    QTest::newRow("adjacent") << QVector<QRect>{QRect(0, 0, 10, 10), QRect(10, 0, 10, 10)};
+    QTest::newRow("stacked") << QVector<QRect>{QRect(0, 0, 10, 10), QRect(0, 10, 10, 10)};
+    QTest::newRow("gap") << QVector<QRect>{QRect(0, 0, 10, 10), QRect(0, 20, 10, 10)};
+    QTest::newRow("steps") << QVector<QRect>{QRect(0, 0, 10, 10), QRect(5, 10, 10, 10), QRect(20, 5, 10, 10)};
+    QTest::newRow("grid") << QVector<QRect>{QRect(0, 0, 10, 10), QRect(20, 0, 10, 10),
+                                            QRect(0, 20, 10, 10), QRect(20, 20, 10, 10)};
+}
+
+void TestRectSet::testUnite()
+{
+    QFETCH(QVector<QRect>, rects);
+    RectSet set;
+    QRegion region;
+    for (const QRect &rect : rects) {
+        set.unite(rect);
+        region |= rect;
+    }
+    QVERIFY(isDisjoint(set));
+    QCOMPARE(set.toRegion(), region);
+    QCOMPARE(set.boundingRect(), region.boundingRect());
+}
+
+void TestRectSet::testSubtract_data()
+{
+    QTest::addColumn<QRect>("rect");
+    QTest::addColumn<QRect>("hole");
+
+    QTest::newRow("disjoint") << QRect(0, 0, 10, 10) << QRect(20, 20, 10, 10);
+    QTest::newRow("everything") << QRect(20, 20, 10, 10) << QRect(0, 0, 100, 100);
+    QTest::newRow("center") << QRect(0, 0, 100, 100) << QRect(40, 40, 20, 20);
+    QTest::newRow("corner") << QRect(0, 0, 100, 100) << QRect(50, 50, 100, 100);
+    QTest::newRow("edge") << QRect(0, 0, 100, 100) << QRect(0, 0, 100, 10);
+}
+
+void TestRectSet::testSubtract()
+{
+    QFETCH(QRect, rect);
+    QFETCH(QRect, hole);
+    RectSet set(rect);
+    set.subtract(hole);
+    QVERIFY(isDisjoint(set));
+    QCOMPARE(set.toRegion(), QRegion(rect) - QRegion(hole));
+    QCOMPARE(set.boundingRect(), (QRegion(rect) - QRegion(hole)).boundingRect());
+}
+
+void TestRectSet::testIntersects()
+{
+    RectSet set(QRect(0, 0, 100, 100));
+    set.subtract(QRect(40, 40, 20, 20));
+    QVERIFY(set.intersects(QRect(0, 0, 10, 10)));
+    QVERIFY(set.intersects(QRect(30, 30, 20, 20)));
+    // within the hole and thus within the bounding rect, but not in the set
+    QVERIFY(!set.intersects(QRect(45, 45, 10, 10)));
+    QVERIFY(!set.intersects(QRect(200, 200, 10, 10)));
+}
+
+void TestRectSet::testRandomOperations()
+{
+    qsrand(42);
+    for (int i = 0; i < 1000; ++i) {
+        RectSet set;
+        QRegion region;
+        const int operations = qrand() % 16 + 1;
+        for (int j = 0; j < operations; ++j) {
+            const QRect rect(qrand() % 200, qrand() % 200, qrand() % 80, qrand() % 80);
+            if (qrand() % 3) {
+                set.unite(rect);
+                region |= rect;
+            } else {
+                set.subtract(rect);
+                region -= rect;
+            }
+        }
+        QVERIFY(isDisjoint(set));
+        QCOMPARE(set.toRegion(), region);
+    }
+}
+
+void TestRectSet::testDamageHistory()
+{
+    const QRegion fallback(0, 0, 100, 100);
+    DamageHistory history;
+    // nothing known yet
+    QCOMPARE(history.accumulated(1, fallback), fallback);
+
+    for (int i = 0; i < DamageHistory::s_maxFrames + 5; ++i) {
+        history.add(QRect(i, 0, 1, 1));
+    }
+    // undefined content
+    QCOMPARE(history.accumulated(0, fallback), fallback);
+    // the buffer presented last frame needs no repair
+    QCOMPARE(history.accumulated(1, fallback), QRegion());
+    const int last = DamageHistory::s_maxFrames + 4;
+    QCOMPARE(history.accumulated(2, fallback), QRegion(last, 0, 1, 1));
+    QCOMPARE(history.accumulated(4, fallback), QRegion(last - 2, 0, 3, 1));
+    QCOMPARE(history.accumulated(DamageHistory::s_maxFrames, fallback),
+             QRegion(last - DamageHistory::s_maxFrames + 2, 0, DamageHistory::s_maxFrames - 1, 1));
+    // older frames are dropped
+    QCOMPARE(history.accumulated(DamageHistory::s_maxFrames + 1, fallback), fallback);
+
+    history.clear();
+    QCOMPARE(history.accumulated(1, fallback), fallback);
+}
+
+void TestRectSet::benchmarkOcclusion_data()
+{
+    QTest::addColumn<bool>("useRectSet");
+    QTest::addColumn<int>("windowCount");
+
+    QTest::newRow("QRegion/10") << false << 10;
+    QTest::newRow("RectSet/10") << true << 10;
+    QTest::newRow("QRegion/50") << false << 50;
+    QTest::newRow("RectSet/50") << true << 50;
+}
+
+void TestRectSet::benchmarkOcclusion()
+{
+    // mimics the occlusion culling pass of Scene::paintSimpleScreen with a mix of
+    // opaque and translucent windows cascaded over the screen
+    QFETCH(bool, useRectSet);
+    QFETCH(int, windowCount);
+
+    QVector<QRect> windows;
+    for (int i = 0; i < windowCount; ++i) {
+        windows << QRect((i * 37) % 1280, (i * 23) % 800, 640, 480);
+    }
+    const QRect damage(100, 100, 300, 200);
+
+    if (useRectSet) {
+        QBENCHMARK {
+            RectSet allclips;
+            RectSet upperTranslucentDamage(damage);
+            for (int i = windows.count() - 1; i >= 0; --i) {
+                RectSet region(windows.at(i));
+                region |= upperTranslucentDamage;
+                region -= allclips;
+                if (i % 2) {
+                    const RectSet clip(windows.at(i));
+                    allclips |= clip;
+                    upperTranslucentDamage |= region - clip;
+                } else {
+                    upperTranslucentDamage |= region;
+                }
+                region.toRegion();
+            }
+        }
+    } else {
+        QBENCHMARK {
+            QRegion allclips;
+            QRegion upperTranslucentDamage(damage);
+            for (int i = windows.count() - 1; i >= 0; --i) {
+                QRegion region(windows.at(i));
+                region |= upperTranslucentDamage;
+                region -= allclips;
+                if (i % 2) {
+                    const QRegion clip(windows.at(i));
+                    allclips |= clip;
+                    upperTranslucentDamage |= region - clip;
+                } else {
+                    upperTranslucentDamage |= region;
+                }
+            }
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(TestRectSet)
+#include "test_rectset.moc"
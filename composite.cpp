@@ -306,6 +306,8 @@ void Compositor::startupWithWorkspace()
     } else
         vBlankInterval = milliToNano(1); // no sync - DO NOT set "0", would cause div-by-zero segfaults.
     m_timeSinceLastVBlank = fpsInterval - (options->vBlankTime() + 1); // means "start now" - we don't have even a slight idea when the first vsync will occur
+    connect(screens(), &Screens::changed, this, &Compositor::updateOutputClocks, Qt::UniqueConnection);
+    updateOutputClocks();
     scheduleRepaint();
     xcb_composite_redirect_subwindows(connection(), rootWindow(), XCB_COMPOSITE_REDIRECT_MANUAL);
     new EffectsHandlerImpl(this, m_scene);   // sets also the 'effects' pointer
@@ -397,6 +399,9 @@ void Compositor::finish()
     m_scene = NULL;
     compositeTimer.stop();
     repaints_region = QRegion();
+    m_outputClocks.clear();
+    m_renderTimeEstimator.reset();
+    invalidatePaintOrder();
     if (Workspace::self()) {
         for (ClientList::ConstIterator it = Workspace::self()->clientList().constBegin();
                 it != Workspace::self()->clientList().constEnd();
@@ -640,6 +645,7 @@ void Compositor::bufferSwapComplete()
 {
     assert(m_bufferSwapPending);
     m_bufferSwapPending = false;
+    m_frameTimeline.mark(FrameTimeline::Stage::PageFlip);
 
     if (m_composeAtSwapCompletion) {
         m_composeAtSwapCompletion = false;
@@ -647,6 +653,165 @@ void Compositor::bufferSwapComplete()
     }
 }
 
+void Compositor::aboutToSwapBuffersForScreen(int screenId)
+{
+    if (screenId < 0 || screenId >= m_outputClocks.count()) {
+        return;
+    }
+    OutputFrameClock &clock = m_outputClocks[screenId];
+    assert(!clock.bufferSwapPending);
+    clock.bufferSwapPending = true;
+}
+
+void Compositor::bufferSwapCompleteForScreen(int screenId, quint64 frame)
+{
+    if (screenId < 0 || screenId >= m_outputClocks.count()) {
+        return;
+    }
+    OutputFrameClock &clock = m_outputClocks[screenId];
+    // with triple buffering the platform reports flips of screens it did not block
+    const bool wasPending = clock.bufferSwapPending;
+    clock.bufferSwapPending = false;
+    clock.lastPresented.start();
+    // other outputs might have started later frames in the meantime
+    m_frameTimeline.mark(FrameTimeline::Stage::PageFlip, frame);
+
+    if (wasPending && m_composeAtSwapCompletion && !m_bufferSwapPending) {
+        m_composeAtSwapCompletion = false;
+        performCompositing();
+    }
+}
+
+void Compositor::addRenderTimeSample(int screenId, qint64 renderTime)
+{
+    if (screenId < 0 || screenId >= m_outputClocks.count()) {
+        m_renderTimeEstimator.addSample(renderTime);
+        return;
+    }
+    m_outputClocks[screenId].renderTime.addSample(renderTime);
+}
+
+bool Compositor::isBufferSwapPendingForScreen(int screenId) const
+{
+    if (screenId < 0 || screenId >= m_outputClocks.count()) {
+        return false;
+    }
+    return m_outputClocks.at(screenId).bufferSwapPending;
+}
+
+bool Compositor::isCompositingScheduled() const
+{
+    return compositeTimer.isActive() || m_composeAtSwapCompletion;
+}
+
+bool Compositor::anyOutputSwapPending() const
+{
+    return std::any_of(m_outputClocks.constBegin(), m_outputClocks.constEnd(),
+        [] (const OutputFrameClock &clock) {
+            return clock.bufferSwapPending;
+        }
+    );
+}
+
+bool Compositor::allOutputsSwapPending() const
+{
+    if (m_outputClocks.isEmpty()) {
+        return false;
+    }
+    return std::all_of(m_outputClocks.constBegin(), m_outputClocks.constEnd(),
+        [] (const OutputFrameClock &clock) {
+            return clock.bufferSwapPending;
+        }
+    );
+}
+
+bool Compositor::outputRepaintsPending() const
+{
+    return std::any_of(m_outputClocks.constBegin(), m_outputClocks.constEnd(),
+        [] (const OutputFrameClock &clock) {
+            return !clock.repaints.isEmpty();
+        }
+    );
+}
+
+void Compositor::updateOutputClocks()
+{
+    const int count = screens()->count();
+    const bool wasPending = anyOutputSwapPending();
+    m_outputClocks.resize(count);
+    for (int i = 0; i < count; ++i) {
+        OutputFrameClock &clock = m_outputClocks[i];
+        int rate = qRound(screens()->refreshRate(i));
+        if (rate <= 0) {
+            rate = m_xrrRefreshRate > 0 ? m_xrrRefreshRate : 60;
+        }
+        const qint64 vBlank = milliToNano(1000) / rate;
+        // honor the max fps setting, but never go below one frame per vblank
+        clock.frameInterval = qMax((options->maxFpsInterval() / vBlank) * vBlank, vBlank);
+    }
+    if (wasPending && !anyOutputSwapPending() && m_composeAtSwapCompletion) {
+        // the screen we were waiting for is gone
+        m_composeAtSwapCompletion = false;
+        scheduleRepaint();
+    }
+}
+
+QRegion Compositor::takeRepaintsForReadyOutputs(const QList<Toplevel*> &windows)
+{
+    QRegion repaints = repaints_region;
+    // clear all repaints, so that post-pass can add repaints for the next repaint
+    repaints_region = QRegion();
+
+    if (!anyOutputSwapPending()) {
+        for (auto it = m_outputClocks.begin(); it != m_outputClocks.end(); ++it) {
+            repaints |= (*it).repaints;
+            (*it).repaints = QRegion();
+        }
+        return repaints;
+    }
+
+    // The Scene resets the repaints of the windows while painting the ready screens,
+    // so they have to be remembered for the screens still waiting for their swap.
+    for (Toplevel *t : windows) {
+        repaints |= t->repaints();
+    }
+    QRegion ready;
+    for (int i = 0; i < m_outputClocks.count(); ++i) {
+        OutputFrameClock &clock = m_outputClocks[i];
+        const QRegion screenRepaints = repaints & screens()->geometry(i);
+        if (clock.bufferSwapPending) {
+            clock.repaints |= screenRepaints;
+        } else {
+            ready |= clock.repaints | screenRepaints;
+            clock.repaints = QRegion();
+        }
+    }
+    return ready;
+}
+
+qint64 Compositor::nextOutputFrameDeadline() const
+{
+    bool hasFrameClock = false;
+    qint64 deadline = -1;
+    for (auto it = m_outputClocks.constBegin(); it != m_outputClocks.constEnd(); ++it) {
+        const OutputFrameClock &clock = *it;
+        if (clock.bufferSwapPending) {
+            hasFrameClock = true;
+            continue;
+        }
+        qint64 remaining = 0;
+        if (clock.lastPresented.isValid()) {
+            hasFrameClock = true;
+            const qint64 renderTime = clock.renderTime.estimate(options->vBlankTime());
+            remaining = qMax<qint64>(0, clock.frameInterval - clock.lastPresented.nsecsElapsed() - renderTime);
+        }
+        if (deadline < 0 || remaining < deadline) {
+            deadline = remaining;
+        }
+    }
+    return hasFrameClock ? deadline : -1;
+}
+
 void Compositor::performCompositing()
 {
     if (m_scene->usesOverlayWindow() && !isOverlayWindowVisible())
@@ -667,13 +832,15 @@ void Compositor::performCompositing()
         return;
     }
 
+    m_frameTimeline.beginFrame();
+
     // Create a list of all windows in the stacking order
-    ToplevelList windows = Workspace::self()->xStackingOrder();
+    const ToplevelList stacking = Workspace::self()->xStackingOrder();
     ToplevelList damaged;
 
     // Reset the damage state of each window and fetch the damage region
     // without waiting for a reply
-    foreach (Toplevel *win, windows) {
+    foreach (Toplevel *win, stacking) {
         if (win->resetAndFetchDamage())
             damaged << win;
     }
@@ -683,28 +850,13 @@ void Compositor::performCompositing()
         xcb_flush(connection());
     }
 
-    // Move elevated windows to the top of the stacking order
-    foreach (EffectWindow *c, static_cast<EffectsHandlerImpl *>(effects)->elevatedWindows()) {
-        Toplevel* t = static_cast< EffectWindowImpl* >(c)->window();
-        windows.removeAll(t);
-        windows.append(t);
-    }
-
     // Get the replies
     foreach (Toplevel *win, damaged) {
-        // Discard the cached lanczos texture
-        if (win->effectWindow()) {
-            const QVariant texture = win->effectWindow()->data(LanczosCacheRole);
-            if (texture.isValid()) {
-                delete static_cast<GLTexture *>(texture.value<void*>());
-                win->effectWindow()->setData(LanczosCacheRole, QVariant());
-            }
-        }
-
         win->getDamageRegionReply();
     }
+    m_frameTimeline.mark(FrameTimeline::Stage::DamageFetched);
 
-    if (repaints_region.isEmpty() && !windowRepaintsPending()) {
+    if (repaints_region.isEmpty() && !windowRepaintsPending() && !outputRepaintsPending()) {
         m_scene->idle();
         m_timeSinceLastVBlank = fpsInterval - (options->vBlankTime() + 1); // means "start now"
         m_timeSinceStart += m_timeSinceLastVBlank;
@@ -716,30 +868,22 @@ void Compositor::performCompositing()
         return;
     }
 
-    // skip windows that are not yet ready for being painted and if screen is locked skip windows that are
-    // neither lockscreen nor inputmethod windows
-    // TODO ?
-    // this cannot be used so carelessly - needs protections against broken clients, the window
-    // should not get focus before it's displayed, handle unredirected windows properly and so on.
-    foreach (Toplevel *t, windows) {
-        if (!t->readyForPainting()) {
-            windows.removeAll(t);
-        }
-        if (waylandServer() && waylandServer()->isScreenLocked()) {
-            if(!t->isLockScreen() && !t->isInputMethod()) {
-                windows.removeAll(t);
-            }
-        }
-    }
+    const ToplevelList windows = paintOrder(stacking);
 
-    QRegion repaints = repaints_region;
-    // clear all repaints, so that post-pass can add repaints for the next repaint
-    repaints_region = QRegion();
+    QRegion repaints = takeRepaintsForReadyOutputs(windows);
+    if (repaints.isEmpty() && anyOutputSwapPending()) {
+        // only screens waiting for their buffer swap have something to paint
+        m_composeAtSwapCompletion = true;
+        compositeTimer.stop();
+        return;
+    }
 
     if (m_framesToTestForSafety > 0 && (m_scene->compositingType() & OpenGLCompositing)) {
         kwinApp()->platform()->createOpenGLSafePoint(Platform::OpenGLSafePoint::PreFrame);
     }
+    // the scene reports the render times through addRenderTimeSample()
     m_timeSinceLastVBlank = m_scene->paint(repaints, windows);
+    m_frameTimeline.mark(FrameTimeline::Stage::Present);
     if (m_framesToTestForSafety > 0) {
         if (m_scene->compositingType() & OpenGLCompositing) {
             kwinApp()->platform()->createOpenGLSafePoint(Platform::OpenGLSafePoint::PostFrame);
@@ -768,10 +912,74 @@ void Compositor::performCompositing()
     if (m_bufferSwapPending && m_scene->syncsToVBlank()) {
         m_composeAtSwapCompletion = true;
     } else {
+        // screens still waiting for their swap get repainted once it completed,
+        // all other screens follow their own frame clock
+        m_composeAtSwapCompletion = anyOutputSwapPending();
         scheduleRepaint();
     }
 }
 
+const ToplevelList &Compositor::paintOrder(const ToplevelList &stacking)
+{
+    const QList<EffectWindow*> elevated = static_cast<EffectsHandlerImpl *>(effects)->elevatedWindows();
+    const bool locked = waylandServer() && waylandServer()->isScreenLocked();
+    // the lists are implicitly shared, so comparing them is cheap as long as nothing changed
+    bool dirty = stacking != m_paintOrderStacking || elevated != m_paintOrderElevated || locked != m_paintOrderLocked;
+    if (!dirty) {
+        dirty = std::any_of(m_notReadyForPainting.constBegin(), m_notReadyForPainting.constEnd(),
+                            [] (Toplevel *t) { return t->readyForPainting(); });
+    }
+    if (!dirty) {
+        return m_paintOrder;
+    }
+    m_paintOrderStacking = stacking;
+    m_paintOrderElevated = elevated;
+    m_paintOrderLocked = locked;
+    m_paintOrder.clear();
+    m_notReadyForPainting.clear();
+
+    ToplevelList elevatedToplevels;
+    elevatedToplevels.reserve(elevated.count());
+    foreach (EffectWindow *c, elevated) {
+        elevatedToplevels << static_cast< EffectWindowImpl* >(c)->window();
+    }
+
+    // skip windows that are not yet ready for being painted and if screen is locked skip windows that are
+    // neither lockscreen nor inputmethod windows
+    // TODO ?
+    // this cannot be used so carelessly - needs protections against broken clients, the window
+    // should not get focus before it's displayed, handle unredirected windows properly and so on.
+    auto add = [this, locked] (Toplevel *t) {
+        if (!t->readyForPainting()) {
+            m_notReadyForPainting << t;
+            return;
+        }
+        if (locked && !t->isLockScreen() && !t->isInputMethod()) {
+            return;
+        }
+        m_paintOrder << t;
+    };
+    m_paintOrder.reserve(stacking.count() + elevatedToplevels.count());
+    foreach (Toplevel *t, stacking) {
+        if (!elevatedToplevels.contains(t)) {
+            add(t);
+        }
+    }
+    // elevated windows are on top of the stacking order
+    foreach (Toplevel *t, elevatedToplevels) {
+        add(t);
+    }
+    return m_paintOrder;
+}
+
+void Compositor::invalidatePaintOrder()
+{
+    m_paintOrderStacking.clear();
+    m_paintOrderElevated.clear();
+    m_paintOrder.clear();
+    m_notReadyForPainting.clear();
+}
+
 template <class T>
 static bool repaintsPending(const QList<T*> &windows)
 {
@@ -833,15 +1041,22 @@ void Compositor::setCompositeTimer()
         return;
     }
 
+    // Don't start the timer if every screen is waiting for its swap,
+    // the first completed swap triggers the next pass
+    if (m_composeAtSwapCompletion && allOutputsSwapPending()) {
+        return;
+    }
+
     uint waitTime = 1;
+    const qint64 outputDeadline = nextOutputFrameDeadline();
 
     if (m_scene->blocksForRetrace()) {
 
-        // TODO: make vBlankTime dynamic?!
-        // It's required because glXWaitVideoSync will *likely* block a full frame if one enters
-        // a retrace pass which can last a variable amount of time, depending on the actual screen
-        // Now, my ooold 19" CRT can do such retrace so that 2ms are entirely sufficient,
-        // while another ooold 15" TFT requires about 6ms
+        // The render time is required because glXWaitVideoSync will *likely* block a full frame if
+        // one enters a retrace pass which can last a variable amount of time, depending on the actual
+        // screen and on how expensive the scene is. Until enough frames are rendered to predict it,
+        // the configured vBlankTime is used.
+        const qint64 renderTime = qMin(m_renderTimeEstimator.estimate(options->vBlankTime()), vBlankInterval);
 
         qint64 padding = m_timeSinceLastVBlank;
         if (padding > fpsInterval) {
@@ -852,13 +1067,16 @@ void Compositor::setCompositeTimer()
             //               "remaining time of the first vsync" + "time for the other vsyncs of the frame"
         }
 
-        if (padding < options->vBlankTime()) { // we'll likely miss this frame
-            waitTime = nanoToMilli(padding + vBlankInterval - options->vBlankTime()); // so we add one
+        if (padding < renderTime) { // we'll likely miss this frame
+            waitTime = nanoToMilli(padding + vBlankInterval - renderTime); // so we add one
         } else {
-            waitTime = nanoToMilli(padding - options->vBlankTime());
+            waitTime = nanoToMilli(padding - renderTime);
         }
     }
-    else { // w/o blocking vsync we just jump to the next demanded tick
+    else if (outputDeadline >= 0) {
+        // each screen follows its own refresh rate, wake up for the earliest one
+        waitTime = qMax<qint64>(1, nanoToMilli(outputDeadline));
+    } else { // w/o blocking vsync we just jump to the next demanded tick
         if (fpsInterval > m_timeSinceLastVBlank) {
             waitTime = nanoToMilli(fpsInterval - m_timeSinceLastVBlank);
             if (!waitTime) {
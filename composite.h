@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define KWIN_COMPOSITE_H
 // KWin
 #include <kwinglobals.h>
+#include "frametimeline.h"
 // KDE
 #include <KSelectionOwner>
 // Qt
@@ -31,11 +32,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QTimer>
 #include <QBasicTimer>
 #include <QRegion>
+#include <QVector>
 
 namespace KWin {
 
 class Client;
+class EffectWindow;
 class Scene;
+class Toplevel;
 
 class CompositorSelectionOwner : public KSelectionOwner
 {
@@ -118,6 +122,24 @@ public:
     void keepSupportProperty(xcb_atom_t atom);
     void removeSupportProperty(xcb_atom_t atom);
 
+    /**
+     * @returns Whether a buffer swap is pending on the screen with @p screenId.
+     * @see aboutToSwapBuffersForScreen
+     **/
+    bool isBufferSwapPendingForScreen(int screenId) const;
+    /**
+     * @returns Whether a compositing pass is already scheduled, e.g. to let a platform fold
+     * its own updates into the next frame instead of presenting them separately.
+     **/
+    bool isCompositingScheduled() const;
+
+    /**
+     * @returns the timestamps of the last compositing passes.
+     **/
+    FrameTimeline *frameTimeline() {
+        return &m_frameTimeline;
+    }
+
 public Q_SLOTS:
     void addRepaintFull();
     /**
@@ -181,6 +203,28 @@ public Q_SLOTS:
      */
     void bufferSwapComplete();
 
+    /**
+     * Notifies the compositor that SwapBuffers() is about to be called for the screen
+     * with @p screenId. Only the repaints of that screen are deferred until
+     * bufferSwapCompleteForScreen() is called, all other screens continue to be rendered.
+     */
+    void aboutToSwapBuffersForScreen(int screenId);
+
+    /**
+     * Notifies the compositor that a pending buffer swap on the screen with @p screenId
+     * has completed. Platforms which queue buffers may also report swaps the screen was
+     * not blocked for, these only update the presentation time of the screen.
+     * @param frame the FrameTimeline sequence of the frame which got presented, @c 0 if the
+     * swap did not present a frame, e.g. a cursor update
+     */
+    void bufferSwapCompleteForScreen(int screenId, quint64 frame);
+    /**
+     * Called by the scene with the time in nsec it took to render the screen with @p screenId,
+     * or all screens at once for a @p screenId of @c -1. The samples predict the render time
+     * of the next frames, so the time of a swap blocking for the vblank must not be included.
+     */
+    void addRenderTimeSample(int screenId, qint64 renderTime);
+
 Q_SIGNALS:
     void compositingToggled(bool active);
     void aboutToDestroy();
@@ -206,11 +250,33 @@ private Q_SLOTS:
     void slotConfigChanged();
     void releaseCompositorSelection();
     void deleteUnusedSupportProperties();
+    void updateOutputClocks();
 
 private:
     void claimCompositorSelection();
     void setCompositeTimer();
     bool windowRepaintsPending() const;
+    bool outputRepaintsPending() const;
+    bool anyOutputSwapPending() const;
+    bool allOutputsSwapPending() const;
+    /**
+     * Takes the repaints of all screens which are not waiting for a buffer swap. The repaints
+     * of the other screens are kept until their swap completed.
+     **/
+    QRegion takeRepaintsForReadyOutputs(const QList<Toplevel*> &windows);
+    /**
+     * @returns time in nsec until the next screen with its own frame clock should start
+     * rendering or @c -1 if no screen drives its own frame clock.
+     **/
+    qint64 nextOutputFrameDeadline() const;
+    /**
+     * @returns the windows to paint in @p stacking order with the elevated windows on top,
+     * without the windows which are not ready for painting or hidden by the lock screen.
+     * The list is only rebuilt if the stacking order, the elevated windows, the lock screen
+     * state or the readiness of a window changed.
+     **/
+    const QList<Toplevel*> &paintOrder(const QList<Toplevel*> &stacking);
+    void invalidatePaintOrder();
     /**
      * Continues the startup after Scene And Workspace are created
      **/
@@ -241,6 +307,27 @@ private:
     bool m_composeAtSwapCompletion;
     int m_framesToTestForSafety = 3;
 
+    /**
+     * Frame clock of one screen, indexed by the screen id as used in Screens.
+     * Only used by platforms presenting each screen on its own (e.g. DRM).
+     **/
+    struct OutputFrameClock {
+        qint64 frameInterval = 0;
+        QElapsedTimer lastPresented;
+        QRegion repaints;
+        bool bufferSwapPending = false;
+        RenderTimeEstimator renderTime;
+    };
+    QVector<OutputFrameClock> m_outputClocks;
+    FrameTimeline m_frameTimeline;
+    RenderTimeEstimator m_renderTimeEstimator;
+
+    QList<Toplevel*> m_paintOrder;
+    QList<Toplevel*> m_paintOrderStacking;
+    QList<EffectWindow*> m_paintOrderElevated;
+    QList<Toplevel*> m_notReadyForPainting;
+    bool m_paintOrderLocked = false;
+
     KWIN_SINGLETON_VARIABLE(Compositor, s_compositor)
 };
 }
@@ -181,6 +181,14 @@ void DBusInterface::showDebugConsole()
     console->show();
 }
 
+QString DBusInterface::frameTimeline()
+{
+    if (!Compositor::compositing()) {
+        return QString();
+    }
+    return Compositor::self()->frameTimeline()->toString();
+}
+
 CompositorDBusInterface::CompositorDBusInterface(Compositor *parent)
     : QObject(parent)
     , m_compositor(parent)
@@ -65,6 +65,11 @@ public Q_SLOTS: // METHODS
     QString supportInformation();
     Q_NOREPLY void unclutterDesktop();
     Q_NOREPLY void showDebugConsole();
+    /**
+     * @returns the timestamps of the stages of the last compositing passes,
+     * one line per frame. Empty if not compositing.
+     **/
+    QString frameTimeline();
 
 private Q_SLOTS:
     void becomeKWinService(const QString &service);
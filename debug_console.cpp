@@ -468,6 +468,8 @@ DebugConsole::DebugConsole()
     m_ui->windowsView->setItemDelegate(new DebugConsoleDelegate(this));
     m_ui->windowsView->setModel(new DebugConsoleModel(this));
     m_ui->surfacesView->setModel(new SurfaceTreeModel(this));
+    FrameTimelineModel *framesModel = new FrameTimelineModel(this);
+    m_ui->framesView->setModel(framesModel);
 #if HAVE_INPUT
     if (kwinApp()->usesLibinput()) {
         m_ui->inputDevicesView->setModel(new InputDeviceModel(this));
@@ -488,7 +490,7 @@ DebugConsole::DebugConsole()
 
     connect(m_ui->quitButton, &QAbstractButton::clicked, this, &DebugConsole::deleteLater);
     connect(m_ui->tabWidget, &QTabWidget::currentChanged, this,
-        [this] (int index) {
+        [this, framesModel] (int index) {
             // delay creation of input event filter until the tab is selected
             if (index == 2 && m_inputFilter.isNull()) {
                 m_inputFilter.reset(new DebugConsoleFilter(m_ui->inputTextEdit));
@@ -498,6 +500,10 @@ DebugConsole::DebugConsole()
                 updateKeyboardTab();
                 connect(input(), &InputRedirection::keyStateChanged, this, &DebugConsole::updateKeyboardTab);
             }
+            if (index == 6) {
+                // the timeline changes with each frame, only take a snapshot when looking at it
+                framesModel->update();
+            }
         }
     );
 
@@ -1371,6 +1377,87 @@ QVariant SurfaceTreeModel::data(const QModelIndex &index, int role) const
     return QVariant();
 }
 
+FrameTimelineModel::FrameTimelineModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+FrameTimelineModel::~FrameTimelineModel() = default;
+
+void FrameTimelineModel::update()
+{
+    beginResetModel();
+    if (Compositor::compositing()) {
+        m_frames = Compositor::self()->frameTimeline()->frames();
+    } else {
+        m_frames.clear();
+    }
+    endResetModel();
+}
+
+int FrameTimelineModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    // the first column holds the frame number, the next ones the offset of a stage to the start,
+    // the last two the buffer count and whether the frame got queued
+    return FrameTimeline::StageCount + 2;
+}
+
+int FrameTimelineModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_frames.count();
+}
+
+QVariant FrameTimelineModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    if (section == 0) {
+        return i18nc("Column header for the number of a compositing pass", "Frame");
+    }
+    if (section == FrameTimeline::StageCount) {
+        return i18nc("Column header for the number of buffers the outputs present with", "Buffers");
+    }
+    if (section == FrameTimeline::StageCount + 1) {
+        return i18nc("Column header for whether a frame waited for a pending page flip", "Queued");
+    }
+    return i18nc("Column header, %1 is the name of a compositing stage", "%1 (ms)",
+                 FrameTimeline::stageName(FrameTimeline::Stage(section)));
+}
+
+QVariant FrameTimelineModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    if (index.row() >= m_frames.count() || index.column() >= columnCount(QModelIndex())) {
+        return QVariant();
+    }
+    // newest frame first
+    const FrameTimeline::Frame &frame = m_frames.at(m_frames.count() - index.row() - 1);
+    if (index.column() == 0) {
+        return frame.sequence;
+    }
+    if (index.column() == FrameTimeline::StageCount) {
+        return frame.bufferCount;
+    }
+    if (index.column() == FrameTimeline::StageCount + 1) {
+        return frame.queued ? i18nc("A frame waited for a pending page flip", "yes") : i18nc("A frame did not wait for a page flip", "no");
+    }
+    const qint64 timestamp = frame.timestamps[index.column()];
+    if (timestamp < 0) {
+        return QStringLiteral("-");
+    }
+    const qint64 start = frame.timestamps[int(FrameTimeline::Stage::Start)];
+    return QString::number((timestamp - start) / 1000000.0, 'f', 2);
+}
+
 #if HAVE_INPUT
 InputDeviceModel::InputDeviceModel(QObject *parent)
     : QAbstractItemModel(parent)
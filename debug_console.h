@@ -22,10 +22,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <kwin_export.h>
 #include <config-kwin.h>
+#include "frametimeline.h"
 #include "input.h"
 #include "input_event_spy.h"
 
 #include <QAbstractItemModel>
+#include <QAbstractTableModel>
 #include <QStyledItemDelegate>
 #include <QVector>
 
@@ -127,6 +129,27 @@ public:
     QModelIndex parent(const QModelIndex &child) const override;
 };
 
+class FrameTimelineModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    explicit FrameTimelineModel(QObject *parent = nullptr);
+    virtual ~FrameTimelineModel();
+
+    int columnCount(const QModelIndex &parent) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
+    int rowCount(const QModelIndex &parent) const override;
+
+    /**
+     * Takes a new snapshot of the Compositor's FrameTimeline.
+     **/
+    void update();
+
+private:
+    QVector<FrameTimeline::Frame> m_frames;
+};
+
 class DebugConsoleFilter : public InputEventSpy
 {
 public:
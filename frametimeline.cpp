@@ -0,0 +1,187 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "frametimeline.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+namespace KWin
+{
+
+FrameTimeline::FrameTimeline()
+{
+    m_clock.start();
+}
+
+FrameTimeline::~FrameTimeline() = default;
+
+void FrameTimeline::beginFrame()
+{
+    m_sequence++;
+    Frame &frame = m_frames[m_sequence % s_capacity];
+    frame.sequence = m_sequence;
+    frame.timestamps.fill(-1);
+    frame.timestamps[int(Stage::Start)] = m_clock.nsecsElapsed();
+    frame.bufferCount = m_bufferCount;
+    frame.queued = false;
+}
+
+void FrameTimeline::mark(Stage stage)
+{
+    mark(stage, m_sequence);
+}
+
+void FrameTimeline::mark(Stage stage, quint64 sequence)
+{
+    if (sequence == 0) {
+        return;
+    }
+    Frame &frame = m_frames[sequence % s_capacity];
+    if (frame.sequence != sequence) {
+        // got overwritten by a later frame
+        return;
+    }
+    frame.timestamps[int(stage)] = m_clock.nsecsElapsed();
+}
+
+void FrameTimeline::markQueued()
+{
+    if (m_sequence == 0) {
+        return;
+    }
+    m_frames[m_sequence % s_capacity].queued = true;
+}
+
+void FrameTimeline::setBufferCount(int count)
+{
+    m_bufferCount = count;
+}
+
+qint64 FrameTimeline::elapsed(Stage from, Stage to) const
+{
+    if (m_sequence == 0) {
+        return -1;
+    }
+    const Frame &frame = m_frames[m_sequence % s_capacity];
+    const qint64 start = frame.timestamps[int(from)];
+    const qint64 end = frame.timestamps[int(to)];
+    if (start < 0 || end < 0) {
+        return -1;
+    }
+    return end - start;
+}
+
+QVector<FrameTimeline::Frame> FrameTimeline::frames() const
+{
+    const quint64 first = m_sequence >= quint64(s_capacity) ? m_sequence - s_capacity + 1 : 1;
+    QVector<Frame> ret;
+    ret.reserve(s_capacity);
+    for (quint64 sequence = first; sequence <= m_sequence; ++sequence) {
+        ret << m_frames[sequence % s_capacity];
+    }
+    return ret;
+}
+
+QString FrameTimeline::stageName(Stage stage)
+{
+    switch (stage) {
+    case Stage::Start:
+        return QStringLiteral("start");
+    case Stage::DamageFetched:
+        return QStringLiteral("damage");
+    case Stage::PrePaintScreen:
+        return QStringLiteral("prePaintScreen");
+    case Stage::PaintWindows:
+        return QStringLiteral("paintWindows");
+    case Stage::Present:
+        return QStringLiteral("present");
+    case Stage::PageFlip:
+        return QStringLiteral("pageFlip");
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+QString FrameTimeline::toString() const
+{
+    QString text;
+    QStringList header{QStringLiteral("frame")};
+    for (int i = 0; i < StageCount; ++i) {
+        header << stageName(Stage(i));
+    }
+    header << QStringLiteral("buffers") << QStringLiteral("queued");
+    text.append(header.join(QLatin1Char(' ')) + QLatin1Char('\n'));
+
+    const auto recorded = frames();
+    for (const Frame &frame : recorded) {
+        const qint64 start = frame.timestamps[int(Stage::Start)];
+        QStringList line{QString::number(frame.sequence), QString::number(start / 1000)};
+        for (int i = int(Stage::Start) + 1; i < StageCount; ++i) {
+            const qint64 timestamp = frame.timestamps[i];
+            line << (timestamp < 0 ? QStringLiteral("-") : QString::number((timestamp - start) / 1000));
+        }
+        line << QString::number(frame.bufferCount) << QString::number(frame.queued ? 1 : 0);
+        text.append(line.join(QLatin1Char(' ')) + QLatin1Char('\n'));
+    }
+    return text;
+}
+
+// the percentile of the samples used as prediction
+static const int s_percentile = 90;
+// added to the prediction to cover the jitter of the millisecond based composite timer
+static const qint64 s_safetyMargin = 1000000;
+// below this number of samples the prediction is not reliable
+static const int s_minimumSamples = 8;
+
+RenderTimeEstimator::RenderTimeEstimator()
+{
+    m_samples.fill(0);
+}
+
+void RenderTimeEstimator::addSample(qint64 renderTime)
+{
+    if (renderTime < 0) {
+        return;
+    }
+    m_samples[m_next] = renderTime;
+    m_next = (m_next + 1) % s_sampleCount;
+    m_count = qMin(m_count + 1, s_sampleCount);
+}
+
+qint64 RenderTimeEstimator::estimate(qint64 fallback) const
+{
+    if (m_count < s_minimumSamples) {
+        return fallback;
+    }
+    std::array<qint64, s_sampleCount> sorted = m_samples;
+    auto end = sorted.begin() + m_count;
+    auto percentile = sorted.begin() + (m_count - 1) * s_percentile / 100;
+    std::nth_element(sorted.begin(), percentile, end);
+    return *percentile + s_safetyMargin;
+}
+
+void RenderTimeEstimator::reset()
+{
+    m_next = 0;
+    m_count = 0;
+}
+
+}
@@ -0,0 +1,187 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef KWIN_FRAMETIMELINE_H
+#define KWIN_FRAMETIMELINE_H
+
+#include <kwin_export.h>
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include <array>
+
+namespace KWin
+{
+
+/**
+ * @brief Records timestamps of the stages of the last compositing passes.
+ *
+ * Every pass of Compositor::performCompositing() starts a new frame in a fixed size ring
+ * buffer. The stages of the pass add their timestamp to the current frame. Old frames are
+ * overwritten, so there is no allocation while compositing.
+ *
+ * The timeline is not thread safe, it gets written and read from the main thread only.
+ **/
+class KWIN_EXPORT FrameTimeline
+{
+public:
+    enum class Stage {
+        /**
+         * The compositing pass started.
+         **/
+        Start,
+        /**
+         * The damage of all windows got fetched.
+         **/
+        DamageFetched,
+        /**
+         * The effects finished prePaintScreen.
+         **/
+        PrePaintScreen,
+        /**
+         * The windows are painted.
+         **/
+        PaintWindows,
+        /**
+         * The frame got swapped or presented.
+         **/
+        Present,
+        /**
+         * The page flip of the frame completed.
+         **/
+        PageFlip
+    };
+    static const int StageCount = int(Stage::PageFlip) + 1;
+
+    struct Frame {
+        /**
+         * Increasing number of the compositing pass, @c 0 for a frame which has not been used.
+         **/
+        quint64 sequence = 0;
+        /**
+         * Timestamps in nsec on a monotonic clock, @c -1 if the stage has not been reached.
+         **/
+        std::array<qint64, StageCount> timestamps;
+        /**
+         * The number of buffers the outputs were presenting with, @c 3 with triple buffering.
+         **/
+        int bufferCount = 2;
+        /**
+         * Whether the frame had to wait in a queue for a pending page flip.
+         **/
+        bool queued = false;
+    };
+
+    FrameTimeline();
+    ~FrameTimeline();
+
+    /**
+     * Starts a new frame, overwriting the oldest one in the ring buffer.
+     **/
+    void beginFrame();
+    /**
+     * Sets the timestamp of @p stage in the current frame to now.
+     * If a stage is reached several times, e.g. once per screen, the last one wins.
+     **/
+    void mark(Stage stage);
+    /**
+     * Sets the timestamp of @p stage in the frame with @p sequence to now, if it is still
+     * recorded. For stages which complete after the following frames started, like the page
+     * flip of a frame on one output while another output renders the next frame.
+     **/
+    void mark(Stage stage, quint64 sequence);
+    /**
+     * @returns the sequence number of the current frame, @c 0 before the first frame.
+     **/
+    quint64 currentFrame() const {
+        return m_sequence;
+    }
+    /**
+     * Marks the current frame as queued behind a pending page flip.
+     **/
+    void markQueued();
+    /**
+     * Sets the number of buffers the outputs present with, used from the next frame on.
+     **/
+    void setBufferCount(int count);
+
+    /**
+     * @returns the time in nsec between @p from and @p to in the current frame or @c -1 if
+     * one of the stages has not been reached yet.
+     **/
+    qint64 elapsed(Stage from, Stage to) const;
+
+    /**
+     * @returns a snapshot of the recorded frames, oldest first.
+     **/
+    QVector<Frame> frames() const;
+    /**
+     * @returns the frames as text, one line per frame with the offset of each stage
+     * to the start of the frame in usec, followed by the buffer count and whether the
+     * frame got queued.
+     **/
+    QString toString() const;
+
+    static QString stageName(Stage stage);
+
+    static const int s_capacity = 256;
+
+private:
+    std::array<Frame, s_capacity> m_frames;
+    quint64 m_sequence = 0;
+    QElapsedTimer m_clock;
+    int m_bufferCount = 2;
+};
+
+/**
+ * @brief Predicts how long the next frame will take to render.
+ *
+ * Keeps the render times of the last frames and uses a high percentile of them as
+ * the prediction, so that a single slow frame doesn't delay all following frames, but
+ * expensive effects like blur are taken into account as soon as they are active for a
+ * few frames.
+ **/
+class KWIN_EXPORT RenderTimeEstimator
+{
+public:
+    RenderTimeEstimator();
+
+    /**
+     * Adds the render time in nsec of the last frame.
+     **/
+    void addSample(qint64 renderTime);
+    /**
+     * @returns the predicted render time in nsec for the next frame including a safety margin,
+     * or @p fallback as long as not enough frames got rendered.
+     **/
+    qint64 estimate(qint64 fallback) const;
+    void reset();
+
+    static const int s_sampleCount = 32;
+
+private:
+    std::array<qint64, s_sampleCount> m_samples;
+    int m_next = 0;
+    int m_count = 0;
+};
+
+}
+
+#endif
@@ -41,7 +41,229 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 namespace KWin
 {
 
-LanczosFilter::LanczosFilter(QObject* parent)
+// a window damaged within this time after it got filtered is not filtered again right away
+static const int s_throttleInterval = 500;
+
+// the sizes of the textures are rounded up to a multiple of it
+static const int s_bucketSize = 64;
+
+static qint64 textureSize(const QSize &size)
+{
+    return qint64(size.width()) * size.height() * 4;
+}
+
+static QSize bucketSize(const QSize &size)
+{
+    return QSize((size.width() + s_bucketSize - 1) / s_bucketSize * s_bucketSize,
+                 (size.height() + s_bucketSize - 1) / s_bucketSize * s_bucketSize);
+}
+
+/**
+ * @returns the normalized texture coordinates of the far corner of the content of @p size
+ **/
+static QVector2D contentCoords(GLTexture *texture, const QSize &size)
+{
+    return QVector2D(size.width() / float(texture->width()), size.height() / float(texture->height()));
+}
+
+/**
+ * Renders the content of @p size of the bucketed @p texture to @p rect, like GLTexture::render.
+ **/
+static void renderContent(GLTexture *texture, const QSize &size, const QRegion &region, const QRect &rect, bool hardwareClipping)
+{
+    const QVector2D coords = contentCoords(texture, size);
+    const float verts[ 4 * 2 ] = {
+        0.0f, 0.0f,
+        0.0f, float(rect.height()),
+        float(rect.width()), 0.0f,
+        float(rect.width()), float(rect.height())
+    };
+    // y needs to be swapped, the content was copied from the bottom of the framebuffer
+    const float texcoords[ 4 * 2 ] = {
+        0.0f, coords.y(),
+        0.0f, 0.0f,
+        coords.x(), coords.y(),
+        coords.x(), 0.0f
+    };
+    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
+    vbo->reset();
+    vbo->setData(4, 2, verts, texcoords);
+    vbo->render(region, GL_TRIANGLE_STRIP, hardwareClipping);
+}
+
+LanczosCache::LanczosCache(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+    m_throttleTimer.setSingleShot(true);
+    m_throttleTimer.setInterval(s_throttleInterval);
+    connect(&m_throttleTimer, &QTimer::timeout, this, &LanczosCache::repaintThrottled);
+    connect(effects, &EffectsHandler::windowDamaged, this, &LanczosCache::invalidate);
+    connect(effects, &EffectsHandler::windowDeleted, this, &LanczosCache::remove);
+    connect(options, &Options::glLanczosCacheSizeChanged, this, &LanczosCache::updateBudget);
+    updateBudget();
+}
+
+LanczosCache::~LanczosCache()
+{
+    clear();
+}
+
+GLTexture *LanczosCache::texture(EffectWindow *w, const QSize &size)
+{
+    auto it = m_entries.find(w);
+    if (it == m_entries.end() || !it->texture) {
+        return nullptr;
+    }
+    if (it->size != size) {
+        release(it->texture);
+        it->texture = nullptr;
+        return nullptr;
+    }
+    it->lastUsed = ++m_useCounter;
+    return it->texture;
+}
+
+bool LanczosCache::isThrottled(EffectWindow *w)
+{
+    auto it = m_entries.constFind(w);
+    if (it == m_entries.constEnd() || it->texture) {
+        return false;
+    }
+    if (m_clock.elapsed() - it->filteredAt >= s_throttleInterval) {
+        return false;
+    }
+    // make sure it gets filtered once the window stops changing
+    m_throttled.insert(w);
+    if (!m_throttleTimer.isActive()) {
+        m_throttleTimer.start();
+    }
+    return true;
+}
+
+void LanczosCache::insert(EffectWindow *w, GLTexture *texture, const QSize &size)
+{
+    Entry &entry = m_entries[w];
+    if (entry.texture) {
+        release(entry.texture);
+    }
+    entry.texture = texture;
+    entry.size = size;
+    entry.lastUsed = ++m_useCounter;
+    entry.filteredAt = m_clock.elapsed();
+    // acquire() already accounted for the texture
+    trim(w);
+}
+
+GLTexture *LanczosCache::acquire(const QSize &size)
+{
+    const QSize bucket = bucketSize(size);
+    auto it = m_pool.find(qMakePair(bucket.width(), bucket.height()));
+    if (it != m_pool.end() && !it->isEmpty()) {
+        GLTexture *texture = it->takeLast();
+        if (it->isEmpty()) {
+            m_pool.erase(it);
+        }
+        return texture;
+    }
+    GLTexture *texture = new GLTexture(GL_RGBA8, bucket.width(), bucket.height());
+    texture->setFilter(GL_LINEAR);
+    texture->setWrapMode(GL_CLAMP_TO_EDGE);
+    m_size += textureSize(bucket);
+    return texture;
+}
+
+void LanczosCache::release(GLTexture *texture)
+{
+    m_pool[qMakePair(texture->width(), texture->height())].append(texture);
+    trim();
+}
+
+void LanczosCache::clear()
+{
+    for (const Entry &entry : qAsConst(m_entries)) {
+        delete entry.texture;
+    }
+    m_entries.clear();
+    for (const QList<GLTexture*> &textures : qAsConst(m_pool)) {
+        qDeleteAll(textures);
+    }
+    m_pool.clear();
+    m_throttled.clear();
+    m_size = 0;
+}
+
+void LanczosCache::invalidate(EffectWindow *w)
+{
+    auto it = m_entries.find(w);
+    if (it == m_entries.end() || !it->texture) {
+        return;
+    }
+    // keep the entry to know when the window got filtered the last time
+    release(it->texture);
+    it->texture = nullptr;
+}
+
+void LanczosCache::remove(EffectWindow *w)
+{
+    m_throttled.remove(w);
+    auto it = m_entries.find(w);
+    if (it == m_entries.end()) {
+        return;
+    }
+    if (it->texture) {
+        release(it->texture);
+    }
+    m_entries.erase(it);
+}
+
+void LanczosCache::updateBudget()
+{
+    m_budget = qint64(options->glLanczosCacheSize()) * 1024 * 1024;
+    trim();
+}
+
+void LanczosCache::trim(EffectWindow *keep)
+{
+    // first drop the unused textures, then the least recently used ones
+    while (m_size > m_budget && !m_pool.isEmpty()) {
+        auto it = m_pool.begin();
+        GLTexture *texture = it->takeFirst();
+        if (it->isEmpty()) {
+            m_pool.erase(it);
+        }
+        m_size -= textureSize(texture->size());
+        delete texture;
+    }
+    while (m_size > m_budget) {
+        auto lru = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (!it->texture || it.key() == keep) {
+                continue;
+            }
+            if (lru == m_entries.end() || it->lastUsed < lru->lastUsed) {
+                lru = it;
+            }
+        }
+        if (lru == m_entries.end()) {
+            // only the texture in use is left, keep it even if it is over budget
+            break;
+        }
+        m_size -= textureSize(lru->texture->size());
+        delete lru->texture;
+        lru->texture = nullptr;
+    }
+}
+
+void LanczosCache::repaintThrottled()
+{
+    for (EffectWindow *w : qAsConst(m_throttled)) {
+        w->addRepaintFull();
+    }
+    m_throttled.clear();
+}
+
+LanczosFilter::LanczosFilter(LanczosCache *cache, QObject* parent)
     : QObject(parent)
     , m_offscreenTex(0)
     , m_offscreenTarget(0)
@@ -49,6 +271,8 @@ LanczosFilter::LanczosFilter(QObject* parent)
     , m_shader(0)
     , m_uOffsets(0)
     , m_uKernel(0)
+    , m_uMaxCoord(0)
+    , m_cache(cache)
 {
 }
 
@@ -101,6 +325,7 @@ void LanczosFilter::init()
         ShaderBinder binder(m_shader.data());
         m_uKernel     = m_shader->uniformLocation("kernel");
         m_uOffsets    = m_shader->uniformLocation("offsets");
+        m_uMaxCoord   = m_shader->uniformLocation("maxCoord");
     } else {
         qCDebug(KWIN_CORE) << "Shader is not valid";
         m_shader.reset();
@@ -207,43 +432,41 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             int sw = width;
             int sh = height;
 
-            GLTexture *cachedTexture = static_cast< GLTexture*>(w->data(LanczosCacheRole).value<void*>());
+            GLTexture *cachedTexture = m_cache->texture(w, QSize(tw, th));
             if (cachedTexture) {
-                if (cachedTexture->width() == tw && cachedTexture->height() == th) {
-                    cachedTexture->bind();
-                    if (hardwareClipping) {
-                        glEnable(GL_SCISSOR_TEST);
-                    }
-
-                    glEnable(GL_BLEND);
-                    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-                    const qreal rgb = data.brightness() * data.opacity();
-                    const qreal a = data.opacity();
-
-                    ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
-                    GLShader *shader = binder.shader();
-                    QMatrix4x4 mvp = data.screenProjectionMatrix();
-                    mvp.translate(textureRect.x(), textureRect.y());
-                    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
-                    shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
-                    shader->setUniform(GLShader::Saturation, data.saturation());
-
-                    cachedTexture->render(region, textureRect, hardwareClipping);
-
-                    glDisable(GL_BLEND);
-                    if (hardwareClipping) {
-                        glDisable(GL_SCISSOR_TEST);
-                    }
-                    cachedTexture->unbind();
-                    m_timer.start(5000, this);
-                    return;
-                } else {
-                    // offscreen texture not matching - delete
-                    delete cachedTexture;
-                    cachedTexture = 0;
-                    w->setData(LanczosCacheRole, QVariant());
+                cachedTexture->bind();
+                if (hardwareClipping) {
+                    glEnable(GL_SCISSOR_TEST);
+                }
+
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+                const qreal rgb = data.brightness() * data.opacity();
+                const qreal a = data.opacity();
+
+                ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
+                GLShader *shader = binder.shader();
+                QMatrix4x4 mvp = data.screenProjectionMatrix();
+                mvp.translate(textureRect.x(), textureRect.y());
+                shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+                shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
+                shader->setUniform(GLShader::Saturation, data.saturation());
+
+                renderContent(cachedTexture, QSize(tw, th), region, textureRect, hardwareClipping);
+
+                glDisable(GL_BLEND);
+                if (hardwareClipping) {
+                    glDisable(GL_SCISSOR_TEST);
                 }
+                cachedTexture->unbind();
+                m_timer.start(5000, this);
+                return;
+            }
+            if (m_cache->isThrottled(w)) {
+                // the window changes too often, paint it with the normal filter for now
+                w->sceneWindow()->performPaint(mask, region, data);
+                return;
             }
 
             WindowPaintData thumbData = data;
@@ -268,10 +491,8 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             w->sceneWindow()->performPaint(mask, infiniteRegion(), thumbData);
 
             // Create a scratch texture and copy the rendered window into it
-            GLTexture tex(GL_RGBA8, sw, sh);
-            tex.setFilter(GL_LINEAR);
-            tex.setWrapMode(GL_CLAMP_TO_EDGE);
-            tex.bind();
+            GLTexture *tex = m_cache->acquire(QSize(sw, sh));
+            tex->bind();
 
             glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, sw, sh);
 
@@ -279,11 +500,12 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             float dx = sw / float(tw);
             int kernelSize;
             createKernel(dx, &kernelSize);
-            createOffsets(kernelSize, sw, Qt::Horizontal);
+            createOffsets(kernelSize, tex->width(), Qt::Horizontal);
 
             ShaderManager::instance()->pushShader(m_shader.data());
             m_shader->setUniform(GLShader::ModelViewProjectionMatrix, modelViewProjectionMatrix);
             setUniforms();
+            setMaxCoord(tex, QSize(sw, sh));
 
             // Draw the window back into the FBO, this time scaled horizontally
             glClear(GL_COLOR_BUFFER_BIT);
@@ -292,59 +514,59 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             verts.reserve(12);
             texCoords.reserve(12);
 
-            texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
+            // the scratch textures are bucketed, only the part with the content gets sampled
+            QVector2D coords = contentCoords(tex, QSize(sw, sh));
+            texCoords << coords.x() << 0.0; verts << tw  << 0.0; // Top right
             texCoords << 0.0 << 0.0; verts << 0.0 << 0.0; // Top left
-            texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
-            texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
-            texCoords << 1.0 << 1.0; verts << tw  << sh;  // Bottom right
-            texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
+            texCoords << 0.0 << coords.y(); verts << 0.0 << sh;  // Bottom left
+            texCoords << 0.0 << coords.y(); verts << 0.0 << sh;  // Bottom left
+            texCoords << coords.x() << coords.y(); verts << tw  << sh;  // Bottom right
+            texCoords << coords.x() << 0.0; verts << tw  << 0.0; // Top right
             GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
             vbo->reset();
             vbo->setData(6, 2, verts.constData(), texCoords.constData());
             vbo->render(GL_TRIANGLES);
 
             // At this point we don't need the scratch texture anymore
-            tex.unbind();
-            tex.discard();
+            tex->unbind();
+            m_cache->release(tex);
 
             // create scratch texture for second rendering pass
-            GLTexture tex2(GL_RGBA8, tw, sh);
-            tex2.setFilter(GL_LINEAR);
-            tex2.setWrapMode(GL_CLAMP_TO_EDGE);
-            tex2.bind();
+            GLTexture *tex2 = m_cache->acquire(QSize(tw, sh));
+            tex2->bind();
 
             glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, tw, sh);
 
             // Set up the shader for vertical scaling
             float dy = sh / float(th);
             createKernel(dy, &kernelSize);
-            createOffsets(kernelSize, m_offscreenTex->height(), Qt::Vertical);
+            createOffsets(kernelSize, tex2->height(), Qt::Vertical);
             setUniforms();
+            setMaxCoord(tex2, QSize(tw, sh));
 
             // Now draw the horizontally scaled window in the FBO at the right
             // coordinates on the screen, while scaling it vertically and blending it.
             glClear(GL_COLOR_BUFFER_BIT);
 
             verts.clear();
+            texCoords.clear();
+            coords = contentCoords(tex2, QSize(tw, sh));
 
-            verts << tw  << 0.0; // Top right
-            verts << 0.0 << 0.0; // Top left
-            verts << 0.0 << th;  // Bottom left
-            verts << 0.0 << th;  // Bottom left
-            verts << tw  << th;  // Bottom right
-            verts << tw  << 0.0; // Top right
+            texCoords << coords.x() << 0.0; verts << tw  << 0.0; // Top right
+            texCoords << 0.0 << 0.0; verts << 0.0 << 0.0; // Top left
+            texCoords << 0.0 << coords.y(); verts << 0.0 << th;  // Bottom left
+            texCoords << 0.0 << coords.y(); verts << 0.0 << th;  // Bottom left
+            texCoords << coords.x() << coords.y(); verts << tw  << th;  // Bottom right
+            texCoords << coords.x() << 0.0; verts << tw  << 0.0; // Top right
             vbo->setData(6, 2, verts.constData(), texCoords.constData());
             vbo->render(GL_TRIANGLES);
 
-            tex2.unbind();
-            tex2.discard();
+            tex2->unbind();
+            m_cache->release(tex2);
             ShaderManager::instance()->popShader();
 
             // create cache texture
-            GLTexture *cache = new GLTexture(GL_RGBA8, tw, th);
-
-            cache->setFilter(GL_LINEAR);
-            cache->setWrapMode(GL_CLAMP_TO_EDGE);
+            GLTexture *cache = m_cache->acquire(QSize(tw, th));
             cache->bind();
             glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - th, tw, th);
             GLRenderTarget::popRenderTarget();
@@ -367,7 +589,7 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
             shader->setUniform(GLShader::Saturation, data.saturation());
 
-            cache->render(region, textureRect, hardwareClipping);
+            renderContent(cache, QSize(tw, th), region, textureRect, hardwareClipping);
 
             glDisable(GL_BLEND);
 
@@ -376,7 +598,7 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             }
 
             cache->unbind();
-            w->setData(LanczosCacheRole, QVariant::fromValue(static_cast<void*>(cache)));
+            m_cache->insert(w, cache, QSize(tw, th));
 
             // Delete the offscreen surface after 5 seconds
             m_timer.start(5000, this);
@@ -395,27 +617,7 @@ void LanczosFilter::timerEvent(QTimerEvent *event)
         delete m_offscreenTex;
         m_offscreenTarget = 0;
         m_offscreenTex = 0;
-        foreach (Client *c, Workspace::self()->clientList()) {
-            discardCacheTexture(c->effectWindow());
-        }
-        foreach (Client *c, Workspace::self()->desktopList()) {
-            discardCacheTexture(c->effectWindow());
-        }
-        foreach (Unmanaged *u, Workspace::self()->unmanagedList()) {
-            discardCacheTexture(u->effectWindow());
-        }
-        foreach (Deleted *d, Workspace::self()->deletedList()) {
-            discardCacheTexture(d->effectWindow());
-        }
-    }
-}
-
-void LanczosFilter::discardCacheTexture(EffectWindow *w)
-{
-    QVariant cachedTextureVariant = w->data(LanczosCacheRole);
-    if (cachedTextureVariant.isValid()) {
-        delete static_cast< GLTexture*>(cachedTextureVariant.value<void*>());
-        w->setData(LanczosCacheRole, QVariant());
+        m_cache->clear();
     }
 }
 
@@ -425,5 +627,12 @@ void LanczosFilter::setUniforms()
     glUniform4fv(m_uKernel, 16, (const GLfloat*)m_kernel);
 }
 
+void LanczosFilter::setMaxCoord(GLTexture *texture, const QSize &size)
+{
+    // the center of the last texel of the content, so that the kernel never samples outside of it
+    const QVector2D coords = contentCoords(texture, size);
+    glUniform2f(m_uMaxCoord, coords.x() - 0.5f / texture->width(), coords.y() - 0.5f / texture->height());
+}
+
 } // namespace
 
@@ -24,6 +24,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <QObject>
 #include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
 #include <QVector>
 #include <QVector2D>
 #include <QVector4D>
@@ -40,13 +44,85 @@ class GLTexture;
 class GLRenderTarget;
 class GLShader;
 
+/**
+ * @brief Cache for the Lanczos filtered textures of the windows.
+ *
+ * The textures are kept until the window gets damaged or the memory budget configured through
+ * Options::glLanczosCacheSize is exceeded, in which case the least recently used ones get evicted.
+ * Texture sizes are rounded up to buckets of 64 pixels and the content only fills the texture
+ * partially. Textures which are no longer used are kept in a pool per bucket, so that the filter
+ * can reuse them for windows of a similar size, e.g. the thumbnails of Present Windows.
+ *
+ * Windows which get damaged continuously, e.g. while playing a video, are only filtered again
+ * once the throttle interval elapsed, in between they have to be painted with a cheaper filter.
+ **/
+class LanczosCache
+    : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LanczosCache(QObject *parent = nullptr);
+    ~LanczosCache();
+
+    /**
+     * @returns the cached texture of @p w if it is still valid and got filtered to @p size,
+     * otherwise @c nullptr
+     **/
+    GLTexture *texture(EffectWindow *w, const QSize &size);
+    /**
+     * @returns whether @p w got filtered too recently to be filtered again
+     **/
+    bool isThrottled(EffectWindow *w);
+    /**
+     * Adds the @p texture of @p w filtered to @p size, the cache takes over ownership.
+     **/
+    void insert(EffectWindow *w, GLTexture *texture, const QSize &size);
+    /**
+     * @returns a texture from the pool or a new one if there is none. It is at least of @p size,
+     * the content has to be put at its origin. Pass it back with release() or insert().
+     **/
+    GLTexture *acquire(const QSize &size);
+    /**
+     * Returns the no longer needed @p texture to the pool.
+     **/
+    void release(GLTexture *texture);
+    /**
+     * Drops all textures.
+     **/
+    void clear();
+
+private:
+    void invalidate(EffectWindow *w);
+    void remove(EffectWindow *w);
+    void updateBudget();
+    void trim(EffectWindow *keep = nullptr);
+    void repaintThrottled();
+
+    struct Entry {
+        GLTexture *texture = nullptr;
+        // the size of the content in the texture
+        QSize size;
+        quint64 lastUsed = 0;
+        qint64 filteredAt = 0;
+    };
+    QHash<EffectWindow*, Entry> m_entries;
+    QHash<QPair<int, int>, QList<GLTexture*> > m_pool;
+    QSet<EffectWindow*> m_throttled;
+    QTimer m_throttleTimer;
+    QElapsedTimer m_clock;
+    quint64 m_useCounter = 0;
+    qint64 m_size = 0;
+    qint64 m_budget = 0;
+};
+
 class LanczosFilter
     : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit LanczosFilter(QObject* parent = 0);
+    explicit LanczosFilter(LanczosCache *cache, QObject* parent = 0);
     ~LanczosFilter();
     void performPaint(EffectWindowImpl* w, int mask, QRegion region, WindowPaintData& data);
 
@@ -56,7 +132,7 @@ private:
     void init();
     void updateOffscreenSurfaces();
     void setUniforms();
-    void discardCacheTexture(EffectWindow *w);
+    void setMaxCoord(GLTexture *texture, const QSize &size);
 
     void createKernel(float delta, int *kernelSize);
     void createOffsets(int count, float width, Qt::Orientation direction);
@@ -67,8 +143,10 @@ private:
     QScopedPointer<GLShader> m_shader;
     int m_uOffsets;
     int m_uKernel;
+    int m_uMaxCoord;
     QVector2D m_offsets[16];
     QVector4D m_kernel[16];
+    LanczosCache *m_cache;
 };
 
 } // namespace
@@ -1360,6 +1360,128 @@ void WindowQuadList::makeInterleavedArrays(unsigned int type, GLVertex2D *vertic
     }
 }
 
+/***************************************************************
+ WindowQuadArrays
+***************************************************************/
+
+WindowQuadArrays::WindowQuadArrays()
+{
+}
+
+WindowQuadArrays::WindowQuadArrays(const WindowQuadList &quads)
+{
+    m_data.reserve(quads.count() * s_floatsPerQuad);
+    for (const WindowQuad &quad : quads) {
+        append(quad);
+    }
+}
+
+void WindowQuadArrays::append(const WindowQuad &quad)
+{
+    const int offset = m_data.count();
+    m_data.resize(offset + s_floatsPerQuad);
+    float *data = m_data.data() + offset;
+    for (int j = 0; j < 4; j++) {
+        const WindowVertex &wv = quad[j];
+        data[j] = wv.x();
+        data[4 + j] = wv.y();
+        data[8 + j] = wv.u();
+        data[12 + j] = wv.v();
+    }
+}
+
+void WindowQuadArrays::clear()
+{
+    m_data.clear();
+}
+
+void WindowQuadArrays::makeInterleavedArrays(unsigned int type, GLVertex2D *vertices, const QMatrix4x4 &textureMatrix) const
+{
+    // Since we know that the texture matrix just scales and translates
+    // we can use this information to optimize the transformation
+    const float coeffU = textureMatrix(0, 0);
+    const float coeffV = textureMatrix(1, 1);
+    const float offsetU = textureMatrix(0, 3);
+    const float offsetV = textureMatrix(1, 3);
+
+    assert(type == GL_QUADS || type == GL_TRIANGLES);
+
+    const float *data = m_data.constData();
+    const int quadCount = count();
+    float *vertex = reinterpret_cast<float *>(vertices);
+
+#ifdef HAVE_SSE2
+    const __m128 cu = _mm_set1_ps(coeffU);
+    const __m128 cv = _mm_set1_ps(coeffV);
+    const __m128 ou = _mm_set1_ps(offsetU);
+    const __m128 ov = _mm_set1_ps(offsetV);
+    // the vertex buffer is usually write combined memory, bypass the cache if possible
+    const bool aligned = !(intptr_t(vertex) & 0xf);
+    auto store = [aligned] (float *dst, __m128 value) {
+        if (aligned) {
+            _mm_stream_ps(dst, value);
+        } else {
+            _mm_storeu_ps(dst, value);
+        }
+    };
+
+    for (int i = 0; i < quadCount; i++, data += s_floatsPerQuad) {
+        __m128 v0 = _mm_loadu_ps(data);      // x of all four vertices
+        __m128 v1 = _mm_loadu_ps(data + 4);  // y
+        __m128 v2 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(data + 8), cu), ou);  // u
+        __m128 v3 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(data + 12), cv), ov); // v
+        // afterwards each register holds one interleaved vertex
+        _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+        if (type == GL_QUADS) {
+            store(vertex,      v0); // Top-left
+            store(vertex + 4,  v1); // Top-right
+            store(vertex + 8,  v2); // Bottom-right
+            store(vertex + 12, v3); // Bottom-left
+            vertex += 16;
+        } else {
+            // First triangle
+            store(vertex,      v1); // Top-right
+            store(vertex + 4,  v0); // Top-left
+            store(vertex + 8,  v3); // Bottom-left
+
+            // Second triangle
+            store(vertex + 12, v3); // Bottom-left
+            store(vertex + 16, v2); // Bottom-right
+            store(vertex + 20, v1); // Top-right
+            vertex += 24;
+        }
+    }
+#else
+    for (int i = 0; i < quadCount; i++, data += s_floatsPerQuad) {
+        GLVertex2D v[4];
+        for (int j = 0; j < 4; j++) {
+            v[j].position = QVector2D(data[j], data[4 + j]);
+            v[j].texcoord = QVector2D(data[8 + j] * coeffU + offsetU, data[12 + j] * coeffV + offsetV);
+        }
+
+        GLVertex2D *dst = reinterpret_cast<GLVertex2D *>(vertex);
+        if (type == GL_QUADS) {
+            for (int j = 0; j < 4; j++) {
+                *(dst++) = v[j];
+            }
+            vertex += 16;
+        } else {
+            // First triangle
+            *(dst++) = v[1]; // Top-right
+            *(dst++) = v[0]; // Top-left
+            *(dst++) = v[3]; // Bottom-left
+
+            // Second triangle
+            *(dst++) = v[3]; // Bottom-left
+            *(dst++) = v[2]; // Bottom-right
+            *(dst++) = v[1]; // Top-right
+            vertex += 24;
+        }
+    }
+#endif // HAVE_SSE2
+}
+
 void WindowQuadList::makeArrays(float **vertices, float **texcoords, const QSizeF &size, bool yInverted) const
 {
     *vertices = new float[count() * 6 * 2];
@@ -2245,6 +2245,43 @@ public:
     bool isTransformed() const;
 };
 
+/**
+ * @short Compact float copy of the vertices of a WindowQuadList.
+ *
+ * The vertices are stored as structure of arrays per quad, that is the four x, y, u and v
+ * coordinates of a quad follow each other. This allows to convert them into the interleaved
+ * GLVertex2D layout with a few SIMD instructions and keeping the arrays for windows whose
+ * quads didn't change avoids converting the doubles of the WindowQuads on each frame.
+ *
+ * @since 5.10
+ **/
+class KWINEFFECTS_EXPORT WindowQuadArrays
+{
+public:
+    WindowQuadArrays();
+    explicit WindowQuadArrays(const WindowQuadList &quads);
+
+    void append(const WindowQuad &quad);
+    void clear();
+    /**
+     * @returns the number of quads.
+     **/
+    int count() const {
+        return m_data.count() / s_floatsPerQuad;
+    }
+    bool isEmpty() const {
+        return m_data.isEmpty();
+    }
+    /**
+     * Same as WindowQuadList::makeInterleavedArrays.
+     **/
+    void makeInterleavedArrays(unsigned int type, GLVertex2D *vertices, const QMatrix4x4 &matrix) const;
+
+private:
+    static const int s_floatsPerQuad = 16;
+    QVector<float> m_data;
+};
+
 class KWINEFFECTS_EXPORT WindowPrePaintData
 {
 public:
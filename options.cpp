@@ -122,6 +122,8 @@ Options::Options(QObject *parent)
     , m_glStrictBinding(Options::defaultGlStrictBinding())
     , m_glStrictBindingFollowsDriver(Options::defaultGlStrictBindingFollowsDriver())
     , m_glCoreProfile(Options::defaultGLCoreProfile())
+    , m_glLanczosCacheSize(Options::defaultGlLanczosCacheSize())
+    , m_glTripleBuffering(Options::defaultGlTripleBuffering())
     , m_glPreferBufferSwap(Options::defaultGlPreferBufferSwap())
     , m_glPlatformInterface(Options::defaultGlPlatformInterface())
     , m_windowsBlockCompositing(true)
@@ -705,6 +707,24 @@ void Options::setGLCoreProfile(bool value)
     emit glCoreProfileChanged();
 }
 
+void Options::setGlLanczosCacheSize(int glLanczosCacheSize)
+{
+    if (m_glLanczosCacheSize == glLanczosCacheSize) {
+        return;
+    }
+    m_glLanczosCacheSize = glLanczosCacheSize;
+    emit glLanczosCacheSizeChanged();
+}
+
+void Options::setGlTripleBuffering(bool glTripleBuffering)
+{
+    if (m_glTripleBuffering == glTripleBuffering) {
+        return;
+    }
+    m_glTripleBuffering = glTripleBuffering;
+    emit glTripleBufferingChanged();
+}
+
 void Options::setWindowsBlockCompositing(bool value)
 {
     if (m_windowsBlockCompositing == value) {
@@ -972,6 +992,8 @@ void Options::reloadCompositingSettings(bool force)
         setGlStrictBinding(config.readEntry("GLStrictBinding", Options::defaultGlStrictBinding()));
     }
     setGLCoreProfile(config.readEntry("GLCore", Options::defaultGLCoreProfile()));
+    setGlLanczosCacheSize(qMax(0, config.readEntry("GLLanczosCacheSize", Options::defaultGlLanczosCacheSize())));
+    setGlTripleBuffering(config.readEntry("GLTripleBuffering", Options::defaultGlTripleBuffering()));
 
     char c = 0;
     const QString s = config.readEntry("GLPreferBufferSwap", QString(Options::defaultGlPreferBufferSwap()));
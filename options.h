@@ -187,6 +187,15 @@ class KWIN_EXPORT Options : public QObject
      **/
     Q_PROPERTY(bool glStrictBindingFollowsDriver READ isGlStrictBindingFollowsDriver WRITE setGlStrictBindingFollowsDriver NOTIFY glStrictBindingFollowsDriverChanged)
     Q_PROPERTY(bool glCoreProfile READ glCoreProfile WRITE setGLCoreProfile NOTIFY glCoreProfileChanged)
+    /**
+     * The amount of video memory in MiB the Lanczos filter may use for caching scaled windows.
+     **/
+    Q_PROPERTY(int glLanczosCacheSize READ glLanczosCacheSize WRITE setGlLanczosCacheSize NOTIFY glLanczosCacheSizeChanged)
+    /**
+     * Whether platforms which support it may queue a third buffer behind a pending page flip
+     * instead of blocking the compositor until the flip completed.
+     **/
+    Q_PROPERTY(bool glTripleBuffering READ glTripleBuffering WRITE setGlTripleBuffering NOTIFY glTripleBufferingChanged)
     Q_PROPERTY(GlSwapStrategy glPreferBufferSwap READ glPreferBufferSwap WRITE setGlPreferBufferSwap NOTIFY glPreferBufferSwapChanged)
     Q_PROPERTY(KWin::OpenGLPlatformInterface glPlatformInterface READ glPlatformInterface WRITE setGlPlatformInterface NOTIFY glPlatformInterfaceChanged)
     Q_PROPERTY(bool windowsBlockCompositing READ windowsBlockCompositing WRITE setWindowsBlockCompositing NOTIFY windowsBlockCompositingChanged)
@@ -581,6 +590,12 @@ public:
     bool glCoreProfile() const {
         return m_glCoreProfile;
     }
+    int glLanczosCacheSize() const {
+        return m_glLanczosCacheSize;
+    }
+    bool glTripleBuffering() const {
+        return m_glTripleBuffering;
+    }
     OpenGLPlatformInterface glPlatformInterface() const {
         return m_glPlatformInterface;
     }
@@ -656,6 +671,8 @@ public:
     void setGlStrictBinding(bool glStrictBinding);
     void setGlStrictBindingFollowsDriver(bool glStrictBindingFollowsDriver);
     void setGLCoreProfile(bool glCoreProfile);
+    void setGlLanczosCacheSize(int glLanczosCacheSize);
+    void setGlTripleBuffering(bool glTripleBuffering);
     void setGlPreferBufferSwap(char glPreferBufferSwap);
     void setGlPlatformInterface(OpenGLPlatformInterface interface);
     void setWindowsBlockCompositing(bool set);
@@ -763,6 +780,12 @@ public:
     static bool defaultGLCoreProfile() {
         return false;
     }
+    static int defaultGlLanczosCacheSize() {
+        return 64;
+    }
+    static bool defaultGlTripleBuffering() {
+        return false;
+    }
     static GlSwapStrategy defaultGlPreferBufferSwap() {
         return AutoSwapStrategy;
     }
@@ -845,6 +868,8 @@ Q_SIGNALS:
     void glStrictBindingChanged();
     void glStrictBindingFollowsDriverChanged();
     void glCoreProfileChanged();
+    void glLanczosCacheSizeChanged();
+    void glTripleBufferingChanged();
     void glPreferBufferSwapChanged();
     void glPlatformInterfaceChanged();
     void windowsBlockCompositingChanged();
@@ -891,6 +916,8 @@ private:
     bool m_glStrictBinding;
     bool m_glStrictBindingFollowsDriver;
     bool m_glCoreProfile;
+    int m_glLanczosCacheSize;
+    bool m_glTripleBuffering;
     GlSwapStrategy m_glPreferBufferSwap;
     OpenGLPlatformInterface m_glPlatformInterface;
     bool m_windowsBlockCompositing;
@@ -52,6 +52,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <libdrm/drm_mode.h>
+#include <libdrm/drm_fourcc.h>
 
 #ifndef DRM_CAP_CURSOR_WIDTH
 #define DRM_CAP_CURSOR_WIDTH 0x8
@@ -175,7 +176,23 @@ void DrmBackend::reactivate()
     }
     // restart compositor
     m_pageFlipsPending = 0;
-    if (Compositor *compositor = Compositor::self()) {
+    Compositor *compositor = Compositor::self();
+    for (int i = 0; i < m_outputs.size(); ++i) {
+        DrmOutput *o = m_outputs.at(i);
+        delete o->m_queuedBuffer;
+        o->m_queuedBuffer = nullptr;
+        o->m_queuedFrame = 0;
+        if (!o->m_pageFlipPending) {
+            continue;
+        }
+        o->m_pageFlipPending = false;
+        o->m_swapPending = false;
+        if (compositor) {
+            // the compositor is still blocked, this won't trigger a repaint yet
+            compositor->bufferSwapCompleteForScreen(i, 0);
+        }
+    }
+    if (compositor) {
         compositor->bufferSwapComplete();
         compositor->addRepaintFull();
     }
@@ -187,7 +204,7 @@ void DrmBackend::deactivate()
         return;
     }
     // block compositor
-    if (m_pageFlipsPending == 0 && Compositor::self()) {
+    if (Compositor::self()) {
         Compositor::self()->aboutToSwapBuffers();
     }
     // hide cursor and disable
@@ -207,14 +224,43 @@ void DrmBackend::pageFlipHandler(int fd, unsigned int frame, unsigned int sec, u
     Q_UNUSED(usec)
     auto output = reinterpret_cast<DrmOutput*>(data);
     output->pageFlipped();
-    output->m_backend->m_pageFlipsPending--;
-    if (output->m_backend->m_pageFlipsPending == 0) {
-        // TODO: improve, this currently means we wait for all page flips or all outputs.
-        // It would be better to driver the repaint per output
-        if (Compositor::self()) {
-            Compositor::self()->bufferSwapComplete();
+    DrmBackend *backend = output->m_backend;
+    backend->m_pageFlipsPending--;
+    if (!output->m_pageFlipPending) {
+        return;
+    }
+    output->m_pageFlipPending = false;
+    const quint64 flippedFrame = output->m_pendingFrame;
+    output->m_pendingFrame = 0;
+    if (output->m_queuedBuffer) {
+        DrmBuffer *queued = output->m_queuedBuffer;
+        output->m_queuedBuffer = nullptr;
+        if (output->present(queued)) {
+            backend->m_pageFlipsPending++;
+            output->m_pageFlipPending = true;
+            output->m_pendingFrame = output->m_queuedFrame;
+        } else if (backend->m_buffers.contains(queued) && output->m_nextBuffer != queued) {
+            // present() does not free the buffer on its early failures, e.g. when the output got
+            // switched off, and nobody else holds it: a gbm surface would lose its buffer for good
+            delete queued;
+        }
+        output->m_queuedFrame = 0;
+    }
+    // each output drives its own repaint, other outputs keep their pending flips
+    Compositor *compositor = Compositor::self();
+    if (output->m_pageFlipPending && !backend->m_tripleBuffering) {
+        // triple buffering got disabled while a frame was queued, wait for its flip
+        if (compositor) {
+            compositor->frameTimeline()->mark(FrameTimeline::Stage::PageFlip, flippedFrame);
         }
+        return;
+    }
+    output->m_swapPending = false;
+    if (compositor) {
+        // with triple buffering this unblocks the output, a new frame can be queued
+        compositor->bufferSwapCompleteForScreen(backend->m_outputs.indexOf(output), flippedFrame);
     }
+    backend->scheduleCursor(output);
 }
 
 void DrmBackend::openDrm()
@@ -249,41 +295,7 @@ void DrmBackend::openDrm()
 
     // trying to activate Atomic Mode Setting (this means also Universal Planes)
     if (qEnvironmentVariableIsSet("KWIN_DRM_AMS")) {
-        if (drmSetClientCap(m_fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0) {
-            qCDebug(KWIN_DRM) << "Using Atomic Mode Setting.";
-            m_atomicModeSetting = true;
-
-            ScopedDrmPointer<drmModePlaneRes, &drmModeFreePlaneResources> planeResources(drmModeGetPlaneResources(m_fd));
-            if (!planeResources) {
-                qCWarning(KWIN_DRM) << "Failed to get plane resources. Falling back to legacy mode";
-                m_atomicModeSetting = false;
-            }
-
-            if (m_atomicModeSetting) {
-                qCDebug(KWIN_DRM) << "Number of planes:" << planeResources->count_planes;
-
-                // create the plane objects
-                for (unsigned int i = 0; i < planeResources->count_planes; ++i) {
-                    drmModePlane *kplane = drmModeGetPlane(m_fd, planeResources->planes[i]);
-                    DrmPlane *p = new DrmPlane(kplane->plane_id, m_fd);
-
-                    if (p->init()) {
-                        p->setPossibleCrtcs(kplane->possible_crtcs);
-                        p->setFormats(kplane->formats, kplane->count_formats);
-                        m_planes << p;
-                    } else {
-                        delete p;
-                    }
-                }
-
-                if (m_planes.isEmpty()) {
-                    qCWarning(KWIN_DRM) << "Failed to create any plane. Falling back to legacy mode";
-                    m_atomicModeSetting = false;
-                }
-            }
-        } else {
-            qCWarning(KWIN_DRM) << "drmSetClientCap for Atomic Mode Setting failed. Using legacy mode.";
-        }
+        initAtomicModeSetting();
     }
 
     queryResources();
@@ -324,6 +336,45 @@ void DrmBackend::openDrm()
     initCursor();
 }
 
+void DrmBackend::initAtomicModeSetting()
+{
+    if (drmSetClientCap(m_fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0) {
+        qCDebug(KWIN_DRM) << "Using Atomic Mode Setting.";
+        m_atomicModeSetting = true;
+
+        ScopedDrmPointer<drmModePlaneRes, &drmModeFreePlaneResources> planeResources(drmModeGetPlaneResources(m_fd));
+        if (!planeResources) {
+            qCWarning(KWIN_DRM) << "Failed to get plane resources. Falling back to legacy mode";
+            m_atomicModeSetting = false;
+        }
+
+        if (m_atomicModeSetting) {
+            qCDebug(KWIN_DRM) << "Number of planes:" << planeResources->count_planes;
+
+            // create the plane objects
+            for (unsigned int i = 0; i < planeResources->count_planes; ++i) {
+                drmModePlane *kplane = drmModeGetPlane(m_fd, planeResources->planes[i]);
+                DrmPlane *p = new DrmPlane(kplane->plane_id, m_fd);
+
+                if (p->init()) {
+                    p->setPossibleCrtcs(kplane->possible_crtcs);
+                    p->setFormats(kplane->formats, kplane->count_formats);
+                    m_planes << p;
+                } else {
+                    delete p;
+                }
+            }
+
+            if (m_planes.isEmpty()) {
+                qCWarning(KWIN_DRM) << "Failed to create any plane. Falling back to legacy mode";
+                m_atomicModeSetting = false;
+            }
+        }
+    } else {
+        qCWarning(KWIN_DRM) << "drmSetClientCap for Atomic Mode Setting failed. Using legacy mode.";
+    }
+}
+
 void DrmBackend::queryResources()
 {
     if (m_fd < 0) {
@@ -353,7 +404,8 @@ void DrmBackend::queryResources()
             continue;
         }
         bool crtcFound = false;
-        const quint32 crtcId = findCrtc(resources.data(), connector.data(), &crtcFound);
+        // the outputs created in this pass are not in m_outputs yet
+        const quint32 crtcId = findCrtc(resources.data(), connector.data(), m_outputs + connectedOutputs, &crtcFound);
         if (!crtcFound) {
             continue;
         }
@@ -500,14 +552,14 @@ DrmOutput *DrmBackend::findOutput(const QByteArray &uuid)
     return nullptr;
 }
 
-quint32 DrmBackend::findCrtc(drmModeRes *res, drmModeConnector *connector, bool *ok)
+quint32 DrmBackend::findCrtc(drmModeRes *res, drmModeConnector *connector, const QVector<DrmOutput*> &outputs, bool *ok)
 {
     if (ok) {
         *ok = false;
     }
     ScopedDrmPointer<_drmModeEncoder, &drmModeFreeEncoder> encoder(drmModeGetEncoder(m_fd, connector->encoder_id));
     if (encoder) {
-        if (!crtcIsUsed(encoder->crtc_id)) {
+        if (!crtcIsUsed(encoder->crtc_id, outputs)) {
             if (ok) {
                 *ok = true;
             }
@@ -524,7 +576,7 @@ quint32 DrmBackend::findCrtc(drmModeRes *res, drmModeConnector *connector, bool
             if (!(encoder->possible_crtcs & (1 << j))) {
                 continue;
             }
-            if (!crtcIsUsed(res->crtcs[j])) {
+            if (!crtcIsUsed(res->crtcs[j], outputs)) {
                 if (ok) {
                     *ok = true;
                 }
@@ -535,22 +587,115 @@ quint32 DrmBackend::findCrtc(drmModeRes *res, drmModeConnector *connector, bool
     return 0;
 }
 
-bool DrmBackend::crtcIsUsed(quint32 crtc)
+bool DrmBackend::crtcIsUsed(quint32 crtc, const QVector<DrmOutput*> &outputs)
 {
-    auto it = std::find_if(m_outputs.constBegin(), m_outputs.constEnd(),
+    auto it = std::find_if(outputs.constBegin(), outputs.constEnd(),
         [crtc] (DrmOutput *o) {
             return o->m_crtcId == crtc;
         }
     );
-    return it != m_outputs.constEnd();
+    return it != outputs.constEnd();
 }
 
-void DrmBackend::present(DrmBuffer *buffer, DrmOutput *output)
+bool DrmBackend::present(DrmBuffer *buffer, DrmOutput *output)
 {
-    if (output->present(buffer)) {
-        m_pageFlipsPending++;
-        if (m_pageFlipsPending == 1 && Compositor::self()) {
-            Compositor::self()->aboutToSwapBuffers();
+    Compositor *compositor = Compositor::self();
+    const quint64 frame = compositor ? compositor->frameTimeline()->currentFrame() : 0;
+    if (m_tripleBuffering && output->m_pageFlipPending) {
+        // a frame which never got flipped is replaced by the newer one
+        delete output->m_queuedBuffer;
+        output->m_queuedBuffer = buffer;
+        output->m_queuedFrame = frame;
+        blockOutput(output);
+        if (compositor) {
+            compositor->frameTimeline()->markQueued();
+        }
+        return true;
+    }
+    if (!output->present(buffer)) {
+        return false;
+    }
+    pageFlipQueued(output, frame);
+    return true;
+}
+
+bool DrmBackend::canPresent(DrmOutput *output) const
+{
+    if (m_tripleBuffering && output->m_pageFlipPending) {
+        return true;
+    }
+    return output->canPresent();
+}
+
+void DrmBackend::presentCursor(DrmOutput *output)
+{
+    if (output->presentCursor()) {
+        // the screen waits for the cursor like for any other flip
+        pageFlipQueued(output, 0);
+    }
+}
+
+void DrmBackend::scheduleCursor(DrmOutput *output)
+{
+    if (!output->m_cursorDirty || output->m_pageFlipPending) {
+        // the page flip handler picks the cursor up
+        return;
+    }
+    Compositor *compositor = Compositor::self();
+    if (compositor && compositor->isCompositingScheduled()) {
+        // let the next frame take the cursor along, unless it does not touch this output
+        if (!output->m_cursorTimer->isActive()) {
+            output->m_cursorTimer->start(qMax(1, 1000000 / qMax(1, output->currentRefreshRate())));
+        }
+        return;
+    }
+    presentCursor(output);
+}
+
+void DrmBackend::presentCursors()
+{
+    for (auto it = m_outputs.constBegin(); it != m_outputs.constEnd(); ++it) {
+        scheduleCursor(*it);
+    }
+}
+
+void DrmBackend::pageFlipQueued(DrmOutput *output, quint64 frame)
+{
+    m_pageFlipsPending++;
+    output->m_pageFlipPending = true;
+    output->m_pendingFrame = frame;
+    if (!m_tripleBuffering) {
+        blockOutput(output);
+    }
+}
+
+void DrmBackend::blockOutput(DrmOutput *output)
+{
+    if (output->m_swapPending) {
+        return;
+    }
+    output->m_swapPending = true;
+    if (Compositor::self()) {
+        Compositor::self()->aboutToSwapBuffersForScreen(m_outputs.indexOf(output));
+    }
+}
+
+void DrmBackend::setTripleBuffering(bool enable)
+{
+    if (m_tripleBuffering == enable) {
+        return;
+    }
+    m_tripleBuffering = enable;
+    if (Compositor::self()) {
+        Compositor::self()->frameTimeline()->setBufferCount(enable ? 3 : 2);
+    }
+    if (enable) {
+        return;
+    }
+    // with double buffering an output is blocked for as long as its page flip is pending
+    for (auto it = m_outputs.constBegin(); it != m_outputs.constEnd(); ++it) {
+        if ((*it)->m_pageFlipPending) {
+            blockOutput(*it);
         }
     }
 }
@@ -571,6 +716,7 @@ void DrmBackend::initCursor()
                     (*it)->hideCursor();
                 }
             }
+            presentCursors();
         }
     );
     uint64_t capability = 0;
@@ -586,7 +732,8 @@ void DrmBackend::initCursor()
         cursorSize.setHeight(64);
     }
     auto createCursor = [this, cursorSize] (int index) {
-        m_cursor[index] = createBuffer(cursorSize);
+        // the cursor plane blends with the alpha channel
+        m_cursor[index] = createBuffer(cursorSize, DRM_FORMAT_ARGB8888);
         if (!m_cursor[index]->map(QImage::Format_ARGB32_Premultiplied)) {
             return false;
         }
@@ -651,8 +798,10 @@ void DrmBackend::doHideCursor()
     for (auto it = m_outputs.constBegin(); it != m_outputs.constEnd(); ++it) {
         (*it)->hideCursor();
     }
+    presentCursors();
 }
 
+// with cursor planes this also schedules the commit of the buffer set in setCursor
 void DrmBackend::moveCursor()
 {
     const QPoint p = Cursor::pos() - softwareCursorHotspot();
@@ -662,6 +811,7 @@ void DrmBackend::moveCursor()
     for (auto it = m_outputs.constBegin(); it != m_outputs.constEnd(); ++it) {
         (*it)->moveCursor(p);
     }
+    presentCursors();
 }
 
 Screens *DrmBackend::createScreens(QObject *parent)
@@ -685,7 +835,12 @@ OpenGLBackend *DrmBackend::createOpenGLBackend()
 
 DrmBuffer *DrmBackend::createBuffer(const QSize &size)
 {
-    DrmBuffer *b = new DrmBuffer(this, size);
+    return createBuffer(size, DRM_FORMAT_XRGB8888);
+}
+
+DrmBuffer *DrmBackend::createBuffer(const QSize &size, quint32 format)
+{
+    DrmBuffer *b = new DrmBuffer(this, size, format);
     m_buffers << b;
     return b;
 }
@@ -702,6 +857,23 @@ DrmBuffer *DrmBackend::createBuffer(gbm_surface *surface)
 #endif
 }
 
+DrmBuffer *DrmBackend::createBuffer(KWayland::Server::BufferInterface *clientBuffer)
+{
+#if HAVE_GBM
+    DrmBuffer *b = new DrmBuffer(this, clientBuffer);
+    m_buffers << b;
+    if (!b->bufferId()) {
+        delete b;
+        return nullptr;
+    }
+    b->m_deleteAfterPageFlip = true;
+    return b;
+#else
+    Q_UNUSED(clientBuffer)
+    return nullptr;
+#endif
+}
+
 void DrmBackend::bufferDestroyed(DrmBuffer *b)
 {
     m_buffers.removeAll(b);
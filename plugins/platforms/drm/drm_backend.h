@@ -40,6 +40,7 @@ namespace KWayland
 {
 namespace Server
 {
+class BufferInterface;
 class OutputInterface;
 class OutputDeviceInterface;
 class OutputChangeSet;
@@ -73,8 +74,30 @@ public:
 
     void init() override;
     DrmBuffer *createBuffer(const QSize &size);
+    /**
+     * Creates a dumb buffer with the DRM fourcc @p format, e.g. DRM_FORMAT_ARGB8888 for cursors.
+     **/
+    DrmBuffer *createBuffer(const QSize &size, quint32 format);
     DrmBuffer *createBuffer(gbm_surface *surface);
-    void present(DrmBuffer *buffer, DrmOutput *output);
+    /**
+     * Imports @p clientBuffer for direct scanout.
+     * @returns the buffer or @c null if the client buffer cannot be scanned out
+     **/
+    DrmBuffer *createBuffer(KWayland::Server::BufferInterface *clientBuffer);
+    /**
+     * Presents @p buffer on @p output. With triple buffering a buffer presented while a page
+     * flip is pending gets queued and flipped once the pending flip completed, only then the
+     * compositor is blocked for @p output.
+     **/
+    bool present(DrmBuffer *buffer, DrmOutput *output);
+    /**
+     * Whether present() takes a buffer for @p output now, either flipping or queueing it.
+     **/
+    bool canPresent(DrmOutput *output) const;
+    /**
+     * Commits the pending cursor changes of @p output on its own, if it has a cursor plane.
+     **/
+    void presentCursor(DrmOutput *output);
 
     int fd() const {
         return m_fd;
@@ -105,6 +128,15 @@ public:
         return m_gbmDevice;
     }
 
+    /**
+     * Whether a frame may be queued behind a pending page flip. Only the gbm based OpenGL
+     * backend enables it, the dumb buffers of the QPainter backend are double buffered.
+     **/
+    void setTripleBuffering(bool enable);
+    bool tripleBuffering() const {
+        return m_tripleBuffering;
+    }
+
 public Q_SLOTS:
     void turnOutputsOn();
 
@@ -118,8 +150,25 @@ protected:
     void doShowCursor() override;
 
 private:
+    friend class DrmHarness;
     static void pageFlipHandler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *data);
+    /**
+     * @param frame the FrameTimeline sequence of the presented frame, @c 0 for cursor updates
+     **/
+    void pageFlipQueued(DrmOutput *output, quint64 frame);
+    void blockOutput(DrmOutput *output);
+    /**
+     * Commits the pending cursor changes of @p output, unless a scheduled frame can take them
+     * along. Then they are only committed on their own if that frame does not touch @p output.
+     **/
+    void scheduleCursor(DrmOutput *output);
+    void presentCursors();
     void openDrm();
+    /**
+     * Switches the device to atomic mode setting and creates the plane objects, stays with
+     * legacy mode setting if that fails.
+     **/
+    void initAtomicModeSetting();
     void activate(bool active);
     void reactivate();
     void deactivate();
@@ -128,8 +177,11 @@ private:
     void updateCursor();
     void moveCursor();
     void initCursor();
-    quint32 findCrtc(drmModeRes *res, drmModeConnector *connector, bool *ok = nullptr);
-    bool crtcIsUsed(quint32 crtc);
+    /**
+     * Finds a CRTC for @p connector which none of @p outputs drives.
+     **/
+    quint32 findCrtc(drmModeRes *res, drmModeConnector *connector, const QVector<DrmOutput*> &outputs, bool *ok = nullptr);
+    bool crtcIsUsed(quint32 crtc, const QVector<DrmOutput*> &outputs);
     void outputDpmsChanged();
     void readOutputsConfiguration();
     QByteArray generateOutputConfigurationUuid() const;
@@ -145,6 +197,7 @@ private:
     bool m_cursorEnabled = false;
     int m_cursorIndex = 0;
     int m_pageFlipsPending = 0;
+    bool m_tripleBuffering = false;
     bool m_active = false;
     QVector<DrmBuffer*> m_buffers;
     // all available planes: primarys, cursors and overlays
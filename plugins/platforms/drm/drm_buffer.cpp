@@ -22,11 +22,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "logging.h"
 
+// KWayland
+#include <KWayland/Server/buffer_interface.h>
 // system
 #include <sys/mman.h>
 #include <errno.h>
 // drm
 #include <xf86drm.h>
+#include <libdrm/drm_fourcc.h>
 #if HAVE_GBM
 #include <gbm.h>
 #endif
@@ -35,7 +38,7 @@ namespace KWin
 {
 
 
-DrmBuffer::DrmBuffer(DrmBackend *backend, const QSize &size)
+DrmBuffer::DrmBuffer(DrmBackend *backend, const QSize &size, quint32 format)
     : m_backend(backend)
     , m_size(size)
 {
@@ -51,9 +54,13 @@ DrmBuffer::DrmBuffer(DrmBackend *backend, const QSize &size)
     m_handle = createArgs.handle;
     m_bufferSize = createArgs.size;
     m_stride = createArgs.pitch;
-    if (drmModeAddFB(m_backend->fd(), size.width(), size.height(), 24, 32,
-                     m_stride, createArgs.handle, &m_bufferId) != 0) {
-        qCWarning(KWIN_DRM) << "drmModeAddFB failed with errno" << errno;
+    // drmModeAddFB only knows depth and bpp, which is XRGB8888 for 24/32 and drops the alpha
+    const uint32_t handles[4] = {m_handle, 0, 0, 0};
+    const uint32_t pitches[4] = {m_stride, 0, 0, 0};
+    const uint32_t offsets[4] = {0, 0, 0, 0};
+    if (drmModeAddFB2(m_backend->fd(), size.width(), size.height(), format,
+                      handles, pitches, offsets, &m_bufferId, 0) != 0) {
+        qCWarning(KWIN_DRM) << "drmModeAddFB2 failed with errno" << errno;
     }
 }
 
@@ -91,9 +98,42 @@ DrmBuffer::DrmBuffer(DrmBackend *backend, gbm_surface *surface)
 #endif
 }
 
+DrmBuffer::DrmBuffer(DrmBackend *backend, KWayland::Server::BufferInterface *clientBuffer)
+    : m_backend(backend)
+{
+#if HAVE_GBM
+    // only buffers shared through wl_drm can be imported, shared memory would need a copy
+    m_bo = gbm_bo_import(m_backend->gbmDevice(), GBM_BO_IMPORT_WL_BUFFER, clientBuffer->resource(), GBM_BO_USE_SCANOUT);
+    if (!m_bo) {
+        qCDebug(KWIN_DRM) << "Importing client buffer for scanout failed";
+        return;
+    }
+    const quint32 format = gbm_bo_get_format(m_bo);
+    if (format != GBM_FORMAT_XRGB8888 && format != GBM_FORMAT_ARGB8888) {
+        qCDebug(KWIN_DRM) << "Client buffer format" << format << "cannot be scanned out";
+        return;
+    }
+    m_size = QSize(gbm_bo_get_width(m_bo), gbm_bo_get_height(m_bo));
+    m_stride = gbm_bo_get_stride(m_bo);
+    if (drmModeAddFB(m_backend->fd(), m_size.width(), m_size.height(), 24, 32, m_stride, gbm_bo_get_handle(m_bo).u32, &m_bufferId) != 0) {
+        qCDebug(KWIN_DRM) << "drmModeAddFB for client buffer failed";
+        m_bufferId = 0;
+        return;
+    }
+    // keep the client from reusing the buffer while it is on screen
+    m_clientBuffer = clientBuffer;
+    m_clientBuffer->ref();
+#else
+    Q_UNUSED(clientBuffer)
+#endif
+}
+
 DrmBuffer::~DrmBuffer()
 {
     m_backend->bufferDestroyed(this);
+    if (m_clientBuffer) {
+        m_clientBuffer->unref();
+    }
     delete m_image;
     if (m_memory) {
         munmap(m_memory, m_bufferSize);
@@ -133,7 +173,12 @@ void DrmBuffer::releaseGbm()
 {
 #if HAVE_GBM
     if (m_bo) {
-        gbm_surface_release_buffer(m_surface, m_bo);
+        if (m_surface) {
+            gbm_surface_release_buffer(m_surface, m_bo);
+        } else {
+            // imported for direct scanout
+            gbm_bo_destroy(m_bo);
+        }
         m_bo = nullptr;
     }
 #endif
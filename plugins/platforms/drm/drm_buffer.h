@@ -21,11 +21,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define KWIN_DRM_BUFFER_H
 
 #include <QImage>
+#include <QPointer>
 #include <QSize>
 
 struct gbm_bo;
 struct gbm_surface;
 
+namespace KWayland
+{
+namespace Server
+{
+class BufferInterface;
+}
+}
+
 namespace KWin
 {
 
@@ -58,6 +67,12 @@ public:
     bool isGbm() const {
         return m_bo != nullptr;
     }
+    /**
+     * The client buffer which got imported for direct scanout, if any.
+     **/
+    KWayland::Server::BufferInterface *clientBuffer() const {
+        return m_clientBuffer.data();
+    }
     bool deleteAfterPageFlip() const {
         return m_deleteAfterPageFlip;
     }
@@ -66,8 +81,9 @@ public:
 
 private:
     friend class DrmBackend;
-    DrmBuffer(DrmBackend *backend, const QSize &size);
+    DrmBuffer(DrmBackend *backend, const QSize &size, quint32 format);
     DrmBuffer(DrmBackend *backend, gbm_surface *surface);
+    DrmBuffer(DrmBackend *backend, KWayland::Server::BufferInterface *clientBuffer);
     DrmBackend *m_backend;
     gbm_surface *m_surface = nullptr;
     gbm_bo *m_bo = nullptr;
@@ -79,6 +95,7 @@ private:
     void *m_memory = nullptr;
     QImage *m_image = nullptr;
     bool m_deleteAfterPageFlip = false;
+    QPointer<KWayland::Server::BufferInterface> m_clientBuffer;
 };
 
 }
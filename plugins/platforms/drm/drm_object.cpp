@@ -59,6 +59,10 @@ void DrmObject::initProp(int n, drmModeObjectProperties *properties, QVector<QBy
 void DrmObject::setPropValue(int index, uint64_t new_value)
 {
     Q_ASSERT(index < m_props.size());
+    if (m_props[index]->value() != new_value) {
+        // the kernel does not know the new value yet
+        m_propsValid &= ~(1U << index);
+    }
     m_props[index]->setValue(new_value);
     return;
 }
@@ -132,7 +132,7 @@ void DrmPlane::setFormats(uint32_t const *f, int fcount)
 {
     m_formats.resize(fcount);
     for (int i = 0; i < fcount; i++) {
-        m_formats[i] = *f;
+        m_formats[i] = f[i];
     }
 }
 
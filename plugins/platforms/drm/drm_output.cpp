@@ -47,6 +47,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // drm
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include <libdrm/drm_fourcc.h>
 #include <libdrm/drm_mode.h>
 
 
@@ -56,13 +57,21 @@ namespace KWin
 DrmOutput::DrmOutput(DrmBackend *backend)
     : QObject()
     , m_backend(backend)
+    , m_cursorTimer(new QTimer(this))
 {
+    m_cursorTimer->setSingleShot(true);
+    connect(m_cursorTimer, &QTimer::timeout, this,
+        [this] {
+            m_backend->presentCursor(this);
+        }
+    );
 }
 
 DrmOutput::~DrmOutput()
 {
     hideCursor();
     cleanupBlackBuffer();
+    delete m_queuedBuffer;
     delete m_crtc;
     delete m_conn;
     delete m_waylandOutput.data();
@@ -71,6 +80,11 @@ DrmOutput::~DrmOutput()
 
 void DrmOutput::hideCursor()
 {
+    if (m_cursorPlane) {
+        m_cursorBuffer = nullptr;
+        m_cursorDirty = true;
+        return;
+    }
     drmModeSetCursor(m_backend->fd(), m_crtcId, 0, 0, 0);
 }
 
@@ -84,6 +98,11 @@ void DrmOutput::restoreSaved()
 
 void DrmOutput::showCursor(DrmBuffer *c)
 {
+    if (m_cursorPlane) {
+        m_cursorBuffer = c;
+        m_cursorDirty = true;
+        return;
+    }
     const QSize &s = c->size();
     drmModeSetCursor(m_backend->fd(), m_crtcId, c->handle(), s.width(), s.height());
 }
@@ -91,9 +110,101 @@ void DrmOutput::showCursor(DrmBuffer *c)
 void DrmOutput::moveCursor(const QPoint &globalPos)
 {
     const QPoint p = globalPos - m_globalPos;
+    if (m_cursorPlane) {
+        if (m_cursorPos != p) {
+            m_cursorPos = p;
+            m_cursorDirty = m_cursorDirty || m_cursorBuffer;
+        }
+        return;
+    }
     drmModeMoveCursor(m_backend->fd(), m_crtcId, p.x(), p.y());
 }
 
+bool DrmOutput::presentCursor()
+{
+    if (!m_cursorPlane || !m_cursorDirty || m_pageFlipPending) {
+        return false;
+    }
+    m_cursorTimer->stop();
+    if (!LogindIntegration::self()->isActiveSession() || m_dpmsMode != DpmsMode::On) {
+        return false;
+    }
+    if (!m_primaryPlane->current()) {
+        // the cursor gets committed with the mode set
+        return false;
+    }
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        qCWarning(KWIN_DRM) << "DRM: couldn't allocate atomic request";
+        return false;
+    }
+    if (!atomicReqCursorPopulate(req)) {
+        drmModeAtomicFree(req);
+        fallbackToLegacyCursor();
+        return false;
+    }
+    // only touches the cursor plane, no composition involved
+    if (drmModeAtomicCommit(m_backend->fd(), req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, this)) {
+        qCWarning(KWIN_DRM) << "Atomic cursor request failed to commit:" << strerror(errno);
+        drmModeAtomicFree(req);
+        fallbackToLegacyCursor();
+        return false;
+    }
+    drmModeAtomicFree(req);
+    m_cursorDirty = false;
+    return true;
+}
+
+bool DrmOutput::atomicReqCursorPopulate(drmModeAtomicReq *req)
+{
+    // the whole state is small, always send it
+    m_cursorPlane->setPropsValid(0);
+    m_cursorPlane->setPropsPending(0);
+    bool ret = true;
+    auto add = [this, req, &ret] (DrmPlane::PropertyIndex index, uint64_t value) {
+        ret &= m_cursorPlane->atomicAddProperty(req, int(index), value);
+        m_cursorPlane->setPropValue(int(index), value);
+    };
+    if (m_cursorBuffer) {
+        const QSize &s = m_cursorBuffer->size();
+        add(DrmPlane::PropertyIndex::FbId, m_cursorBuffer->bufferId());
+        add(DrmPlane::PropertyIndex::CrtcId, m_crtc->id());
+        add(DrmPlane::PropertyIndex::SrcX, 0);
+        add(DrmPlane::PropertyIndex::SrcY, 0);
+        add(DrmPlane::PropertyIndex::SrcW, s.width() << 16);
+        add(DrmPlane::PropertyIndex::SrcH, s.height() << 16);
+        // the position is signed
+        add(DrmPlane::PropertyIndex::CrtcX, uint64_t(qint64(m_cursorPos.x())));
+        add(DrmPlane::PropertyIndex::CrtcY, uint64_t(qint64(m_cursorPos.y())));
+        add(DrmPlane::PropertyIndex::CrtcW, s.width());
+        add(DrmPlane::PropertyIndex::CrtcH, s.height());
+    } else {
+        add(DrmPlane::PropertyIndex::FbId, 0);
+        add(DrmPlane::PropertyIndex::CrtcId, 0);
+    }
+    if (!ret) {
+        qCWarning(KWIN_DRM) << "Failed to populate atomic cursor plane" << m_cursorPlane->id();
+    }
+    return ret;
+}
+
+void DrmOutput::fallbackToLegacyCursor()
+{
+    qCWarning(KWIN_DRM) << "Cursor plane" << m_cursorPlane->id() << "failed, using legacy cursor on CRTC" << m_crtcId;
+    m_cursorPlane->setOutput(nullptr);
+    m_cursorPlane = nullptr;
+    m_cursorDirty = false;
+    m_cursorTimer->stop();
+    DrmBuffer *c = m_cursorBuffer;
+    m_cursorBuffer = nullptr;
+    if (c) {
+        showCursor(c);
+        drmModeMoveCursor(m_backend->fd(), m_crtcId, m_cursorPos.x(), m_cursorPos.y());
+    } else {
+        hideCursor();
+    }
+}
+
 QSize DrmOutput::size() const
 {
     return QSize(m_mode.hdisplay, m_mode.vdisplay);
@@ -168,6 +279,10 @@ bool DrmOutput::init(drmModeConnector *connector)
         if (!initPrimaryPlane()) {
             return false;
         }
+        if (!initCursorPlane()) {
+            qCDebug(KWIN_DRM) << "No cursor plane, using legacy cursor on CRTC" << m_crtcId;
+        }
+        initOverlayPlanes();
     }
     m_savedCrtc.reset(drmModeGetCrtc(m_backend->fd(), m_crtcId));
     if (!blank()) {
@@ -501,7 +616,7 @@ bool DrmOutput::initPrimaryPlane()
     return false;
 }
 
-bool DrmOutput::initCursorPlane()       // TODO: Add call in init (but needs layer support in general first)
+bool DrmOutput::initCursorPlane()
 {
     for (int i = 0; i < m_backend->planes().size(); ++i) {
         DrmPlane* p = m_backend->planes()[i];
@@ -520,6 +635,10 @@ bool DrmOutput::initCursorPlane()       // TODO: Add call in init (but needs lay
         if (!p->isCrtcSupported(m_crtcId)) {
             continue;
         }
+        // the cursor buffers are created with alpha
+        if (!p->formats().contains(DRM_FORMAT_ARGB8888)) {
+            continue;
+        }
         p->setOutput(this);
         m_cursorPlane = p;
         qCDebug(KWIN_DRM) << "Initialized cursor plane" << p->id() << "on CRTC" << m_crtcId;
@@ -528,6 +647,24 @@ bool DrmOutput::initCursorPlane()       // TODO: Add call in init (but needs lay
     return false;
 }
 
+void DrmOutput::initOverlayPlanes()
+{
+    for (DrmPlane *p : m_backend->planes()) {
+        if (p->type() != DrmPlane::TypeIndex::Overlay) {
+            continue;
+        }
+        // the planes are always added as XRGB8888 framebuffers
+        if (!p->formats().contains(DRM_FORMAT_XRGB8888)) {
+            continue;
+        }
+        if (!p->isCrtcSupported(m_crtcId)) {
+            continue;
+        }
+        m_overlayPlanes << p;
+    }
+    qCDebug(KWIN_DRM) << "Found" << m_overlayPlanes.count() << "overlay planes for CRTC" << m_crtcId;
+}
+
 void DrmOutput::initDpms(drmModeConnector *connector)
 {
     for (int i = 0; i < connector->count_props; ++i) {
@@ -685,6 +822,13 @@ void DrmOutput::pageFlipped()
 
 void DrmOutput::pageFlippedBufferRemover(DrmBuffer *oldbuffer, DrmBuffer *newbuffer)
 {
+    if (!newbuffer) {
+        // an overlay plane got disabled
+        if (oldbuffer && oldbuffer->deleteAfterPageFlip()) {
+            delete oldbuffer;
+        }
+        return;
+    }
     if (newbuffer->deleteAfterPageFlip()) {
         if ( oldbuffer && oldbuffer != newbuffer ) {
             delete oldbuffer;
@@ -730,6 +874,140 @@ bool DrmOutput::present(DrmBuffer *buffer)
     }
 }
 
+bool DrmOutput::canPresent() const
+{
+    if (!LogindIntegration::self()->isActiveSession() || m_dpmsMode != DpmsMode::On) {
+        return false;
+    }
+    if (m_backend->atomicModeSetting()) {
+        return !m_primaryPlane->next() && !m_pageFlipPending;
+    }
+    return !m_nextBuffer;
+}
+
+bool DrmOutput::presentsWithoutModeset(DrmBuffer *buffer) const
+{
+    if (buffer->size() != size()) {
+        return false;
+    }
+    if (m_backend->atomicModeSetting()) {
+        return m_primaryPlane->current() != nullptr;
+    }
+    return m_lastStride == buffer->stride() && m_lastGbm == buffer->isGbm();
+}
+
+QRegion DrmOutput::assignOverlays(const QVector<QPair<KWayland::Server::BufferInterface*, QRect>> &candidates)
+{
+    QRegion covered;
+    // a frame queued behind the pending flip gets composited completely
+    if (m_pageFlipPending) {
+        return covered;
+    }
+    // forget the assignment of the last frame, the planes keep showing their current buffer
+    QVector<DrmPlane*> free;
+    for (DrmPlane *p : qAsConst(m_overlayPlanes)) {
+        if (p->output() == this) {
+            if (p->next() && p->next() != p->current()) {
+                delete p->next();
+            }
+            p->setNext(nullptr);
+            if (!p->current()) {
+                p->setOutput(nullptr);
+            }
+        }
+        if (!p->output() || p->output() == this) {
+            free << p;
+        }
+    }
+    if (!m_backend->atomicModeSetting() || !m_primaryPlane->current()) {
+        return covered;
+    }
+    const QRect outputRect(m_globalPos, size());
+    QVector<DrmPlane*> assigned;
+    for (const auto &candidate : candidates) {
+        if (free.isEmpty()) {
+            break;
+        }
+        const QRect &geometry = candidate.second;
+        if (!outputRect.contains(geometry)) {
+            continue;
+        }
+        // keep a plane which already shows the buffer
+        auto it = std::find_if(free.begin(), free.end(),
+            [&candidate] (DrmPlane *p) {
+                return p->current() && p->current()->clientBuffer() == candidate.first;
+            }
+        );
+        DrmBuffer *buffer = it != free.end() ? (*it)->current() : m_backend->createBuffer(candidate.first);
+        if (!buffer || buffer->size() != geometry.size()) {
+            if (buffer && it == free.end()) {
+                delete buffer;
+            }
+            continue;
+        }
+        // a shown buffer must not move, its old plane would release it after the flip
+        const QVector<DrmPlane*> tries = it != free.end() ? QVector<DrmPlane*>{*it} : free;
+        DrmPlane *plane = nullptr;
+        for (DrmPlane *p : tries) {
+            DrmOutput *previousOutput = p->output();
+            p->setOutput(this);
+            p->setNext(buffer);
+            p->setPropValue(int(DrmPlane::PropertyIndex::SrcX), 0);
+            p->setPropValue(int(DrmPlane::PropertyIndex::SrcY), 0);
+            p->setPropValue(int(DrmPlane::PropertyIndex::SrcW), buffer->size().width() << 16);
+            p->setPropValue(int(DrmPlane::PropertyIndex::SrcH), buffer->size().height() << 16);
+            p->setPropValue(int(DrmPlane::PropertyIndex::CrtcX), geometry.x() - m_globalPos.x());
+            p->setPropValue(int(DrmPlane::PropertyIndex::CrtcY), geometry.y() - m_globalPos.y());
+            p->setPropValue(int(DrmPlane::PropertyIndex::CrtcW), geometry.width());
+            p->setPropValue(int(DrmPlane::PropertyIndex::CrtcH), geometry.height());
+            p->setPropValue(int(DrmPlane::PropertyIndex::CrtcId), m_crtc->id());
+            if (testOverlays(assigned + QVector<DrmPlane*>{p})) {
+                plane = p;
+                break;
+            }
+            p->setNext(nullptr);
+            p->setOutput(p->current() ? previousOutput : nullptr);
+        }
+        if (!plane) {
+            if (it == free.end()) {
+                delete buffer;
+            }
+            continue;
+        }
+        free.removeOne(plane);
+        assigned << plane;
+        covered |= geometry;
+    }
+    return covered;
+}
+
+bool DrmOutput::testOverlays(const QVector<DrmPlane*> &planes)
+{
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        return false;
+    }
+    bool ok = true;
+    for (DrmPlane *p : planes) {
+        // test the whole state, the real commit sends it again
+        p->setPropsValid(0);
+        ok = ok && p->atomicReqPlanePopulate(req) != DrmObject::AtomicReturn::Error;
+        p->setPropsPending(0);
+    }
+    ok = ok && drmModeAtomicCommit(m_backend->fd(), req, DRM_MODE_ATOMIC_TEST_ONLY, nullptr) == 0;
+    drmModeAtomicFree(req);
+    return ok;
+}
+
+bool DrmOutput::overlaysChanged() const
+{
+    return std::any_of(m_overlayPlanes.constBegin(), m_overlayPlanes.constEnd(),
+        [this] (DrmPlane *p) {
+            return p->output() == this && p->next() != p->current();
+        }
+    );
+}
+
 bool DrmOutput::presentAtomically(DrmBuffer *buffer)
 {
     if (!LogindIntegration::self()->isActiveSession()) {
@@ -740,7 +1018,7 @@ bool DrmOutput::presentAtomically(DrmBuffer *buffer)
         qCWarning(KWIN_DRM) << "No present() while screen off.";
         return false;
     }
-    if (m_primaryPlane->next()) {
+    if (m_primaryPlane->next() || m_pageFlipPending) {
         qCWarning(KWIN_DRM) << "Page not yet flipped.";
         return false;
     }
@@ -782,7 +1060,7 @@ bool DrmOutput::presentAtomically(DrmBuffer *buffer)
                                                 // i.e.: Assign planes
     bool anyDamage = false;
     foreach (DrmPlane* p, m_backend->planes()){
-        if (p->output() != this) {
+        if (p->output() != this || p == m_cursorPlane) {
             continue;
         }
         ret = p->atomicReqPlanePopulate(req);
@@ -812,7 +1090,24 @@ bool DrmOutput::presentAtomically(DrmBuffer *buffer)
         m_planesFlipList << m_primaryPlane;
     }
 
-    if (drmModeAtomicCommit(m_backend->fd(), req, flags, this)) {
+    // pending cursor changes go with the frame, a failing cursor must not take the frame down
+    const int withoutCursor = drmModeAtomicGetCursor(req);
+    bool cursorDirty = m_cursorPlane && m_cursorDirty;
+    if (cursorDirty && !atomicReqCursorPopulate(req)) {
+        drmModeAtomicSetCursor(req, withoutCursor);
+        fallbackToLegacyCursor();
+        cursorDirty = false;
+    }
+
+    bool committed = drmModeAtomicCommit(m_backend->fd(), req, flags, this) == 0;
+    if (!committed && cursorDirty) {
+        qCWarning(KWIN_DRM) << "Atomic request with cursor failed to commit:" << strerror(errno);
+        drmModeAtomicSetCursor(req, withoutCursor);
+        fallbackToLegacyCursor();
+        cursorDirty = false;
+        committed = drmModeAtomicCommit(m_backend->fd(), req, flags, this) == 0;
+    }
+    if (!committed) {
         qCWarning(KWIN_DRM) << "Atomic request failed to commit:" << strerror(errno);
         drmModeAtomicFree(req);
         m_primaryPlane->setNext(nullptr);
@@ -828,6 +1123,10 @@ bool DrmOutput::presentAtomically(DrmBuffer *buffer)
     foreach (DrmPlane* p, m_planesFlipList) {
         p->setPropsValid(p->propsValid() | p->propsPending());
     }
+    if (cursorDirty) {
+        m_cursorDirty = false;
+        m_cursorTimer->stop();
+    }
 
     drmModeAtomicFree(req);
     return true;
@@ -883,11 +1182,13 @@ DrmObject::AtomicReturn DrmOutput::atomicReqModesetPopulate(drmModeAtomicReq *re
         m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::SrcH), m_mode.vdisplay << 16);
         m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::CrtcW), m_mode.hdisplay);
         m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::CrtcH), m_mode.vdisplay);
+        m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::CrtcId), m_crtc->id());
     } else {
         m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::SrcW), 0);
         m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::SrcH), 0);
         m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::CrtcW), 0);
         m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::CrtcH), 0);
+        m_primaryPlane->setPropValue(int(DrmPlane::PropertyIndex::CrtcId), 0);
     }
 
     bool ret = true;
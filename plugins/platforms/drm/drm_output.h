@@ -24,9 +24,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "drm_object.h"
 
 #include <QObject>
+#include <QPair>
 #include <QPoint>
 #include <QPointer>
+#include <QRegion>
 #include <QSize>
+#include <QTimer>
 #include <QVector>
 #include <xf86drmMode.h>
 
@@ -34,6 +37,7 @@ namespace KWayland
 {
 namespace Server
 {
+class BufferInterface;
 class OutputInterface;
 class OutputDeviceInterface;
 class OutputChangeSet;
@@ -61,11 +65,41 @@ public:
         QSize physicalSize;
     };
     virtual ~DrmOutput();
+    /**
+     * With a cursor plane the cursor changes are only remembered, they get committed together
+     * with the next present or by presentCursor.
+     **/
     void showCursor(DrmBuffer *buffer);
     void hideCursor();
     void moveCursor(const QPoint &globalPos);
+    /**
+     * Commits the pending changes of the cursor plane in an atomic request of their own.
+     * @returns @c true if a page flip event is pending for the request
+     **/
+    bool presentCursor();
     bool init(drmModeConnector *connector);
     bool present(DrmBuffer *buffer);
+    /**
+     * Whether present() can flip to a new buffer now. Some of its failures, e.g. an inactive
+     * session, leave the buffer with the caller or keep it.
+     **/
+    bool canPresent() const;
+    /**
+     * Whether presenting @p buffer is just a page flip, e.g. a buffer with another stride
+     * requires a mode set with legacy mode setting.
+     **/
+    bool presentsWithoutModeset(DrmBuffer *buffer) const;
+    /**
+     * Puts the client buffers of @p candidates, ordered top to bottom and each paired with its
+     * global geometry, on free overlay planes for the next present. Each assignment is checked
+     * with a test-only commit against the current state of the CRTC.
+     * @returns the region covered by the overlay planes
+     **/
+    QRegion assignOverlays(const QVector<QPair<KWayland::Server::BufferInterface*, QRect>> &candidates);
+    /**
+     * @returns Whether the next present changes what the overlay planes show.
+     **/
+    bool overlaysChanged() const;
     void pageFlipped();
     void restoreSaved();
     bool blank();
@@ -101,6 +135,7 @@ Q_SIGNALS:
 
 private:
     friend class DrmBackend;
+    friend class DrmHarness;
     DrmOutput(DrmBackend *backend);
     void cleanupBlackBuffer();
     bool presentAtomically(DrmBuffer *buffer);
@@ -115,7 +150,15 @@ private:
     void pageFlippedBufferRemover(DrmBuffer *oldbuffer, DrmBuffer *newbuffer);
     bool initPrimaryPlane();
     bool initCursorPlane();
+    void initOverlayPlanes();
+    bool testOverlays(const QVector<DrmPlane*> &planes);
     DrmObject::AtomicReturn atomicReqModesetPopulate(drmModeAtomicReq *req, bool enable);
+    bool atomicReqCursorPopulate(drmModeAtomicReq *req);
+    /**
+     * Releases the cursor plane after a failed commit and sets the current cursor through
+     * the legacy ioctls, the kernel drives the cursor plane itself then.
+     **/
+    void fallbackToLegacyCursor();
 
     DrmBackend *m_backend;
     QPoint m_globalPos;
@@ -127,6 +170,14 @@ private:
     DrmBuffer *m_currentBuffer = nullptr;
     DrmBuffer *m_nextBuffer = nullptr;
     DrmBuffer *m_blackBuffer = nullptr;
+    bool m_pageFlipPending = false;
+    // FrameTimeline sequence of the frame the pending page flip presents
+    quint64 m_pendingFrame = 0;
+    // with triple buffering the frame waiting for the pending page flip
+    DrmBuffer *m_queuedBuffer = nullptr;
+    quint64 m_queuedFrame = 0;
+    // whether the compositor is blocked for this output
+    bool m_swapPending = false;
     struct CrtcCleanup {
         static void inline cleanup(_drmModeCrtc *ptr) {
             drmModeFreeCrtc(ptr);       // TODO: Atomically? See compositor-drm.c l.3670
@@ -147,6 +198,14 @@ private:
     DrmPlane* m_primaryPlane = nullptr;
     DrmPlane* m_cursorPlane = nullptr;
     QVector<DrmPlane*> m_planesFlipList;
+    // overlay planes usable with the CRTC, shared with other outputs
+    QVector<DrmPlane*> m_overlayPlanes;
+    // state of the cursor plane, committed if dirty
+    DrmBuffer *m_cursorBuffer = nullptr;
+    QPoint m_cursorPos;
+    bool m_cursorDirty = false;
+    // commits the cursor if no frame got presented after all
+    QTimer *m_cursorTimer = nullptr;
 };
 
 }
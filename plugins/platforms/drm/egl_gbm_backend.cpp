@@ -58,10 +58,17 @@ EglGbmBackend::EglGbmBackend(DrmBackend *b)
             m_outputs.erase(it);
         }
     );
+    connect(options, &Options::glTripleBufferingChanged, this,
+        [this] {
+            m_backend->setTripleBuffering(options->glTripleBuffering());
+        }
+    );
 }
 
 EglGbmBackend::~EglGbmBackend()
 {
+    // a following backend might not be able to queue its buffers
+    m_backend->setTripleBuffering(false);
     // TODO: cleanup front buffer?
     cleanup();
 }
@@ -128,6 +135,7 @@ void EglGbmBackend::init()
     initKWinGL();
     initBufferAge();
     initWayland();
+    m_backend->setTripleBuffering(options->glTripleBuffering());
 }
 
 bool EglGbmBackend::initRenderingContext()
@@ -264,21 +272,47 @@ QRegion EglGbmBackend::prepareRenderingForScreen(int screenId)
     const Output &o = m_outputs.at(screenId);
     makeContextCurrent(o);
     if (supportsBufferAge()) {
-        QRegion region;
-
-        // Note: An age of zero means the buffer contents are undefined
-        if (o.bufferAge > 0 && o.bufferAge <= o.damageHistory.count()) {
-            for (int i = 0; i < o.bufferAge - 1; i++)
-                region |= o.damageHistory[i];
-        } else {
-            region = o.output->geometry();
-        }
-
-        return region;
+        return o.damageHistory.accumulated(o.bufferAge, o.output->geometry());
     }
     return QRegion();
 }
 
+bool EglGbmBackend::directScanout(int screenId, KWayland::Server::BufferInterface *buffer)
+{
+    Output &o = m_outputs[screenId];
+    // present() does not free the buffer on all of its failures, the imported buffer would
+    // keep the client buffer referenced and the client never gets it released
+    if (!m_backend->canPresent(o.output)) {
+        return false;
+    }
+    DrmBuffer *drmBuffer = m_backend->createBuffer(buffer);
+    if (!drmBuffer) {
+        return false;
+    }
+    // a mode set for every switch between scanout and composition would flicker
+    if (!o.output->presentsWithoutModeset(drmBuffer)) {
+        delete drmBuffer;
+        return false;
+    }
+    // the remaining failures free the buffer
+    if (!m_backend->present(drmBuffer, o.output)) {
+        return false;
+    }
+    // the frames of the gbm surface miss what got scanned out
+    o.bufferAge = 0;
+    return true;
+}
+
+QRegion EglGbmBackend::assignOverlays(int screenId, const QVector<OverlayCandidate> &candidates)
+{
+    QVector<QPair<KWayland::Server::BufferInterface*, QRect>> buffers;
+    buffers.reserve(candidates.count());
+    for (const OverlayCandidate &candidate : candidates) {
+        buffers << qMakePair(candidate.buffer, candidate.geometry);
+    }
+    return m_outputs.at(screenId).output->assignOverlays(buffers);
+}
+
 void EglGbmBackend::endRenderingFrame(const QRegion &renderedRegion, const QRegion &damagedRegion)
 {
     Q_UNUSED(renderedRegion)
@@ -288,7 +322,7 @@ void EglGbmBackend::endRenderingFrame(const QRegion &renderedRegion, const QRegi
 void EglGbmBackend::endRenderingFrameForScreen(int screenId, const QRegion &renderedRegion, const QRegion &damagedRegion)
 {
     Output &o = m_outputs[screenId];
-    if (damagedRegion.intersected(o.output->geometry()).isEmpty() && screenId == 0) {
+    if (damagedRegion.intersected(o.output->geometry()).isEmpty() && screenId == 0 && !o.output->overlaysChanged()) {
 
         // If the damaged region of a window is fully occluded, the only
         // rendering done, if any, will have been to repair a reused back
@@ -316,11 +350,7 @@ void EglGbmBackend::endRenderingFrameForScreen(int screenId, const QRegion &rend
     // age on the first output. To properly support buffer age on all outputs the rendering needs to
     // be refactored in general.
     if (supportsBufferAge() && screenId == 0) {
-        if (o.damageHistory.count() > 10) {
-            o.damageHistory.removeLast();
-        }
-
-        o.damageHistory.prepend(damagedRegion.intersected(o.output->geometry()));
+        o.damageHistory.add(damagedRegion.intersected(o.output->geometry()));
     }
 }
 
@@ -47,6 +47,8 @@ public:
     bool usesOverlayWindow() const override;
     bool perScreenRendering() const override;
     QRegion prepareRenderingForScreen(int screenId) override;
+    bool directScanout(int screenId, KWayland::Server::BufferInterface *buffer) override;
+    QRegion assignOverlays(int screenId, const QVector<OverlayCandidate> &candidates) override;
     void init() override;
 
 protected:
@@ -66,7 +68,7 @@ private:
         /**
         * @brief The damage history for the past 10 frames.
         */
-        QList<QRegion> damageHistory;
+        DamageHistory damageHistory;
     };
     bool makeContextCurrent(const Output &output);
     void presentOnOutput(Output &output);
@@ -48,6 +48,8 @@ DrmQPainterBackend::DrmQPainterBackend(DrmBackend *backend)
             delete (*it).buffer[0];
             delete (*it).buffer[1];
             m_outputs.erase(it);
+            // the ids of the following screens changed
+            resetDamageHistory();
         }
     );
 }
@@ -90,23 +92,42 @@ bool DrmQPainterBackend::needsFullRepaint() const
     return true;
 }
 
+bool DrmQPainterBackend::supportsBufferAge() const
+{
+    return true;
+}
+
+int DrmQPainterBackend::bufferAge(int screenId) const
+{
+    const Output &o = m_outputs.at(screenId);
+    return o.age[o.index];
+}
+
 void DrmQPainterBackend::prepareRenderingFrame()
 {
-    for (auto it = m_outputs.begin(); it != m_outputs.end(); ++it) {
-        (*it).index = ((*it).index + 1) % 2;
-    }
 }
 
 void DrmQPainterBackend::present(int mask, const QRegion &damage)
 {
     Q_UNUSED(mask)
-    Q_UNUSED(damage)
     if (!LogindIntegration::self()->isActiveSession()) {
         return;
     }
-    for (auto it = m_outputs.begin(); it != m_outputs.end(); ++it) {
-        const Output &o = *it;
+    for (int i = 0; i < m_outputs.count(); ++i) {
+        Output &o = m_outputs[i];
+        // outputs without damage were not rendered this frame, e.g. as they still wait for a page flip
+        if (!damage.intersects(o.output->geometry())) {
+            continue;
+        }
         m_backend->present(o.buffer[o.index], o.output);
+        addToDamageHistory(i, damage.intersected(o.output->geometry()));
+        for (int &age : o.age) {
+            if (age > 0) {
+                age++;
+            }
+        }
+        o.age[o.index] = 1;
+        o.index = (o.index + 1) % 2;
     }
 }
 
@@ -43,11 +43,15 @@ public:
     void prepareRenderingFrame() override;
     void present(int mask, const QRegion &damage) override;
     bool perScreenRendering() const override;
+    bool supportsBufferAge() const override;
+    int bufferAge(int screenId) const override;
 
 private:
     void initOutput(DrmOutput *output);
     struct Output {
         DrmBuffer *buffer[2];
+        // frames since the buffer got presented, 0 if it never was
+        int age[2] = {0, 0};
         DrmOutput *output;
         int index = 0;
     };
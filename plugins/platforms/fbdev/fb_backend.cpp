@@ -130,6 +130,35 @@ bool FramebufferBackend::queryScreenInfo()
     m_bufferLength = fixinfo.smem_len;
     m_bytesPerLine = fixinfo.line_length;
 
+    // double buffering needs a second screen below the first one the display can be panned to
+    const quint64 screenLength = quint64(varinfo.yres) * fixinfo.line_length;
+    if (fixinfo.ypanstep != 0 && varinfo.yres % fixinfo.ypanstep == 0 &&
+            varinfo.yres_virtual >= varinfo.yres * 2 &&
+            fixinfo.smem_len >= screenLength * 2) {
+        m_bufferCount = 2;
+    } else {
+        m_bufferCount = 1;
+    }
+    qCDebug(KWIN_FB) << "Virtual Resolution: " << varinfo.xres_virtual << "x" << varinfo.yres_virtual;
+    qCDebug(KWIN_FB) << "Buffers: " << m_bufferCount;
+
+    return true;
+}
+
+bool FramebufferBackend::panToBuffer(int index)
+{
+    if (m_fd < 0 || index < 0 || index >= m_bufferCount) {
+        return false;
+    }
+    // panning only evaluates the offsets and the vmode
+    fb_var_screeninfo varinfo = {};
+    varinfo.xoffset = 0;
+    varinfo.yoffset = index * m_resolution.height();
+    varinfo.activate = FB_ACTIVATE_VBL;
+    if (ioctl(m_fd, FBIOPAN_DISPLAY, &varinfo) < 0) {
+        qCWarning(KWIN_FB) << "Failed to pan the display to buffer" << index;
+        return false;
+    }
     return true;
 }
 
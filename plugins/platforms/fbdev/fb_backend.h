@@ -77,6 +77,18 @@ public:
     bool isBGR() const {
         return m_bgr;
     }
+    /**
+     * @returns the number of screen sized buffers in the mapped memory the display can be
+     * panned to, 2 if the virtual resolution allows double buffering, otherwise 1.
+     **/
+    int bufferCount() const {
+        return m_bufferCount;
+    }
+    /**
+     * Pans the display to the buffer at @p index, synchronized to the vertical blank.
+     * @returns whether the display got panned.
+     **/
+    bool panToBuffer(int index);
 
 private:
     void openFrameBuffer();
@@ -97,6 +109,7 @@ private:
     int m_fd = -1;
     quint32 m_bufferLength = 0;
     int m_bytesPerLine = 0;
+    int m_bufferCount = 1;
     void *m_memory = nullptr;
     QImage::Format m_imageFormat = QImage::Format_Invalid;
     bool m_bgr = false;
@@ -24,28 +24,94 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "virtual_terminal.h"
 // Qt
 #include <QPainter>
+// system
+#include <cstring>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
 namespace KWin
 {
+
+// truncates like QImage's conversion from RGB32 to RGB16
+static inline quint16 convertToRgb16(quint32 pixel)
+{
+    return ((pixel >> 3) & 0x001f) | ((pixel >> 5) & 0x07e0) | ((pixel >> 8) & 0xf800);
+}
+
+static void convertRowToRgb16(const quint32 *source, quint16 *target, int pixels)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i blueMask = _mm_set1_epi32(0x001f);
+    const __m128i greenMask = _mm_set1_epi32(0x07e0);
+    const __m128i redMask = _mm_set1_epi32(0xf800);
+    // packing saturates signed, thus move the 16 bit values into the signed range and back
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(short(0x8000));
+    for (; i + 8 <= pixels; i += 8) {
+        __m128i result[2];
+        for (int j = 0; j < 2; ++j) {
+            const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i + j * 4));
+            __m128i c = _mm_and_si128(_mm_srli_epi32(p, 3), blueMask);
+            c = _mm_or_si128(c, _mm_and_si128(_mm_srli_epi32(p, 5), greenMask));
+            c = _mm_or_si128(c, _mm_and_si128(_mm_srli_epi32(p, 8), redMask));
+            result[j] = _mm_sub_epi32(c, bias32);
+        }
+        const __m128i packed = _mm_xor_si128(_mm_packs_epi32(result[0], result[1]), bias16);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), packed);
+    }
+#endif
+    for (; i < pixels; ++i) {
+        target[i] = convertToRgb16(source[i]);
+    }
+}
+
+static void convertRowToRgb888(const quint32 *source, uchar *target, int pixels, bool bgr)
+{
+    // in memory order, the blue channel comes first if the framebuffer is BGR
+    const int first = bgr ? 0 : 16;
+    const int last = bgr ? 16 : 0;
+    for (int i = 0; i < pixels; ++i) {
+        const quint32 pixel = source[i];
+        target[0] = pixel >> first;
+        target[1] = pixel >> 8;
+        target[2] = pixel >> last;
+        target += 3;
+    }
+}
+
 FramebufferQPainterBackend::FramebufferQPainterBackend(FramebufferBackend *backend)
     : QObject()
     , QPainterBackend()
     , m_renderBuffer(backend->size(), QImage::Format_RGB32)
     , m_backend(backend)
+    , m_bufferCount(backend->bufferCount())
 {
     m_renderBuffer.fill(Qt::black);
 
     m_backend->map();
 
-    m_backBuffer = QImage((uchar*)backend->mappedMemory(),
-                          backend->bytesPerLine() / (backend->bitsPerPixel() / 8),
-                          backend->bufferSize() / backend->bytesPerLine(),
-                          backend->bytesPerLine(), backend->imageFormat());
-
-    m_backBuffer.fill(Qt::black);
+    // black in all supported formats
+    if (uchar *memory = static_cast<uchar *>(m_backend->mappedMemory())) {
+        std::memset(memory, 0, m_backend->bufferSize());
+    }
+    m_pendingDamage.resize(m_bufferCount);
+    if (m_bufferCount > 1) {
+        if (m_backend->panToBuffer(0)) {
+            m_backBufferIndex = 1;
+        } else {
+            m_bufferCount = 1;
+            m_pendingDamage.resize(1);
+        }
+    }
     connect(VirtualTerminal::self(), &VirtualTerminal::activeChanged, this,
         [this] (bool active) {
             if (active) {
+                // the framebuffer got drawn on while switched away
+                for (QRegion &pending : m_pendingDamage) {
+                    pending = m_renderBuffer.rect();
+                }
                 Compositor::self()->bufferSwapComplete();
                 Compositor::self()->addRepaintFull();
             } else {
@@ -71,15 +137,72 @@ void FramebufferQPainterBackend::prepareRenderingFrame()
 {
 }
 
+uchar *FramebufferQPainterBackend::bufferMemory(int index) const
+{
+    uchar *memory = static_cast<uchar *>(m_backend->mappedMemory());
+    if (!memory) {
+        return nullptr;
+    }
+    return memory + index * m_renderBuffer.height() * m_backend->bytesPerLine();
+}
+
+void FramebufferQPainterBackend::copyToBuffer(int index, const QRegion &region)
+{
+    uchar *memory = bufferMemory(index);
+    if (!memory) {
+        return;
+    }
+    const int bytesPerLine = m_backend->bytesPerLine();
+    const QImage::Format format = m_backend->imageFormat();
+    const bool bgr = m_backend->isBGR();
+    for (const QRect &rect : region.rects()) {
+        const int x = rect.x();
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            const quint32 *source = reinterpret_cast<const quint32 *>(m_renderBuffer.constScanLine(y)) + x;
+            uchar *target = memory + y * bytesPerLine;
+            if (format == QImage::Format_RGB32 && !bgr) {
+                std::memcpy(target + x * 4, source, rect.width() * 4);
+            } else if (format == QImage::Format_RGB16 && !bgr) {
+                convertRowToRgb16(source, reinterpret_cast<quint16 *>(target) + x, rect.width());
+            } else if (format == QImage::Format_RGB888) {
+                convertRowToRgb888(source, target + x * 3, rect.width(), bgr);
+            } else {
+                // not produced by FramebufferBackend, go through QImage to be on the safe side
+                QImage row(target, m_renderBuffer.width(), 1, bytesPerLine, format);
+                QPainter p(&row);
+                p.setCompositionMode(QPainter::CompositionMode_Source);
+                const QImage sourceRow = m_renderBuffer.copy(x, y, rect.width(), 1);
+                p.drawImage(QPoint(x, 0), bgr ? sourceRow.rgbSwapped() : sourceRow);
+            }
+        }
+    }
+}
+
 void FramebufferQPainterBackend::present(int mask, const QRegion &damage)
 {
     Q_UNUSED(mask)
-    Q_UNUSED(damage)
     if (!VirtualTerminal::self()->isActive()) {
         return;
     }
-    QPainter p(&m_backBuffer);
-    p.drawImage(QPoint(0, 0), m_backend->isBGR() ? m_renderBuffer.rgbSwapped() : m_renderBuffer);
+    // the back buffer still misses the damage of the frames presented since it was shown
+    for (QRegion &pending : m_pendingDamage) {
+        pending |= damage;
+    }
+    QRegion &region = m_pendingDamage[m_backBufferIndex];
+    copyToBuffer(m_backBufferIndex, region & m_renderBuffer.rect());
+    region = QRegion();
+    if (m_bufferCount == 1) {
+        return;
+    }
+    if (!m_backend->panToBuffer(m_backBufferIndex)) {
+        // fall back to drawing into the visible buffer
+        m_bufferCount = 1;
+        m_pendingDamage.fill(m_renderBuffer.rect(), 1);
+        m_backBufferIndex = 0;
+        Compositor::self()->addRepaintFull();
+        return;
+    }
+    m_backBufferIndex = (m_backBufferIndex + 1) % m_bufferCount;
 }
 
 bool FramebufferQPainterBackend::usesOverlayWindow() const
@@ -41,9 +41,15 @@ public:
     void present(int mask, const QRegion &damage) override;
 
 private:
+    uchar *bufferMemory(int index) const;
+    void copyToBuffer(int index, const QRegion &region);
     QImage m_renderBuffer;
-    QImage m_backBuffer;
     FramebufferBackend *m_backend;
+    int m_bufferCount = 1;
+    // the buffer in the mapped memory the next frame gets copied to
+    int m_backBufferIndex = 0;
+    // per buffer the region the buffer is not up to date in
+    QVector<QRegion> m_pendingDamage;
 };
 
 }
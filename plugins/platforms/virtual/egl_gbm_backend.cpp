@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // kwin
 #include "composite.h"
 #include "virtual_backend.h"
+#include "frame_capture.h"
 #include "options.h"
 #include "screens.h"
 #if HAVE_UDEV
@@ -229,47 +230,12 @@ QRegion EglGbmBackend::prepareRenderingFrame()
     return QRegion(0, 0, screens()->size().width(), screens()->size().height());
 }
 
-static void convertFromGLImage(QImage &img, int w, int h)
-{
-    // from QtOpenGL/qgl.cpp
-    // Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies)
-    // see http://qt.gitorious.org/qt/qt/blobs/master/src/opengl/qgl.cpp
-    if (QSysInfo::ByteOrder == QSysInfo::BigEndian) {
-        // OpenGL gives RGBA; Qt wants ARGB
-        uint *p = (uint*)img.bits();
-        uint *end = p + w * h;
-        while (p < end) {
-            uint a = *p << 24;
-            *p = (*p >> 8) | a;
-            p++;
-        }
-    } else {
-        // OpenGL gives ABGR (i.e. RGBA backwards); Qt wants ARGB
-        for (int y = 0; y < h; y++) {
-            uint *q = (uint*)img.scanLine(y);
-            for (int x = 0; x < w; ++x) {
-                const uint pixel = *q;
-                *q = ((pixel << 16) & 0xff0000) | ((pixel >> 16) & 0xff)
-                     | (pixel & 0xff00ff00);
-
-                q++;
-            }
-        }
-
-    }
-    img = img.mirrored();
-}
-
 void EglGbmBackend::endRenderingFrame(const QRegion &renderedRegion, const QRegion &damagedRegion)
 {
     Q_UNUSED(renderedRegion)
-    Q_UNUSED(damagedRegion)
     glFlush();
-    if (m_backend->saveFrames()) {
-        QImage img = QImage(QSize(m_backBuffer->width(), m_backBuffer->height()), QImage::Format_ARGB32);
-        glReadnPixels(0, 0, m_backBuffer->width(), m_backBuffer->height(), GL_RGBA, GL_UNSIGNED_BYTE, img.byteCount(), (GLvoid*)img.bits());
-        convertFromGLImage(img, m_backBuffer->width(), m_backBuffer->height());
-        img.save(QStringLiteral("%1/%2.png").arg(m_backend->saveFrames()).arg(QString::number(m_frameCounter++)));
+    if (FrameCapture *capture = m_backend->frameCapture()) {
+        capture->captureOpenGL(0, QSize(m_backBuffer->width(), m_backBuffer->height()), damagedRegion);
     }
     GLRenderTarget::popRenderTarget();
 }
@@ -55,7 +55,6 @@ private:
     VirtualBackend *m_backend;
     GLTexture *m_backBuffer = nullptr;
     GLRenderTarget *m_fbo = nullptr;
-    int m_frameCounter = 0;
     friend class EglGbmTexture;
 };
 
@@ -0,0 +1,323 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "frame_capture.h"
+#include <logging.h>
+// kwin libs
+#include <kwinglutils_funcs.h>
+// Qt
+#include <QFile>
+#include <QHash>
+#include <QSharedPointer>
+#include <QThread>
+#include <QtEndian>
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+namespace KWin
+{
+
+// the number of frames that may wait for the worker thread
+static const int s_maxPendingFrames = 8;
+
+static const char s_rawMagic[8] = {'K', 'W', 'I', 'N', 'R', 'A', 'W', '\0'};
+static const quint32 s_rawVersion = 1;
+
+// converts a pixel read back as GL_RGBA to QImage::Format_ARGB32
+static inline quint32 swizzle(quint32 pixel)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    return (pixel & 0xff00ff00) | ((pixel >> 16) & 0xff) | ((pixel & 0xff) << 16);
+#else
+    return (pixel >> 8) | (pixel << 24);
+#endif
+}
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+static inline __m128i swizzle(__m128i pixels)
+{
+    const __m128i greenAlpha = _mm_set1_epi32(0xff00ff00);
+    const __m128i blue = _mm_set1_epi32(0x000000ff);
+    __m128i r = _mm_and_si128(pixels, greenAlpha);
+    r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(pixels, 16), blue));
+    return _mm_or_si128(r, _mm_slli_epi32(_mm_and_si128(pixels, blue), 16));
+}
+#endif
+
+// swaps the rows @p a and @p b while converting them from GL_RGBA
+static void swapSwizzled(quint32 *a, quint32 *b, int pixels)
+{
+    int i = 0;
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(a + i), swizzle(pb));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(b + i), swizzle(pa));
+    }
+#endif
+    for (; i < pixels; ++i) {
+        const quint32 pa = a[i];
+        a[i] = swizzle(b[i]);
+        b[i] = swizzle(pa);
+    }
+}
+
+/**
+ * Converts the bottom up GL_RGBA rows in @p data to top down QImage::Format_ARGB32
+ * in a single pass.
+ **/
+static void convertFromOpenGL(uchar *data, int width, int height)
+{
+    const int stride = width * 4;
+    int top = 0;
+    int bottom = height - 1;
+    for (; top < bottom; ++top, --bottom) {
+        swapSwizzled(reinterpret_cast<quint32 *>(data + top * stride),
+                     reinterpret_cast<quint32 *>(data + bottom * stride), width);
+    }
+    if (top == bottom) {
+        quint32 *row = reinterpret_cast<quint32 *>(data + top * stride);
+        for (int i = 0; i < width; ++i) {
+            row[i] = swizzle(row[i]);
+        }
+    }
+}
+
+class FrameWriter : public QObject
+{
+    Q_OBJECT
+public:
+    FrameWriter(const QString &directory, FrameCapture::Format format, QSemaphore *free);
+    virtual ~FrameWriter();
+
+public Q_SLOTS:
+    void write(const KWin::CapturedFrame &frame);
+
+private:
+    void writePng(const CapturedFrame &frame, const uchar *pixels, QImage::Format format);
+    void writeRaw(const CapturedFrame &frame, const uchar *pixels, QImage::Format format);
+    struct Stream {
+        QSharedPointer<QFile> file;
+        QSize size;
+        QImage::Format format = QImage::Format_Invalid;
+        int index = 0;
+    };
+    QString m_directory;
+    FrameCapture::Format m_format;
+    QSemaphore *m_free;
+    QHash<int, Stream> m_streams;
+    // the content of the screens the PNG images are saved from
+    QHash<int, QImage> m_images;
+};
+
+FrameWriter::FrameWriter(const QString &directory, FrameCapture::Format format, QSemaphore *free)
+    : QObject()
+    , m_directory(directory)
+    , m_format(format)
+    , m_free(free)
+{
+}
+
+FrameWriter::~FrameWriter() = default;
+
+void FrameWriter::write(const KWin::CapturedFrame &frame)
+{
+    QByteArray pixels = frame.pixels;
+    QImage::Format format = frame.format;
+    if (frame.fromOpenGL) {
+        uchar *data = reinterpret_cast<uchar *>(pixels.data());
+        for (const QRect &rect : frame.rects) {
+            convertFromOpenGL(data, rect.width(), rect.height());
+            data += rect.width() * rect.height() * 4;
+        }
+        format = QImage::Format_ARGB32;
+    }
+    const uchar *data = reinterpret_cast<const uchar *>(pixels.constData());
+    switch (m_format) {
+    case FrameCapture::Format::Png:
+        writePng(frame, data, format);
+        break;
+    case FrameCapture::Format::Raw:
+        writeRaw(frame, data, format);
+        break;
+    }
+    m_free->release();
+}
+
+void FrameWriter::writePng(const CapturedFrame &frame, const uchar *pixels, QImage::Format format)
+{
+    QImage &image = m_images[frame.screen];
+    if (image.size() != frame.size || image.format() != format) {
+        image = QImage(frame.size, format);
+        image.fill(Qt::black);
+    }
+    for (const QRect &rect : frame.rects) {
+        const int bytesPerLine = rect.width() * 4;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            std::memcpy(image.scanLine(y) + rect.x() * 4, pixels, bytesPerLine);
+            pixels += bytesPerLine;
+        }
+    }
+    image.save(QStringLiteral("%1/screen%2-%3.png").arg(m_directory, QString::number(frame.screen), QString::number(frame.sequence)));
+}
+
+void FrameWriter::writeRaw(const CapturedFrame &frame, const uchar *pixels, QImage::Format format)
+{
+    Stream &stream = m_streams[frame.screen];
+    if (stream.file.isNull() || stream.size != frame.size || stream.format != format) {
+        const QString name = stream.index == 0
+            ? QStringLiteral("%1/screen%2.raw").arg(m_directory, QString::number(frame.screen))
+            : QStringLiteral("%1/screen%2-%3.raw").arg(m_directory, QString::number(frame.screen), QString::number(stream.index));
+        stream.file.reset(new QFile(name));
+        stream.size = frame.size;
+        stream.format = format;
+        stream.index++;
+        if (!stream.file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qCWarning(KWIN_VIRTUAL) << "Failed to open" << name << "for the frame capture";
+            return;
+        }
+        RawStreamHeader header;
+        std::memcpy(header.magic, s_rawMagic, sizeof(header.magic));
+        header.version = qToLittleEndian(s_rawVersion);
+        header.format = qToLittleEndian(quint32(format));
+        header.width = qToLittleEndian(quint32(frame.size.width()));
+        header.height = qToLittleEndian(quint32(frame.size.height()));
+        stream.file->write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+    if (!stream.file->isOpen()) {
+        return;
+    }
+    RawFrameHeader header;
+    header.sequence = qToLittleEndian(frame.sequence);
+    header.timestamp = qToLittleEndian(frame.timestamp);
+    header.rectCount = qToLittleEndian(quint32(frame.rects.count()));
+    header.reserved = 0;
+    stream.file->write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const QRect &rect : frame.rects) {
+        RawRect r;
+        r.x = qToLittleEndian(qint32(rect.x()));
+        r.y = qToLittleEndian(qint32(rect.y()));
+        r.width = qToLittleEndian(qint32(rect.width()));
+        r.height = qToLittleEndian(qint32(rect.height()));
+        stream.file->write(reinterpret_cast<const char *>(&r), sizeof(r));
+        const qint64 bytes = qint64(rect.width()) * rect.height() * 4;
+        stream.file->write(reinterpret_cast<const char *>(pixels), bytes);
+        pixels += bytes;
+    }
+    stream.file->flush();
+}
+
+FrameCapture::FrameCapture(const QString &directory, Format format, QObject *parent)
+    : QObject(parent)
+    , m_thread(new QThread(this))
+    , m_writer(new FrameWriter(directory, format, &m_free))
+    , m_free(s_maxPendingFrames)
+{
+    qRegisterMetaType<KWin::CapturedFrame>();
+    m_thread->setObjectName(QStringLiteral("KWin frame capture"));
+    m_writer->moveToThread(m_thread);
+    connect(this, &FrameCapture::frameCaptured, m_writer, &FrameWriter::write, Qt::QueuedConnection);
+    m_thread->start();
+    m_clock.start();
+}
+
+FrameCapture::~FrameCapture()
+{
+    // let the worker write the pending frames
+    m_free.acquire(s_maxPendingFrames);
+    m_thread->quit();
+    m_thread->wait();
+    delete m_writer;
+}
+
+void FrameCapture::submit(CapturedFrame &frame)
+{
+    if (frame.screen >= m_sequences.count()) {
+        m_sequences.resize(frame.screen + 1);
+    }
+    frame.sequence = m_sequences[frame.screen]++;
+    frame.timestamp = m_clock.nsecsElapsed();
+    // blocks if the worker falls behind
+    m_free.acquire();
+    emit frameCaptured(frame);
+}
+
+void FrameCapture::capture(int screen, const QImage &image, const QRegion &damage)
+{
+    if (image.depth() != 32) {
+        qCWarning(KWIN_VIRTUAL) << "Cannot capture an image of depth" << image.depth();
+        return;
+    }
+    CapturedFrame frame;
+    frame.screen = screen;
+    frame.size = image.size();
+    frame.format = image.format();
+    int bytes = 0;
+    for (const QRect &rect : (damage & image.rect()).rects()) {
+        frame.rects << rect;
+        bytes += rect.width() * rect.height() * 4;
+    }
+    if (frame.rects.isEmpty()) {
+        return;
+    }
+    frame.pixels.resize(bytes);
+    uchar *out = reinterpret_cast<uchar *>(frame.pixels.data());
+    for (const QRect &rect : qAsConst(frame.rects)) {
+        const int bytesPerLine = rect.width() * 4;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            std::memcpy(out, image.constScanLine(y) + rect.x() * 4, bytesPerLine);
+            out += bytesPerLine;
+        }
+    }
+    submit(frame);
+}
+
+void FrameCapture::captureOpenGL(int screen, const QSize &size, const QRegion &damage)
+{
+    CapturedFrame frame;
+    frame.screen = screen;
+    frame.size = size;
+    frame.fromOpenGL = true;
+    int bytes = 0;
+    for (const QRect &rect : (damage & QRect(QPoint(0, 0), size)).rects()) {
+        frame.rects << rect;
+        bytes += rect.width() * rect.height() * 4;
+    }
+    if (frame.rects.isEmpty()) {
+        return;
+    }
+    frame.pixels.resize(bytes);
+    uchar *out = reinterpret_cast<uchar *>(frame.pixels.data());
+    for (const QRect &rect : qAsConst(frame.rects)) {
+        const int rectBytes = rect.width() * rect.height() * 4;
+        glReadnPixels(rect.x(), size.height() - rect.y() - rect.height(), rect.width(), rect.height(),
+                      GL_RGBA, GL_UNSIGNED_BYTE, rectBytes, out);
+        out += rectBytes;
+    }
+    submit(frame);
+}
+
+}
+
+#include "frame_capture.moc"
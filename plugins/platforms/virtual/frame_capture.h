@@ -0,0 +1,138 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef KWIN_VIRTUAL_FRAME_CAPTURE_H
+#define KWIN_VIRTUAL_FRAME_CAPTURE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMetaType>
+#include <QObject>
+#include <QRegion>
+#include <QSemaphore>
+#include <QVector>
+
+class QThread;
+
+namespace KWin
+{
+
+/**
+ * Layout of the raw frame stream, all fields are little endian.
+ *
+ * A stream starts with a RawStreamHeader. It is followed by a RawFrameHeader per frame,
+ * each followed by @c rectCount RawRects. Every RawRect is directly followed by the
+ * pixels of the rect, @c width * 4 bytes per row without padding, in the QImage::Format
+ * given in the stream header. Replaying the rects of all frames up to a frame onto a
+ * black image results in the content of the screen at that frame.
+ *
+ * If the size of a screen changes a new stream gets started in a new file.
+ **/
+struct RawStreamHeader {
+    char magic[8];
+    quint32 version;
+    quint32 format;
+    quint32 width;
+    quint32 height;
+};
+
+struct RawFrameHeader {
+    quint64 sequence;
+    // nsec since the capture started
+    qint64 timestamp;
+    quint32 rectCount;
+    quint32 reserved;
+};
+
+struct RawRect {
+    qint32 x;
+    qint32 y;
+    qint32 width;
+    qint32 height;
+};
+
+/**
+ * The damaged part of a frame handed to the worker thread.
+ **/
+struct CapturedFrame {
+    int screen = 0;
+    quint64 sequence = 0;
+    qint64 timestamp = 0;
+    QSize size;
+    QImage::Format format = QImage::Format_RGB32;
+    // in screen coordinates with the origin in the top left corner
+    QVector<QRect> rects;
+    // the pixels of the rects in the same order, 4 bytes per pixel without padding
+    QByteArray pixels;
+    // whether the rects are stored bottom up in RGBA byte order as read back from OpenGL
+    bool fromOpenGL = false;
+};
+
+class FrameWriter;
+
+/**
+ * @brief Saves the frames rendered by the virtual platform from a worker thread.
+ *
+ * The compositor thread only copies the damaged rects of a frame, converting and
+ * encoding happens in the worker thread. Frames are either written as a PNG image per
+ * screen and frame or as a raw stream per screen, see RawStreamHeader.
+ *
+ * The number of frames waiting for the worker is limited, if it falls behind capturing
+ * blocks instead of dropping frames.
+ **/
+class FrameCapture : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Format {
+        Png,
+        Raw
+    };
+    FrameCapture(const QString &directory, Format format, QObject *parent = nullptr);
+    virtual ~FrameCapture();
+
+    /**
+     * Captures the @p damage of @p image, the current content of @p screen.
+     * The pixels are copied, the image can be painted on right after.
+     **/
+    void capture(int screen, const QImage &image, const QRegion &damage);
+    /**
+     * Captures the @p damage of the currently bound OpenGL framebuffer of @p size
+     * as @p screen.
+     **/
+    void captureOpenGL(int screen, const QSize &size, const QRegion &damage);
+
+Q_SIGNALS:
+    void frameCaptured(const KWin::CapturedFrame &frame);
+
+private:
+    void submit(CapturedFrame &frame);
+    QThread *m_thread;
+    FrameWriter *m_writer;
+    QSemaphore m_free;
+    QElapsedTimer m_clock;
+    QVector<quint64> m_sequences;
+};
+
+}
+
+Q_DECLARE_METATYPE(KWin::CapturedFrame)
+
+#endif
@@ -19,7 +19,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *********************************************************************/
 #include "scene_qpainter_virtual_backend.h"
 #include "virtual_backend.h"
+#include "frame_capture.h"
 #include "cursor.h"
+#include "qpaintertiledbuffer.h"
 #include "screens.h"
 
 #include <QPainter>
@@ -34,7 +36,10 @@ VirtualQPainterBackend::VirtualQPainterBackend(VirtualBackend *backend)
     createOutputs();
 }
 
-VirtualQPainterBackend::~VirtualQPainterBackend() = default;
+VirtualQPainterBackend::~VirtualQPainterBackend()
+{
+    qDeleteAll(m_tiledBuffers);
+}
 
 QImage *VirtualQPainterBackend::buffer()
 {
@@ -46,11 +51,26 @@ QImage *VirtualQPainterBackend::bufferForScreen(int screen)
     return &m_backBuffers[screen];
 }
 
+QPainterTiledBuffer *VirtualQPainterBackend::tiledBufferForScreen(int screenId)
+{
+    return m_tiledBuffers.value(screenId);
+}
+
 bool VirtualQPainterBackend::needsFullRepaint() const
 {
     return true;
 }
 
+bool VirtualQPainterBackend::supportsBufferAge() const
+{
+    return true;
+}
+
+int VirtualQPainterBackend::bufferAge(int screenId) const
+{
+    return m_bufferAges.value(screenId);
+}
+
 void VirtualQPainterBackend::prepareRenderingFrame()
 {
 }
@@ -58,20 +78,40 @@ void VirtualQPainterBackend::prepareRenderingFrame()
 void VirtualQPainterBackend::createOutputs()
 {
     m_backBuffers.clear();
+    qDeleteAll(m_tiledBuffers);
+    m_tiledBuffers.clear();
+    const int tileSize = m_backend->qPainterTileSize();
     for (int i = 0; i < screens()->count(); ++i) {
         QImage buffer(screens()->size(i), QImage::Format_RGB32);
         buffer.fill(Qt::black);
         m_backBuffers << buffer;
+        if (tileSize > 0) {
+            QPainterTiledBuffer *tiles = new QPainterTiledBuffer(buffer.size(), buffer.format(), tileSize);
+            tiles->fill(Qt::black);
+            tiles->copyDirtyTiles(&m_backBuffers.last());
+            m_tiledBuffers << tiles;
+        }
     }
+    m_bufferAges.fill(0, m_backBuffers.count());
+    resetDamageHistory();
 }
 
 void VirtualQPainterBackend::present(int mask, const QRegion &damage)
 {
     Q_UNUSED(mask)
-    Q_UNUSED(damage)
-    if (m_backend->saveFrames()) {
-        for (int i=0; i < m_backBuffers.size() ; i++) {
-            m_backBuffers[i].save(QStringLiteral("%1/screen%2-%3.png").arg(m_backend->screenshotDirPath(), QString::number(i), QString::number(m_frameCounter++)));
+    FrameCapture *capture = m_backend->frameCapture();
+    for (int i = 0; i < m_backBuffers.count(); ++i) {
+        const QRect geometry = screens()->geometry(i);
+        if (damage.intersects(geometry)) {
+            const QRegion screenDamage = damage.intersected(geometry);
+            addToDamageHistory(i, screenDamage);
+            m_bufferAges[i] = 1;
+            if (QPainterTiledBuffer *tiles = m_tiledBuffers.value(i)) {
+                tiles->copyDirtyTiles(&m_backBuffers[i]);
+            }
+            if (capture) {
+                capture->capture(i, m_backBuffers[i], screenDamage.translated(-geometry.topLeft()));
+            }
         }
     }
 }
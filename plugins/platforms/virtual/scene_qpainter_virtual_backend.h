@@ -38,18 +38,24 @@ public:
 
     QImage *buffer() override;
     QImage *bufferForScreen(int screenId) override;
+    QPainterTiledBuffer *tiledBufferForScreen(int screenId) override;
     bool needsFullRepaint() const override;
     bool usesOverlayWindow() const override;
     void prepareRenderingFrame() override;
     void present(int mask, const QRegion &damage) override;
     bool perScreenRendering() const override;
+    bool supportsBufferAge() const override;
+    int bufferAge(int screenId) const override;
 
 private:
     void createOutputs();
 
     QVector<QImage> m_backBuffers;
+    // only used with a VirtualBackend::qPainterTileSize, copied into m_backBuffers on present
+    QVector<QPainterTiledBuffer*> m_tiledBuffers;
+    // the buffers are reused without swapping, thus 1 once presented
+    QVector<int> m_bufferAges;
     VirtualBackend *m_backend;
-    int m_frameCounter = 0;
 };
 
 }
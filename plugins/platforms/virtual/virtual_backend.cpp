@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "screens_virtual.h"
 #include "wayland_server.h"
 #include "egl_gbm_backend.h"
+#include "frame_capture.h"
 // Qt
 #include <QTemporaryDir>
 // KWayland
@@ -46,8 +47,11 @@ VirtualBackend::VirtualBackend(QObject *parent)
         }
         if (!m_screenshotDir.isNull()) {
             qDebug() << "Screenshots saved to: " << m_screenshotDir->path();
+            const bool raw = qgetenv("KWIN_WAYLAND_VIRTUAL_SCREENSHOTS_FORMAT") == QByteArrayLiteral("raw");
+            m_frameCapture.reset(new FrameCapture(m_screenshotDir->path(), raw ? FrameCapture::Format::Raw : FrameCapture::Format::Png));
         }
     }
+    setQPainterTileSize(qEnvironmentVariableIntValue("KWIN_QPAINTER_TILE_SIZE"));
     setSupportsPointerWarping(true);
 }
 
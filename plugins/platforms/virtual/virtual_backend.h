@@ -32,6 +32,7 @@ struct gbm_device;
 
 namespace KWin
 {
+class FrameCapture;
 
 class KWIN_EXPORT VirtualBackend : public Platform
 {
@@ -58,6 +59,12 @@ public:
         return !m_screenshotDir.isNull();
     }
     QString screenshotDirPath() const;
+    /**
+     * The capture the rendered frames are handed to, @c null if frames are not saved.
+     **/
+    FrameCapture *frameCapture() const {
+        return m_frameCapture.data();
+    }
 
     Screens *createScreens(QObject *parent = nullptr) override;
     QPainterBackend* createQPainterBackend() override;
@@ -71,6 +78,19 @@ public:
         m_outputScale = scale;
     }
 
+    /**
+     * The size of the square tiles the QPainter backend renders each output into, 0 to render
+     * into the linear buffers directly. Tiles pay off for very large outputs, e.g. 8K.
+     * Initialized from the environment variable KWIN_QPAINTER_TILE_SIZE, changes apply
+     * once the outputs are created again.
+     **/
+    int qPainterTileSize() const {
+        return m_qPainterTileSize;
+    }
+    Q_INVOKABLE void setQPainterTileSize(int size) {
+        m_qPainterTileSize = qMax(0, size);
+    }
+
     int drmFd() const {
         return m_drmFd;
     }
@@ -93,7 +113,10 @@ private:
     QSize m_size;
     int m_outputCount = 1;
     qreal m_outputScale = 1;
+    int m_qPainterTileSize = 0;
     QScopedPointer<QTemporaryDir> m_screenshotDir;
+    // destroyed before the directory, it still writes the pending frames into it
+    QScopedPointer<FrameCapture> m_frameCapture;
     int m_drmFd = -1;
     gbm_device *m_gbmDevice = nullptr;
 };
@@ -0,0 +1,503 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "qpainterrecorder.h"
+
+#include <QPixmap>
+#include <QRawFont>
+#include <QTextItem>
+#include <QTextLayout>
+
+namespace KWin
+{
+
+/**
+ * Unlike QRectF::united this keeps rects without a size, a pen still paints them.
+ **/
+static QRectF unitedRects(const QVector<QRectF> &rects)
+{
+    if (rects.isEmpty()) {
+        return QRectF();
+    }
+    QPointF topLeft = rects.first().normalized().topLeft();
+    QPointF bottomRight = rects.first().normalized().bottomRight();
+    for (const QRectF &r : rects) {
+        const QRectF rect = r.normalized();
+        topLeft = QPointF(qMin(topLeft.x(), rect.left()), qMin(topLeft.y(), rect.top()));
+        bottomRight = QPointF(qMax(bottomRight.x(), rect.right()), qMax(bottomRight.y(), rect.bottom()));
+    }
+    return QRectF(topLeft, bottomRight);
+}
+
+/**
+ * The engine announces all features, so that QPainter hands every draw call with the
+ * untransformed coordinates and the complete state to it instead of emulating anything.
+ **/
+class QPainterRecorder::Engine : public QPaintEngine
+{
+public:
+    explicit Engine(QPainterRecorder *recorder)
+        : QPaintEngine(QPaintEngine::AllFeatures)
+        , m_recorder(recorder)
+    {
+    }
+
+    bool begin(QPaintDevice *device) override {
+        Q_UNUSED(device)
+        // a new painter starts in the initial state
+        m_transform.reset();
+        m_pen = QPen();
+        m_hasClip = false;
+        m_clipEnabled = false;
+        return true;
+    }
+    bool end() override {
+        return true;
+    }
+    Type type() const override {
+        return QPaintEngine::User;
+    }
+
+    void updateState(const QPaintEngineState &state) override;
+    void drawRects(const QRect *rects, int rectCount) override;
+    void drawRects(const QRectF *rects, int rectCount) override;
+    void drawPath(const QPainterPath &path) override;
+    void drawPolygon(const QPointF *points, int pointCount, PolygonDrawMode mode) override;
+    void drawPolygon(const QPoint *points, int pointCount, PolygonDrawMode mode) override;
+    void drawPixmap(const QRectF &r, const QPixmap &pm, const QRectF &sr) override;
+    void drawImage(const QRectF &r, const QImage &pm, const QRectF &sr, Qt::ImageConversionFlags flags) override;
+    void drawTiledPixmap(const QRectF &r, const QPixmap &pixmap, const QPointF &s) override;
+    void drawTextItem(const QPointF &p, const QTextItem &textItem) override;
+
+private:
+    Command &append(Command::Type type) {
+        m_recorder->m_commands.append(Command());
+        Command &command = m_recorder->m_commands.last();
+        command.type = type;
+        return command;
+    }
+    void updateClip(const QRect &clip, Qt::ClipOperation operation);
+    void setBounds(Command &command, const QRectF &rect, bool stroked) const;
+    QPainterRecorder *m_recorder;
+    // the state the bounds of the draw commands depend on, as the replay applies it
+    QTransform m_transform;
+    QPen m_pen;
+    QRect m_clip;
+    bool m_hasClip = false;
+    bool m_clipEnabled = false;
+};
+
+void QPainterRecorder::Engine::updateClip(const QRect &clip, Qt::ClipOperation operation)
+{
+    switch (operation) {
+    case Qt::NoClip:
+        m_hasClip = false;
+        m_clipEnabled = false;
+        break;
+    case Qt::ReplaceClip:
+        m_clip = clip;
+        m_hasClip = true;
+        m_clipEnabled = true;
+        break;
+    case Qt::IntersectClip:
+        m_clip = m_hasClip ? m_clip & clip : clip;
+        m_hasClip = true;
+        m_clipEnabled = true;
+        break;
+    }
+}
+
+void QPainterRecorder::Engine::setBounds(Command &command, const QRectF &rect, bool stroked) const
+{
+    QRectF bounds = rect;
+    // antialiasing and the rounding of the edges
+    qreal deviceMargin = 1;
+    if (stroked && m_pen.style() != Qt::NoPen) {
+        // caps and miter joins reach out further than half the width
+        const qreal margin = qMax<qreal>(1, m_pen.widthF()) * qMax<qreal>(1, m_pen.miterLimit());
+        if (m_pen.isCosmetic()) {
+            deviceMargin += margin;
+        } else {
+            bounds.adjust(-margin, -margin, margin, margin);
+        }
+    }
+    command.bounds = m_transform.mapRect(bounds).adjusted(-deviceMargin, -deviceMargin, deviceMargin, deviceMargin).toAlignedRect();
+    if (m_clipEnabled && m_hasClip) {
+        command.bounds &= m_clip;
+    }
+}
+
+void QPainterRecorder::Engine::updateState(const QPaintEngineState &state)
+{
+    Command &command = append(Command::Type::State);
+    const QPaintEngine::DirtyFlags dirty = state.state();
+    command.dirty = dirty;
+    // clips are mapped with the transform at the time they are set, thus always store it
+    command.transform = state.transform();
+    if (dirty & DirtyPen) {
+        command.pen = state.pen();
+    }
+    if (dirty & DirtyBrush) {
+        command.brush = state.brush();
+    }
+    if (dirty & DirtyBrushOrigin) {
+        command.brushOrigin = state.brushOrigin();
+    }
+    if (dirty & DirtyBackground) {
+        command.background = state.backgroundBrush();
+    }
+    if (dirty & DirtyBackgroundMode) {
+        command.backgroundMode = state.backgroundMode();
+    }
+    if (dirty & DirtyFont) {
+        command.font = state.font();
+    }
+    if (dirty & DirtyHints) {
+        command.hints = state.renderHints();
+    }
+    if (dirty & DirtyCompositionMode) {
+        command.compositionMode = state.compositionMode();
+    }
+    if (dirty & DirtyOpacity) {
+        command.opacity = state.opacity();
+    }
+    if (dirty & (DirtyClipRegion | DirtyClipPath)) {
+        command.clipOperation = state.clipOperation();
+    }
+    if (dirty & DirtyClipRegion) {
+        command.clipRegion = state.clipRegion();
+        updateClip(command.transform.mapRect(QRectF(command.clipRegion.boundingRect())).toAlignedRect(), command.clipOperation);
+    }
+    if (dirty & DirtyClipPath) {
+        command.path = state.clipPath();
+        updateClip(command.transform.mapRect(command.path.controlPointRect()).toAlignedRect(), command.clipOperation);
+    }
+    if (dirty & DirtyClipEnabled) {
+        command.clipEnabled = state.isClipEnabled();
+        m_clipEnabled = command.clipEnabled;
+    }
+    m_transform = command.transform;
+    if (dirty & DirtyPen) {
+        m_pen = command.pen;
+    }
+}
+
+void QPainterRecorder::Engine::drawRects(const QRect *rects, int rectCount)
+{
+    Command &command = append(Command::Type::Rects);
+    command.rects.reserve(rectCount);
+    for (int i = 0; i < rectCount; ++i) {
+        command.rects.append(QRectF(rects[i]));
+    }
+    setBounds(command, unitedRects(command.rects), true);
+}
+
+void QPainterRecorder::Engine::drawRects(const QRectF *rects, int rectCount)
+{
+    Command &command = append(Command::Type::Rects);
+    command.rects.reserve(rectCount);
+    for (int i = 0; i < rectCount; ++i) {
+        command.rects.append(rects[i]);
+    }
+    setBounds(command, unitedRects(command.rects), true);
+}
+
+void QPainterRecorder::Engine::drawPath(const QPainterPath &path)
+{
+    Command &command = append(Command::Type::Path);
+    command.path = path;
+    setBounds(command, path.controlPointRect(), true);
+}
+
+void QPainterRecorder::Engine::drawPolygon(const QPointF *points, int pointCount, PolygonDrawMode mode)
+{
+    Command &command = append(Command::Type::Polygon);
+    command.polygon.reserve(pointCount);
+    for (int i = 0; i < pointCount; ++i) {
+        command.polygon.append(points[i]);
+    }
+    command.polygonMode = mode;
+    setBounds(command, command.polygon.boundingRect(), true);
+}
+
+void QPainterRecorder::Engine::drawPolygon(const QPoint *points, int pointCount, PolygonDrawMode mode)
+{
+    Command &command = append(Command::Type::Polygon);
+    command.polygon.reserve(pointCount);
+    for (int i = 0; i < pointCount; ++i) {
+        command.polygon.append(QPointF(points[i]));
+    }
+    command.polygonMode = mode;
+    setBounds(command, command.polygon.boundingRect(), true);
+}
+
+void QPainterRecorder::Engine::drawPixmap(const QRectF &r, const QPixmap &pm, const QRectF &sr)
+{
+    // pixmaps must not be used outside the gui thread, for the raster pixmaps
+    // used by KWin the conversion shares the data
+    drawImage(r, pm.toImage(), sr, Qt::AutoColor);
+}
+
+void QPainterRecorder::Engine::drawImage(const QRectF &r, const QImage &pm, const QRectF &sr, Qt::ImageConversionFlags flags)
+{
+    Command &command = append(Command::Type::Image);
+    command.target = r;
+    command.image = pm;
+    command.source = sr;
+    command.imageFlags = flags;
+    setBounds(command, r, false);
+}
+
+void QPainterRecorder::Engine::drawTiledPixmap(const QRectF &r, const QPixmap &pixmap, const QPointF &s)
+{
+    Command &command = append(Command::Type::TiledImage);
+    command.target = r;
+    command.image = pixmap.toImage();
+    command.source = QRectF(s, QSizeF());
+    setBounds(command, r, false);
+}
+
+void QPainterRecorder::Engine::drawTextItem(const QPointF &p, const QTextItem &textItem)
+{
+    // QTextItem does not expose its glyphs, shape the text here so that the replay draws the
+    // positioned glyphs with the direction and decorations of the item instead of reshaping it
+    const QTextItem::RenderFlags flags = textItem.renderFlags();
+    QTextOption option(Qt::AlignLeft | Qt::AlignAbsolute);
+    option.setWrapMode(QTextOption::NoWrap);
+    option.setTextDirection(flags.testFlag(QTextItem::RightToLeft) ? Qt::RightToLeft : Qt::LeftToRight);
+    QTextLayout layout(textItem.text(), textItem.font(), m_recorder);
+    layout.setTextOption(option);
+    layout.beginLayout();
+    QTextLine line = layout.createLine();
+    if (line.isValid()) {
+        line.setNumColumns(textItem.text().length());
+        line.setPosition(QPointF(0, 0));
+    }
+    layout.endLayout();
+    if (!line.isValid()) {
+        return;
+    }
+
+    Command &command = append(Command::Type::Text);
+    // the item is positioned at its baseline, the layout at the top of the line
+    command.target = QRectF(p - QPointF(0, line.ascent()), QSizeF(line.naturalTextWidth(), line.height()));
+    const QList<QGlyphRun> runs = layout.glyphRuns();
+    command.textRuns.reserve(runs.count());
+    QRectF bounds = command.target;
+    for (const QGlyphRun &run : runs) {
+        TextRun textRun;
+        // the run might use a fallback font, pin the exact face so that the glyph indexes stay valid
+        const QRawFont rawFont = run.rawFont();
+        textRun.font = textItem.font();
+        textRun.font.setFamily(rawFont.familyName());
+        textRun.font.setStyleName(rawFont.styleName());
+        textRun.font.setStyleStrategy(QFont::StyleStrategy(textRun.font.styleStrategy() | QFont::NoFontMerging));
+        textRun.glyphIndexes = run.glyphIndexes();
+        textRun.positions = run.positions();
+        textRun.flags = run.flags();
+        textRun.flags.setFlag(QGlyphRun::Overline, flags.testFlag(QTextItem::Overline));
+        textRun.flags.setFlag(QGlyphRun::Underline, flags.testFlag(QTextItem::Underline));
+        textRun.flags.setFlag(QGlyphRun::StrikeOut, flags.testFlag(QTextItem::StrikeOut));
+        command.textRuns << textRun;
+        // glyphs might reach out of the line, e.g. italic ones
+        bounds |= run.boundingRect().translated(command.target.topLeft());
+    }
+    setBounds(command, bounds, false);
+}
+
+QPainterRecorder::QPainterRecorder(QImage *target)
+    : QPaintDevice()
+    , m_target(target)
+    , m_engine(new Engine(this))
+{
+}
+
+QPainterRecorder::~QPainterRecorder() = default;
+
+QPaintEngine *QPainterRecorder::paintEngine() const
+{
+    return m_engine.data();
+}
+
+int QPainterRecorder::metric(PaintDeviceMetric metric) const
+{
+    // pretend to be the target, so that QPainter::setWindow and fonts behave the same
+    switch (metric) {
+    case PdmWidth:
+        return m_target->width();
+    case PdmHeight:
+        return m_target->height();
+    case PdmWidthMM:
+        return m_target->widthMM();
+    case PdmHeightMM:
+        return m_target->heightMM();
+    case PdmNumColors:
+        return m_target->colorCount();
+    case PdmDepth:
+        return m_target->depth();
+    case PdmDpiX:
+        return m_target->logicalDpiX();
+    case PdmDpiY:
+        return m_target->logicalDpiY();
+    case PdmPhysicalDpiX:
+        return m_target->physicalDpiX();
+    case PdmPhysicalDpiY:
+        return m_target->physicalDpiY();
+    case PdmDevicePixelRatio:
+        return m_target->devicePixelRatio();
+    default:
+        return QPaintDevice::metric(metric);
+    }
+}
+
+void QPainterRecorder::clear()
+{
+    m_commands.clear();
+}
+
+void QPainterRecorder::replay()
+{
+    QPainter painter(m_target);
+    replay(&painter);
+}
+
+void QPainterRecorder::replay(QPainter *painter) const
+{
+    replay(painter, QPoint(0, 0));
+}
+
+void QPainterRecorder::replay(QPainter *painter, const QPoint &offset) const
+{
+    const QTransform deviceOffset = QTransform::fromTranslate(-offset.x(), -offset.y());
+    for (const Command &command : m_commands) {
+        replay(painter, command, deviceOffset);
+    }
+}
+
+void QPainterRecorder::replay(QPainter *painter, const QPoint &offset, const QVector<int> &drawCommands) const
+{
+    const QTransform deviceOffset = QTransform::fromTranslate(-offset.x(), -offset.y());
+    int index = 0;
+    for (int drawCommand : drawCommands) {
+        for (; index < drawCommand; ++index) {
+            if (m_commands.at(index).type == Command::Type::State) {
+                replay(painter, m_commands.at(index), deviceOffset);
+            }
+        }
+        replay(painter, m_commands.at(drawCommand), deviceOffset);
+        index = drawCommand + 1;
+    }
+}
+
+void QPainterRecorder::replay(QPainter *painter, const Command &command, const QTransform &deviceOffset) const
+{
+    switch (command.type) {
+    case Command::Type::State: {
+        const QPaintEngine::DirtyFlags dirty = command.dirty;
+        painter->setTransform(command.transform * deviceOffset);
+        if (dirty & QPaintEngine::DirtyClipRegion) {
+            painter->setClipRegion(command.clipRegion, command.clipOperation);
+        }
+        if (dirty & QPaintEngine::DirtyClipPath) {
+            painter->setClipPath(command.path, command.clipOperation);
+        }
+        if (dirty & QPaintEngine::DirtyClipEnabled) {
+            painter->setClipping(command.clipEnabled);
+        }
+        if (dirty & QPaintEngine::DirtyPen) {
+            painter->setPen(command.pen);
+        }
+        if (dirty & QPaintEngine::DirtyBrush) {
+            painter->setBrush(command.brush);
+        }
+        if (dirty & QPaintEngine::DirtyBrushOrigin) {
+            painter->setBrushOrigin(command.brushOrigin);
+        }
+        if (dirty & QPaintEngine::DirtyBackground) {
+            painter->setBackground(command.background);
+        }
+        if (dirty & QPaintEngine::DirtyBackgroundMode) {
+            painter->setBackgroundMode(command.backgroundMode);
+        }
+        if (dirty & QPaintEngine::DirtyFont) {
+            painter->setFont(command.font);
+        }
+        if (dirty & QPaintEngine::DirtyHints) {
+            painter->setRenderHints(command.hints, true);
+            painter->setRenderHints(~command.hints, false);
+        }
+        if (dirty & QPaintEngine::DirtyCompositionMode) {
+            painter->setCompositionMode(command.compositionMode);
+        }
+        if (dirty & QPaintEngine::DirtyOpacity) {
+            painter->setOpacity(command.opacity);
+        }
+        break;
+    }
+    case Command::Type::Rects:
+        painter->drawRects(command.rects);
+        break;
+    case Command::Type::Path:
+        painter->drawPath(command.path);
+        break;
+    case Command::Type::Polygon:
+        switch (command.polygonMode) {
+        case QPaintEngine::OddEvenMode:
+            painter->drawPolygon(command.polygon, Qt::OddEvenFill);
+            break;
+        case QPaintEngine::WindingMode:
+            painter->drawPolygon(command.polygon, Qt::WindingFill);
+            break;
+        case QPaintEngine::ConvexMode:
+            painter->drawConvexPolygon(command.polygon);
+            break;
+        case QPaintEngine::PolylineMode:
+            painter->drawPolyline(command.polygon);
+            break;
+        }
+        break;
+    case Command::Type::Image:
+        painter->drawImage(command.target, command.image, command.source, command.imageFlags);
+        break;
+    case Command::Type::TiledImage: {
+        // QPixmaps cannot be created in the worker threads, tile with a texture brush instead
+        QBrush brush(command.image);
+        brush.setTransform(QTransform::fromTranslate(command.target.x() - command.source.x(),
+                                                     command.target.y() - command.source.y()));
+        const QPointF origin = painter->brushOrigin();
+        painter->setBrushOrigin(QPointF());
+        painter->fillRect(command.target, brush);
+        painter->setBrushOrigin(origin);
+        break;
+    }
+    case Command::Type::Text:
+        for (const TextRun &textRun : command.textRuns) {
+            // the font cache is per thread, this is a font engine of the replaying thread
+            QGlyphRun run;
+            run.setRawFont(QRawFont::fromFont(textRun.font));
+            run.setGlyphIndexes(textRun.glyphIndexes);
+            run.setPositions(textRun.positions);
+            run.setFlags(textRun.flags);
+            painter->drawGlyphRun(command.target.topLeft(), run);
+        }
+        break;
+    }
+}
+
+}
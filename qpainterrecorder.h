@@ -0,0 +1,166 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef KWIN_QPAINTERRECORDER_H
+#define KWIN_QPAINTERRECORDER_H
+
+#include <kwin_export.h>
+
+#include <QBrush>
+#include <QFont>
+#include <QGlyphRun>
+#include <QImage>
+#include <QPaintDevice>
+#include <QPaintEngine>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPen>
+#include <QRegion>
+#include <QScopedPointer>
+#include <QTransform>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * @brief Paint device recording the painting done for a QImage to replay it later on.
+ *
+ * A QPainter begun on the recorder behaves as if it were painting on the target image,
+ * but only the state changes and draw calls get stored. Images and pixmaps are kept as
+ * implicitly shared QImages, so recording does not copy pixels.
+ *
+ * This allows the SceneQPainter to walk the scene graph and run the effects on the main
+ * thread, while the rasterization, which only touches the recorded values, is done in
+ * a worker thread with replay().
+ **/
+class KWIN_EXPORT QPainterRecorder : public QPaintDevice
+{
+public:
+    explicit QPainterRecorder(QImage *target);
+    ~QPainterRecorder() override;
+
+    QPaintEngine *paintEngine() const override;
+
+    QImage *target() const {
+        return m_target;
+    }
+    bool isEmpty() const {
+        return m_commands.isEmpty();
+    }
+    int commandCount() const {
+        return m_commands.count();
+    }
+    /**
+     * @returns the area of the target the command at @p index can paint to, grown by the pen
+     * and antialiasing and cut to the clip. Changes of the painter state have an empty area.
+     **/
+    QRect boundingRect(int index) const {
+        return m_commands.at(index).bounds;
+    }
+    /**
+     * Paints the recorded commands onto the target image.
+     * The recorder must not be painted on while replaying.
+     **/
+    void replay();
+    /**
+     * Paints the recorded commands with @p painter, which should be in its initial state.
+     **/
+    void replay(QPainter *painter) const;
+    /**
+     * Paints the recorded commands with @p painter on a device which is placed at @p offset
+     * in the target image, e.g. a tile of it.
+     **/
+    void replay(QPainter *painter, const QPoint &offset) const;
+    /**
+     * Like above, but of the draw commands only the ones at the sorted @p drawCommands get
+     * replayed, e.g. the ones whose boundingRect intersects the tile. The state changes
+     * before the last of them are all replayed.
+     **/
+    void replay(QPainter *painter, const QPoint &offset, const QVector<int> &drawCommands) const;
+    void clear();
+
+protected:
+    int metric(PaintDeviceMetric metric) const override;
+
+private:
+    class Engine;
+    /**
+     * A glyph run without its QRawFont: the font engine behind it belongs to the thread which
+     * created it and its glyph cache must not be used from the replaying threads. The replay
+     * gets the raw font for @c font from the font cache of its own thread.
+     **/
+    struct TextRun {
+        QFont font;
+        QVector<quint32> glyphIndexes;
+        QVector<QPointF> positions;
+        QGlyphRun::GlyphRunFlags flags;
+    };
+    struct Command {
+        enum class Type {
+            State,
+            Rects,
+            Path,
+            Polygon,
+            Image,
+            TiledImage,
+            Text
+        };
+        Type type = Type::State;
+        // in the coordinates of the target, empty for State
+        QRect bounds;
+        // State
+        QPaintEngine::DirtyFlags dirty;
+        QTransform transform;
+        QPen pen;
+        QBrush brush;
+        QPointF brushOrigin;
+        QBrush background;
+        Qt::BGMode backgroundMode = Qt::TransparentMode;
+        QFont font;
+        QPainter::RenderHints hints;
+        QPainter::CompositionMode compositionMode = QPainter::CompositionMode_SourceOver;
+        qreal opacity = 1.0;
+        Qt::ClipOperation clipOperation = Qt::NoClip;
+        QRegion clipRegion;
+        bool clipEnabled = false;
+        // Path and clip path
+        QPainterPath path;
+        // Rects and Polygon
+        QVector<QRectF> rects;
+        QPolygonF polygon;
+        QPaintEngine::PolygonDrawMode polygonMode = QPaintEngine::WindingMode;
+        // Image, TiledImage and Text
+        QRectF target;
+        QRectF source;
+        QImage image;
+        Qt::ImageConversionFlags imageFlags;
+        // Text, positioned relative to the top left of the target
+        QVector<TextRun> textRuns;
+    };
+    void replay(QPainter *painter, const Command &command, const QTransform &deviceOffset) const;
+
+    QImage *m_target;
+    QScopedPointer<Engine> m_engine;
+    QVector<Command> m_commands;
+};
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "qpainterscaledimage.h"
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+namespace KWin
+{
+
+const int QPainterScaledImage::s_maxLevel;
+
+int QPainterScaledImage::levelForScale(qreal scale)
+{
+    int level = 0;
+    while (level < s_maxLevel && scale * 2 <= 1.0) {
+        scale *= 2;
+        ++level;
+    }
+    return level;
+}
+
+QRect QPainterScaledImage::mapToLevel(const QRect &rect, int level)
+{
+    const int factor = 1 << level;
+    return QRect(QPoint(rect.left() / factor, rect.top() / factor),
+                 QPoint(rect.right() / factor, rect.bottom() / factor));
+}
+
+QRegion QPainterScaledImage::mapToBuffer(const QRegion &damage, int scale)
+{
+    if (scale == 1) {
+        return damage;
+    }
+    QRegion mapped;
+    for (const QRect &rect : damage.rects()) {
+        mapped |= QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
+    }
+    return mapped;
+}
+
+void QPainterScaledImage::downscaleBox(const QImage &source, QImage &target, const QRect &rect)
+{
+    const int sourceWidth = source.width();
+    const int sourceHeight = source.height();
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const quint32 *top = reinterpret_cast<const quint32 *>(source.constScanLine(qMin(y * 2, sourceHeight - 1)));
+        const quint32 *bottom = reinterpret_cast<const quint32 *>(source.constScanLine(qMin(y * 2 + 1, sourceHeight - 1)));
+        quint32 *out = reinterpret_cast<quint32 *>(target.scanLine(y));
+        int x = rect.left();
+#if defined(__SSE2__)
+        for (; x + 3 <= rect.right() && (x + 4) * 2 <= sourceWidth; x += 4) {
+            const __m128i rows0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(top + x * 2)),
+                                               _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + x * 2)));
+            const __m128i rows1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(top + x * 2 + 4)),
+                                               _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + x * 2 + 4)));
+            const __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(rows0), _mm_castsi128_ps(rows1), _MM_SHUFFLE(2, 0, 2, 0)));
+            const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(rows0), _mm_castsi128_ps(rows1), _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), _mm_avg_epu8(even, odd));
+        }
+#endif
+        for (; x <= rect.right(); ++x) {
+            const int left = qMin(x * 2, sourceWidth - 1);
+            const int right = qMin(x * 2 + 1, sourceWidth - 1);
+            // rounds the same way as the SSE2 code path
+            quint32 result = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                const quint32 first = (((top[left] >> shift) & 0xff) + ((bottom[left] >> shift) & 0xff) + 1) >> 1;
+                const quint32 second = (((top[right] >> shift) & 0xff) + ((bottom[right] >> shift) & 0xff) + 1) >> 1;
+                result |= ((first + second + 1) >> 1) << shift;
+            }
+            out[x] = result;
+        }
+    }
+}
+
+const QImage &QPainterScaledImage::image(const QImage &source, int level)
+{
+    if (level <= 0 || source.isNull()) {
+        return source;
+    }
+    level = qMin(level, s_maxLevel);
+    if (m_levels.count() < level) {
+        m_levels.resize(level);
+    }
+    const QImage &previous = image(source, level - 1);
+    Level &scaled = m_levels[level - 1];
+    const QSize size(qMax(1, previous.width() / 2), qMax(1, previous.height() / 2));
+    if (scaled.image.size() != size || scaled.image.format() != previous.format()) {
+        scaled.image = QImage(size, previous.format());
+        downscaleBox(previous, scaled.image, scaled.image.rect());
+    } else {
+        for (const QRect &rect : scaled.damage.rects()) {
+            downscaleBox(previous, scaled.image, mapToLevel(rect, level) & scaled.image.rect());
+        }
+    }
+    scaled.damage = QRegion();
+    return scaled.image;
+}
+
+void QPainterScaledImage::addDamage(const QRegion &damage)
+{
+    for (Level &scaled : m_levels) {
+        if (scaled.image.isNull()) {
+            continue;
+        }
+        scaled.damage |= damage;
+        // windows only painted unscaled would otherwise collect an ever growing region
+        if (scaled.damage.rectCount() > 32) {
+            scaled.damage = scaled.damage.boundingRect();
+        }
+    }
+}
+
+void QPainterScaledImage::clear()
+{
+    m_levels.clear();
+}
+
+}
@@ -0,0 +1,87 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef KWIN_QPAINTERSCALEDIMAGE_H
+#define KWIN_QPAINTERSCALEDIMAGE_H
+
+#include <kwin_export.h>
+
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * @brief The downscaled copies of an image, in power-of-two levels down to a sixteenth.
+ *
+ * The levels are created on demand from the previous level with a 2x2 box filter. Damage
+ * added to them is in the pixels of the source image, the damaged parts of a level get
+ * filtered again the next time it is requested.
+ **/
+class KWIN_EXPORT QPainterScaledImage
+{
+public:
+    static const int s_maxLevel = 4;
+
+    /**
+     * @returns the level of the scaled image which is the smallest one still
+     * at least as large as the image drawn with @p scale.
+     **/
+    static int levelForScale(qreal scale);
+    /**
+     * @returns the pixels of @p level which the pixels in @p rect of the source image contribute to.
+     **/
+    static QRect mapToLevel(const QRect &rect, int level);
+    /**
+     * Maps @p damage in surface local coordinates to the pixels of a buffer with @p scale.
+     **/
+    static QRegion mapToBuffer(const QRegion &damage, int scale);
+    /**
+     * Averages 2x2 pixels of @p source into the pixels of @p rect in @p target, which is
+     * half the size of @p source rounded down. Both images need to have 32 bit pixels.
+     **/
+    static void downscaleBox(const QImage &source, QImage &target, const QRect &rect);
+
+    /**
+     * Returns @p source downscaled by 2 to the power of @p level, level 0 is @p source itself.
+     * The source needs to have 32 bit pixels and to be the same image for all calls, apart
+     * from the parts passed to addDamage.
+     **/
+    const QImage &image(const QImage &source, int level);
+    /**
+     * Marks @p damage, in the pixels of the source image, to be filtered again.
+     **/
+    void addDamage(const QRegion &damage);
+    void clear();
+
+private:
+    struct Level {
+        QImage image;
+        // in the pixels of the source image, the part not yet updated
+        QRegion damage;
+    };
+    // the image for level n is at n - 1
+    QVector<Level> m_levels;
+};
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "qpaintertiledbuffer.h"
+#include "qpainterrecorder.h"
+
+#include <QPainter>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <cstring>
+
+namespace KWin
+{
+
+QPainterTiledBuffer::QPainterTiledBuffer(const QSize &size, QImage::Format format, int tileSize)
+    : m_size(size)
+    , m_format(format)
+    , m_tileSize(qMax(1, tileSize))
+    , m_columns((size.width() + m_tileSize - 1) / m_tileSize)
+{
+    const int rows = (size.height() + m_tileSize - 1) / m_tileSize;
+    m_tiles.reserve(m_columns * rows);
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < m_columns; ++column) {
+            const QRect geometry = QRect(column * m_tileSize, row * m_tileSize, m_tileSize, m_tileSize) & QRect(QPoint(0, 0), size);
+            m_tiles.append({QImage(geometry.size(), format), geometry, QRegion()});
+        }
+    }
+}
+
+QVector<int> QPainterTiledBuffer::tilesIn(const QRegion &region) const
+{
+    QVector<int> indices;
+    if (m_tiles.isEmpty()) {
+        return indices;
+    }
+    QVector<bool> added(m_tiles.count(), false);
+    for (const QRect &rect : region.rects()) {
+        const QRect range = tileRange(rect);
+        for (int row = range.top(); row <= range.bottom(); ++row) {
+            for (int column = range.left(); column <= range.right(); ++column) {
+                const int index = row * m_columns + column;
+                if (!added[index]) {
+                    added[index] = true;
+                    indices << index;
+                }
+            }
+        }
+    }
+    return indices;
+}
+
+QRect QPainterTiledBuffer::tileRange(const QRect &rect) const
+{
+    const QRect bounds = rect & QRect(QPoint(0, 0), m_size);
+    if (bounds.isEmpty()) {
+        return QRect();
+    }
+    return QRect(QPoint(bounds.left() / m_tileSize, bounds.top() / m_tileSize),
+                 QPoint(bounds.right() / m_tileSize, bounds.bottom() / m_tileSize));
+}
+
+void QPainterTiledBuffer::fill(const QColor &color)
+{
+    for (Tile &tile : m_tiles) {
+        tile.image.fill(color);
+        tile.dirty = tile.geometry;
+    }
+}
+
+void QPainterTiledBuffer::replay(const QPainterRecorder &recording, const QRegion &region)
+{
+    struct Bin {
+        int tile;
+        QVector<int> drawCommands;
+    };
+    QVector<Bin> bins;
+    QVector<int> binOfTile(m_tiles.count(), -1);
+    for (int index : tilesIn(region)) {
+        binOfTile[index] = bins.count();
+        bins.append({index, QVector<int>()});
+    }
+    // each tile only replays the draw commands painting to it instead of the whole frame
+    for (int command = 0; command < recording.commandCount(); ++command) {
+        const QRect range = tileRange(recording.boundingRect(command));
+        for (int row = range.top(); row <= range.bottom(); ++row) {
+            for (int column = range.left(); column <= range.right(); ++column) {
+                const int bin = binOfTile.at(row * m_columns + column);
+                if (bin != -1) {
+                    bins[bin].drawCommands << command;
+                }
+            }
+        }
+    }
+    // a tile nothing paints to keeps its content
+    bins.erase(std::remove_if(bins.begin(), bins.end(), [] (const Bin &bin) {
+        return bin.drawCommands.isEmpty();
+    }), bins.end());
+    for (const Bin &bin : qAsConst(bins)) {
+        Tile &tile = m_tiles[bin.tile];
+        tile.dirty |= region.intersected(tile.geometry);
+    }
+    // each tile is an image of its own, thus they can be rasterized at the same time
+    QtConcurrent::blockingMap(bins, [this, &recording] (const Bin &bin) {
+        Tile &tile = m_tiles[bin.tile];
+        QPainter painter(&tile.image);
+        recording.replay(&painter, tile.geometry.topLeft(), bin.drawCommands);
+    });
+}
+
+QRegion QPainterTiledBuffer::copyDirtyTiles(QImage *target)
+{
+    QRegion copied;
+    if (target->size() != m_size || target->format() != m_format) {
+        return copied;
+    }
+    const int bytesPerPixel = target->depth() / 8;
+    for (Tile &tile : m_tiles) {
+        if (tile.dirty.isEmpty()) {
+            continue;
+        }
+        // only the damaged part, the rest of the tile is in the target already
+        for (const QRect &rect : tile.dirty.rects()) {
+            const QPoint source = rect.topLeft() - tile.geometry.topLeft();
+            const int bytesPerLine = rect.width() * bytesPerPixel;
+            for (int y = 0; y < rect.height(); ++y) {
+                std::memcpy(target->scanLine(rect.y() + y) + rect.x() * bytesPerPixel,
+                            tile.image.constScanLine(source.y() + y) + source.x() * bytesPerPixel, bytesPerLine);
+            }
+        }
+        copied |= tile.dirty;
+        tile.dirty = QRegion();
+    }
+    return copied;
+}
+
+}
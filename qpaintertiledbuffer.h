@@ -0,0 +1,119 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef KWIN_QPAINTERTILEDBUFFER_H
+#define KWIN_QPAINTERTILEDBUFFER_H
+
+#include <kwin_export.h>
+
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+namespace KWin
+{
+class QPainterRecorder;
+
+/**
+ * @brief A screen buffer split into square tiles, each stored in its own QImage.
+ *
+ * A tile only covers a few cache lines per row, so rasterizing a damaged area stays within
+ * the tiles it touches instead of striding over rows of the width of the screen. This is
+ * for very large buffers, e.g. 8K or several outputs side by side in one virtual screen.
+ *
+ * The painting of a frame is recorded with a QPainterRecorder and replayed into the tiles
+ * touched by the painted region, in parallel. Each tile only replays the draw commands whose
+ * bounds intersect it. The painted region of those tiles is dirty until it is copied into
+ * the linear buffer with copyDirtyTiles.
+ **/
+class KWIN_EXPORT QPainterTiledBuffer
+{
+public:
+    explicit QPainterTiledBuffer(const QSize &size, QImage::Format format = QImage::Format_RGB32, int tileSize = s_defaultTileSize);
+
+    QSize size() const {
+        return m_size;
+    }
+    int tileSize() const {
+        return m_tileSize;
+    }
+    int tileCount() const {
+        return m_tiles.count();
+    }
+    /**
+     * @returns the part of the buffer covered by the tile at @p index, the tiles at the
+     * right and bottom edge might be smaller than the tile size.
+     **/
+    QRect tileGeometry(int index) const {
+        return m_tiles.at(index).geometry;
+    }
+    const QImage &tile(int index) const {
+        return m_tiles.at(index).image;
+    }
+    bool isDirty(int index) const {
+        return !m_tiles.at(index).dirty.isEmpty();
+    }
+    /**
+     * @returns the part of the tile at @p index which is not copied yet, in the coordinates
+     * of the buffer.
+     **/
+    QRegion dirtyRegion(int index) const {
+        return m_tiles.at(index).dirty;
+    }
+    /**
+     * @returns the indices of the tiles intersecting @p region.
+     **/
+    QVector<int> tilesIn(const QRegion &region) const;
+
+    void fill(const QColor &color);
+    /**
+     * Replays @p recording into the tiles intersecting @p region and marks @p region dirty
+     * in the tiles a draw command painted to. The recording must have been made for a target
+     * of the size of the buffer. What it paints outside of @p region is not marked dirty.
+     **/
+    void replay(const QPainterRecorder &recording, const QRegion &region);
+    /**
+     * Copies the dirty regions of the tiles into @p target, which has the size and format
+     * of the buffer, and marks them clean.
+     * @returns the region which got copied.
+     **/
+    QRegion copyDirtyTiles(QImage *target);
+
+    static const int s_defaultTileSize = 128;
+
+private:
+    struct Tile {
+        QImage image;
+        QRect geometry;
+        QRegion dirty;
+    };
+    /**
+     * @returns the columns and rows of the tiles intersecting @p rect, empty if none does.
+     **/
+    QRect tileRange(const QRect &rect) const;
+    QSize m_size;
+    QImage::Format m_format;
+    int m_tileSize;
+    int m_columns;
+    QVector<Tile> m_tiles;
+};
+
+}
+
+#endif
@@ -0,0 +1,286 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "rectset.h"
+
+#include <QVector>
+
+#include <algorithm>
+
+namespace KWin
+{
+
+/**
+ * Appends the parts of @p rect not covered by @p hole to @p out, at most four rectangles.
+ **/
+template <typename T>
+static void subtractRect(const QRect &rect, const QRect &hole, T &out)
+{
+    const QRect overlap = rect & hole;
+    if (overlap.isEmpty()) {
+        out.append(rect);
+        return;
+    }
+    if (overlap.top() > rect.top()) {
+        out.append(QRect(rect.left(), rect.top(), rect.width(), overlap.top() - rect.top()));
+    }
+    if (overlap.bottom() < rect.bottom()) {
+        out.append(QRect(rect.left(), overlap.bottom() + 1, rect.width(), rect.bottom() - overlap.bottom()));
+    }
+    if (overlap.left() > rect.left()) {
+        out.append(QRect(rect.left(), overlap.top(), overlap.left() - rect.left(), overlap.height()));
+    }
+    if (overlap.right() < rect.right()) {
+        out.append(QRect(overlap.right() + 1, overlap.top(), rect.right() - overlap.right(), overlap.height()));
+    }
+}
+
+RectSet::RectSet(const QRect &rect)
+{
+    if (!rect.isEmpty()) {
+        m_rects.append(rect);
+        m_bounds = rect;
+    }
+}
+
+RectSet::RectSet(const QRegion &region)
+{
+    // the rects of a QRegion are already disjoint
+    const QVector<QRect> rects = region.rects();
+    m_rects.reserve(rects.count());
+    for (const QRect &rect : rects) {
+        m_rects.append(rect);
+    }
+    m_bounds = region.boundingRect();
+}
+
+bool RectSet::intersects(const QRect &rect) const
+{
+    if (!m_bounds.intersects(rect)) {
+        return false;
+    }
+    for (const QRect &r : *this) {
+        if (r.intersects(rect)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RectSet::clear()
+{
+    m_rects.clear();
+    m_bounds = QRect();
+}
+
+void RectSet::updateBounds()
+{
+    m_bounds = QRect();
+    for (const QRect &r : *this) {
+        m_bounds |= r;
+    }
+}
+
+void RectSet::unite(const QRect &rect)
+{
+    if (rect.isEmpty()) {
+        return;
+    }
+    if (!m_bounds.intersects(rect)) {
+        // fast path: nothing to split
+        m_rects.append(rect);
+        m_bounds |= rect;
+        return;
+    }
+    QVarLengthArray<QRect, s_inlineRects> fragments;
+    fragments.append(rect);
+    int count = 0;
+    for (int i = 0; i < m_rects.count(); ++i) {
+        const QRect &existing = m_rects.at(i);
+        if (existing.contains(rect)) {
+            // fast path: already covered
+            return;
+        }
+        if (rect.contains(existing)) {
+            // covered by the new rect, drop it
+            continue;
+        }
+        if (existing.intersects(rect)) {
+            QVarLengthArray<QRect, s_inlineRects> remaining;
+            for (const QRect &fragment : fragments) {
+                subtractRect(fragment, existing, remaining);
+            }
+            fragments = remaining;
+        }
+        m_rects[count++] = existing;
+    }
+    m_rects.resize(count);
+    m_rects.append(fragments.constData(), fragments.count());
+    m_bounds |= rect;
+}
+
+void RectSet::unite(const RectSet &other)
+{
+    if (isEmpty()) {
+        *this = other;
+        return;
+    }
+    for (const QRect &rect : other) {
+        unite(rect);
+    }
+}
+
+void RectSet::subtract(const QRect &rect)
+{
+    if (!m_bounds.intersects(rect)) {
+        return;
+    }
+    if (rect.contains(m_bounds)) {
+        clear();
+        return;
+    }
+    QVarLengthArray<QRect, s_inlineRects> remaining;
+    for (const QRect &existing : *this) {
+        subtractRect(existing, rect, remaining);
+    }
+    m_rects = remaining;
+    updateBounds();
+}
+
+void RectSet::subtract(const RectSet &other)
+{
+    if (!m_bounds.intersects(other.boundingRect())) {
+        return;
+    }
+    for (const QRect &rect : other) {
+        subtract(rect);
+        if (isEmpty()) {
+            return;
+        }
+    }
+}
+
+QRegion RectSet::toRegion() const
+{
+    if (m_rects.isEmpty()) {
+        return QRegion();
+    }
+    if (m_rects.count() == 1) {
+        return QRegion(m_rects.first());
+    }
+    // Uniting rect by rect normalizes the QRegion each time, which is quadratic in the rect count.
+    // QRegion::setRects takes all at once, but needs them in y-x bands: the rects of a band share
+    // top and height, are sorted by x and neither overlap nor touch, and two touching bands differ.
+    QVector<int> edges;
+    edges.reserve(m_rects.count() * 2);
+    for (const QRect &rect : *this) {
+        edges << rect.top() << rect.bottom() + 1;
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    QVarLengthArray<QRect, s_inlineRects> byTop(m_rects);
+    std::sort(byTop.begin(), byTop.end(), [] (const QRect &a, const QRect &b) { return a.top() < b.top(); });
+
+    QVector<QRect> bands;
+    bands.reserve(m_rects.count() * 2);
+    QVarLengthArray<QRect, s_inlineRects> active;
+    QVarLengthArray<QPair<int, int>, s_inlineRects> spans;
+    int previousBand = 0;
+    int previousSpans = 0;
+    int next = 0;
+    for (int i = 0; i + 1 < edges.count(); ++i) {
+        const int top = edges.at(i);
+        const int bottom = edges.at(i + 1) - 1;
+        int count = 0;
+        for (const QRect &rect : active) {
+            if (rect.bottom() >= top) {
+                active[count++] = rect;
+            }
+        }
+        active.resize(count);
+        while (next < byTop.count() && byTop.at(next).top() == top) {
+            active.append(byTop.at(next++));
+        }
+        if (active.isEmpty()) {
+            previousSpans = 0;
+            continue;
+        }
+        spans.clear();
+        for (const QRect &rect : active) {
+            spans.append(qMakePair(rect.left(), rect.right()));
+        }
+        std::sort(spans.begin(), spans.end());
+        count = 0;
+        for (int j = 1; j < spans.count(); ++j) {
+            if (spans.at(j).first <= spans.at(count).second + 1) {
+                spans[count].second = qMax(spans.at(count).second, spans.at(j).second);
+            } else {
+                spans[++count] = spans.at(j);
+            }
+        }
+        spans.resize(count + 1);
+        // extend the band above if it has the same spans
+        bool same = previousSpans == spans.count();
+        for (int j = 0; same && j < spans.count(); ++j) {
+            const QRect &above = bands.at(previousBand + j);
+            same = above.left() == spans.at(j).first && above.right() == spans.at(j).second;
+        }
+        if (same) {
+            for (int j = 0; j < spans.count(); ++j) {
+                bands[previousBand + j].setBottom(bottom);
+            }
+            continue;
+        }
+        previousBand = bands.count();
+        previousSpans = spans.count();
+        for (const auto &span : spans) {
+            bands << QRect(QPoint(span.first, top), QPoint(span.second, bottom));
+        }
+    }
+    QRegion region;
+    region.setRects(bands.constData(), bands.count());
+    return region;
+}
+
+void DamageHistory::add(const QRegion &region)
+{
+    if (m_frames.count() >= s_maxFrames) {
+        m_frames.removeLast();
+    }
+    m_frames.prepend(RectSet(region));
+}
+
+QRegion DamageHistory::accumulated(int bufferAge, const QRegion &fallback) const
+{
+    if (bufferAge <= 0 || bufferAge > m_frames.count()) {
+        return fallback;
+    }
+    RectSet region;
+    for (int i = 0; i < bufferAge - 1; ++i) {
+        region |= m_frames.at(i);
+    }
+    return region.toRegion();
+}
+
+void DamageHistory::clear()
+{
+    m_frames.clear();
+}
+
+}
@@ -0,0 +1,132 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+Copyright (C) 2017 agent <agent@local>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#ifndef KWIN_RECTSET_H
+#define KWIN_RECTSET_H
+
+#include <kwin_export.h>
+
+#include <QList>
+#include <QRect>
+#include <QRegion>
+#include <QVarLengthArray>
+
+namespace KWin
+{
+
+/**
+ * @brief A set of non-overlapping rectangles for the region operations done on each frame.
+ *
+ * Unlike QRegion the rectangles are not normalized into y-x bands after each operation,
+ * they are only kept disjoint. The first rectangles are stored inline, so that the common
+ * case of windows consisting of a few rectangles does not allocate at all.
+ *
+ * It is meant for accumulating clips and damage within a frame, convert to QRegion with
+ * toRegion() where the result is handed on.
+ **/
+class KWIN_EXPORT RectSet
+{
+public:
+    RectSet() = default;
+    RectSet(const QRect &rect);
+    explicit RectSet(const QRegion &region);
+
+    bool isEmpty() const {
+        return m_rects.isEmpty();
+    }
+    int rectCount() const {
+        return m_rects.count();
+    }
+    const QRect *begin() const {
+        return m_rects.constData();
+    }
+    const QRect *end() const {
+        return m_rects.constData() + m_rects.count();
+    }
+    QRect boundingRect() const {
+        return m_bounds;
+    }
+    bool intersects(const QRect &rect) const;
+
+    void clear();
+    void unite(const QRect &rect);
+    void unite(const RectSet &other);
+    void subtract(const QRect &rect);
+    void subtract(const RectSet &other);
+
+    RectSet &operator|=(const RectSet &other) {
+        unite(other);
+        return *this;
+    }
+    RectSet &operator-=(const RectSet &other) {
+        subtract(other);
+        return *this;
+    }
+
+    QRegion toRegion() const;
+
+    static const int s_inlineRects = 8;
+
+private:
+    void updateBounds();
+    QVarLengthArray<QRect, s_inlineRects> m_rects;
+    QRect m_bounds;
+};
+
+inline RectSet operator|(RectSet a, const RectSet &b)
+{
+    a |= b;
+    return a;
+}
+
+inline RectSet operator-(RectSet a, const RectSet &b)
+{
+    a -= b;
+    return a;
+}
+
+/**
+ * @brief The damage of the last frames presented on a screen.
+ *
+ * It brings a reused back buffer up to date, with the damage of all frames presented since
+ * the buffer's content was presented.
+ **/
+class KWIN_EXPORT DamageHistory
+{
+public:
+    /**
+     * Saves the damage of a presented frame.
+     **/
+    void add(const QRegion &region);
+    /**
+     * @returns the damage of the frames presented after a buffer of @p bufferAge, or
+     * @p fallback if that is not known any more. An age of zero means the content is undefined.
+     **/
+    QRegion accumulated(int bufferAge, const QRegion &fallback) const;
+    void clear();
+
+    static const int s_maxFrames = 11;
+
+private:
+    QList<RectSet> m_frames;
+};
+
+}
+
+#endif
@@ -72,9 +72,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QVector2D>
 
 #include "client.h"
+#include "composite.h"
 #include "deleted.h"
 #include "effects.h"
 #include "overlaywindow.h"
+#include "rectset.h"
 #include "screens.h"
 #include "shadow.h"
 #include "wayland_server.h"
@@ -124,6 +126,9 @@ void Scene::paintScreen(int* mask, const QRegion &damage, const QRegion &repaint
     pdata.paint = region;
 
     effects->prePaintScreen(pdata, time_diff);
+    if (Compositor *compositor = Compositor::self()) {
+        compositor->frameTimeline()->mark(FrameTimeline::Stage::PrePaintScreen);
+    }
     *mask = pdata.mask;
     region = pdata.paint;
 
@@ -149,6 +154,9 @@ void Scene::paintScreen(int* mask, const QRegion &damage, const QRegion &repaint
 
     ScreenPaintData data(projection, outputGeometry);
     effects->paintScreen(*mask, region, data);
+    if (Compositor *compositor = Compositor::self()) {
+        compositor->frameTimeline()->mark(FrameTimeline::Stage::PaintWindows);
+    }
 
     foreach (Window *w, stacking_order) {
         effects->postPaintWindow(effectWindow(w));
@@ -314,6 +322,21 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
                                                                     data.mask, data.quads)));
     }
 
+    // The effects had their say, the scene might present some windows without painting them
+    QRegion presented;
+    QRegion unpresented;
+    if (presentWithoutPainting(phase2data, &presented, &unpresented)) {
+        painted_region = QRegion();
+        damaged_region = QRegion();
+        return;
+    }
+    if (!unpresented.isEmpty()) {
+        dirtyArea |= unpresented;
+        for (int i = 0; i < phase2data.count(); ++i) {
+            phase2data[i].second.region |= unpresented;
+        }
+    }
+
     // Save the part of the repaint region that's exclusively rendered to
     // bring a reused back buffer up to date. Then union the dirty region
     // with the repaint region.
@@ -328,52 +351,37 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
         fullRepaint = (dirtyArea == displayRegion);
     }
 
-    QRegion allclips, upperTranslucentDamage;
-    upperTranslucentDamage = repaint_region;
-
-    // This is the occlusion culling pass
-    for (int i = phase2data.count() - 1; i >= 0; --i) {
-        QPair< Window*, Phase2Data > *entry = &phase2data[i];
-        Phase2Data *data = &entry->second;
-
-        if (fullRepaint)
-            data->region = displayRegion;
-        else
-            data->region |= upperTranslucentDamage;
-
-        // subtract the parts which will possibly been drawn as part of
-        // a higher opaque window
-        data->region -= allclips;
-
-        // Here we rely on WindowPrePaintData::setTranslucent() to remove
-        // the clip if needed.
-        if (!data->clip.isEmpty() && !(data->mask & PAINT_WINDOW_TRANSFORMED)) {
-            // clip away the opaque regions for all windows below this one
-            allclips |= data->clip;
-            // extend the translucent damage for windows below this by remaining (translucent) regions
-            if (!fullRepaint)
-                upperTranslucentDamage |= data->region - data->clip;
-        } else if (!fullRepaint) {
-            upperTranslucentDamage |= data->region;
-        }
+    // Here we rely on WindowPrePaintData::setTranslucent() to remove
+    // the clip if needed.
+    QVector<WindowPaintRegion> regions;
+    regions.reserve(phase2data.count());
+    for (const auto &entry : phase2data) {
+        const Phase2Data &data = entry.second;
+        regions.append({data.region, (data.mask & PAINT_WINDOW_TRANSFORMED) ? QRegion() : data.clip});
     }
-
-    QRegion paintedArea;
+    if (!presented.isEmpty()) {
+        // hides everything below like an opaque window on top
+        regions.append({QRegion(), presented});
+    }
+    QRegion background;
     // Fill any areas of the root window not covered by opaque windows
-    if (!(orig_mask & PAINT_SCREEN_BACKGROUND_FIRST)) {
-        paintedArea = dirtyArea - allclips;
-        paintBackground(paintedArea);
+    const bool paintsBackground = !(orig_mask & PAINT_SCREEN_BACKGROUND_FIRST);
+    QRegion paintedArea = cullWindowPaintRegions(regions, dirtyArea, repaint_region, displayRegion,
+                                                 paintsBackground ? &background : nullptr);
+    paintedArea -= presented;
+    if (paintsBackground) {
+        paintBackground(background);
     }
-
-    // Now walk the list bottom to top and draw the windows.
     for (int i = 0; i < phase2data.count(); ++i) {
-        Phase2Data *data = &phase2data[i].second;
+        phase2data[i].second.region = regions.at(i).region;
+    }
 
-        // add all regions which have been drawn so far
-        paintedArea |= data->region;
-        data->region = paintedArea;
+    prepareWindows(phase2data);
 
-        paintWindow(data->window, data->mask, data->region, data->quads);
+    // and draw the windows.
+    for (int i = 0; i < phase2data.count(); ++i) {
+        const Phase2Data &data = phase2data.at(i).second;
+        paintWindow(data.window, data.mask, data.region, data.quads);
     }
 
     if (fullRepaint) {
@@ -392,6 +400,57 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
     }
 }
 
+QRegion cullWindowPaintRegions(QVector<WindowPaintRegion> &windows, const QRegion &dirtyArea,
+                               const QRegion &repaintRegion, const QRegion &displayRegion,
+                               QRegion *background)
+{
+    const bool fullRepaint = (dirtyArea == displayRegion);
+    // The occlusion culling pass works on RectSets, which avoid the normalization
+    // of QRegion for each of the many operations per window
+    RectSet allclips;
+    RectSet upperTranslucentDamage(repaintRegion);
+    // stay RectSets until the accumulation is done
+    QVector<RectSet> regions(windows.count());
+
+    // This is the occlusion culling pass
+    for (int i = windows.count() - 1; i >= 0; --i) {
+        const WindowPaintRegion &window = windows.at(i);
+
+        RectSet region(fullRepaint ? displayRegion : window.region);
+        if (!fullRepaint)
+            region |= upperTranslucentDamage;
+
+        // subtract the parts which will possibly been drawn as part of
+        // a higher opaque window
+        region -= allclips;
+
+        if (!window.clip.isEmpty()) {
+            const RectSet clip(window.clip);
+            // clip away the opaque regions for all windows below this one
+            allclips |= clip;
+            // extend the translucent damage for windows below this by remaining (translucent) regions
+            if (!fullRepaint)
+                upperTranslucentDamage |= region - clip;
+        } else if (!fullRepaint) {
+            upperTranslucentDamage |= region;
+        }
+        regions[i] = region;
+    }
+
+    RectSet paintedArea;
+    if (background) {
+        paintedArea = RectSet(dirtyArea) - allclips;
+        *background = paintedArea.toRegion();
+    }
+
+    // Now walk the list bottom to top and add all regions which have been drawn so far.
+    for (int i = 0; i < windows.count(); ++i) {
+        paintedArea |= regions.at(i);
+        windows[i].region = paintedArea.toRegion();
+    }
+    return windows.isEmpty() ? paintedArea.toRegion() : windows.last().region;
+}
+
 void Scene::windowAdded(Toplevel *c)
 {
     assert(!m_windows.contains(c));
@@ -407,6 +466,7 @@ void Scene::windowAdded(Toplevel *c)
 void Scene::windowClosed(Toplevel *c, Deleted *deleted)
 {
     assert(m_windows.contains(c));
+    clearStackingOrder();
     if (deleted != NULL) {
         // replace c with deleted
         Window* w = m_windows.take(c);
@@ -424,6 +484,7 @@ void Scene::windowClosed(Toplevel *c, Deleted *deleted)
 void Scene::windowDeleted(Deleted *c)
 {
     assert(m_windows.contains(c));
+    clearStackingOrder();
     delete m_windows.take(c);
     c->effectWindow()->setSceneWindow(NULL);
 }
@@ -438,20 +499,63 @@ void Scene::windowGeometryShapeChanged(Toplevel *c)
 
 void Scene::createStackingOrder(ToplevelList toplevels)
 {
-    // TODO: cache the stacking_order in case it has not changed
+    // the Compositor only creates a new list if the stacking order changed,
+    // so comparing the implicitly shared lists is cheap for unchanged frames
+    if (!stacking_order.isEmpty() && toplevels == m_stackingOrderToplevels) {
+        return;
+    }
+    stacking_order.clear();
+    stacking_order.reserve(toplevels.count());
     foreach (Toplevel *c, toplevels) {
         assert(m_windows.contains(c));
         stacking_order.append(m_windows[ c ]);
     }
+    m_stackingOrderToplevels = toplevels;
 }
 
 void Scene::clearStackingOrder()
 {
     stacking_order.clear();
+    m_stackingOrderToplevels.clear();
+}
+
+QVector<int> Scene::damagedScreens(const QRegion &damage) const
+{
+    QRegion region = damage;
+    foreach (Window *w, stacking_order) {
+        region |= w->window()->repaints();
+    }
+    QVector<int> ids;
+    if (region.isEmpty()) {
+        return ids;
+    }
+    Compositor *compositor = Compositor::self();
+    for (int i = 0; i < screens()->count(); ++i) {
+        if (compositor && compositor->isBufferSwapPendingForScreen(i)) {
+            continue;
+        }
+        if (region.intersects(screens()->geometry(i))) {
+            ids << i;
+        }
+    }
+    return ids;
 }
 
 static Scene::Window *s_recursionCheck = NULL;
 
+void Scene::prepareWindows(const QList<QPair<Window*, Phase2Data> > &windows)
+{
+    Q_UNUSED(windows);
+}
+
+bool Scene::presentWithoutPainting(const QList<QPair<Window*, Phase2Data> > &windows, QRegion *presented, QRegion *repaint)
+{
+    Q_UNUSED(windows);
+    Q_UNUSED(presented);
+    Q_UNUSED(repaint);
+    return false;
+}
+
 void Scene::paintWindow(Window* w, int mask, QRegion region, WindowQuadList quads)
 {
     // no painting outside visible screen (and no transformations)
@@ -692,6 +796,17 @@ void Scene::Window::unreferencePreviousPixmap()
     }
 }
 
+void Scene::Window::updatePixmapWithoutPainting()
+{
+    WindowPixmap *pixmap = windowPixmap<WindowPixmap>();
+    if (!pixmap) {
+        return;
+    }
+    // the tracked damage of the surfaces stays for the texture update
+    pixmap->updateBuffer();
+    toplevel->resetDamage();
+}
+
 void Scene::Window::pixmapDiscarded()
 {
     if (!m_currentPixmap.isNull()) {
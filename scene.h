@@ -56,6 +56,33 @@ class OverlayWindow;
 class Shadow;
 class WindowPixmap;
 
+/**
+ * The regions of a window in the occlusion culling of Scene::paintSimpleScreen.
+ **/
+struct WindowPaintRegion {
+    // the damage of the window, afterwards the area painted up to and including the window
+    QRegion region;
+    // the opaque part of the window hiding the windows below, empty if it hides nothing
+    QRegion clip;
+};
+
+/**
+ * The occlusion culling of Scene::paintSimpleScreen for the @p windows, bottom to top.
+ * The region of each window gets reduced to the part not hidden by the windows above,
+ * extended by the translucent damage above it. Then the regions are accumulated bottom
+ * to top, so that each holds the area painted up to and including the window.
+ *
+ * @param dirtyArea The damage of the frame, including @p repaintRegion
+ * @param repaintRegion The damage to bring a reused back buffer up to date
+ * @param displayRegion The area painted on a full repaint
+ * @param background Set to the part of @p dirtyArea not hidden by any window, @c nullptr
+ * if the background is already painted
+ * @returns the area painted by the background and all windows
+ **/
+KWIN_EXPORT QRegion cullWindowPaintRegions(QVector<WindowPaintRegion> &windows, const QRegion &dirtyArea,
+                                           const QRegion &repaintRegion, const QRegion &displayRegion,
+                                           QRegion *background);
+
 // The base class for compositing backends.
 class KWIN_EXPORT Scene : public QObject
 {
@@ -170,7 +197,14 @@ public Q_SLOTS:
 protected:
     virtual Window *createWindow(Toplevel *toplevel) = 0;
     void createStackingOrder(ToplevelList toplevels);
+    // invalidates the cached stacking order
     void clearStackingOrder();
+    /**
+     * @returns the ids of the screens which have to be repainted for @p damage and the
+     * repaints of the windows in the stacking order. Screens which are still waiting
+     * for their buffer swap are skipped, the Compositor keeps their repaints.
+     **/
+    QVector<int> damagedScreens(const QRegion &damage) const;
     // shared implementation, starts painting the screen
     void paintScreen(int *mask, const QRegion &damage, const QRegion &repaint,
                      QRegion *updateRegion, QRegion *validRegion, const QMatrix4x4 &projection = QMatrix4x4(), const QRect &outputGeometry = QRect());
@@ -210,6 +244,14 @@ protected:
         int mask;
         WindowQuadList quads;
     };
+    // called by paintSimpleScreen() with the final regions of all windows before the first one
+    // gets painted, lets the scene prepare all windows at once. The default is NOOP
+    virtual void prepareWindows(const QList<QPair<Window*, Phase2Data> > &windows);
+    // called by paintSimpleScreen() after the pre-paint pass with the windows to paint, lets the
+    // scene present windows without painting them, e.g. on hardware planes. Returns true if nothing
+    // has to be painted at all, otherwise sets @p presented to the area not to paint and @p repaint
+    // to the area which is no longer presented that way. The default is NOOP
+    virtual bool presentWithoutPainting(const QList<QPair<Window*, Phase2Data> > &windows, QRegion *presented, QRegion *repaint);
     // The region which actually has been painted by paintScreen() and should be
     // copied from the buffer to the screen. I.e. the region returned from Scene::paintScreen().
     // Since prePaintWindow() can extend areas to paint, these changes would have to propagate
@@ -227,8 +269,10 @@ private:
     void paintWindowThumbnails(Scene::Window *w, QRegion region, qreal opacity, qreal brightness, qreal saturation);
     void paintDesktopThumbnails(Scene::Window *w);
     QHash< Toplevel*, Window* > m_windows;
-    // windows in their stacking order
+    // windows in their stacking order, kept between frames as long as the stacking order does not change
     QVector< Window* > stacking_order;
+    // the toplevels stacking_order got created from
+    ToplevelList m_stackingOrderToplevels;
 };
 
 // The base class for windows representations in composite backends
@@ -288,6 +332,12 @@ public:
     Shadow* shadow();
     void referencePreviousPixmap();
     void unreferencePreviousPixmap();
+    /**
+     * Moves the WindowPixmap to the current buffers of the surfaces without painting the window,
+     * e.g. when they got presented on a hardware plane. The buffers the window was painted from
+     * last get released to the client. The textures get updated once the window gets painted again.
+     **/
+    void updatePixmapWithoutPainting();
 protected:
     WindowQuadList makeQuads(WindowQuadType type, const QRegion& reg, const QPoint &textureOffset = QPoint(0, 0)) const;
     WindowQuadList makeDecorationQuads(const QRect *rects, const QRegion &region) const;
@@ -452,6 +502,7 @@ protected:
     }
 
 private:
+    friend class Scene::Window;
     Scene::Window *m_window;
     xcb_pixmap_t m_pixmap;
     QSize m_pixmapSize;
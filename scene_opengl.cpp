@@ -44,6 +44,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "screens.h"
 #include "decorations/decoratedclient.h"
 
+#include <KWayland/Server/buffer_interface.h>
 #include <KWayland/Server/subcompositor_interface.h>
 #include <KWayland/Server/surface_interface.h>
 
@@ -58,6 +59,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QDBusInterface>
 #include <QGraphicsScale>
 #include <QStringList>
+#include <QVarLengthArray>
 #include <QVector2D>
 #include <QVector4D>
 #include <QMatrix4x4>
@@ -82,6 +84,11 @@ namespace KWin
 
 extern int currentRefreshRate();
 
+// the layout of the GLVertex2D based window geometry
+static const GLVertexAttrib s_windowVertexAttribs[] = {
+    { VA_Position, 2, GL_FLOAT, offsetof(GLVertex2D, position) },
+    { VA_TexCoord, 2, GL_FLOAT, offsetof(GLVertex2D, texcoord) },
+};
 
 /**
  * SyncObject represents a fence used to synchronize operations in
@@ -302,6 +309,108 @@ bool SyncManager::updateFences()
 // -----------------------------------------------------------------------
 
 
+/**
+ * Measures how long rendering a screen takes. Where timer queries are supported, the time the
+ * GPU spent on the commands gets added. The query result is read back in a later frame, so
+ * that the CPU never waits for the GPU.
+ **/
+class RenderTimer
+{
+public:
+    explicit RenderTimer(bool gpuTimer);
+    ~RenderTimer();
+
+    void begin();
+    void end();
+    /**
+     * @returns the render time in nsec of the last finished measurement, or @c -1 if no
+     * measurement finished since the last call.
+     **/
+    qint64 takeSample();
+
+private:
+    void collect();
+
+    QElapsedTimer m_cpuTimer;
+    qint64 m_cpuTime = 0;
+    qint64 m_sample = -1;
+    GLuint m_query = 0;
+    bool m_queryPending = false;
+    bool m_measuring = false;
+};
+
+RenderTimer::RenderTimer(bool gpuTimer)
+{
+    if (gpuTimer) {
+        glGenQueries(1, &m_query);
+    }
+}
+
+RenderTimer::~RenderTimer()
+{
+    if (m_query) {
+        glDeleteQueries(1, &m_query);
+    }
+}
+
+void RenderTimer::begin()
+{
+    collect();
+    // a frame whose GPU time is still unknown leaves the query busy, skip measuring this one
+    m_measuring = !m_queryPending;
+    if (!m_measuring) {
+        return;
+    }
+    m_cpuTimer.start();
+    if (m_query) {
+        glBeginQuery(GL_TIME_ELAPSED, m_query);
+    }
+}
+
+void RenderTimer::end()
+{
+    if (!m_measuring) {
+        return;
+    }
+    m_measuring = false;
+    m_cpuTime = m_cpuTimer.nsecsElapsed();
+    if (m_query) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_queryPending = true;
+    } else {
+        m_sample = m_cpuTime;
+    }
+}
+
+void RenderTimer::collect()
+{
+    if (!m_queryPending) {
+        return;
+    }
+    GLint available = 0;
+    glGetQueryObjectiv(m_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return;
+    }
+    GLuint64 gpuTime = 0;
+    glGetQueryObjectui64v(m_query, GL_QUERY_RESULT, &gpuTime);
+    m_queryPending = false;
+    // the GPU might only start once the commands got flushed, so the sum is the upper bound
+    m_sample = m_cpuTime + qint64(gpuTime);
+}
+
+qint64 RenderTimer::takeSample()
+{
+    collect();
+    const qint64 sample = m_sample;
+    m_sample = -1;
+    return sample;
+}
+
+
+// -----------------------------------------------------------------------
+
+
 
 //****************************************
 // SceneOpenGL
@@ -335,26 +444,13 @@ void OpenGLBackend::idle()
 
 void OpenGLBackend::addToDamageHistory(const QRegion &region)
 {
-    if (m_damageHistory.count() > 10)
-        m_damageHistory.removeLast();
-
-    m_damageHistory.prepend(region);
+    m_damageHistory.add(region);
 }
 
 QRegion OpenGLBackend::accumulatedDamageHistory(int bufferAge) const
 {
-    QRegion region;
-
-    // Note: An age of zero means the buffer contents are undefined
-    if (bufferAge > 0 && bufferAge <= m_damageHistory.count()) {
-        for (int i = 0; i < bufferAge - 1; i++)
-            region |= m_damageHistory[i];
-    } else {
-        const QSize &s = screens()->size();
-        region = QRegion(0, 0, s.width(), s.height());
-    }
-
-    return region;
+    const QSize &s = screens()->size();
+    return m_damageHistory.accumulated(bufferAge, QRegion(0, 0, s.width(), s.height()));
 }
 
 OverlayWindow* OpenGLBackend::overlayWindow()
@@ -380,6 +476,20 @@ bool OpenGLBackend::perScreenRendering() const
     return false;
 }
 
+bool OpenGLBackend::directScanout(int screenId, KWayland::Server::BufferInterface *buffer)
+{
+    Q_UNUSED(screenId)
+    Q_UNUSED(buffer)
+    return false;
+}
+
+QRegion OpenGLBackend::assignOverlays(int screenId, const QVector<OverlayCandidate> &candidates)
+{
+    Q_UNUSED(screenId)
+    Q_UNUSED(candidates)
+    return QRegion();
+}
+
 /************************************************
  * SceneOpenGL
  ***********************************************/
@@ -437,6 +547,8 @@ SceneOpenGL::SceneOpenGL(OpenGLBackend *backend, QObject *parent)
             qCDebug(KWIN_CORE) << "Explicit synchronization with the X command stream disabled by environment variable";
         }
     }
+
+    m_gpuRenderTimer = !glPlatform->isGLES() && (hasGLVersion(3, 3) || hasGLExtension(QByteArrayLiteral("GL_ARB_timer_query")));
 }
 
 static SceneOpenGL *gs_debuggedScene = nullptr;
@@ -447,6 +559,7 @@ SceneOpenGL::~SceneOpenGL()
     SceneOpenGL::EffectFrame::cleanup();
     if (init_ok) {
         delete m_syncManager;
+        qDeleteAll(m_renderTimers);
 
         // backend might be still needed for a different scene
         delete m_backend;
@@ -692,12 +805,14 @@ qint64 SceneOpenGL::paint(QRegion damage, ToplevelList toplevels)
     if (m_backend->perScreenRendering()) {
         // trigger start render timer
         m_backend->prepareRenderingFrame();
-        for (int i = 0; i < screens()->count(); ++i) {
+        const QVector<int> damaged = damagedScreens(damage);
+        m_overlayRegions.resize(screens()->count());
+        for (int i : damaged) {
             const QRect &geo = screens()->geometry(i);
             QRegion update;
             QRegion valid;
             // prepare rendering makes context current on the output
-            QRegion repaint = m_backend->prepareRenderingForScreen(i);
+            const QRegion repaint = m_backend->prepareRenderingForScreen(i);
             GLVertexBuffer::setVirtualScreenGeometry(geo);
             GLRenderTarget::setVirtualScreenGeometry(geo);
 
@@ -707,13 +822,30 @@ qint64 SceneOpenGL::paint(QRegion damage, ToplevelList toplevels)
                 return 0;
             }
 
+            RenderTimer *timer = renderTimer(i);
+            timer->begin();
             int mask = 0;
             updateProjectionMatrix();
+            // the windows can only be presented without painting after the effects' pre-paint pass
+            m_presentingScreen = i;
+            m_presentedWithoutPainting = false;
+            m_scannedOut = false;
             paintScreen(&mask, damage.intersected(geo), repaint, &update, &valid, projectionMatrix(), geo);   // call generic implementation
+            if (!m_presentedWithoutPainting && !m_overlayRegions.value(i).isEmpty()) {
+                // painted with transformations, everything got painted
+                m_backend->assignOverlays(i, QVector<OpenGLBackend::OverlayCandidate>());
+                m_overlayRegions[i] = QRegion();
+            }
+            m_presentingScreen = -1;
 
             GLVertexBuffer::streamingBuffer()->endOfFrame();
+            // the swap might block till the vblank, it does not count
+            timer->end();
 
-            m_backend->endRenderingFrameForScreen(i, valid, update);
+            // when scanned out nothing got painted, the buffer is already presented
+            if (!m_scannedOut) {
+                m_backend->endRenderingFrameForScreen(i, valid, update);
+            }
 
             GLVertexBuffer::streamingBuffer()->framePosted();
         }
@@ -729,6 +861,8 @@ qint64 SceneOpenGL::paint(QRegion damage, ToplevelList toplevels)
         GLVertexBuffer::setVirtualScreenGeometry(screens()->geometry());
         GLRenderTarget::setVirtualScreenGeometry(screens()->geometry());
 
+        RenderTimer *timer = renderTimer(0);
+        timer->begin();
         int mask = 0;
         updateProjectionMatrix();
         paintScreen(&mask, damage, repaint, &updateRegion, &validRegion, projectionMatrix());   // call generic implementation
@@ -749,6 +883,7 @@ qint64 SceneOpenGL::paint(QRegion damage, ToplevelList toplevels)
         }
 
         GLVertexBuffer::streamingBuffer()->endOfFrame();
+        timer->end();
 
         m_backend->endRenderingFrame(validRegion, updateRegion);
 
@@ -765,11 +900,169 @@ qint64 SceneOpenGL::paint(QRegion damage, ToplevelList toplevels)
         m_currentFence = nullptr;
     }
 
-    // do cleanup
-    clearStackingOrder();
+    // the GPU times of earlier frames might have arrived in the meantime
+    if (Compositor *compositor = Compositor::self()) {
+        const bool perScreen = m_backend->perScreenRendering();
+        for (int i = 0; i < m_renderTimers.count(); ++i) {
+            const qint64 sample = m_renderTimers.at(i)->takeSample();
+            if (sample >= 0) {
+                compositor->addRenderTimeSample(perScreen ? i : -1, sample);
+            }
+        }
+    }
+
     return m_backend->renderTime();
 }
 
+RenderTimer *SceneOpenGL::renderTimer(int index)
+{
+    while (m_renderTimers.count() <= index) {
+        m_renderTimers << new RenderTimer(m_gpuRenderTimer);
+    }
+    return m_renderTimers.at(index);
+}
+
+/**
+ * Whether effects change how the window @p w gets painted in this frame, according to the
+ * @p mask after their pre-paint pass, or paint something behind it.
+ **/
+static bool paintedByEffects(Scene::Window *w, int mask)
+{
+    if (mask & (Scene::PAINT_WINDOW_TRANSFORMED | Scene::PAINT_WINDOW_TRANSLUCENT)) {
+        return true;
+    }
+    const EffectWindowImpl *effectWindow = w->window()->effectWindow();
+    if (!effectWindow) {
+        return false;
+    }
+    return effectWindow->data(WindowBlurBehindRole).isValid() || effectWindow->data(WindowForceBlurRole).toBool() ||
+        effectWindow->data(WindowBackgroundContrastRole).isValid() || effectWindow->data(WindowForceBackgroundContrastRole).toBool();
+}
+
+Scene::Window *SceneOpenGL::directScanoutCandidate(const QRect &screenGeometry, const QList<QPair<Scene::Window*, Phase2Data> > &windows) const
+{
+    // a software cursor paints on top of the windows
+    if (!waylandServer() || kwinApp()->platform()->usesSoftwareCursor()) {
+        return nullptr;
+    }
+    // only the topmost window on the screen can be scanned out
+    for (auto it = windows.crbegin(); it != windows.crend(); ++it) {
+        Scene::Window *w = it->first;
+        Toplevel *toplevel = w->window();
+        if (!toplevel->visibleRect().intersects(screenGeometry)) {
+            continue;
+        }
+        AbstractClient *c = dynamic_cast<AbstractClient*>(toplevel);
+        if (!c || !c->isFullScreen() || c->isDecorated() || !w->isOpaque() ||
+                toplevel->visibleRect() != screenGeometry || paintedByEffects(w, it->second.mask)) {
+            return nullptr;
+        }
+        KWayland::Server::SurfaceInterface *surface = toplevel->surface();
+        if (!surface || surface->scale() != 1 || !surface->childSubSurfaces().isEmpty()) {
+            return nullptr;
+        }
+        KWayland::Server::BufferInterface *buffer = surface->buffer();
+        // shared memory buffers have to be copied anyway
+        if (!buffer || buffer->shmBuffer() || buffer->size() != screenGeometry.size()) {
+            return nullptr;
+        }
+        return w;
+    }
+    return nullptr;
+}
+
+static void collectOverlayCandidates(KWayland::Server::SurfaceInterface *surface, const QPoint &pos, const QRect &screenGeometry,
+                                     QRegion *above, QVector<OpenGLBackend::OverlayCandidate> *candidates)
+{
+    // the sub-surfaces are stacked above their parent, the last one is the topmost
+    const auto subSurfaces = surface->childSubSurfaces();
+    for (auto it = subSurfaces.crbegin(); it != subSurfaces.crend(); ++it) {
+        const auto &subSurface = *it;
+        if (subSurface.isNull() || subSurface->surface().isNull() || !subSurface->surface()->isMapped()) {
+            continue;
+        }
+        collectOverlayCandidates(subSurface->surface().data(), pos + subSurface->position(), screenGeometry, above, candidates);
+    }
+    const QRect geometry(pos, surface->size());
+    KWayland::Server::BufferInterface *buffer = surface->buffer();
+    if (buffer && !buffer->shmBuffer() && !buffer->hasAlphaChannel() && surface->scale() == 1 &&
+            buffer->size() == geometry.size() && screenGeometry.contains(geometry) && !above->intersects(geometry)) {
+        candidates->append({buffer, geometry});
+    }
+    *above |= geometry;
+}
+
+QRegion SceneOpenGL::assignOverlays(int screenId, const QRect &screenGeometry, const QList<QPair<Scene::Window*, Phase2Data> > &windows)
+{
+    QVector<OpenGLBackend::OverlayCandidate> candidates;
+    // the window of each candidate
+    QVector<Scene::Window*> candidateWindows;
+    // nothing may be painted on top of the surfaces
+    if (waylandServer() && !kwinApp()->platform()->usesSoftwareCursor()) {
+        QRegion above;
+        for (auto it = windows.crbegin(); it != windows.crend(); ++it) {
+            Scene::Window *w = it->first;
+            const int mask = it->second.mask;
+            if (mask & PAINT_WINDOW_TRANSFORMED) {
+                // could end up anywhere on the screen, covering the windows below
+                break;
+            }
+            Toplevel *toplevel = w->window();
+            if (!toplevel->visibleRect().intersects(screenGeometry)) {
+                continue;
+            }
+            KWayland::Server::SurfaceInterface *surface = toplevel->surface();
+            if (surface && toplevel->opacity() == 1.0 && !paintedByEffects(w, mask)) {
+                collectOverlayCandidates(surface, toplevel->pos() + toplevel->clientPos(), screenGeometry, &above, &candidates);
+                while (candidateWindows.count() < candidates.count()) {
+                    candidateWindows << w;
+                }
+            }
+            above |= toplevel->visibleRect();
+        }
+    }
+    const QRegion overlays = m_backend->assignOverlays(screenId, candidates);
+    // the overlays reference the buffers, the pixmaps must not keep the last painted ones
+    Scene::Window *updated = nullptr;
+    for (int i = 0; i < candidates.count(); ++i) {
+        Scene::Window *w = candidateWindows.at(i);
+        if (w != updated && overlays.intersects(candidates.at(i).geometry)) {
+            w->updatePixmapWithoutPainting();
+            updated = w;
+        }
+    }
+    return overlays;
+}
+
+bool SceneOpenGL::presentWithoutPainting(const QList<QPair<Scene::Window*, Phase2Data> > &windows, QRegion *presented, QRegion *repaint)
+{
+    // only once per screen, without per screen rendering nothing is presented this way
+    if (m_presentingScreen < 0 || m_presentedWithoutPainting) {
+        return false;
+    }
+    const int screenId = m_presentingScreen;
+    const QRect &geo = screens()->geometry(screenId);
+    const QRegion previousOverlays = m_overlayRegions.at(screenId);
+    m_presentedWithoutPainting = true;
+    if (Scene::Window *w = directScanoutCandidate(geo, windows)) {
+        // the overlay planes would show on top of the scanned out buffer
+        m_backend->assignOverlays(screenId, QVector<OpenGLBackend::OverlayCandidate>());
+        m_overlayRegions[screenId] = QRegion();
+        if (m_backend->directScanout(screenId, w->window()->surface()->buffer())) {
+            // the scanout references the buffer, the pixmap must not keep the last painted one
+            w->updatePixmapWithoutPainting();
+            m_scannedOut = true;
+            return true;
+        }
+    }
+    // what the overlays no longer cover has to be painted again
+    const QRegion overlays = assignOverlays(screenId, geo, windows);
+    *presented = overlays;
+    *repaint = previousOverlays - overlays;
+    m_overlayRegions[screenId] = overlays;
+    return false;
+}
+
 QMatrix4x4 SceneOpenGL::transformation(int mask, const ScreenPaintData &data) const
 {
     QMatrix4x4 matrix;
@@ -991,6 +1284,9 @@ bool SceneOpenGL2::supported(OpenGLBackend *backend)
 SceneOpenGL2::SceneOpenGL2(OpenGLBackend *backend, QObject *parent)
     : SceneOpenGL(backend, parent)
     , m_lanczosFilter(NULL)
+    , m_lanczosCache(nullptr)
+    , m_windowBatch(nullptr)
+    , m_windowBatchSerial(0)
 {
     if (!init_ok) {
         // base ctor already failed
@@ -1034,6 +1330,8 @@ SceneOpenGL2::SceneOpenGL2(OpenGLBackend *backend, QObject *parent)
 
 SceneOpenGL2::~SceneOpenGL2()
 {
+    delete m_windowBatch;
+    delete m_lanczosCache;
 }
 
 QMatrix4x4 SceneOpenGL2::createProjectionMatrix() const
@@ -1078,6 +1376,50 @@ void SceneOpenGL2::paintSimpleScreen(int mask, QRegion region)
     m_screenProjectionMatrix = m_projectionMatrix;
 
     Scene::paintSimpleScreen(mask, region);
+
+    // the batch is only valid for this pass
+    m_windowBatchSerial++;
+}
+
+void SceneOpenGL2::prepareWindows(const QList<QPair<Scene::Window*, Phase2Data> > &windows)
+{
+    m_windowBatchSerial++;
+
+    const bool indexedQuads = GLVertexBuffer::supportsIndexedQuads();
+    const GLenum primitiveType = indexedQuads ? GL_QUADS : GL_TRIANGLES;
+    const int verticesPerQuad = indexedQuads ? 4 : 6;
+
+    QVarLengthArray<SceneOpenGL2Window *, 32> batched;
+    int vertexCount = 0;
+    for (const auto &entry : windows) {
+        const Phase2Data &data = entry.second;
+        SceneOpenGL2Window *w = static_cast<SceneOpenGL2Window *>(data.window);
+        const int count = w->prepareBatch(data.mask, data.region, data.quads, verticesPerQuad);
+        if (count > 0) {
+            batched << w;
+            vertexCount += count;
+        }
+    }
+    if (batched.count() < 2) {
+        // a single window does not gain anything compared to the streaming buffer
+        return;
+    }
+
+    if (!m_windowBatch) {
+        m_windowBatch = new GLVertexBuffer(GLVertexBuffer::Stream);
+        m_windowBatch->setAttribLayout(s_windowVertexAttribs, 2, sizeof(GLVertex2D));
+    }
+
+    // upload the geometry of all windows with a single map
+    GLVertex2D *map = (GLVertex2D *) m_windowBatch->map(vertexCount * sizeof(GLVertex2D));
+    if (!map) {
+        return;
+    }
+    int firstVertex = 0;
+    for (SceneOpenGL2Window *w : batched) {
+        firstVertex += w->writeBatch(map, firstVertex, primitiveType, m_windowBatchSerial);
+    }
+    m_windowBatch->unmap();
 }
 
 void SceneOpenGL2::paintGenericScreen(int mask, ScreenPaintData data)
@@ -1121,7 +1463,11 @@ void SceneOpenGL2::performPaintWindow(EffectWindowImpl* w, int mask, QRegion reg
 {
     if (mask & PAINT_WINDOW_LANCZOS) {
         if (!m_lanczosFilter) {
-            m_lanczosFilter = new LanczosFilter(this);
+            if (!m_lanczosCache) {
+                // the cache outlives the filter, which gets recreated on screen changes
+                m_lanczosCache = new LanczosCache(this);
+            }
+            m_lanczosFilter = new LanczosFilter(m_lanczosCache, this);
             // recreate the lanczos filter when the screen gets resized
             connect(screens(), SIGNAL(changed()), SLOT(resetLanczosFilter()));
         }
@@ -1254,13 +1600,35 @@ QMatrix4x4 SceneOpenGL::Window::transformation(int mask, const WindowPaintData &
     return matrix;
 }
 
+bool SceneOpenGL::Window::isClippingRequired(const QRegion &region, const WindowQuadList &quads) const
+{
+    if (region == infiniteRegion() || quads.isEmpty()) {
+        return false;
+    }
+    qreal left = quads.first().left();
+    qreal top = quads.first().top();
+    qreal right = quads.first().right();
+    qreal bottom = quads.first().bottom();
+    for (const WindowQuad &quad : quads) {
+        left = qMin(left, quad.left());
+        top = qMin(top, quad.top());
+        right = qMax(right, quad.right());
+        bottom = qMax(bottom, quad.bottom());
+    }
+    // parts outside of the screen don't need to be clipped, they are not visible anyway
+    const QRect screen(QPoint(0, 0), screens()->size());
+    const QRect bounds = QRectF(QPointF(left, top), QPointF(right, bottom)).translated(x(), y()).toAlignedRect() & screen;
+    return !(QRegion(bounds) - region).isEmpty();
+}
+
 bool SceneOpenGL::Window::beginRenderWindow(int mask, const QRegion &region, WindowPaintData &data)
 {
     if (region.isEmpty())
         return false;
 
     m_hardwareClipping = region != infiniteRegion() && (mask & PAINT_WINDOW_TRANSFORMED) && !(mask & PAINT_SCREEN_TRANSFORMED);
-    if (region != infiniteRegion() && !m_hardwareClipping) {
+    // keep the quads untouched if the region covers them, so that they stay shared with the cached leafs
+    if (!m_hardwareClipping && isClippingRequired(region, data.quads)) {
         WindowQuadList quads;
         quads.reserve(data.quads.count());
 
@@ -1305,14 +1673,9 @@ bool SceneOpenGL::Window::beginRenderWindow(int mask, const QRegion &region, Win
 
     s_frameTexture->setFilter(filter == ImageFilterGood ? GL_LINEAR : GL_NEAREST);
 
-    const GLVertexAttrib attribs[] = {
-        { VA_Position, 2, GL_FLOAT, offsetof(GLVertex2D, position) },
-        { VA_TexCoord, 2, GL_FLOAT, offsetof(GLVertex2D, texcoord) },
-    };
-
     GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
     vbo->reset();
-    vbo->setAttribLayout(attribs, 2, sizeof(GLVertex2D));
+    vbo->setAttribLayout(s_windowVertexAttribs, 2, sizeof(GLVertex2D));
 
     return true;
 }
@@ -1361,6 +1724,7 @@ WindowPixmap* SceneOpenGL::Window::createWindowPixmap()
 SceneOpenGL2Window::SceneOpenGL2Window(Toplevel *c)
     : SceneOpenGL::Window(c)
     , m_blendingEnabled(false)
+    , m_batchSerial(0)
 {
 }
 
@@ -1386,7 +1750,7 @@ void SceneOpenGL2Window::setBlendEnabled(bool enabled)
     m_blendingEnabled = enabled;
 }
 
-void SceneOpenGL2Window::setupLeafNodes(LeafNode *nodes, const WindowQuadList *quads, const WindowPaintData &data)
+void SceneOpenGL2Window::setupLeafNodes(LeafNode *nodes, const WindowQuadArrays *quads, const WindowPaintData &data)
 {
     if (!quads[ShadowLeaf].isEmpty()) {
         nodes[ShadowLeaf].texture = static_cast<SceneOpenGLShadow *>(m_shadow)->shadowTexture();
@@ -1470,6 +1834,123 @@ static void renderSubSurface(GLShader *shader, const QMatrix4x4 &mvp, const QMat
     }
 }
 
+void SceneOpenGL2Window::updateLeafQuads(const WindowQuadList &quads)
+{
+    if (quads.isSharedWith(m_leafQuadsSource) && !m_leafQuadsSource.isEmpty()) {
+        // neither the window nor an effect changed the quads since the last frame
+        return;
+    }
+    m_leafQuadsSource = quads;
+    for (int i = 0; i < LeafCount; i++) {
+        m_leafQuads[i].clear();
+    }
+
+    // Split the quads into separate lists for each type
+    for (const WindowQuad &quad : quads) {
+        switch (quad.type()) {
+        case WindowQuadDecoration:
+            m_leafQuads[DecorationLeaf].append(quad);
+            continue;
+
+        case WindowQuadContents:
+            m_leafQuads[ContentLeaf].append(quad);
+            continue;
+
+        case WindowQuadShadow:
+            m_leafQuads[ShadowLeaf].append(quad);
+            continue;
+
+        default:
+            continue;
+        }
+    }
+}
+
+int SceneOpenGL2Window::prepareBatch(int mask, const QRegion &region, const WindowQuadList &quads, int verticesPerQuad)
+{
+    m_batchQuads = WindowQuadList();
+    if (mask & (Scene::PAINT_WINDOW_TRANSFORMED | Scene::PAINT_SCREEN_TRANSFORMED)) {
+        return 0;
+    }
+    // same clipping as done by Scene::paintWindow and beginRenderWindow
+    const QRegion screenRegion = region & QRect(QPoint(0, 0), screens()->size());
+    if (screenRegion.isEmpty() || isClippingRequired(screenRegion, quads)) {
+        return 0;
+    }
+    OpenGLWindowPixmap *pixmap = windowPixmap<OpenGLWindowPixmap>();
+    if (!pixmap || pixmap->texture()->isNull()) {
+        return 0;
+    }
+
+    updateLeafQuads(quads);
+
+    GLTexture *textures[LeafCount] = { nullptr, nullptr, pixmap->texture(), nullptr };
+    TextureCoordinateType coordinateTypes[LeafCount] = {
+        NormalizedCoordinates, UnnormalizedCoordinates, UnnormalizedCoordinates, NormalizedCoordinates
+    };
+    if (!m_leafQuads[ShadowLeaf].isEmpty()) {
+        textures[ShadowLeaf] = static_cast<SceneOpenGLShadow *>(m_shadow)->shadowTexture();
+    }
+    if (!m_leafQuads[DecorationLeaf].isEmpty()) {
+        textures[DecorationLeaf] = getDecorationTexture();
+    }
+
+    int vertexCount = 0;
+    for (int i = 0; i < LeafCount; i++) {
+        m_batch[i] = BatchRange();
+        if (m_leafQuads[i].isEmpty() || !textures[i]) {
+            continue;
+        }
+        m_batch[i].vertexCount = m_leafQuads[i].count() * verticesPerQuad;
+        m_batch[i].textureMatrix = textures[i]->matrix(coordinateTypes[i]);
+        vertexCount += m_batch[i].vertexCount;
+    }
+    if (vertexCount > 0) {
+        m_batchQuads = quads;
+    }
+    return vertexCount;
+}
+
+int SceneOpenGL2Window::writeBatch(GLVertex2D *vertices, int firstVertex, GLenum primitiveType, quint64 serial)
+{
+    int v = firstVertex;
+    for (int i = 0; i < LeafCount; i++) {
+        if (m_batch[i].vertexCount == 0) {
+            continue;
+        }
+        m_batch[i].firstVertex = v;
+        m_leafQuads[i].makeInterleavedArrays(primitiveType, &vertices[v], m_batch[i].textureMatrix);
+        v += m_batch[i].vertexCount;
+    }
+    m_batchSerial = serial;
+    return v - firstVertex;
+}
+
+bool SceneOpenGL2Window::isBatchValid(int mask, const WindowPaintData &data, const LeafNode *nodes, int verticesPerQuad) const
+{
+    if (m_batchSerial != static_cast<SceneOpenGL2 *>(m_scene)->windowBatchSerial()) {
+        return false;
+    }
+    // an effect changed the quads or the way the window is painted
+    if (m_batchQuads.isEmpty() || !data.quads.isSharedWith(m_batchQuads)) {
+        return false;
+    }
+    if ((mask & (Scene::PAINT_WINDOW_TRANSFORMED | Scene::PAINT_SCREEN_TRANSFORMED)) || data.crossFadeProgress() != 1.0) {
+        return false;
+    }
+    // binding the textures might have changed their size
+    for (int i = 0; i < LeafCount; i++) {
+        const int vertexCount = (m_leafQuads[i].isEmpty() || !nodes[i].texture) ? 0 : m_leafQuads[i].count() * verticesPerQuad;
+        if (vertexCount != m_batch[i].vertexCount) {
+            return false;
+        }
+        if (vertexCount > 0 && nodes[i].texture->matrix(nodes[i].coordinateType) != m_batch[i].textureMatrix) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void SceneOpenGL2Window::performPaint(int mask, QRegion region, WindowPaintData data)
 {
     if (!beginRenderWindow(mask, region, data))
@@ -1498,33 +1979,18 @@ void SceneOpenGL2Window::performPaint(int mask, QRegion region, WindowPaintData
     const GLenum filter = (mask & (Effect::PAINT_WINDOW_TRANSFORMED | Effect::PAINT_SCREEN_TRANSFORMED))
                            && options->glSmoothScale() != 0 ? GL_LINEAR : GL_NEAREST;
 
-    WindowQuadList quads[LeafCount];
-
-    // Split the quads into separate lists for each type
-    foreach (const WindowQuad &quad, data.quads) {
-        switch (quad.type()) {
-        case WindowQuadDecoration:
-            quads[DecorationLeaf].append(quad);
-            continue;
-
-        case WindowQuadContents:
-            quads[ContentLeaf].append(quad);
-            continue;
-
-        case WindowQuadShadow:
-            quads[ShadowLeaf].append(quad);
-            continue;
-
-        default:
-            continue;
-        }
-    }
+    updateLeafQuads(data.quads);
+    WindowQuadArrays *quads = m_leafQuads;
+    quads[PreviousContentLeaf].clear();
 
     if (data.crossFadeProgress() != 1.0) {
         OpenGLWindowPixmap *previous = previousWindowPixmap<OpenGLWindowPixmap>();
         if (previous) {
             const QRect &oldGeometry = previous->contentsRect();
-            for (const WindowQuad &quad : quads[ContentLeaf]) {
+            for (const WindowQuad &quad : data.quads) {
+                if (quad.type() != WindowQuadContents) {
+                    continue;
+                }
                 // we need to create new window quads with normalize texture coordinates
                 // normal quads divide the x/y position by width/height. This would not work as the texture
                 // is larger than the visible content in case of a decorated Client resulting in garbage being shown.
@@ -1548,29 +2014,39 @@ void SceneOpenGL2Window::performPaint(int mask, QRegion region, WindowPaintData
     const GLenum primitiveType = indexedQuads ? GL_QUADS : GL_TRIANGLES;
     const int verticesPerQuad = indexedQuads ? 4 : 6;
 
-    const size_t size = verticesPerQuad *
-        (quads[0].count() + quads[1].count() + quads[2].count() + quads[3].count()) * sizeof(GLVertex2D);
-
-    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
-    GLVertex2D *map = (GLVertex2D *) vbo->map(size);
-
     LeafNode nodes[LeafCount];
     setupLeafNodes(nodes, quads, data);
 
-    for (int i = 0, v = 0; i < LeafCount; i++) {
-        if (quads[i].isEmpty() || !nodes[i].texture)
-            continue;
+    GLVertexBuffer *vbo = nullptr;
+    if (isBatchValid(mask, data, nodes, verticesPerQuad)) {
+        // the geometry got already uploaded together with the other windows
+        vbo = static_cast<SceneOpenGL2 *>(m_scene)->windowBatch();
+        for (int i = 0; i < LeafCount; i++) {
+            nodes[i].firstVertex = m_batch[i].firstVertex;
+            nodes[i].vertexCount = m_batch[i].vertexCount;
+        }
+    } else {
+        const size_t size = verticesPerQuad *
+            (quads[0].count() + quads[1].count() + quads[2].count() + quads[3].count()) * sizeof(GLVertex2D);
 
-        nodes[i].firstVertex = v;
-        nodes[i].vertexCount = quads[i].count() * verticesPerQuad;
+        vbo = GLVertexBuffer::streamingBuffer();
+        GLVertex2D *map = (GLVertex2D *) vbo->map(size);
 
-        const QMatrix4x4 matrix = nodes[i].texture->matrix(nodes[i].coordinateType);
+        for (int i = 0, v = 0; i < LeafCount; i++) {
+            if (quads[i].isEmpty() || !nodes[i].texture)
+                continue;
 
-        quads[i].makeInterleavedArrays(primitiveType, &map[v], matrix);
-        v += quads[i].count() * verticesPerQuad;
-    }
+            nodes[i].firstVertex = v;
+            nodes[i].vertexCount = quads[i].count() * verticesPerQuad;
+
+            const QMatrix4x4 matrix = nodes[i].texture->matrix(nodes[i].coordinateType);
 
-    vbo->unmap();
+            quads[i].makeInterleavedArrays(primitiveType, &map[v], matrix);
+            v += quads[i].count() * verticesPerQuad;
+        }
+
+        vbo->unmap();
+    }
     vbo->bindArrays();
 
     // Make sure the blend function is set up correctly in case we will be doing blending
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef KWIN_SCENE_OPENGL_H
 #define KWIN_SCENE_OPENGL_H
 
+#include "rectset.h"
 #include "scene.h"
 #include "shadow.h"
 
@@ -32,10 +33,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 namespace KWin
 {
+class LanczosCache;
 class LanczosFilter;
 class OpenGLBackend;
 class SyncManager;
 class SyncObject;
+class RenderTimer;
 
 class KWIN_EXPORT SceneOpenGL
     : public Scene
@@ -95,6 +98,7 @@ protected:
     virtual void extendPaintRegion(QRegion &region, bool opaqueFullscreen);
     QMatrix4x4 transformation(int mask, const ScreenPaintData &data) const;
     virtual void paintDesktop(int desktop, int mask, const QRegion &region, ScreenPaintData &data);
+    bool presentWithoutPainting(const QList<QPair<Scene::Window*, Phase2Data> > &windows, QRegion *presented, QRegion *repaint) override;
 
     void handleGraphicsReset(GLenum status);
 
@@ -108,11 +112,23 @@ protected:
     bool init_ok;
 private:
     bool viewportLimitsMatched(const QSize &size) const;
+    Scene::Window *directScanoutCandidate(const QRect &screenGeometry, const QList<QPair<Scene::Window*, Phase2Data> > &windows) const;
+    QRegion assignOverlays(int screenId, const QRect &screenGeometry, const QList<QPair<Scene::Window*, Phase2Data> > &windows);
+    RenderTimer *renderTimer(int index);
 private:
     bool m_debug;
     OpenGLBackend *m_backend;
     SyncManager *m_syncManager;
     SyncObject *m_currentFence;
+    // per screen the region shown by overlay planes in the last frame
+    QVector<QRegion> m_overlayRegions;
+    // the screen painted by paintScreen, -1 without per screen rendering
+    int m_presentingScreen = -1;
+    bool m_presentedWithoutPainting = false;
+    bool m_scannedOut = false;
+    // per screen, or a single one without per screen rendering
+    QVector<RenderTimer*> m_renderTimers;
+    bool m_gpuRenderTimer = false;
 };
 
 class SceneOpenGL2 : public SceneOpenGL
@@ -130,8 +146,22 @@ public:
     QMatrix4x4 projectionMatrix() const override { return m_projectionMatrix; }
     QMatrix4x4 screenProjectionMatrix() const override { return m_screenProjectionMatrix; }
 
+    /**
+     * The vertex buffer holding the geometry of all windows prepared in prepareWindows().
+     **/
+    GLVertexBuffer *windowBatch() const {
+        return m_windowBatch;
+    }
+    /**
+     * Changes whenever the content of windowBatch() is no longer valid.
+     **/
+    quint64 windowBatchSerial() const {
+        return m_windowBatchSerial;
+    }
+
 protected:
     virtual void paintSimpleScreen(int mask, QRegion region);
+    void prepareWindows(const QList<QPair<Scene::Window*, Phase2Data> > &windows) override;
     virtual void paintGenericScreen(int mask, ScreenPaintData data);
     virtual void doPaintBackground(const QVector< float >& vertices);
     virtual Scene::Window *createWindow(Toplevel *t);
@@ -147,9 +177,12 @@ private:
 
 private:
     LanczosFilter *m_lanczosFilter;
+    LanczosCache *m_lanczosCache;
     QMatrix4x4 m_projectionMatrix;
     QMatrix4x4 m_screenProjectionMatrix;
     GLuint vao;
+    GLVertexBuffer *m_windowBatch;
+    quint64 m_windowBatchSerial;
 };
 
 class SceneOpenGL::TexturePrivate
@@ -216,6 +249,10 @@ protected:
 
     QMatrix4x4 transformation(int mask, const WindowPaintData &data) const;
     GLTexture *getDecorationTexture() const;
+    /**
+     * Whether parts of @p quads on the screen are outside of @p region and thus need to be clipped.
+     **/
+    bool isClippingRequired(const QRegion &region, const WindowQuadList &quads) const;
 
 protected:
     SceneOpenGL *m_scene;
@@ -250,18 +287,54 @@ public:
     explicit SceneOpenGL2Window(Toplevel *c);
     virtual ~SceneOpenGL2Window();
 
+    /**
+     * Prepares the window to be painted from SceneOpenGL2::windowBatch().
+     * @returns the number of vertices the window needs or @c 0 if it cannot be batched
+     **/
+    int prepareBatch(int mask, const QRegion &region, const WindowQuadList &quads, int verticesPerQuad);
+    /**
+     * Writes the vertices of the window prepared by prepareBatch() to @p vertices starting
+     * at @p firstVertex.
+     * @returns the number of written vertices
+     **/
+    int writeBatch(GLVertex2D *vertices, int firstVertex, GLenum primitiveType, quint64 serial);
+
 protected:
     QMatrix4x4 modelViewProjectionMatrix(int mask, const WindowPaintData &data) const;
     QVector4D modulate(float opacity, float brightness) const;
     void setBlendEnabled(bool enabled);
-    void setupLeafNodes(LeafNode *nodes, const WindowQuadList *quads, const WindowPaintData &data);
+    void setupLeafNodes(LeafNode *nodes, const WindowQuadArrays *quads, const WindowPaintData &data);
     virtual void performPaint(int mask, QRegion region, WindowPaintData data);
 
 private:
+    /**
+     * Splits @p quads into the leafs, unless they are still the same as in the last frame.
+     **/
+    void updateLeafQuads(const WindowQuadList &quads);
     /**
      * Whether prepareStates enabled blending and restore states should disable again.
      **/
     bool m_blendingEnabled;
+    /**
+     * The quads the leafs got created from. As long as no effect modified the quads,
+     * the list passed to performPaint shares its data with it.
+     **/
+    WindowQuadList m_leafQuadsSource;
+    WindowQuadArrays m_leafQuads[LeafCount];
+
+    struct BatchRange
+    {
+        int firstVertex = 0;
+        int vertexCount = 0;
+        QMatrix4x4 textureMatrix;
+    };
+    /**
+     * Whether performPaint can draw the leafs from the vertices written by writeBatch().
+     **/
+    bool isBatchValid(int mask, const WindowPaintData &data, const LeafNode *nodes, int verticesPerQuad) const;
+    WindowQuadList m_batchQuads;
+    BatchRange m_batch[LeafCount];
+    quint64 m_batchSerial;
 };
 
 class OpenGLWindowPixmap : public WindowPixmap
@@ -418,6 +491,33 @@ public:
      **/
     virtual bool perScreenRendering() const;
     virtual QRegion prepareRenderingForScreen(int screenId);
+    /**
+     * @brief Tries to present the client @p buffer on the screen @p screenId without compositing.
+     *
+     * The SceneOpenGL only calls this if the buffer belongs to an opaque window covering exactly
+     * the screen with nothing painted on top of it. A backend can then skip the rendering of the
+     * screen, e.g. by scanning out the buffer directly.
+     * Default implementation returns @c false.
+     *
+     * @return bool @c true if the buffer got presented, @c false if the screen has to be rendered
+     **/
+    virtual bool directScanout(int screenId, KWayland::Server::BufferInterface *buffer);
+    struct OverlayCandidate {
+        KWayland::Server::BufferInterface *buffer;
+        QRect geometry;
+    };
+    /**
+     * @brief Tries to show client buffers on the screen @p screenId without compositing them.
+     *
+     * The @p candidates are opaque surfaces with nothing painted on top of them, ordered top to
+     * bottom. A backend can show any of them, e.g. on overlay planes, for the next frame.
+     * The SceneOpenGL does not paint the returned region. Calling this with no candidates
+     * removes what got shown before.
+     * Default implementation returns an empty region.
+     *
+     * @return QRegion The region of the screen not to be rendered
+     **/
+    virtual QRegion assignOverlays(int screenId, const QVector<OverlayCandidate> &candidates);
     /**
      * @brief Compositor is going into idle mode, flushes any pending paints.
      **/
@@ -634,7 +734,7 @@ private:
     /**
      * @brief The damage history for the past 10 frames.
      */
-    QList<QRegion> m_damageHistory;
+    DamageHistory m_damageHistory;
     /**
      * @brief Timer to measure how long a frame renders.
      **/
@@ -28,6 +28,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "screens.h"
 #include "toplevel.h"
 #include "platform.h"
+#include "qpainterrecorder.h"
+#include "qpainterscaledimage.h"
+#include "qpaintertiledbuffer.h"
 #include "wayland_server.h"
 #include <KWayland/Server/buffer_interface.h>
 #include <KWayland/Server/subcompositor_interface.h>
@@ -36,8 +39,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // Qt
 #include <QDebug>
 #include <QPainter>
+#include <QtConcurrentMap>
 #include <KDecoration2/Decoration>
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 namespace KWin
 {
 
@@ -84,6 +92,45 @@ QImage *QPainterBackend::bufferForScreen(int screenId)
     return buffer();
 }
 
+QPainterTiledBuffer *QPainterBackend::tiledBufferForScreen(int screenId)
+{
+    Q_UNUSED(screenId)
+    return nullptr;
+}
+
+bool QPainterBackend::supportsBufferAge() const
+{
+    return false;
+}
+
+int QPainterBackend::bufferAge(int screenId) const
+{
+    Q_UNUSED(screenId)
+    return 0;
+}
+
+void QPainterBackend::addToDamageHistory(int screenId, const QRegion &region)
+{
+    if (screenId >= m_damageHistory.count()) {
+        m_damageHistory.resize(screenId + 1);
+    }
+    m_damageHistory[screenId].add(region);
+}
+
+QRegion QPainterBackend::accumulatedDamageHistory(int screenId) const
+{
+    const QRegion geometry = screens()->geometry(screenId);
+    if (screenId >= m_damageHistory.count()) {
+        return geometry;
+    }
+    return m_damageHistory.at(screenId).accumulated(bufferAge(screenId), geometry);
+}
+
+void QPainterBackend::resetDamageHistory()
+{
+    m_damageHistory.clear();
+}
+
 //****************************************
 // SceneQPainter
 //****************************************
@@ -139,29 +186,85 @@ qint64 SceneQPainter::paint(QRegion damage, ToplevelList toplevels)
     int mask = 0;
     m_backend->prepareRenderingFrame();
     if (m_backend->perScreenRendering()) {
-        const bool needsFullRepaint = m_backend->needsFullRepaint();
-        if (needsFullRepaint) {
-            mask |= Scene::PAINT_SCREEN_BACKGROUND_FIRST;
-            damage = screens()->geometry();
-        }
+        const bool bufferAge = m_backend->supportsBufferAge();
+        const bool needsFullRepaint = !bufferAge && m_backend->needsFullRepaint();
         QRegion overallUpdate;
-        for (int i = 0; i < screens()->count(); ++i) {
+        const QVector<int> damaged = damagedScreens(damage);
+        if (!needsFullRepaint) {
+            // the window repaints get reset while painting the first screen
+            for (Scene::Window *w : stacking_order) {
+                damage |= w->window()->repaints();
+            }
+        }
+        // with multiple screens the painting gets recorded while walking the scene and
+        // running the effects on this thread, the recordings are rasterized in parallel
+        const bool parallel = damaged.count() > 1;
+        QVector<QPainterRecorder*> recordings;
+        // tiled buffers are always recorded, the recording gets replayed per tile
+        struct TiledRecording {
+            QPainterTiledBuffer *buffer;
+            QPainterRecorder *recorder;
+            QRegion region;
+        };
+        QVector<TiledRecording> tiledRecordings;
+        // per screen the time it took to paint or record it, the rasterization is added later
+        QVector<QPair<int, qint64>> screenTimes;
+        for (int i : damaged) {
             const QRect geometry = screens()->geometry(i);
             QImage *buffer = m_backend->bufferForScreen(i);
             if (!buffer || buffer->isNull()) {
                 continue;
             }
-            m_painter->begin(buffer);
+            QElapsedTimer screenTimer;
+            screenTimer.start();
+            QPainterTiledBuffer *tiled = m_backend->tiledBufferForScreen(i);
+            if (tiled) {
+                QPainterRecorder *recorder = new QPainterRecorder(buffer);
+                tiledRecordings.append({tiled, recorder, QRegion()});
+                m_painter->begin(recorder);
+            } else if (parallel) {
+                QPainterRecorder *recorder = new QPainterRecorder(buffer);
+                recordings << recorder;
+                m_painter->begin(recorder);
+            } else {
+                m_painter->begin(buffer);
+            }
             m_painter->save();
             m_painter->setWindow(geometry);
 
+            mask = needsFullRepaint ? int(Scene::PAINT_SCREEN_BACKGROUND_FIRST) : 0;
+            const QRegion screenDamage = needsFullRepaint ? QRegion(geometry) : damage.intersected(geometry);
+            // bring a reused buffer up to date
+            const QRegion repaint = bufferAge ? m_backend->accumulatedDamageHistory(i).intersected(geometry) : QRegion();
             QRegion updateRegion, validRegion;
-            paintScreen(&mask, damage.intersected(geometry), QRegion(), &updateRegion, &validRegion);
-            overallUpdate = overallUpdate.united(updateRegion);
-            paintCursor();
+            paintScreen(&mask, screenDamage, repaint, &updateRegion, &validRegion);
+            overallUpdate |= updateRegion.intersected(geometry);
+            const QRect cursor = paintCursor();
 
             m_painter->restore();
             m_painter->end();
+            if (tiled) {
+                // everything painted on, in the coordinates of the buffer
+                tiledRecordings.last().region = (updateRegion | validRegion | cursor).intersected(geometry).translated(-geometry.topLeft());
+            }
+            screenTimes << qMakePair(i, screenTimer.nsecsElapsed());
+        }
+        QElapsedTimer rasterizeTimer;
+        rasterizeTimer.start();
+        QtConcurrent::blockingMap(recordings, [] (QPainterRecorder *recorder) {
+            recorder->replay();
+        });
+        qDeleteAll(recordings);
+        for (const TiledRecording &recording : tiledRecordings) {
+            recording.buffer->replay(*recording.recorder, recording.region);
+            delete recording.recorder;
+        }
+        // the screens get rasterized together, each one is done once all are done
+        const qint64 rasterizeTime = rasterizeTimer.nsecsElapsed();
+        if (Compositor *compositor = Compositor::self()) {
+            for (const auto &screenTime : qAsConst(screenTimes)) {
+                compositor->addRenderTimeSample(screenTime.first, screenTime.second + rasterizeTime);
+            }
         }
         m_backend->showOverlay();
         m_backend->present(mask, overallUpdate);
@@ -180,12 +283,12 @@ qint64 SceneQPainter::paint(QRegion damage, ToplevelList toplevels)
         m_backend->showOverlay();
 
         m_painter->end();
+        if (Compositor *compositor = Compositor::self()) {
+            compositor->addRenderTimeSample(-1, renderTimer.nsecsElapsed());
+        }
         m_backend->present(mask, updateRegion);
     }
 
-    // do cleanup
-    clearStackingOrder();
-
     emit frameRendered();
 
     return renderTimer.nsecsElapsed();
@@ -197,19 +300,20 @@ void SceneQPainter::paintBackground(QRegion region)
     m_painter->drawRects(region.rects());
 }
 
-void SceneQPainter::paintCursor()
+QRect SceneQPainter::paintCursor()
 {
     if (!kwinApp()->platform()->usesSoftwareCursor()) {
-        return;
+        return QRect();
     }
     const QImage img = kwinApp()->platform()->softwareCursor();
     if (img.isNull()) {
-        return;
+        return QRect();
     }
     const QPoint cursorPos = Cursor::pos();
     const QPoint hotspot = kwinApp()->platform()->softwareCursorHotspot();
     m_painter->drawImage(cursorPos - hotspot, img);
     kwinApp()->platform()->markCursorAsRendered();
+    return QRect(cursorPos - hotspot, img.size());
 }
 
 Scene::Window *SceneQPainter::createWindow(Toplevel *toplevel)
@@ -264,6 +368,145 @@ static void paintSubSurface(QPainter *painter, const QPoint &pos, QPainterWindow
     }
 }
 
+// multiplies the four 8 bit channels of @p x with @p a in the range of 0 to 255
+static inline quint32 byteMul(quint32 x, quint32 a)
+{
+    quint32 t = (x & 0xff00ff) * a + 0x800080;
+    t = ((t + ((t >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+    x = ((x >> 8) & 0xff00ff) * a + 0x800080;
+    x = (x + ((x >> 8) & 0xff00ff)) & 0xff00ff00;
+    return x | t;
+}
+
+#if defined(__SSE2__)
+// the same as byteMul on 16 bit lanes
+static inline __m128i byteMul(__m128i x, __m128i a)
+{
+    x = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(0x80));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static inline __m128i blendConstantAlpha(__m128i s, __m128i d, __m128i alpha)
+{
+    const __m128i full = _mm_set1_epi16(0xff);
+    s = byteMul(s, alpha);
+    // broadcast the alpha of each pixel to its four channels
+    __m128i inverse = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+    inverse = _mm_sub_epi16(full, _mm_shufflehi_epi16(inverse, _MM_SHUFFLE(3, 3, 3, 3)));
+    return _mm_add_epi16(s, byteMul(d, inverse));
+}
+#endif
+
+/**
+ * Blends @p pixels premultiplied ARGB32 pixels of @p src scaled by the constant @p alpha
+ * over @p dst. If @p opaque the alpha channel of the source is ignored, as with
+ * QImage::Format_RGB32.
+ **/
+static void blendConstantAlpha(const quint32 *src, quint32 *dst, int pixels, quint32 alpha, bool opaque)
+{
+    const quint32 forcedAlpha = opaque ? 0xff000000 : 0;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a = _mm_set1_epi16(alpha);
+    const __m128i sourceAlpha = _mm_set1_epi32(forcedAlpha);
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i s = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), sourceAlpha);
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        const __m128i low = blendConstantAlpha(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), a);
+        const __m128i high = blendConstantAlpha(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; i < pixels; ++i) {
+        const quint32 s = byteMul(src[i] | forcedAlpha, alpha);
+        dst[i] = s + byteMul(dst[i], 255 - (s >> 24));
+    }
+}
+
+/**
+ * Draws @p source of @p image at @p pos with the opacity of @p painter directly into the image
+ * it paints on, limited to @p clip. Both are in the coordinates mapped by @p transform.
+ *
+ * This avoids rendering the window into a temporary image to apply the opacity. Returns
+ * @c false without painting if the painter's state does not allow it, in which case the
+ * caller has to paint through the painter.
+ **/
+static bool drawImageWithOpacity(QPainter *painter, const QTransform &transform, const QPoint &pos,
+                                 const QImage &image, const QRect &source, const QRegion &clip)
+{
+    if (painter->device()->devType() != QInternal::Image) {
+        return false;
+    }
+    QImage *target = static_cast<QImage*>(painter->device());
+    if (target->format() != QImage::Format_RGB32 && target->format() != QImage::Format_ARGB32_Premultiplied) {
+        return false;
+    }
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32_Premultiplied) {
+        return false;
+    }
+    // writing to a shared image would detach it from the painter
+    if (!target->isDetached()) {
+        return false;
+    }
+    if (transform.type() > QTransform::TxTranslate ||
+            transform.dx() != int(transform.dx()) || transform.dy() != int(transform.dy())) {
+        return false;
+    }
+    if (painter->compositionMode() != QPainter::CompositionMode_SourceOver) {
+        return false;
+    }
+    const QPoint offset(transform.dx(), transform.dy());
+    const QRect src = source & image.rect();
+    // from image to target coordinates
+    const QPoint delta = pos + offset - source.topLeft();
+    const QRegion region = clip.translated(offset) & QRect(src.topLeft() + delta, src.size()) & target->rect();
+
+    const quint32 alpha = qRound(painter->opacity() * 255);
+    const bool opaque = image.format() == QImage::Format_RGB32;
+    for (const QRect &rect : region.rects()) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            const quint32 *s = reinterpret_cast<const quint32 *>(image.constScanLine(y - delta.y())) + rect.left() - delta.x();
+            quint32 *d = reinterpret_cast<quint32 *>(target->scanLine(y)) + rect.left();
+            // an opaque target stays opaque, as byteMul is exact for an alpha of 255
+            blendConstantAlpha(s, d, rect.width(), alpha, opaque);
+        }
+    }
+    return true;
+}
+
+static inline QRectF originalRect(const WindowQuad &quad)
+{
+    return QRectF(QPointF(quad.originalLeft(), quad.originalTop()), QPointF(quad.originalRight(), quad.originalBottom()));
+}
+
+/**
+ * Draws the @p source of @p image mapped from the original rect of @p quad to its
+ * vertices, which effects might have moved.
+ **/
+static void drawImageOnQuad(QPainter *painter, const WindowQuad &quad, const QImage &image, const QRectF &source)
+{
+    const QRectF original = originalRect(quad);
+    if (original.isEmpty()) {
+        return;
+    }
+    QPolygonF from;
+    from << original.topLeft() << original.topRight() << original.bottomRight() << original.bottomLeft();
+    QPolygonF to;
+    for (int i = 0; i < 4; ++i) {
+        to << QPointF(quad[i].x(), quad[i].y());
+    }
+    QTransform transform;
+    if (!QTransform::quadToQuad(from, to, transform)) {
+        return;
+    }
+    painter->save();
+    painter->setTransform(transform, true);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    painter->drawImage(original, image, source);
+    painter->restore();
+}
+
 void SceneQPainter::Window::performPaint(int mask, QRegion region, WindowPaintData data)
 {
     if (!(mask & (PAINT_WINDOW_TRANSFORMED | PAINT_SCREEN_TRANSFORMED)))
@@ -280,9 +523,9 @@ void SceneQPainter::Window::performPaint(int mask, QRegion region, WindowPaintDa
         toplevel->resetDamage();
     }
 
-    QPainter *scenePainter = m_scene->painter();
-    QPainter *painter = scenePainter;
+    QPainter *painter = m_scene->painter();
     painter->save();
+    const QTransform screenTransform = painter->combinedTransform();
     painter->setClipRegion(region);
     painter->setClipping(true);
 
@@ -291,25 +534,45 @@ void SceneQPainter::Window::performPaint(int mask, QRegion region, WindowPaintDa
         painter->translate(data.xTranslation(), data.yTranslation());
         painter->scale(data.xScale(), data.yScale());
     }
+    // effects moved the vertices of the quads, each quad is then mapped on its own
+    const bool transformedQuads = data.quads.isTransformed();
 
+    // like the OpenGL scene the shadow, decoration and content are each painted with the
+    // window's opacity, instead of blending them as a group through a temporary image
     const bool opaque = qFuzzyCompare(1.0, data.opacity());
-    QImage tempImage;
-    QPainter tempPainter;
     if (!opaque) {
-        // need a temp render target which we later on blit to the screen
-        tempImage = QImage(toplevel->visibleRect().size(), QImage::Format_ARGB32_Premultiplied);
-        tempImage.fill(Qt::transparent);
-        tempPainter.begin(&tempImage);
-        tempPainter.save();
-        tempPainter.translate(toplevel->geometry().topLeft() - toplevel->visibleRect().topLeft());
-        painter = &tempPainter;
+        painter->setOpacity(painter->opacity() * data.opacity());
     }
-    renderShadow(painter);
-    renderWindowDecorations(painter);
+    if (!transformedQuads) {
+        renderShadow(painter);
+    }
+    renderWindowDecorations(painter, data.quads, transformedQuads);
 
     // render content
     const QRect src = QRect(toplevel->clientPos() + toplevel->clientContentPos(), toplevel->clientSize());
-    painter->drawImage(toplevel->clientPos(), pixmap->image(), src);
+    const QTransform transform = painter->combinedTransform();
+    const int level = transform.type() == QTransform::TxScale
+        ? QPainterScaledImage::levelForScale(qMax(qAbs(transform.m11()), qAbs(transform.m22())))
+        : 0;
+    if (transformedQuads) {
+        const QPointF offset = toplevel->clientContentPos();
+        for (const WindowQuad &quad : data.quads) {
+            if (quad.type() == WindowQuadContents) {
+                drawImageOnQuad(painter, quad, pixmap->image(), originalRect(quad).translated(offset));
+            }
+        }
+    } else if (level > 0) {
+        // downscaling the full image for every frame is too slow for overviews
+        const QImage &scaled = pixmap->scaledImage(level);
+        const qreal xFactor = qreal(scaled.width()) / pixmap->image().width();
+        const qreal yFactor = qreal(scaled.height()) / pixmap->image().height();
+        painter->setRenderHint(QPainter::SmoothPixmapTransform);
+        painter->drawImage(QRectF(toplevel->clientPos(), toplevel->clientSize()), scaled,
+                           QRectF(src.x() * xFactor, src.y() * yFactor, src.width() * xFactor, src.height() * yFactor));
+    } else if (opaque || (mask & PAINT_WINDOW_TRANSFORMED) ||
+            !drawImageWithOpacity(painter, screenTransform, pos() + toplevel->clientPos(), pixmap->image(), src, region)) {
+        painter->drawImage(toplevel->clientPos(), pixmap->image(), src);
+    }
 
     // render subsurfaces
     const auto &children = pixmap->children();
@@ -320,17 +583,6 @@ void SceneQPainter::Window::performPaint(int mask, QRegion region, WindowPaintDa
         paintSubSurface(painter, toplevel->clientPos(), static_cast<QPainterWindowPixmap*>(pixmap));
     }
 
-    if (!opaque) {
-        tempPainter.restore();
-        tempPainter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-        QColor translucent(Qt::transparent);
-        translucent.setAlphaF(data.opacity());
-        tempPainter.fillRect(QRect(QPoint(0, 0), toplevel->visibleRect().size()), translucent);
-        tempPainter.end();
-        painter = scenePainter;
-        painter->drawImage(toplevel->visibleRect().topLeft() - toplevel->geometry().topLeft(), tempImage);
-    }
-
     painter->restore();
 }
 
@@ -339,55 +591,10 @@ void SceneQPainter::Window::renderShadow(QPainter* painter)
     if (!toplevel->shadow()) {
         return;
     }
-    SceneQPainterShadow *shadow = static_cast<SceneQPainterShadow *>(toplevel->shadow());
-    const QPixmap &topLeft     = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementTopLeft);
-    const QPixmap &top         = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementTop);
-    const QPixmap &topRight    = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementTopRight);
-    const QPixmap &bottomLeft  = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementBottomLeft);
-    const QPixmap &bottom      = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementBottom);
-    const QPixmap &bottomRight = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementBottomRight);
-    const QPixmap &left        = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementLeft);
-    const QPixmap &right       = shadow->shadowPixmap(SceneQPainterShadow::ShadowElementRight);
-
-    const int leftOffset   = shadow->leftOffset();
-    const int topOffset    = shadow->topOffset();
-    const int rightOffset  = shadow->rightOffset();
-    const int bottomOffset = shadow->bottomOffset();
-
-    // top left
-    painter->drawPixmap(-leftOffset, -topOffset, topLeft);
-    // top right
-    painter->drawPixmap(toplevel->width() - topRight.width() + rightOffset, -topOffset, topRight);
-    // bottom left
-    painter->drawPixmap(-leftOffset, toplevel->height() - bottomLeft.height() + bottomOffset, bottomLeft);
-    // bottom right
-    painter->drawPixmap(toplevel->width() - bottomRight.width() + rightOffset,
-                        toplevel->height() - bottomRight.height() + bottomOffset,
-                        bottomRight);
-    // top
-    painter->drawPixmap(topLeft.width() - leftOffset, -topOffset,
-                        toplevel->width() - topLeft.width() - topRight.width() + leftOffset + rightOffset,
-                        top.height(),
-                        top);
-    // left
-    painter->drawPixmap(-leftOffset, topLeft.height() - topOffset, left.width(),
-                        toplevel->height() - topLeft.height() - bottomLeft.height() + topOffset + bottomOffset,
-                        left);
-    // right
-    painter->drawPixmap(toplevel->width() - right.width() + rightOffset,
-                        topRight.height() - topOffset,
-                        right.width(),
-                        toplevel->height() - topRight.height() - bottomRight.height() + topOffset + bottomOffset,
-                        right);
-    // bottom
-    painter->drawPixmap(bottomLeft.width() - leftOffset,
-                        toplevel->height() - bottom.height() + bottomOffset,
-                        toplevel->width() - bottomLeft.width() - bottomRight.width() + leftOffset + rightOffset,
-                        bottom.height(),
-                        bottom);
+    static_cast<SceneQPainterShadow *>(toplevel->shadow())->paint(painter, toplevel->size());
 }
 
-void SceneQPainter::Window::renderWindowDecorations(QPainter *painter)
+void SceneQPainter::Window::renderWindowDecorations(QPainter *painter, const WindowQuadList &quads, bool transformedQuads)
 {
     // TODO: custom decoration opacity
     AbstractClient *client = dynamic_cast<AbstractClient*>(toplevel);
@@ -417,6 +624,36 @@ void SceneQPainter::Window::renderWindowDecorations(QPainter *painter)
         return;
     }
 
+    if (transformedQuads) {
+        const QRect rects[] = {dtr, dlr, drr, dbr};
+        const SceneQPainterDecorationRenderer::DecorationPart parts[] = {
+            SceneQPainterDecorationRenderer::DecorationPart::Top,
+            SceneQPainterDecorationRenderer::DecorationPart::Left,
+            SceneQPainterDecorationRenderer::DecorationPart::Right,
+            SceneQPainterDecorationRenderer::DecorationPart::Bottom
+        };
+        for (const WindowQuad &quad : quads) {
+            if (quad.type() != WindowQuadDecoration) {
+                continue;
+            }
+            const QRectF original = originalRect(quad);
+            for (int i = 0; i < 4; ++i) {
+                if (!rects[i].contains(original.center().toPoint())) {
+                    continue;
+                }
+                // the images of the parts are scaled to the rects when drawn
+                const QImage &image = renderer->image(parts[i]);
+                const qreal xFactor = qreal(image.width()) / rects[i].width();
+                const qreal yFactor = qreal(image.height()) / rects[i].height();
+                const QRectF source = original.translated(-rects[i].topLeft());
+                drawImageOnQuad(painter, quad, image, QRectF(source.x() * xFactor, source.y() * yFactor,
+                                                             source.width() * xFactor, source.height() * yFactor));
+                break;
+            }
+        }
+        return;
+    }
+
     painter->drawImage(dtr, renderer->image(SceneQPainterDecorationRenderer::DecorationPart::Top));
     painter->drawImage(dlr, renderer->image(SceneQPainterDecorationRenderer::DecorationPart::Left));
     painter->drawImage(drr, renderer->image(SceneQPainterDecorationRenderer::DecorationPart::Right));
@@ -461,6 +698,7 @@ void QPainterWindowPixmap::create()
     }
     // performing deep copy, this could probably be improved
     m_image = buffer()->data().copy();
+    m_scaledImages.clear();
     if (auto s = surface()) {
         s->resetTrackedDamage();
     }
@@ -478,18 +716,41 @@ void QPainterWindowPixmap::updateBuffer()
     const auto &b = buffer();
     if (b.isNull()) {
         m_image = QImage();
+        m_scaledImages.clear();
         return;
     }
     if (b == oldBuffer) {
         return;
     }
     // perform deep copy
+    const QSize oldSize = m_image.size();
     m_image = b->data().copy();
+    if (m_image.size() != oldSize) {
+        m_scaledImages.clear();
+    } else if (auto s = surface()) {
+        // the damage is in surface local coordinates, the scaled images in the buffer's pixels
+        m_scaledImages.addDamage(QPainterScaledImage::mapToBuffer(s->trackedDamage(), s->scale()));
+    } else {
+        m_scaledImages.addDamage(m_image.rect());
+    }
     if (auto s = surface()) {
         s->resetTrackedDamage();
     }
 }
 
+const QImage &QPainterWindowPixmap::scaledImage(int level)
+{
+    if (level <= 0 || m_image.isNull()) {
+        return m_image;
+    }
+    // the box filter works on 32 bit pixels
+    if (m_image.depth() != 32) {
+        m_image = m_image.convertToFormat(m_image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+        m_scaledImages.clear();
+    }
+    return m_scaledImages.image(m_image, level);
+}
+
 bool QPainterWindowPixmap::isValid() const
 {
     if (!m_image.isNull()) {
@@ -594,9 +855,120 @@ bool SceneQPainterShadow::prepareBackend()
         // TODO: implement for QPainter
         return false;
     }
+    // the elements changed
+    m_cache.clear();
+    m_cacheSize = QSize();
     return true;
 }
 
+void SceneQPainterShadow::paintElements(QPainter *painter, const QSize &size) const
+{
+    const QPixmap &topLeft     = shadowPixmap(ShadowElementTopLeft);
+    const QPixmap &top         = shadowPixmap(ShadowElementTop);
+    const QPixmap &topRight    = shadowPixmap(ShadowElementTopRight);
+    const QPixmap &bottomLeft  = shadowPixmap(ShadowElementBottomLeft);
+    const QPixmap &bottom      = shadowPixmap(ShadowElementBottom);
+    const QPixmap &bottomRight = shadowPixmap(ShadowElementBottomRight);
+    const QPixmap &left        = shadowPixmap(ShadowElementLeft);
+    const QPixmap &right       = shadowPixmap(ShadowElementRight);
+
+    const int leftOffset   = this->leftOffset();
+    const int topOffset    = this->topOffset();
+    const int rightOffset  = this->rightOffset();
+    const int bottomOffset = this->bottomOffset();
+
+    // top left
+    painter->drawPixmap(-leftOffset, -topOffset, topLeft);
+    // top right
+    painter->drawPixmap(size.width() - topRight.width() + rightOffset, -topOffset, topRight);
+    // bottom left
+    painter->drawPixmap(-leftOffset, size.height() - bottomLeft.height() + bottomOffset, bottomLeft);
+    // bottom right
+    painter->drawPixmap(size.width() - bottomRight.width() + rightOffset,
+                        size.height() - bottomRight.height() + bottomOffset,
+                        bottomRight);
+    // top
+    painter->drawPixmap(topLeft.width() - leftOffset, -topOffset,
+                        size.width() - topLeft.width() - topRight.width() + leftOffset + rightOffset,
+                        top.height(),
+                        top);
+    // left
+    painter->drawPixmap(-leftOffset, topLeft.height() - topOffset, left.width(),
+                        size.height() - topLeft.height() - bottomLeft.height() + topOffset + bottomOffset,
+                        left);
+    // right
+    painter->drawPixmap(size.width() - right.width() + rightOffset,
+                        topRight.height() - topOffset,
+                        right.width(),
+                        size.height() - topRight.height() - bottomRight.height() + topOffset + bottomOffset,
+                        right);
+    // bottom
+    painter->drawPixmap(bottomLeft.width() - leftOffset,
+                        size.height() - bottom.height() + bottomOffset,
+                        size.width() - bottomLeft.width() - bottomRight.width() + leftOffset + rightOffset,
+                        bottom.height(),
+                        bottom);
+}
+
+void SceneQPainterShadow::updateCache(const QSize &size)
+{
+    m_cache.clear();
+    m_cacheSize = size;
+
+    const int leftOffset   = this->leftOffset();
+    const int topOffset    = this->topOffset();
+    const int rightOffset  = this->rightOffset();
+    const int bottomOffset = this->bottomOffset();
+    auto height = [this] (ShadowElements element) {
+        return shadowPixmap(element).height();
+    };
+    auto width = [this] (ShadowElements element) {
+        return shadowPixmap(element).width();
+    };
+    // how far the elements reach into the window, the hole in between stays transparent
+    const int top = qMax(qMax(height(ShadowElementTopLeft), height(ShadowElementTop)), height(ShadowElementTopRight)) - topOffset;
+    const int bottom = qMax(qMax(height(ShadowElementBottomLeft), height(ShadowElementBottom)), height(ShadowElementBottomRight)) - bottomOffset;
+    const int left = width(ShadowElementLeft) - leftOffset;
+    const int right = width(ShadowElementRight) - rightOffset;
+
+    const QRect outer(-leftOffset, -topOffset,
+                      size.width() + leftOffset + rightOffset, size.height() + topOffset + bottomOffset);
+    const QRect hole(QPoint(qMax(0, left), qMax(0, top)),
+                     QPoint(size.width() - 1 - qMax(0, right), size.height() - 1 - qMax(0, bottom)));
+    QVector<QRect> parts;
+    if (!hole.isValid()) {
+        parts << outer;
+    } else {
+        parts << QRect(outer.left(), outer.top(), outer.width(), hole.top() - outer.top())
+              << QRect(outer.left(), hole.bottom() + 1, outer.width(), outer.bottom() - hole.bottom())
+              << QRect(outer.left(), hole.top(), hole.left() - outer.left(), hole.height())
+              << QRect(hole.right() + 1, hole.top(), outer.right() - hole.right(), hole.height());
+    }
+    for (const QRect &geometry : parts) {
+        if (geometry.isEmpty()) {
+            continue;
+        }
+        CachedPart part;
+        part.geometry = geometry;
+        part.image = QImage(geometry.size(), QImage::Format_ARGB32_Premultiplied);
+        part.image.fill(Qt::transparent);
+        QPainter painter(&part.image);
+        painter.translate(-geometry.topLeft());
+        paintElements(&painter, size);
+        m_cache << part;
+    }
+}
+
+void SceneQPainterShadow::paint(QPainter *painter, const QSize &size)
+{
+    if (m_cacheSize != size) {
+        updateCache(size);
+    }
+    for (const CachedPart &part : qAsConst(m_cache)) {
+        painter->drawImage(part.geometry.topLeft(), part.image);
+    }
+}
+
 //****************************************
 // QPainterDecorationRenderer
 //****************************************
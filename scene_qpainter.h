@@ -20,6 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef KWIN_SCENE_QPAINTER_H
 #define KWIN_SCENE_QPAINTER_H
 
+#include "qpainterscaledimage.h"
+#include "rectset.h"
 #include "scene.h"
 #include "shadow.h"
 
@@ -27,6 +29,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 namespace KWin {
 
+class QPainterTiledBuffer;
+
 class KWIN_EXPORT QPainterBackend
 {
 public:
@@ -79,12 +83,38 @@ public:
      * @todo Get a better identifier for screen then a counter variable
      **/
     virtual QImage *bufferForScreen(int screenId);
+    /**
+     * The tiled buffer the screen @p screenId gets rendered into instead of
+     * bufferForScreen, if the backend uses tiles. The backend copies the dirty tiles
+     * into bufferForScreen on present.
+     * Default implementation returns @c null.
+     **/
+    virtual QPainterTiledBuffer *tiledBufferForScreen(int screenId);
     virtual bool needsFullRepaint() const = 0;
     /**
      * Whether the rendering needs to be split per screen.
      * Default implementation returns @c false.
      **/
     virtual bool perScreenRendering() const;
+    /**
+     * Whether the backend knows the age of its buffers, see bufferAge.
+     * If it does the SceneQPainter repaints only what changed since the buffer was last
+     * presented, instead of following needsFullRepaint.
+     * Default implementation returns @c false.
+     **/
+    virtual bool supportsBufferAge() const;
+    /**
+     * The age of the buffer for @p screenId, that is the number of frames since its
+     * content was presented. An age of zero means the content is undefined.
+     * Default implementation returns @c 0.
+     * @param screenId The id of the screen as used in Screens
+     **/
+    virtual int bufferAge(int screenId) const;
+    /**
+     * Returns the damage that has accumulated on the screen @p screenId since the current
+     * buffer for it was presented.
+     **/
+    QRegion accumulatedDamageHistory(int screenId) const;
 
 protected:
     QPainterBackend();
@@ -97,9 +127,18 @@ protected:
      * @param reason The reason why the initialization failed.
      **/
     void setFailed(const QString &reason);
+    /**
+     * Saves the @p region presented on the screen @p screenId to the damage history.
+     **/
+    void addToDamageHistory(int screenId, const QRegion &region);
+    /**
+     * Drops the damage history of all screens, e.g. after the buffers got recreated.
+     **/
+    void resetDamageHistory();
 
 private:
     bool m_failed;
+    QVector<DamageHistory> m_damageHistory;
 };
 
 class KWIN_EXPORT SceneQPainter : public Scene
@@ -137,7 +176,7 @@ protected:
 
 private:
     explicit SceneQPainter(QPainterBackend *backend, QObject *parent = nullptr);
-    void paintCursor();
+    QRect paintCursor();
     QScopedPointer<QPainterBackend> m_backend;
     QScopedPointer<QPainter> m_painter;
     class Window;
@@ -153,7 +192,7 @@ protected:
     virtual WindowPixmap *createWindowPixmap() override;
 private:
     void renderShadow(QPainter *painter);
-    void renderWindowDecorations(QPainter *painter);
+    void renderWindowDecorations(QPainter *painter, const WindowQuadList &quads, bool transformedQuads);
     SceneQPainter *m_scene;
 };
 
@@ -167,12 +206,21 @@ public:
 
     void updateBuffer() override;
     const QImage &image();
+    /**
+     * Returns the image downscaled by 2 to the power of @p level with a box filter. The
+     * levels are created on demand from the previous level and only the damaged parts
+     * of them get recreated when the buffer changes.
+     *
+     * @param level The level as returned by QPainterScaledImage::levelForScale, 0 is the image itself
+     **/
+    const QImage &scaledImage(int level);
 
 protected:
     WindowPixmap *createChild(const QPointer<KWayland::Server::SubSurfaceInterface> &subSurface) override;
 private:
     explicit QPainterWindowPixmap(const QPointer<KWayland::Server::SubSurfaceInterface> &subSurface, WindowPixmap *parent);
     QImage m_image;
+    QPainterScaledImage m_scaledImages;
 };
 
 class QPainterEffectFrame : public Scene::EffectFrame
@@ -196,6 +244,16 @@ class SceneQPainterShadow : public Shadow
 public:
     SceneQPainterShadow(Toplevel* toplevel);
     virtual ~SceneQPainterShadow();
+
+    /**
+     * Paints the shadow of a window of @p size with @p painter, which has its origin at the
+     * top left corner of the window.
+     *
+     * The shadow elements get assembled into premultiplied images of the parts of the shadow
+     * frame around the window, which are kept until the size or the shadow changes. Thus
+     * a repaint only blits them.
+     **/
+    void paint(QPainter *painter, const QSize &size);
     using Shadow::ShadowElements;
     using Shadow::ShadowElementTop;
     using Shadow::ShadowElementTopRight;
@@ -213,6 +271,16 @@ public:
     using Shadow::bottomOffset;
 protected:
     virtual bool prepareBackend() override;
+
+private:
+    void paintElements(QPainter *painter, const QSize &size) const;
+    void updateCache(const QSize &size);
+    struct CachedPart {
+        QRect geometry;
+        QImage image;
+    };
+    QVector<CachedPart> m_cache;
+    QSize m_cacheSize;
 };
 
 class SceneQPainterDecorationRenderer : public Decoration::Renderer
@@ -255,9 +255,12 @@ qint64 SceneXrender::paint(QRegion damage, ToplevelList toplevels)
 
     m_backend->showOverlay();
 
+    // the X server renders asynchronously, only the time to issue the requests is known
+    if (Compositor *compositor = Compositor::self()) {
+        compositor->addRenderTimeSample(-1, renderTimer.nsecsElapsed());
+    }
     m_backend->present(mask, updateRegion);
-    // do cleanup
-    clearStackingOrder();
+    Window::endFrame();
 
     return renderTimer.nsecsElapsed();
 }
@@ -307,7 +310,73 @@ Decoration::Renderer *SceneXrender::createDecorationRenderer(Decoration::Decorat
 // SceneXrender::Window
 //****************************************
 
+//****************************************
+// XRenderPicturePool
+//****************************************
+
+// the sizes of the pictures get rounded up to multiples of it to be shared more often
+static const int s_picturePoolGranularity = 64;
+// about five seconds at 60 Hz
+static const int s_picturePoolMaxUnusedFrames = 300;
+
+XRenderPicturePool::~XRenderPicturePool()
+{
+    for (const Entry &entry : qAsConst(m_entries)) {
+        delete entry.picture;
+    }
+}
+
+XRenderPicture *XRenderPicturePool::picture(const QSize &size, int depth)
+{
+    Entry *best = nullptr;
+    for (Entry &entry : m_entries) {
+        if (entry.depth != depth || entry.size.width() < size.width() || entry.size.height() < size.height()) {
+            continue;
+        }
+        if (!best || entry.size.width() * entry.size.height() < best->size.width() * best->size.height()) {
+            best = &entry;
+        }
+    }
+    if (best) {
+        best->unusedFrames = 0;
+        return best->picture;
+    }
+    auto roundUp = [](int value) {
+        return qMax(1, (value + s_picturePoolGranularity - 1) / s_picturePoolGranularity * s_picturePoolGranularity);
+    };
+    const QSize pictureSize(roundUp(size.width()), roundUp(size.height()));
+    xcb_pixmap_t pix = xcb_generate_id(connection());
+    xcb_create_pixmap(connection(), depth, pix, rootWindow(), pictureSize.width(), pictureSize.height());
+    XRenderPicture *picture = new XRenderPicture(pix, depth);
+    xcb_free_pixmap(connection(), pix);
+    m_entries.append({picture, pictureSize, depth, 0});
+    return picture;
+}
+
+QSize XRenderPicturePool::size(const XRenderPicture *picture) const
+{
+    for (const Entry &entry : m_entries) {
+        if (entry.picture == picture) {
+            return entry.size;
+        }
+    }
+    return QSize();
+}
+
+void XRenderPicturePool::endFrame(const XRenderPicture *keep)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (++it->unusedFrames > s_picturePoolMaxUnusedFrames && it->picture != keep) {
+            delete it->picture;
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 XRenderPicture *SceneXrender::Window::s_tempPicture = 0;
+XRenderPicturePool *SceneXrender::Window::s_tempPictures = nullptr;
 QRect SceneXrender::Window::temp_visibleRect;
 XRenderPicture *SceneXrender::Window::s_fadeAlphaPicture = nullptr;
 
@@ -326,7 +395,8 @@ SceneXrender::Window::~Window()
 
 void SceneXrender::Window::cleanup()
 {
-    delete s_tempPicture;
+    delete s_tempPictures;
+    s_tempPictures = nullptr;
     s_tempPicture = NULL;
     delete s_fadeAlphaPicture;
     s_fadeAlphaPicture = nullptr;
@@ -382,23 +452,26 @@ QPoint SceneXrender::Window::mapToScreen(int mask, const WindowPaintData &data,
     return pt;
 }
 
+void SceneXrender::Window::endFrame()
+{
+    if (s_tempPictures) {
+        // the last picture might still be the offscreen target
+        s_tempPictures->endFrame(s_tempPicture);
+    }
+}
+
 void SceneXrender::Window::prepareTempPixmap()
 {
-    const QSize oldSize = temp_visibleRect.size();
     temp_visibleRect = toplevel->visibleRect().translated(-toplevel->pos());
-    if (s_tempPicture && (oldSize.width() < temp_visibleRect.width() || oldSize.height() < temp_visibleRect.height())) {
-        delete s_tempPicture;
-        s_tempPicture = NULL;
-        scene_setXRenderOffscreenTarget(0); // invalidate, better crash than cause weird results for developers
-    }
-    if (!s_tempPicture) {
-        xcb_pixmap_t pix = xcb_generate_id(connection());
-        xcb_create_pixmap(connection(), 32, pix, rootWindow(), temp_visibleRect.width(), temp_visibleRect.height());
-        s_tempPicture = new XRenderPicture(pix, 32);
-        xcb_free_pixmap(connection(), pix);
+    if (!s_tempPictures) {
+        s_tempPictures = new XRenderPicturePool;
     }
+    s_tempPicture = s_tempPictures->picture(temp_visibleRect.size(), 32);
+    // clear one more row and column where possible, the filter of the scaling samples them
+    const QSize size = s_tempPictures->size(s_tempPicture);
     const xcb_render_color_t transparent = {0, 0, 0, 0};
-    const xcb_rectangle_t rect = {0, 0, uint16_t(temp_visibleRect.width()), uint16_t(temp_visibleRect.height())};
+    const xcb_rectangle_t rect = {0, 0, uint16_t(qMin(temp_visibleRect.width() + 1, size.width())),
+                                  uint16_t(qMin(temp_visibleRect.height() + 1, size.height()))};
     xcb_render_fill_rectangles(connection(), XCB_RENDER_PICT_OP_SRC, *s_tempPicture, transparent, 1, &rect);
 }
 
@@ -1235,7 +1308,7 @@ void SceneXRenderDecorationRenderer::render()
     renderPart(top.intersected(geometry),    top.topLeft(),    int(DecorationPart::Top));
     renderPart(right.intersected(geometry),  right.topLeft(),  int(DecorationPart::Right));
     renderPart(bottom.intersected(geometry), bottom.topLeft(), int(DecorationPart::Bottom));
-    xcb_flush(c);
+    // not flushed, the requests go out with the rest of the frame when it is presented
 }
 
 void SceneXRenderDecorationRenderer::resizePixmaps()
@@ -186,6 +186,42 @@ private:
     QScopedPointer<XRenderBackend> m_backend;
 };
 
+/**
+ * @brief Pool of the temporary pictures windows are composed in before they get scaled.
+ *
+ * A picture is handed out for any size it is large enough for, so that windows of
+ * different sizes share the pictures instead of recreating one whenever a larger window
+ * follows a smaller one. The requests of a frame are executed in order, thus a picture
+ * can be reused for the next window as soon as it got composited onto the buffer.
+ * Pictures not used for a while are freed with endFrame.
+ **/
+class XRenderPicturePool
+{
+public:
+    ~XRenderPicturePool();
+    /**
+     * @returns a picture of @p depth which is at least of @p size.
+     **/
+    XRenderPicture *picture(const QSize &size, int depth);
+    /**
+     * @returns the size of @p picture as created by the pool.
+     **/
+    QSize size(const XRenderPicture *picture) const;
+    /**
+     * Frees the pictures not handed out for a while, except for @p keep.
+     **/
+    void endFrame(const XRenderPicture *keep = nullptr);
+
+private:
+    struct Entry {
+        XRenderPicture *picture;
+        QSize size;
+        int depth;
+        int unusedFrames;
+    };
+    QVector<Entry> m_entries;
+};
+
 class SceneXrender::Window
     : public Scene::Window
 {
@@ -196,6 +232,10 @@ public:
     QRegion transformedShape() const;
     void setTransformedShape(const QRegion& shape);
     static void cleanup();
+    /**
+     * Frees the temporary pictures which have not been used for some frames.
+     **/
+    static void endFrame();
 protected:
     virtual WindowPixmap* createWindowPixmap();
 private:
@@ -209,6 +249,7 @@ private:
     QRegion transformed_shape;
     static QRect temp_visibleRect;
     static XRenderPicture *s_tempPicture;
+    static XRenderPicturePool *s_tempPictures;
     static XRenderPicture *s_fadeAlphaPicture;
 };
 
@@ -3,16 +3,18 @@
 uniform sampler2D sampler;
 uniform vec2 offsets[16];
 uniform vec4 kernel[16];
+// the content of bucketed textures does not reach their far edges
+uniform vec2 maxCoord;
 
 in vec2 texcoord0;
 out vec4 fragColor;
 
 void main(void)
 {
-    vec4 sum = texture(sampler, texcoord0.st) * kernel[0];
+    vec4 sum = texture(sampler, min(texcoord0.st, maxCoord)) * kernel[0];
     for (int i = 1; i < 16; i++) {
         sum += texture(sampler, texcoord0.st - offsets[i]) * kernel[i];
-        sum += texture(sampler, texcoord0.st + offsets[i]) * kernel[i];
+        sum += texture(sampler, min(texcoord0.st + offsets[i], maxCoord)) * kernel[i];
     }
     fragColor = sum;
 }